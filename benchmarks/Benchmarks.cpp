@@ -1,14 +1,32 @@
 #include "PluginEditor.h"
+#include "AudioMixerBlock.h"
+#include "MixerKernels.h"
 #include "catch2/benchmark/catch_benchmark_all.hpp"
 #include "catch2/catch_test_macros.hpp"
 
+#include <atomic>
+#include <cstdlib>
+#include <string>
+#include <new>
+
+// Counts every heap allocation in the benchmark binary, used to prove the realtime paths do not allocate.
+static std::atomic<size_t> sAllocations{0};
+void* operator new (size_t size)
+{
+    sAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto p = std::malloc(size)) return p;
+    throw std::bad_alloc{};
+}
+void operator delete (void* p) noexcept { std::free(p); }
+void operator delete (void* p, size_t) noexcept { std::free(p); }
+
 TEST_CASE ("Boot performance")
 {
     BENCHMARK_ADVANCED ("Processor constructor")
     (Catch::Benchmark::Chronometer meter)
     {
         auto gui = juce::ScopedJuceInitialiser_GUI {};
-        std::vector<Catch::Benchmark::storage_for<PluginProcessor>> storage (size_t (meter.runs()));
+        std::vector<Catch::Benchmark::storage_for<AudioStreamPluginProcessor>> storage (size_t (meter.runs()));
         meter.measure ([&] (int i) { storage[(size_t) i].construct(); });
     };
 
@@ -16,7 +34,7 @@ TEST_CASE ("Boot performance")
     (Catch::Benchmark::Chronometer meter)
     {
         auto gui = juce::ScopedJuceInitialiser_GUI {};
-        std::vector<Catch::Benchmark::destructable_object<PluginProcessor>> storage (size_t (meter.runs()));
+        std::vector<Catch::Benchmark::destructable_object<AudioStreamPluginProcessor>> storage (size_t (meter.runs()));
         for (auto& s : storage)
             s.construct();
         meter.measure ([&] (int i) { storage[(size_t) i].destruct(); });
@@ -27,7 +45,7 @@ TEST_CASE ("Boot performance")
     {
         auto gui = juce::ScopedJuceInitialiser_GUI {};
 
-        PluginProcessor plugin;
+        AudioStreamPluginProcessor plugin;
 
         // due to complex construction logic of the editor, let's measure open/close together
         meter.measure ([&] (int /* i */) {
@@ -38,3 +56,77 @@ TEST_CASE ("Boot performance")
         });
     };
 }
+
+TEST_CASE ("Mixer performance")
+{
+    const size_t blockSize = 480;
+    std::vector<Mixer::AudioMixerBlock> mixers(2);
+    Mixer::AudioMixerBlock::resetMixers(mixers, blockSize, 1);
+    std::vector<Mixer::Block> blocks(2, Mixer::Block(blockSize, 0.25f));
+
+    //Warm up: the source lane and the slot exist after the first mix.
+    Mixer::AudioMixerBlock::mix(mixers, 0, blocks, 1);
+
+    SECTION ("AudioMixerBlock::mix does not allocate")
+    {
+        auto allocationsBefore = sAllocations.load();
+        for (int64_t time = 0; time < static_cast<int64_t>(blockSize) * 1000; time += static_cast<int64_t>(blockSize))
+        {
+            Mixer::AudioMixerBlock::mix(mixers, time, blocks, 1);
+        }
+        REQUIRE (sAllocations.load() == allocationsBefore);
+    }
+
+    Mixer::Block playback(blockSize, 0.0f), lastSource(blockSize, 0.0f), source(blockSize, 0.5f);
+
+    BENCHMARK ("Mixer: SubBlocks(AddBlocks(playback, new), old) 480 samples")
+    {
+        playback = Mixer::SubBlocks(Mixer::AddBlocks(playback, source), lastSource);
+        lastSource = source;
+        return playback[0];
+    };
+
+    BENCHMARK ("Mixer: MixDeltaInPlace 480 samples")
+    {
+        Mixer::MixDeltaInPlace(playback.data(), lastSource.data(), source.data(), blockSize);
+        return playback[0];
+    };
+
+    int64_t time = static_cast<int64_t>(blockSize) * 1000;
+    BENCHMARK ("AudioMixerBlock::mix stereo 480 samples")
+    {
+        time += static_cast<int64_t>(blockSize);
+        Mixer::AudioMixerBlock::mix(mixers, time, blocks, 1);
+    };
+}
+
+TEST_CASE ("Mixer kernels performance")
+{
+    for (auto isa : Mixer::Kernels::SupportedISAs())
+    {
+        auto& kernels = Mixer::Kernels::Select(isa);
+        for (size_t blockSize : {64ul, 128ul, 480ul, 1024ul})
+        {
+            Mixer::Block a(blockSize, 0.25f), b(blockSize, 0.5f), out(blockSize, 0.0f);
+            auto suffix = std::string(" ") + Mixer::Kernels::ISAName(isa) + " " + std::to_string(blockSize) + " samples (ns/block)";
+
+            BENCHMARK ("Mixer::Kernels add" + suffix)
+            {
+                kernels.add(a.data(), b.data(), out.data(), blockSize);
+                return out[0];
+            };
+
+            BENCHMARK ("Mixer::Kernels sub" + suffix)
+            {
+                kernels.sub(a.data(), b.data(), out.data(), blockSize);
+                return out[0];
+            };
+
+            BENCHMARK ("Mixer::Kernels mixDelta" + suffix)
+            {
+                kernels.mixDelta(out.data(), a.data(), b.data(), blockSize);
+                return out[0];
+            };
+        }
+    }
+}
@@ -0,0 +1,79 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+#include "MixerKernels.h"
+#include "Utilities.h"
+#include "catch2/benchmark/catch_benchmark_all.hpp"
+#include "catch2/catch_test_macros.hpp"
+
+#include <span>
+#include <string>
+#include <vector>
+
+namespace
+{
+    //Typical DAW block sizes, 480 is 10 ms at 48 kHz.
+    const std::vector<size_t> sBlockSizes {64, 128, 256, 480, 512, 1024};
+}
+
+TEST_CASE ("Channel layout kernels performance")
+{
+    for (auto isa : Mixer::Kernels::SupportedISAs())
+    {
+        auto& kernels = Mixer::Kernels::Select(isa);
+        for (auto blockSize : sBlockSizes)
+        {
+            std::vector<float> left(blockSize, 0.25f), right(blockSize, 0.5f), interleaved(blockSize * 2, 0.0f);
+            auto suffix = std::string(" ") + Mixer::Kernels::ISAName(isa) + " " + std::to_string(blockSize) + " samples (ns/block)";
+
+            BENCHMARK ("Mixer::Kernels interleave2" + suffix)
+            {
+                kernels.interleave2(left.data(), right.data(), interleaved.data(), blockSize);
+                return interleaved[0];
+            };
+
+            BENCHMARK ("Mixer::Kernels deinterleave2" + suffix)
+            {
+                kernels.deinterleave2(interleaved.data(), left.data(), right.data(), blockSize);
+                return left[0];
+            };
+
+            BENCHMARK ("Mixer::Kernels monoSplit" + suffix)
+            {
+                kernels.monoSplit(left.data(), right.data(), blockSize);
+                return left[0];
+            };
+        }
+    }
+}
+
+TEST_CASE ("Utilities::Buffer layout performance")
+{
+    for (size_t channels : {2ul, 6ul})
+    {
+        for (auto blockSize : sBlockSizes)
+        {
+            std::vector<std::vector<float>> blocks(channels, std::vector<float>(blockSize, 0.25f));
+            std::vector<std::span<const float>> constBlocks(blocks.begin(), blocks.end());
+            std::vector<std::span<float>> outBlocks(blocks.begin(), blocks.end());
+            std::vector<float> interleaved(blockSize * channels, 0.0f);
+            auto suffix = std::string(" ") + std::to_string(channels) + " channels " + std::to_string(blockSize) + " samples (ns/block)";
+
+            BENCHMARK ("Utilities::Buffer::interleaveBlocks span" + suffix)
+            {
+                return Utilities::Buffer::interleaveBlocks(interleaved, constBlocks, channels).size();
+            };
+
+            BENCHMARK ("Utilities::Buffer::deinterleaveBlocks span" + suffix)
+            {
+                return Utilities::Buffer::deinterleaveBlocks(outBlocks, interleaved, channels);
+            };
+
+            BENCHMARK ("Utilities::Buffer::interleaveBlocks vector" + suffix)
+            {
+                Utilities::Buffer::interleaveBlocks(interleaved, blocks, channels);
+                return interleaved[0];
+            };
+        }
+    }
+}
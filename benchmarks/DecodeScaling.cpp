@@ -0,0 +1,108 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+#include "DecodePool.h"
+#include "opusImpl.h"
+#include "catch2/catch_test_macros.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    constexpr size_t kPacketsPerPeer = 50;
+    constexpr size_t kTicks = 200;
+
+    struct Peer
+    {
+        std::unique_ptr<OpusImpl::CODEC>        codec;
+        std::vector<std::vector<std::byte>>     packets{};
+    };
+
+    struct Job
+    {
+        Peer*               pPeer{nullptr};
+        size_t              packet{0};
+        std::atomic<size_t>* pDone{nullptr};
+    };
+
+    /*!
+     * @brief A peer with its own CODEC and kPacketsPerPeer packets (10 ms of stereo noise each) to decode.
+     */
+    Peer makePeer(uint32_t seed)
+    {
+        Peer peer{std::make_unique<OpusImpl::CODEC>(OpusImpl::CODECConfig{}), {}};
+        std::vector<float> pcm(peer.codec->blockSamples());
+        for (auto packet = 0ul; packet < kPacketsPerPeer; ++packet)
+        {
+            for (auto index = 0ul; index < pcm.size(); ++index)
+            {
+                seed = seed * 1664525u + 1013904223u;
+                pcm[index] = 0.25f * std::sin(static_cast<float>(index) * 0.01f * static_cast<float>(packet + 1)) + static_cast<float>(seed >> 8) / 167772160.0f;
+            }
+            size_t encodedBytes = 0;
+            peer.codec->encodeChannel(pcm, peer.codec->encodeScratch(), encodedBytes, 0);
+            auto encoded = peer.codec->encodeScratch().first(encodedBytes);
+            peer.packets.emplace_back(encoded.begin(), encoded.end());
+        }
+        return peer;
+    }
+
+    void decode(Job& job)
+    {
+        auto& codec = *job.pPeer->codec;
+        size_t decodedSize = 0;
+        codec.decodeChannel(job.pPeer->packets[job.packet], codec.decodeScratch(), decodedSize, 0);
+        job.pDone->fetch_add(1, std::memory_order_release);
+    }
+
+    /*!
+     * @brief Decode kTicks ticks of one packet per peer, like the mixer host does every 10 ms.
+     * @return Average wall time of a tick, in microseconds.
+     */
+    double runTicks(std::vector<Peer>& peers, size_t workers)
+    {
+        using namespace std::chrono;
+        Mixer::DecodePool<Job> pool{};
+        pool.start(workers, decode);
+        std::atomic<size_t> done{0};
+
+        auto start = steady_clock::now();
+        for (auto tick = 0ul; tick < kTicks; ++tick)
+        {
+            done.store(0, std::memory_order_relaxed);
+            for (auto peer = 0ul; peer < peers.size(); ++peer)
+            {
+                pool.submit(peer, Job{&peers[peer], tick % kPacketsPerPeer, &done});
+            }
+            while (done.load(std::memory_order_acquire) < peers.size()) std::this_thread::yield();
+        }
+        auto elapsed = duration<double, std::micro>(steady_clock::now() - start).count();
+        pool.stop();
+        return elapsed / static_cast<double>(kTicks);
+    }
+}
+
+TEST_CASE ("Per peer decode scaling")
+{
+    auto hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    auto workers = std::min<size_t>(4, hardwareThreads);
+
+    for (auto nPeers : {1ul, 4ul, 8ul, 12ul, 16ul, 24ul})
+    {
+        std::vector<Peer> peers{};
+        for (auto peer = 0ul; peer < nPeers; ++peer) peers.push_back(makePeer(static_cast<uint32_t>(peer + 1)));
+
+        auto serialUs = runTicks(peers, 0);
+        auto pooledUs = runTicks(peers, workers);
+        std::cout << "Decode tick " << nPeers << " peers: inline " << serialUs << " us, "
+                  << workers << " workers " << pooledUs << " us, speedup " << serialUs / pooledUs
+                  << "x (budget 10000 us)" << std::endl;
+        REQUIRE(pooledUs > 0.0);
+    }
+}
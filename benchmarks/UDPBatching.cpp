@@ -0,0 +1,99 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+#include "xlet.h"
+#include "catch2/catch_test_macros.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <iostream>
+#include <thread>
+
+namespace
+{
+    struct LoopbackResult
+    {
+        size_t  received{0};
+        double  packetsPerSecond{0.0};
+        double  cpuMicrosecondsPerPacket{0.0};
+    };
+
+    /*!
+     * @brief Send nPackets from one UDPInOut to another over 127.0.0.1 and measure the receive rate and the process CPU.
+     */
+    LoopbackResult runLoopback(xlet::UDPOptions options, int port, size_t nPackets, size_t packetSize)
+    {
+        using namespace std::chrono;
+        xlet::UDPInOut receiver("127.0.0.1", port, true, false, false, options);
+        xlet::UDPInOut sender("127.0.0.1", port, false, true, false, options);
+
+        std::atomic<size_t> received{0};
+        receiver.letDataFromPeerIsReady.Connect(std::function<void(uint64_t, const xlet::Packet&)>{
+            [&received](uint64_t, const xlet::Packet&) { received.fetch_add(1, std::memory_order_relaxed); }
+        });
+        receiver.run();
+        sender.run();
+        std::this_thread::sleep_for(milliseconds(50));
+
+        auto peerId = sender.getServId();
+        std::vector<std::byte> payload(packetSize, std::byte{0x5a});
+        auto cpuStart = std::clock();
+        auto wallStart = steady_clock::now();
+
+        //Keep a bounded window in flight, so the test measures the I/O path and not the kernel dropping an overflowing
+        //socket buffer. Packets that do get dropped are given up on after a short stall.
+        constexpr size_t kWindow = 128;
+        auto lost = 0ul;
+        for (auto sent = 0ul; sent < nPackets; ++sent)
+        {
+            sender.push_back(xlet::Data{.second = payload, .first = peerId}, xlet::Direction::OUTB);
+            auto stallStart = steady_clock::now();
+            auto seen = received.load();
+            while (sent + 1 > received.load() + lost + kWindow)
+            {
+                if (received.load() != seen) { seen = received.load(); stallStart = steady_clock::now(); }
+                else if (steady_clock::now() - stallStart > milliseconds(5)) lost = sent + 1 - received.load() - kWindow / 2;
+                std::this_thread::yield();
+            }
+        }
+
+        //Wait until the receive count settles.
+        auto lastCount = received.load();
+        auto lastChange = steady_clock::now();
+        while (received.load() < nPackets && steady_clock::now() - lastChange < milliseconds(200))
+        {
+            std::this_thread::sleep_for(milliseconds(1));
+            if (received.load() != lastCount) { lastCount = received.load(); lastChange = steady_clock::now(); }
+        }
+
+        auto wallSeconds = duration<double>(steady_clock::now() - wallStart).count();
+        auto cpuSeconds = static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+        LoopbackResult result{};
+        result.received = received.load();
+        result.packetsPerSecond = static_cast<double>(result.received) / wallSeconds;
+        result.cpuMicrosecondsPerPacket = result.received ? 1e6 * cpuSeconds / static_cast<double>(result.received) : 0.0;
+
+        sender.closeAndJoin();
+        receiver.closeAndJoin();
+        std::this_thread::sleep_for(milliseconds(2 * options.pollTimeoutMs));
+        return result;
+    }
+}
+
+TEST_CASE ("UDP loopback throughput")
+{
+    constexpr size_t kPackets = 100000;
+    constexpr size_t kPacketSize = 200;
+
+    auto legacy = runLoopback(xlet::UDPOptions{.batched = false}, 47001, kPackets, kPacketSize);
+    auto batched = runLoopback(xlet::UDPOptions{.batched = true, .batchSize = 32, .pollTimeoutMs = 50}, 47002, kPackets, kPacketSize);
+
+    for (auto& [name, result] : {std::make_pair("legacy ", legacy), std::make_pair("batched", batched)})
+    {
+        std::cout << "UDP loopback " << name << ": " << result.received << "/" << kPackets << " packets, "
+                  << static_cast<uint64_t>(result.packetsPerSecond) << " packets/s, "
+                  << result.cpuMicrosecondsPerPacket << " us CPU/packet" << std::endl;
+    }
+    REQUIRE(batched.received > 0);
+}
@@ -0,0 +1,101 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+#include "BlockSizeAdapter.h"
+#include "Notifier.h"
+#include "catch2/catch_test_macros.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono;
+
+namespace
+{
+    /*!
+     * @brief A worker shaped like the plugin encoder / mixer threads: drain the BSA, then wait on the notifier.
+     */
+    struct Worker
+    {
+        Utilities::Buffer::BlockSizeAdapter bsa{480, 2};
+        DAWn::Events::Notifier wakeUp;
+        std::atomic<bool> bRun{true};
+        std::atomic<int64_t> pushedAt{0};
+        std::atomic<size_t> popped{0};
+        std::vector<int64_t> latencies{};
+        std::thread thread;
+
+        Worker()
+        {
+            bsa.setNotifier(&wakeUp);
+            latencies.reserve(4096);
+            thread = std::thread{[this]()
+            {
+                std::vector<float> block(960);
+                uint32_t timeStamp;
+                while (bRun)
+                {
+                    auto ticket = wakeUp.ticket();
+                    while (bsa.dataReady())
+                    {
+                        bsa.pop(block, timeStamp);
+                        auto now = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+                        latencies.push_back(now - pushedAt.load());
+                        ++popped;
+                    }
+                    if (bRun) wakeUp.wait(ticket);
+                }
+            }};
+        }
+
+        ~Worker()
+        {
+            bRun = false;
+            wakeUp.notify();
+            thread.join();
+        }
+    };
+}
+
+TEST_CASE ("Worker wake up")
+{
+    {
+        Worker worker;
+        std::this_thread::sleep_for(milliseconds(20));
+
+        auto cpuStart = std::clock();
+        auto wallStart = steady_clock::now();
+        std::this_thread::sleep_for(milliseconds(500));
+        auto cpuSeconds = static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+        auto wallSeconds = duration<double>(steady_clock::now() - wallStart).count();
+        std::cout << "Idle CPU: " << 100.0 * cpuSeconds / wallSeconds << "%" << std::endl;
+        //A sleeping worker, not a spinning one.
+        CHECK(100.0 * cpuSeconds / wallSeconds < 5.0);
+    }
+
+    Worker worker;
+    std::vector<float> block(960, 0.5f);
+    constexpr size_t kRounds = 2000;
+
+    for (size_t round = 0; round < kRounds; ++round)
+    {
+        //Let the worker go back to sleep, so every round measures a real wakeup.
+        std::this_thread::sleep_for(microseconds(500));
+        worker.pushedAt = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+        worker.bsa.push(block.data(), block.size());
+        while (worker.popped.load() <= round) std::this_thread::yield();
+    }
+
+    auto latencies = worker.latencies;
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << "Wake latency (us) p50: " << latencies[latencies.size() / 2] / 1000.0
+              << " p99: " << latencies[latencies.size() * 99 / 100] / 1000.0
+              << " max: " << latencies.back() / 1000.0 << std::endl;
+    REQUIRE(latencies.size() == kRounds);
+    CHECK(latencies[latencies.size() / 2] / 1000.0 < 100.0);
+}
@@ -3,6 +3,9 @@
 //
 
 #include "AudioMixerBlock.h"
+#include "MixerKernels.h"
+
+#include <algorithm>
 
 namespace Mixer
 {
@@ -10,28 +13,72 @@ namespace Mixer
     {
         auto topIndex = std::min(a.size(), b.size());
         std::vector<float> result(topIndex, 0.0f);
-        for (auto index = 0ul; index < topIndex; ++index)
-        {
-            result[index] = a[index] - b[index];
-        }
-
+        Kernels::Active().sub(a.data(), b.data(), result.data(), topIndex);
         return result;
     }
 
     Block AddBlocks(const Block&a, const Block&b)
     {
         auto topIndex = std::min(a.size(), b.size());
-        std::vector<float> result;
-        for (auto index = 0ul; index < topIndex; ++index)
-            result.push_back(a[index] + b[index]);
+        std::vector<float> result(topIndex, 0.0f);
+        Kernels::Active().add(a.data(), b.data(), result.data(), topIndex);
         return result;
     }
 
+    void MixDeltaInPlace(float* playback, float* lastSource, const float* source, size_t size)
+    {
+        Kernels::Active().mixDelta(playback, lastSource, source, size);
+    }
+
+    AudioMixerBlock::AudioMixerBlock()
+    {
+        //The first Active() call picks the kernels (and allocates), keep it off the audio thread.
+        Kernels::Active();
+        allocateTimeline();
+    }
+
+    void AudioMixerBlock::allocateTimeline()
+    {
+        std::lock_guard<DataMutex> lock(data_mutex);
+        mSlots = std::max(mDeltaBlocks, mMaxDeltaBlocks) + (kJitterMarginSamples / mBlockSize) + 1;
+
+        mSlotTime.assign(mSlots, kEmptySlot);
+        mPlayback.assign(mSlots * mBlockSize, 0.0f);
+        mSources.clear();
+        mSources.reserve(kReservedSources * mSlots * mBlockSize);
+        mSources.resize(sourceIDToColumnIndex.size() * mSlots * mBlockSize, 0.0f);
+    }
+
+    size_t AudioMixerBlock::slotIndex(TTime time) const
+    {
+        auto blockSize = static_cast<TTime>(mBlockSize);
+        auto slots = static_cast<TTime>(mSlots);
+        auto blockIndex = time >= 0 ? time / blockSize : (time - blockSize + 1) / blockSize;
+        return static_cast<size_t>(((blockIndex % slots) + slots) % slots);
+    }
+
+    size_t AudioMixerBlock::claimSlot(TTime time)
+    {
+        auto slot = slotIndex(time);
+        auto& slotTime = mSlotTime[slot];
+        if (slotTime == time) return slot;
+        if (slotTime != kEmptySlot && time < slotTime) return mSlots;
+
+        //RECYCLE THE SLOT
+        std::fill(playbackAt(slot), playbackAt(slot) + mBlockSize, 0.0f);
+        for (auto sourceIndex = 0ul; sourceIndex < sourceIDToColumnIndex.size(); ++sourceIndex)
+        {
+            std::fill(sourceAt(sourceIndex, slot), sourceAt(sourceIndex, slot) + mBlockSize, 0.0f);
+        }
+        slotTime = time;
+        return slot;
+    }
+
     void AudioMixerBlock::addSource(TUserID sourceId)
     {
-        std::lock_guard<std::recursive_mutex> lock(data_mutex);
+        std::lock_guard<DataMutex> lock(data_mutex);
         sourceIDToColumnIndex[sourceId] = sourceIDToColumnIndex.size();
-        for(auto&kv:*this) kv.second.push_back(Block(mBlockSize, 0.0f));
+        mSources.resize(sourceIDToColumnIndex.size() * mSlots * mBlockSize, 0.0f);
 
         //TODO: Add the source to the RTP session IF the source is not local (sourceID != 0)
         /* This information comes from the session manager, here we need to define a queue to push the blocks
@@ -39,71 +86,77 @@ namespace Mixer
 
     }
 
-    void AudioMixerBlock::addColumn(int64_t timeIndex)
+    bool AudioMixerBlock::acquire(std::unique_lock<DataMutex>& lock, LockPolicy policy)
     {
-        std::lock_guard<std::recursive_mutex> lock(data_mutex);
-        playbackDataBlock[timeIndex] = Block(mBlockSize, 0.0f);
-        this->operator[](timeIndex) = Column(sourceIDToColumnIndex.size(), Block(mBlockSize, 0.0f));
+        if (policy == LockPolicy::TryOnly) return lock.try_lock();
+        lock.lock();
+        return true;
     }
 
-    void AudioMixerBlock::layoutCheck(int64_t time, Mixer::TUserID sourceID)
+    void AudioMixerBlock::layoutCheck(Mixer::TUserID sourceID)
     {
-        //TIME Index doest not exist, add it
-        if (this->find(time) == this->end())
-        {
-            addColumn(time);
-        }
         //Source ID Indexing is not there (Add the Source).
         if (sourceIDToColumnIndex.find(sourceID) == sourceIDToColumnIndex.end())
         {
             addSource(sourceID);
         }
     }
-    void AudioMixerBlock::replace(
+    bool AudioMixerBlock::replace(
         TTime time,
-        const Block audioBlock,
-        TUserID)
+        std::span<const float> audioBlock,
+        TUserID,
+        LockPolicy policy)
     {
         //SUPER SIMPLE
         {
 
-            std::lock_guard<std::recursive_mutex> lock (data_mutex);
+            std::unique_lock<DataMutex> lock (data_mutex, std::defer_lock);
+            if (!acquire(lock, policy)) return false;
             size_t audioBlockSize = audioBlock.size();
             if (audioBlockSize != mBlockSize)
             {
                 replacingBlockMismatch.Emit(audioBlockSize, mBlockSize);
-                return;
+                return false;
             }
-            playbackDataBlock[time] = audioBlock;
+            auto slot = claimSlot(time);
+            if (slot == mSlots) return false;
+            std::copy(audioBlock.begin(), audioBlock.end(), playbackAt(slot));
         }
-
+        return true;
     }
 
-    void AudioMixerBlock::mix(
+    bool AudioMixerBlock::mix(
         int64_t time,
-        const Block audioBlock,
-        TUserID sourceID)
+        std::span<const float> audioBlock,
+        TUserID sourceID,
+        LockPolicy policy)
     {
-        std::lock_guard<std::recursive_mutex> lock(data_mutex);
+        std::unique_lock<DataMutex> lock(data_mutex, std::defer_lock);
+        if (!acquire(lock, policy)) return false;
         if (mBlockSize != audioBlock.size())
         {
-            return;
+            return false;
         }
-        layoutCheck(time, sourceID);
-        auto& column = this->operator[](time);
-        auto& sourceIDIndex = sourceIDToColumnIndex[sourceID];
-        auto& oldAudioBlock = column[sourceIDIndex];
-        auto& oldPlayback = playbackDataBlock[time];
+        if (policy == LockPolicy::TryOnly && sourceIDToColumnIndex.find(sourceID) == sourceIDToColumnIndex.end())
+        {
+            return false;
+        }
+        layoutCheck(sourceID);
+        auto slot = claimSlot(time);
+        if (slot == mSlots) return false;
+
+        auto oldPlayback = playbackAt(slot);
+        auto oldAudioBlock = sourceAt(sourceIDToColumnIndex[sourceID], slot);
 
         //Update Local Audio Playback Header and source of Audio.
-        playbackDataBlock[time] = SubBlocks(AddBlocks(oldPlayback, audioBlock), oldAudioBlock);
-        oldAudioBlock = audioBlock;
+        MixDeltaInPlace(oldPlayback, oldAudioBlock, audioBlock.data(), mBlockSize);
+        return true;
     }
 
     bool AudioMixerBlock::containsTimeStamp(const int64_t time)
     {
-        std::lock_guard<std::recursive_mutex> lock(data_mutex);
-        return playbackDataBlock.find(time) != playbackDataBlock.end();
+        std::lock_guard<DataMutex> lock(data_mutex);
+        return mSlotTime[slotIndex(time)] == time;
     }
 
     void AudioMixerBlock::mix(
@@ -112,7 +165,7 @@ namespace Mixer
         const std::vector<Block>& splittedBlocks,
         Mixer::TUserID sourceID)
     {
-        for (auto index = 0ul; index < mixers.size(); ++index)
+        for (auto index = 0ul; index < std::min(mixers.size(), splittedBlocks.size()); ++index)
         {
             mixers[index].mix(time, splittedBlocks[index], sourceID);
         }
@@ -124,63 +177,161 @@ namespace Mixer
         const std::vector<Block>& splittedBlocks,
         Mixer::TUserID sourceID)
     {
-        for (auto index = 0ul; index < mixers.size(); ++index)
+        for (auto index = 0ul; index < std::min(mixers.size(), splittedBlocks.size()); ++index)
         {
             mixers[index].replace(time, splittedBlocks[index], sourceID);
         }
     }
 
+    size_t AudioMixerBlock::mix(
+        std::vector<AudioMixerBlock>& mixers,
+        int64_t time,
+        ConstChannels blocks,
+        Mixer::TUserID sourceID,
+        LockPolicy policy)
+    {
+        auto skipped = mixers.size() - std::min(mixers.size(), blocks.size());
+        for (auto index = 0ul; index < std::min(mixers.size(), blocks.size()); ++index)
+        {
+            if (!mixers[index].mix(time, blocks[index], sourceID, policy)) ++skipped;
+        }
+        return skipped;
+    }
+
+    size_t AudioMixerBlock::replace(
+        std::vector<AudioMixerBlock>& mixers,
+        int64_t time,
+        ConstChannels blocks,
+        Mixer::TUserID sourceID,
+        LockPolicy policy)
+    {
+        auto skipped = mixers.size() - std::min(mixers.size(), blocks.size());
+        for (auto index = 0ul; index < std::min(mixers.size(), blocks.size()); ++index)
+        {
+            if (!mixers[index].replace(time, blocks[index], sourceID, policy)) ++skipped;
+        }
+        return skipped;
+    }
+
+    void AudioMixerBlock::registerSource(std::vector<AudioMixerBlock>& mixers, Mixer::TUserID sourceID)
+    {
+        for (auto& mixer : mixers)
+        {
+            std::lock_guard<DataMutex> lock(mixer.data_mutex);
+            mixer.layoutCheck(sourceID);
+        }
+    }
+
     bool AudioMixerBlock::containsTimeStamp(std::vector<AudioMixerBlock>& mixers, const int64_t time)
     {
-        if (!mixers[0].containsTimeStamp(time) || !mixers[1].containsTimeStamp(time))
+        for (auto& mixer : mixers)
         {
-                return false;
+            if (!mixer.containsTimeStamp(time)) return false;
         }
         return true;
     }
 
-    Block AudioMixerBlock::getBlock(const int64_t time, int64_t& pbtime, bool delayed)
+    void AudioMixerBlock::getBlock(const int64_t time, int64_t& pbtime, float* dst, bool delayed)
+    {
+        std::lock_guard<DataMutex> lock(data_mutex);
+        getBlock(time, pbtime, std::span<float>(dst, mBlockSize), delayed, LockPolicy::Wait);
+    }
+
+    bool AudioMixerBlock::getBlock(const int64_t time, int64_t& pbtime, std::span<float> dst, bool delayed, LockPolicy policy)
     {
+        std::unique_lock<DataMutex> lock(data_mutex, std::defer_lock);
+        if (!acquire(lock, policy) || dst.size() != mBlockSize)
+        {
+            std::fill(dst.begin(), dst.end(), 0.0f);
+            return false;
+        }
+
         //Super Simple approach
         pbtime = !delayed ? time : time - static_cast<int64_t>(mDeltaBlocks * mBlockSize);
-
-        std::lock_guard<std::recursive_mutex> lock(data_mutex);
-        if (playbackDataBlock.find(pbtime) == playbackDataBlock.end())
+        auto slot = slotIndex(pbtime);
+        if (mSlotTime[slot] != pbtime)
         {
             //Add Silence.
-            return Block(mBlockSize, 0.0f);
+            std::fill(dst.begin(), dst.end(), 0.0f);
+            return true;
         }
-        return playbackDataBlock[pbtime];
+        std::copy(playbackAt(slot), playbackAt(slot) + mBlockSize, dst.begin());
+        return true;
+    }
+
+    size_t AudioMixerBlock::getBlocks(std::vector<AudioMixerBlock>& mixers, const int64_t time, int64_t& realtime, Channels dst, LockPolicy policy)
+    {
+        auto skipped = 0ul;
+        for (auto index = 0ul; index < std::min(mixers.size(), dst.size()); ++index)
+        {
+            if (!mixers[index].getBlock(time, realtime, dst[index], false, policy)) ++skipped;
+        }
+        return skipped;
+    }
+
+    size_t AudioMixerBlock::getBlocksDelayed(std::vector<AudioMixerBlock>& mixers, const int64_t time, int64_t& realtime, Channels dst, LockPolicy policy)
+    {
+        auto skipped = 0ul;
+        for (auto index = 0ul; index < std::min(mixers.size(), dst.size()); ++index)
+        {
+            if (!mixers[index].getBlock(time, realtime, dst[index], true, policy)) ++skipped;
+        }
+        return skipped;
+    }
+
+    Block AudioMixerBlock::getBlock(const int64_t time, int64_t& pbtime, bool delayed)
+    {
+        std::lock_guard<DataMutex> lock(data_mutex);
+        Block block(mBlockSize, 0.0f);
+        getBlock(time, pbtime, block.data(), delayed);
+        return block;
     }
 
 
     void AudioMixerBlock::flushMixer()
     {
-        std::lock_guard<std::recursive_mutex> lock(data_mutex);
-        playbackDataBlock.clear();
+        std::lock_guard<DataMutex> lock(data_mutex);
         sourceIDToColumnIndex.clear();
-        static_cast<std::unordered_map<int64_t, Column>&>(*this).clear();
+        allocateTimeline();
     }
 
-    void AudioMixerBlock::resetMixer (size_t blockSize, uint32_t delayInSeconds)
+    void AudioMixerBlock::resetMixer (size_t blockSize, uint32_t delayInSeconds, size_t maxDelaySamples)
     {
-        std::lock_guard<std::recursive_mutex> lock(data_mutex);
+        std::lock_guard<DataMutex> lock(data_mutex);
         //Assuming 48k sample/second
         const auto delayInSamples = delayInSeconds * 48000;
         mDeltaBlocks = delayInSamples / blockSize;
+        mMaxDeltaBlocks = std::max(mDeltaBlocks, (maxDelaySamples + blockSize - 1) / blockSize);
 
 
         mBlockSize = blockSize;
         flushMixer();
     }
 
-    void AudioMixerBlock::resetMixers(std::vector<AudioMixerBlock>& mixers, size_t blockSize, uint32_t delayInSeconds)
+    bool AudioMixerBlock::setDelaySamples(size_t delaySamples, LockPolicy policy)
+    {
+        std::unique_lock<DataMutex> lock(data_mutex, std::defer_lock);
+        if (!acquire(lock, policy)) return false;
+        mDeltaBlocks = std::min((delaySamples + mBlockSize - 1) / mBlockSize, mMaxDeltaBlocks);
+        return true;
+    }
+
+    void AudioMixerBlock::resetMixers(std::vector<AudioMixerBlock>& mixers, size_t blockSize, uint32_t delayInSeconds, size_t maxDelaySamples)
     {
         static std::mutex resetMutex;
         std::lock_guard<std::mutex> lock(resetMutex);
         for (auto& mixer : mixers)
         {
-            mixer.resetMixer(blockSize, delayInSeconds);
+            mixer.resetMixer(blockSize, delayInSeconds, maxDelaySamples);
+        }
+    }
+
+    void AudioMixerBlock::setDelay(std::vector<AudioMixerBlock>& mixers, size_t delaySamples, LockPolicy policy)
+    {
+        //A busy mixer keeps its delay until the next call.
+        for (auto& mixer : mixers)
+        {
+            mixer.setDelaySamples(delaySamples, policy);
         }
     }
 }
\ No newline at end of file
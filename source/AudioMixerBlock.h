@@ -6,11 +6,15 @@
 #define AUDIOSTREAMPLUGIN_AUDIOMIXERBLOCK_H
 
 #include <map>
+#include <limits>
+#include <algorithm>
 #include <mutex>
+#include <span>
 #include <vector>
 #include <unordered_map>
 
 #include "Events.h"
+#include "Realtime.h"
 
 namespace Mixer
 {
@@ -19,40 +23,158 @@ namespace Mixer
     using Column = std::vector<Block>;
     using Row = std::map<TTime, Block>;
     using TUserID = uint32_t;
+    /*! @brief One span per channel, the blocks of a DAW buffer without owning them.*/
+    using Channels = std::span<const std::span<float>>;
+    using ConstChannels = std::span<const std::span<const float>>;
+
+    /*!
+     * @brief How a mixer is taken. The audio thread uses TryOnly: a mixer busy on another thread is skipped for that
+     * block (its contribution dropped, silence played) instead of waiting.
+     */
+    enum class LockPolicy
+    {
+        Wait,
+        TryOnly
+    };
+
+    /*!
+     * @brief channels x maxSamples floats in one allocation, seen as one span per channel.
+     *
+     * Sized off the audio thread (prepareToPlay). setSamples only re-points the spans, so a DAW block shorter than
+     * maxSamples is used without allocating.
+     */
+    class PlanarBuffer
+    {
+        std::vector<float>                      mStorage{};
+        std::vector<std::span<float>>           mChannels{};
+        std::vector<std::span<const float>>     mConstChannels{};
+        size_t                                  mMaxSamples{0};
+
+    public:
+        void resize(size_t channels, size_t maxSamples)
+        {
+            mMaxSamples = maxSamples;
+            mStorage.assign(channels * maxSamples, 0.0f);
+            mChannels.resize(channels);
+            mConstChannels.resize(channels);
+            setSamples(maxSamples);
+        }
+        /*! @brief Samples per channel of the next block, clamped to maxSamples.*/
+        void setSamples(size_t samples)
+        {
+            samples = std::min(samples, mMaxSamples);
+            for (auto channel = 0ul; channel < mChannels.size(); ++channel)
+            {
+                mChannels[channel] = std::span<float>(mStorage.data() + channel * mMaxSamples, samples);
+                mConstChannels[channel] = mChannels[channel];
+            }
+        }
+        inline size_t channelCount() const { return mChannels.size(); }
+        inline size_t maxSamples() const { return mMaxSamples; }
+        inline Channels channels() const { return mChannels; }
+        inline ConstChannels constChannels() const { return mConstChannels; }
+    };
 
     Block SubBlocks(const Block& a, const Block& b);
     Block AddBlocks(const Block& a, const Block& b);
 
-
-    class AudioMixerBlock : public std::unordered_map<TTime, Column>
+    /*!
+     * @brief Fused in-place mix. playback += source - lastSource, then lastSource = source.
+     *
+     * Swaps the contribution of a source in a playback block without temporaries.
+     * @param playback The mixed block, updated in place.
+     * @param lastSource The block the source contributed before, replaced with source.
+     * @param source The new block of the source.
+     * @param size Number of samples.
+     */
+    void MixDeltaInPlace(float* playback, float* lastSource, const float* source, size_t size);
+
+
+    /*!
+     * @brief A timeline of mixed audio for ONE channel.
+     *
+     * The timeline is a fixed capacity ring of slots. A timestamp lives in slot (timestamp / blockSize) % N.
+     * Every slot keeps the playback (mixed) block and the last block contributed by each source, all of them
+     * in contiguous float storage. When a newer timestamp lands on a slot, the slot is recycled (zeroed), so memory
+     * stays flat no matter how long the session is.
+     *
+     *     PLAYBACK     [ SLOT 0 | SLOT 1 | ... | SLOT N-1 ]
+     *     SOURCE 0     [ SLOT 0 | SLOT 1 | ... | SLOT N-1 ]
+     *     SOURCE 1     [ SLOT 0 | SLOT 1 | ... | SLOT N-1 ]
+     *
+     * N is sized from the playback delay plus a jitter margin.
+     */
+    class AudioMixerBlock
     {
+        /*! @brief Extra room in the ring (in samples @ 48k) for blocks arriving ahead of / behind the playback head.*/
+        static constexpr size_t kJitterMarginSamples = 48000 / 2;
+        /*! @brief Number of source lanes reserved up front, so peers joining do not reallocate the ring.*/
+        static constexpr size_t kReservedSources = 8;
+        static constexpr TTime kEmptySlot = std::numeric_limits<TTime>::min();
+
         size_t mBlockSize{480};
         size_t mDeltaBlocks{100};
-        std::recursive_mutex data_mutex;
+        /*! @brief The ring is sized for this delay, so the delay can change at runtime up to it without reallocating.*/
+        size_t mMaxDeltaBlocks{100};
+        size_t mSlots{0};
+        using DataMutex = DAWn::Realtime::CheckedMutex<std::recursive_mutex>;
+        DataMutex data_mutex;
         std::unordered_map<TUserID, size_t> sourceIDToColumnIndex {{0, 0}};
-        Row playbackDataBlock {};
 
-        void layoutCheck(int64_t time, TUserID sourceID);
+        /*! @brief Timestamp currently owning each slot. kEmptySlot if none.*/
+        std::vector<TTime> mSlotTime{};
+        /*! @brief Mixed audio, mSlots x mBlockSize.*/
+        std::vector<float> mPlayback{};
+        /*! @brief Per source audio, nSources x mSlots x mBlockSize.*/
+        std::vector<float> mSources{};
+
+        /*! @brief Lock for policy. False if TryOnly found the mixer busy.*/
+        static bool acquire(std::unique_lock<DataMutex>& lock, LockPolicy policy);
+        void layoutCheck(TUserID sourceID);
         void addSource(TUserID sourceId);
-        void addColumn(TTime time);
-        void mix(TTime time, const Block audioBlock, TUserID sourceID);
-        void replace(TTime time, const Block audioBlock, TUserID sourceID);
+        void allocateTimeline();
+        size_t slotIndex(TTime time) const;
+        /*!
+         * @brief Get the slot for a time, recycling it if an older timestamp owns it.
+         * @return The slot index or mSlots if time is older than the slot owner (too late to be mixed).
+         */
+        size_t claimSlot(TTime time);
+        inline float* playbackAt(size_t slot) { return &mPlayback[slot * mBlockSize]; }
+        inline float* sourceAt(size_t sourceIndex, size_t slot) { return &mSources[(sourceIndex * mSlots + slot) * mBlockSize]; }
+
+        /*! @return False if the block was not mixed: busy (TryOnly), wrong size, or a new source with TryOnly.*/
+        bool mix(TTime time, std::span<const float> audioBlock, TUserID sourceID, LockPolicy policy = LockPolicy::Wait);
+        bool replace(TTime time, std::span<const float> audioBlock, TUserID sourceID, LockPolicy policy = LockPolicy::Wait);
 
         void flushMixer();
-        void resetMixer(size_t blockSize, uint32_t delayInSeconds = 0);
+        void resetMixer(size_t blockSize, uint32_t delayInSeconds = 0, size_t maxDelaySamples = 0);
+        bool setDelaySamples(size_t delaySamples, LockPolicy policy = LockPolicy::Wait);
         //OPERATIONAL CONFIGURATION SECTION
 
+        /*!
+         * @brief Copy the playback block for a time into dst (mBlockSize floats). Silence if the time is not in the timeline.
+         */
+        void getBlock(const int64_t time, int64_t& realtime, float* dst, bool delayed = true);
+        /*!
+         * @brief Copy the playback block for a time into dst. Silence if the time is not in the timeline.
+         * @return False, and silence, if the mixer was busy (TryOnly) or dst is not mBlockSize floats.
+         */
+        bool getBlock(const int64_t time, int64_t& realtime, std::span<float> dst, bool delayed, LockPolicy policy);
         Block getBlock(const int64_t time, int64_t& realtime, bool delayed = true);
         static std::vector<Mixer::Block> getBlocks_(std::vector<AudioMixerBlock>& mixers, const int64_t time, int64_t& realtime, bool delayed = true)
         {
-            return std::vector<Mixer::Block>{
-                mixers[0].getBlock(time, realtime, delayed), mixers[1].getBlock(time, realtime, delayed)
-            };
+            std::vector<Mixer::Block> blocks{};
+            blocks.reserve(mixers.size());
+            for (auto& mixer : mixers)
+            {
+                blocks.push_back(mixer.getBlock(time, realtime, delayed));
+            }
+            return blocks;
         }
         bool containsTimeStamp(const int64_t time);
 
     public:
-        AudioMixerBlock(){}
+        AudioMixerBlock();
 
         //MIX & REPLACE SECTION
         static void mix(
@@ -67,9 +189,38 @@ namespace Mixer
             const std::vector<Block>& splittedBlocks,
             Mixer::TUserID sourceID = 0);
 
+        /*!
+         * @brief Mix one block per channel without allocating. A source not seen before is skipped with TryOnly
+         * (adding its lane allocates): register it first with registerSource.
+         * @return Number of mixers the block was not mixed into.
+         */
+        static size_t mix(
+            std::vector<AudioMixerBlock>& mixers,
+            int64_t time,
+            ConstChannels blocks,
+            Mixer::TUserID sourceID,
+            LockPolicy policy = LockPolicy::Wait);
 
-
-        static void resetMixers(std::vector<AudioMixerBlock>& mixers, size_t blockSize, uint32_t delayInSeconds = 0);
+        static size_t replace(
+            std::vector<AudioMixerBlock>& mixers,
+            int64_t time,
+            ConstChannels blocks,
+            Mixer::TUserID sourceID,
+            LockPolicy policy = LockPolicy::Wait);
+
+        /*! @brief Add the lane of a source in every mixer, off the audio thread. Lanes go away on reset.*/
+        static void registerSource(std::vector<AudioMixerBlock>& mixers, Mixer::TUserID sourceID);
+
+        /*!
+         * @brief Reset the mixers.
+         * @param delayInSeconds Initial playout delay.
+         * @param maxDelaySamples Largest delay setDelay will be asked for later. The timeline is sized for it.
+         */
+        static void resetMixers(std::vector<AudioMixerBlock>& mixers, size_t blockSize, uint32_t delayInSeconds = 0, size_t maxDelaySamples = 0);
+        /*!
+         * @brief Change the playout delay of getBlocksDelayed. Rounded up to whole blocks, clamped to the max delay of the last reset.
+         */
+        static void setDelay(std::vector<AudioMixerBlock>& mixers, size_t delaySamples, LockPolicy policy = LockPolicy::Wait);
         static std::vector<Mixer::Block> getBlocksDelayed(std::vector<AudioMixerBlock>& mixers, const int64_t time, int64_t& realtime)
         {
             return getBlocks_(mixers, time, realtime, true);
@@ -78,11 +229,17 @@ namespace Mixer
         {
             return getBlocks_(mixers, time, realtime, false);
         }
+        /*!
+         * @brief getBlocks / getBlocksDelayed into caller storage, one span of the mixer block size per channel.
+         * @return Number of channels left silent because their mixer was busy (TryOnly) or the span size was wrong.
+         */
+        static size_t getBlocks(std::vector<AudioMixerBlock>& mixers, const int64_t time, int64_t& realtime, Channels dst, LockPolicy policy = LockPolicy::Wait);
+        static size_t getBlocksDelayed(std::vector<AudioMixerBlock>& mixers, const int64_t time, int64_t& realtime, Channels dst, LockPolicy policy = LockPolicy::Wait);
 
         static bool containsTimeStamp(std::vector<AudioMixerBlock>& mixers, const int64_t time);
 
 
-        inline static DAWn::Events::Signal<std::vector<Mixer::Block>, int64_t> mixFinished {};
+        inline static DAWn::Events::Signal<const std::vector<Mixer::Block>&, int64_t> mixFinished {};
         inline static DAWn::Events::Signal<std::vector<AudioMixerBlock>&, int64_t> invalidBlock{};
         inline static DAWn::Events::Signal<size_t, size_t> replacingBlockMismatch{};
 
@@ -0,0 +1,148 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+
+#ifndef AUDIOSTREAMPLUGIN_DECODEPOOL_H
+#define AUDIOSTREAMPLUGIN_DECODEPOOL_H
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+#include "ring.h"
+#include "Notifier.h"
+
+namespace Mixer
+{
+    /*!
+     * @brief A small, fixed set of worker threads sharing the inbound decode.
+     *
+     * Every job carries a key (the remote TUserID). A key always lands on the same worker, so:
+     *
+     *     - the decoder state of a peer is only touched by one thread and stays warm in its core cache,
+     *     - the jobs of a peer are handled in the order they were submitted,
+     *     - the per peer input BlockSizeAdapter keeps a single producer.
+     *
+     * Each worker drains its own bounded ring (late audio is useless: a full ring drops its oldest job) and sleeps on
+     * its own Notifier. submit never blocks and never allocates, so it can run on the network thread.
+     *
+     * With 0 workers there is no thread at all and submit runs the handler on the caller.
+     *
+     * stop may run while another thread submits: it waits for the submits in flight, later ones drop their job.
+     */
+    template <typename Job>
+    class DecodePool
+    {
+    public:
+        using Handler = std::function<void(Job&)>;
+        static constexpr size_t kQueueCapacity = 256;
+
+        DecodePool() = default;
+        DecodePool(const DecodePool&) = delete;
+        DecodePool& operator=(const DecodePool&) = delete;
+        ~DecodePool() { stop(); }
+
+        /*!
+         * @brief Start the workers. A running pool is stopped first.
+         * @param workers Number of threads. 0 runs every job on the thread calling submit.
+         * @param handler What to do with a job. Called on the worker owning its key.
+         */
+        void start(size_t workers, Handler handler)
+        {
+            stop();
+            mHandler = std::move(handler);
+            for (auto index = 0ul; index < workers; ++index)
+            {
+                mWorkers.push_back(std::make_unique<Worker>());
+            }
+            bRun.store(true, std::memory_order_seq_cst);
+            for (auto& pWorker : mWorkers)
+            {
+                auto worker = pWorker.get();
+                worker->thread = std::thread{[this, worker]() { run(*worker); }};
+            }
+        }
+
+        /*! @brief Stop and join the workers. Jobs still queued, and jobs submitted from now on, are dropped.*/
+        void stop()
+        {
+            bRun.store(false, std::memory_order_seq_cst);
+            //A submit that saw the pool running is still using mWorkers or the handler.
+            while (mSubmitting.load(std::memory_order_seq_cst) > 0) std::this_thread::yield();
+            for (auto& pWorker : mWorkers)
+            {
+                pWorker->wakeUp.notify();
+                if (pWorker->thread.joinable()) pWorker->thread.join();
+            }
+            mWorkers.clear();
+        }
+
+        /*! @brief The worker jobs with this key run on.*/
+        inline size_t workerFor(uint64_t key) const { return mWorkers.empty() ? 0 : key % mWorkers.size(); }
+        inline size_t workers() const { return mWorkers.size(); }
+
+        /*!
+         * @brief Queue a job on the worker of its key.
+         * @return False if the queue of that worker was full and its oldest job was dropped, or the pool is stopped.
+         */
+        bool submit(uint64_t key, Job job)
+        {
+            mSubmitting.fetch_add(1, std::memory_order_seq_cst);
+            auto queued = false;
+            if (bRun.load(std::memory_order_seq_cst))
+            {
+                if (mWorkers.empty())
+                {
+                    if (mHandler) mHandler(job);
+                    queued = true;
+                }
+                else
+                {
+                    auto& worker = *mWorkers[workerFor(key)];
+                    queued = worker.queue.push(std::move(job));
+                    worker.wakeUp.notify();
+                }
+            }
+            mSubmitting.fetch_sub(1, std::memory_order_release);
+            return queued;
+        }
+
+        xlet::QueueStats stats(size_t worker) const
+        {
+            return worker < mWorkers.size() ? mWorkers[worker]->queue.stats() : xlet::QueueStats{};
+        }
+
+    private:
+        struct Worker
+        {
+            xlet::BoundedQueue<Job>     queue{kQueueCapacity, xlet::Overflow::DropOldest};
+            DAWn::Events::Notifier      wakeUp;
+            std::thread                 thread;
+        };
+
+        void run(Worker& worker)
+        {
+            Job job{};
+            while (bRun.load(std::memory_order_acquire))
+            {
+                auto ticket = worker.wakeUp.ticket();
+                while (worker.queue.tryPop(job))
+                {
+                    mHandler(job);
+                    job = Job{};
+                }
+                if (bRun.load(std::memory_order_acquire)) worker.wakeUp.wait(ticket);
+            }
+        }
+
+        std::vector<std::unique_ptr<Worker>>    mWorkers{};
+        std::atomic<bool>                       bRun{false};
+        std::atomic<size_t>                     mSubmitting{0};
+        Handler                                 mHandler{};
+    };
+}
+
+#endif //AUDIOSTREAMPLUGIN_DECODEPOOL_H
@@ -0,0 +1,128 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+
+#ifndef AUDIOSTREAMPLUGIN_HISTOGRAM_H
+#define AUDIOSTREAMPLUGIN_HISTOGRAM_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+namespace DAWn::Metrics
+{
+    /*!
+     * @brief Log linear histogram of non negative integers (microseconds, samples ...).
+     *
+     * Every power of two is split in kSubBuckets buckets, so a percentile is off by at most 1 / kSubBuckets (3%) of
+     * the value. Values from 2^kMaxBits on land in the last bucket.
+     *
+     * record() is one relaxed fetch_add per counter, no locks: any number of threads record while another takes
+     * snapshots. A snapshot is not atomic as a whole, a record racing with it may be half in.
+     */
+    class Histogram
+    {
+    public:
+        static constexpr size_t kSubBits    = 5;
+        static constexpr size_t kSubBuckets = size_t{1} << kSubBits;
+        static constexpr size_t kMaxBits    = 40;
+        static constexpr size_t kBuckets    = (kMaxBits - kSubBits + 1) * kSubBuckets;
+
+        struct Snapshot
+        {
+            std::array<uint64_t, kBuckets> counts{};
+            uint64_t count{0};
+            uint64_t sum{0};
+            uint64_t max{0};    //!Since the histogram was created, not since the previous snapshot.
+
+            /*! @param quantile 0 .. 1. @return The middle of the bucket holding it, 0 if empty.*/
+            uint64_t percentile(double quantile) const
+            {
+                if (count == 0) return 0;
+                auto rank = static_cast<uint64_t>(std::clamp(quantile, 0.0, 1.0) * static_cast<double>(count - 1)) + 1;
+                auto seen = uint64_t{0};
+                for (auto index = 0ul; index < kBuckets; ++index)
+                {
+                    seen += counts[index];
+                    if (seen >= rank) return std::min(midpoint(index), max);
+                }
+                return max;
+            }
+            inline double mean() const { return count ? static_cast<double>(sum) / static_cast<double>(count) : 0.0; }
+
+            /*! @brief Add the samples of other, as if both had recorded into one histogram.*/
+            Snapshot& operator+=(const Snapshot& other)
+            {
+                for (auto index = 0ul; index < kBuckets; ++index) counts[index] += other.counts[index];
+                count += other.count;
+                sum += other.sum;
+                max = std::max(max, other.max);
+                return *this;
+            }
+
+            /*! @brief What was recorded between earlier and this snapshot (max stays the overall one).*/
+            Snapshot operator-(const Snapshot& earlier) const
+            {
+                Snapshot interval{*this};
+                for (auto index = 0ul; index < kBuckets; ++index) interval.counts[index] -= earlier.counts[index];
+                interval.count -= earlier.count;
+                interval.sum -= earlier.sum;
+                return interval;
+            }
+        };
+
+        void record(uint64_t value)
+        {
+            mCounts[bucket(value)].fetch_add(1, std::memory_order_relaxed);
+            mCount.fetch_add(1, std::memory_order_relaxed);
+            mSum.fetch_add(value, std::memory_order_relaxed);
+            auto max = mMax.load(std::memory_order_relaxed);
+            while (value > max && !mMax.compare_exchange_weak(max, value, std::memory_order_relaxed)) {}
+        }
+
+        Snapshot snapshot() const
+        {
+            Snapshot snapshot{};
+            for (auto index = 0ul; index < kBuckets; ++index) snapshot.counts[index] = mCounts[index].load(std::memory_order_relaxed);
+            snapshot.count = mCount.load(std::memory_order_relaxed);
+            snapshot.sum = mSum.load(std::memory_order_relaxed);
+            snapshot.max = mMax.load(std::memory_order_relaxed);
+            return snapshot;
+        }
+
+        static size_t bucket(uint64_t value)
+        {
+            if (value < kSubBuckets) return static_cast<size_t>(value);
+            auto msb = static_cast<size_t>(63 - std::countl_zero(value));
+            if (msb >= kMaxBits) return kBuckets - 1;
+            auto shift = msb - kSubBits;
+            return (shift + 1) * kSubBuckets + static_cast<size_t>((value >> shift) - kSubBuckets);
+        }
+
+        /*! @brief Smallest value of bucket index.*/
+        static uint64_t lowest(size_t index)
+        {
+            if (index < kSubBuckets) return index;
+            auto shift = index / kSubBuckets - 1;
+            return (kSubBuckets + index % kSubBuckets) << shift;
+        }
+
+        static uint64_t midpoint(size_t index)
+        {
+            if (index < kSubBuckets) return index;
+            auto shift = index / kSubBuckets - 1;
+            return lowest(index) + ((uint64_t{1} << shift) >> 1);
+        }
+
+    private:
+        std::array<std::atomic<uint64_t>, kBuckets> mCounts{};
+        std::atomic<uint64_t> mCount{0};
+        std::atomic<uint64_t> mSum{0};
+        std::atomic<uint64_t> mMax{0};
+    };
+}
+
+#endif //AUDIOSTREAMPLUGIN_HISTOGRAM_H
@@ -0,0 +1,244 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+
+#include "JitterBuffer.h"
+
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+namespace Mixer
+{
+    static int64_t steadyNowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static constexpr TTime kNotReceived = std::numeric_limits<TTime>::min();
+    static constexpr int64_t kSourceTimeoutNs = 1'000'000'000;
+
+    JitterBuffer::JitterBuffer()
+    {
+        reset(Settings{});
+    }
+
+    void JitterBuffer::reset(const Settings& settings)
+    {
+        std::lock_guard lock(mMutex);
+        mSettings = settings;
+        mSettings.packetSamples = std::max<size_t>(mSettings.packetSamples, 1);
+        mSettings.sampleRate = std::max<size_t>(mSettings.sampleRate, 1);
+        mSettings.maxDelaySamples = std::max(mSettings.maxDelaySamples, mSettings.minDelaySamples);
+        mSources.clear();
+        mShrinkCount = 0;
+        mHeadValid.store(false, std::memory_order_relaxed);
+        mDelaySamples.store(mSettings.minDelaySamples, std::memory_order_relaxed);
+    }
+
+    void JitterBuffer::setPlaybackHead(TTime head)
+    {
+        setPlaybackHead(head, steadyNowNs());
+    }
+
+    void JitterBuffer::setPlaybackHead(TTime head, int64_t nowNs)
+    {
+        mHead.store(head, std::memory_order_relaxed);
+        mHeadNs.store(nowNs, std::memory_order_relaxed);
+        mHeadValid.store(true, std::memory_order_release);
+    }
+
+    TTime JitterBuffer::headAt(int64_t nowNs) const
+    {
+        //The head only moves once per DAW block, extrapolate up to one block with the wall clock.
+        auto head = mHead.load(std::memory_order_relaxed);
+        auto elapsedNs = std::max<int64_t>(nowNs - mHeadNs.load(std::memory_order_relaxed), 0);
+        auto elapsedSamples = elapsedNs * static_cast<int64_t>(mSettings.sampleRate) / 1'000'000'000;
+        return head + std::min<int64_t>(elapsedSamples, static_cast<int64_t>(mSettings.blockSize));
+    }
+
+    size_t JitterBuffer::windowSlot(TTime timeStamp) const
+    {
+        auto packetSamples = static_cast<TTime>(mSettings.packetSamples);
+        auto window = static_cast<TTime>(kWindowPackets);
+        auto packetIndex = timeStamp >= 0 ? timeStamp / packetSamples : (timeStamp - packetSamples + 1) / packetSamples;
+        return static_cast<size_t>(((packetIndex % window) + window) % window);
+    }
+
+    int64_t JitterBuffer::targetDelay(const Source& source) const
+    {
+        if (source.latenessCount == 0) return static_cast<int64_t>(mSettings.minDelaySamples);
+        auto worstLateness = *std::max_element(source.lateness.begin(), source.lateness.begin() + static_cast<std::ptrdiff_t>(source.latenessCount));
+        auto headroom = static_cast<int64_t>(mSettings.packetSamples) + static_cast<int64_t>(std::ceil(2.0 * source.stats.jitterSamples));
+        return worstLateness + headroom;
+    }
+
+    void JitterBuffer::updateDelay(int64_t nowNs)
+    {
+        auto desired = static_cast<int64_t>(mSettings.minDelaySamples);
+        for (auto& [sourceID, source] : mSources)
+        {
+            if (nowNs - source.lastHeardNs > kSourceTimeoutNs) continue;
+            desired = std::max(desired, source.stats.targetDelaySamples);
+        }
+        auto target = static_cast<size_t>(std::clamp<int64_t>(desired, static_cast<int64_t>(mSettings.minDelaySamples), static_cast<int64_t>(mSettings.maxDelaySamples)));
+        auto current = mDelaySamples.load(std::memory_order_relaxed);
+
+        if (target >= current)
+        {
+            mShrinkCount = 0;
+            mDelaySamples.store(target, std::memory_order_relaxed);
+            return;
+        }
+        //Shrink slowly: a packet at a time, once the extra delay has been useless for a while.
+        if (current - target < mSettings.packetSamples || ++mShrinkCount < kShrinkHoldPackets) return;
+        mShrinkCount = 0;
+        mDelaySamples.store(std::max(current - mSettings.packetSamples, target), std::memory_order_relaxed);
+    }
+
+    JitterBuffer::Verdict JitterBuffer::admit(TUserID sourceID, TTime timeStamp)
+    {
+        return admit(sourceID, timeStamp, steadyNowNs());
+    }
+
+    JitterBuffer::Verdict JitterBuffer::admit(TUserID sourceID, TTime timeStamp, int64_t arrivalNs)
+    {
+        std::lock_guard lock(mMutex);
+        auto& source = mSources[sourceID];
+        auto packetSamples = static_cast<TTime>(mSettings.packetSamples);
+        if (!source.started) source.receivedAt.fill(kNotReceived);
+
+        source.lastHeardNs = arrivalNs;
+        ++source.stats.received;
+
+        //DUPLICATES AND PACKETS OLDER THAN THE WINDOW
+        auto slot = windowSlot(timeStamp);
+        if (source.started && source.receivedAt[slot] == timeStamp)
+        {
+            ++source.stats.duplicate;
+            return Verdict::Duplicate;
+        }
+        if (source.started && timeStamp <= source.highest - static_cast<TTime>(kWindowPackets) * packetSamples)
+        {
+            ++source.stats.late;
+            return Verdict::Late;
+        }
+        source.receivedAt[slot] = timeStamp;
+        if (!source.started || timeStamp < source.first) source.first = timeStamp;
+        ++source.unique;
+
+        //INTER-ARRIVAL JITTER (RFC 3550): J += (|D(i-1, i)| - J) / 16
+        auto timeStampNs = timeStamp * 1'000'000'000 / static_cast<int64_t>(mSettings.sampleRate);
+        auto transitNs = arrivalNs - timeStampNs;
+        if (source.started)
+        {
+            auto deltaSamples = static_cast<double>(std::llabs(transitNs - source.lastTransitNs)) * static_cast<double>(mSettings.sampleRate) / 1e9;
+            source.stats.jitterSamples += (deltaSamples - source.stats.jitterSamples) / 16.0;
+        }
+        source.lastTransitNs = transitNs;
+
+        auto verdict = source.started && timeStamp == source.lastAdmitted + packetSamples ? Verdict::OnTime : Verdict::Discontinuous;
+        auto superseded = source.started && timeStamp < source.highest;
+        if (!source.started || timeStamp > source.highest) source.highest = timeStamp;
+        source.started = true;
+        auto expectedPackets = expected(source);
+        source.stats.lost = expectedPackets > source.unique ? expectedPackets - source.unique : 0;
+
+        //LATENESS AGAINST THE PLAYBACK HEAD
+        if (mHeadValid.load(std::memory_order_acquire))
+        {
+            auto head = headAt(arrivalNs);
+            source.lateness[source.latenessIndex] = head - timeStamp;
+            source.latenessIndex = (source.latenessIndex + 1) % kWindowPackets;
+            source.latenessCount = std::min(source.latenessCount + 1, kWindowPackets);
+            source.stats.targetDelaySamples = targetDelay(source);
+
+            auto playoutHead = head - static_cast<TTime>(mDelaySamples.load(std::memory_order_relaxed));
+            auto isLate = timeStamp + packetSamples <= playoutHead;
+            updateDelay(arrivalNs);
+            if (isLate)
+            {
+                ++source.stats.late;
+                return Verdict::Late;
+            }
+        }
+
+        //It arrived (no loss), but the packets after it were decoded already: it stays a gap.
+        if (superseded)
+        {
+            ++source.stats.superseded;
+            return Verdict::Superseded;
+        }
+        source.lastAdmitted = timeStamp;
+        return verdict;
+    }
+
+    size_t JitterBuffer::retransmitCandidates(TUserID sourceID, TTime timeStamp, int64_t minSlackSamples, std::span<TTime> missing)
+    {
+        return retransmitCandidates(sourceID, timeStamp, minSlackSamples, missing, steadyNowNs());
+    }
+
+    size_t JitterBuffer::retransmitCandidates(TUserID sourceID, TTime timeStamp, int64_t minSlackSamples, std::span<TTime> missing, int64_t nowNs)
+    {
+        std::lock_guard lock(mMutex);
+        auto it = mSources.find(sourceID);
+        if (it == mSources.end() || !it->second.started || missing.empty()) return 0;
+        auto& source = it->second;
+        auto packetSamples = static_cast<TTime>(mSettings.packetSamples);
+
+        //Not older than the window, the first packet or what was already requested.
+        auto oldest = std::max({
+            timeStamp - static_cast<TTime>(std::min(missing.size(), kWindowPackets - 1)) * packetSamples,
+            source.first,
+            source.retransmitRequested == kNotReceived ? source.first : source.retransmitRequested + packetSamples});
+
+        auto bHeadValid = mHeadValid.load(std::memory_order_acquire);
+        auto playoutHead = bHeadValid ? headAt(nowNs) - static_cast<TTime>(mDelaySamples.load(std::memory_order_relaxed)) : TTime{0};
+        auto count = 0ul;
+        for (auto candidate = timeStamp - packetSamples; candidate >= oldest && count < missing.size(); candidate -= packetSamples)
+        {
+            //Older packets have even less time left.
+            if (bHeadValid && candidate + packetSamples - playoutHead < minSlackSamples) break;
+            if (source.receivedAt[windowSlot(candidate)] == candidate) continue;
+            missing[count++] = candidate;
+        }
+        source.retransmitRequested = std::max(source.retransmitRequested, timeStamp - packetSamples);
+        return count;
+    }
+
+    uint64_t JitterBuffer::expected(const Source& source) const
+    {
+        return static_cast<uint64_t>((source.highest - source.first) / static_cast<TTime>(mSettings.packetSamples)) + 1;
+    }
+
+    double JitterBuffer::fractionLost()
+    {
+        std::lock_guard lock(mMutex);
+        uint64_t expectedInterval = 0;
+        uint64_t receivedInterval = 0;
+        for (auto& [sourceID, source] : mSources)
+        {
+            if (!source.started) continue;
+            auto expectedPackets = expected(source);
+            expectedInterval += expectedPackets - std::min(source.expectedPrior, expectedPackets);
+            receivedInterval += source.unique - std::min(source.uniquePrior, source.unique);
+            source.expectedPrior = expectedPackets;
+            source.uniquePrior = source.unique;
+        }
+        if (expectedInterval == 0 || receivedInterval >= expectedInterval) return 0.0;
+        return static_cast<double>(expectedInterval - receivedInterval) / static_cast<double>(expectedInterval);
+    }
+
+    JitterBuffer::Stats JitterBuffer::stats(TUserID sourceID) const
+    {
+        std::lock_guard lock(mMutex);
+        auto it = mSources.find(sourceID);
+        return it == mSources.end() ? Stats{} : it->second.stats;
+    }
+
+    void JitterBuffer::removeSource(TUserID sourceID)
+    {
+        std::lock_guard lock(mMutex);
+        mSources.erase(sourceID);
+    }
+}
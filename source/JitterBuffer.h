@@ -0,0 +1,165 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+
+#ifndef AUDIOSTREAMPLUGIN_JITTERBUFFER_H
+#define AUDIOSTREAMPLUGIN_JITTERBUFFER_H
+
+#include <array>
+#include <limits>
+#include <atomic>
+#include <mutex>
+#include <span>
+#include <cstdint>
+#include <unordered_map>
+
+#include "AudioMixerBlock.h"
+#include "Realtime.h"
+
+namespace Mixer
+{
+    /*!
+     * @brief Adaptive playout delay for the remote sources of the mixer.
+     *
+     * Every received packet is admitted BEFORE it is decoded. Per remote TUserID the buffer keeps:
+     *
+     *     - which of the last kWindowPackets timestamps were received (duplicates are rejected),
+     *     - the highest timestamp seen (packets below it are superseded: the decoder is past them),
+     *     - the inter-arrival jitter (RFC 3550, 6.4.1) measured on a wall clock,
+     *     - how far behind the local playback head each packet arrived (its lateness).
+     *
+     * A packet is Late when the mixer already played its timestamp: playback head - delay is past it.
+     *
+     * The target delay of a source is the worst lateness over the window, plus a packet and twice the jitter of
+     * headroom. The playout delay is the largest target among the sources heard in the last second, clamped to
+     * [minDelaySamples, maxDelaySamples]. It grows right away and shrinks one packet at a time, only after it has
+     * been too large for kShrinkHoldPackets packets in a row.
+     *
+     * admit runs on the network thread. The audio thread only calls setPlaybackHead and delaySamples, which are
+     * lock free.
+     */
+    class JitterBuffer
+    {
+    public:
+        struct Settings
+        {
+            /*! @brief Samples per network packet (the encoder block size).*/
+            size_t packetSamples{480};
+            /*! @brief Samples per DAW block, the playback head advances in these steps.*/
+            size_t blockSize{480};
+            size_t sampleRate{48000};
+            size_t minDelaySamples{960};
+            size_t maxDelaySamples{24000};
+        };
+
+        enum class Verdict
+        {
+            OnTime,         //!Right after the previous packet of the source.
+            Discontinuous,  //!In time, but not right after the previous packet (loss or reordering). Re-anchor the timeline on it.
+            Late,           //!Its timestamp was already played. Drop it.
+            Duplicate,      //!Already received. Drop it.
+            Superseded      //!Older than a packet already admitted (reordered, or a late retransmission): the decoder is past it. Drop it.
+        };
+
+        struct Stats
+        {
+            uint64_t    received{0};
+            uint64_t    late{0};
+            uint64_t    duplicate{0};
+            /*! @brief Packets that came after a newer one of the source, FEC / PLC had already rebuilt them.*/
+            uint64_t    superseded{0};
+            /*! @brief Packets never received (RFC 3550 cumulative lost: expected - received).*/
+            uint64_t    lost{0};
+            /*! @brief Inter-arrival jitter estimate, in samples.*/
+            double      jitterSamples{0.0};
+            /*! @brief Delay this source alone would need, in samples.*/
+            int64_t     targetDelaySamples{0};
+        };
+
+        static constexpr size_t kWindowPackets = 128;
+        static constexpr size_t kShrinkHoldPackets = 200;
+
+        JitterBuffer();
+
+        /*! @brief Forget every source and restart at the minimum delay.*/
+        void reset(const Settings& settings);
+
+        /*! @brief The local timeline position being played. Call from the audio thread once per block.*/
+        void setPlaybackHead(TTime head);
+        void setPlaybackHead(TTime head, int64_t nowNs);
+
+        /*!
+         * @brief Classify a packet and update the delay estimate.
+         * @param sourceID The remote user.
+         * @param timeStamp The timeline position of the first sample in the packet.
+         * @return Late, Duplicate and Superseded packets must be dropped. Packets are decoded in the order they are
+         * admitted, one older than a packet already admitted would move the decoder and the input BSA back.
+         */
+        Verdict admit(TUserID sourceID, TTime timeStamp);
+        Verdict admit(TUserID sourceID, TTime timeStamp, int64_t arrivalNs);
+
+        /*!
+         * @brief The packets missing right before timeStamp that can still be played if they are sent again.
+         *
+         * Call after timeStamp was admitted as Discontinuous. A missing packet is a candidate if it was never
+         * received, was not a candidate before, and will not be late for another minSlackSamples (the round trip
+         * of a retransmission). The newest candidates come first.
+         * @param missing Filled with the candidate timestamps, its size caps how many.
+         * @return How many candidates were written.
+         */
+        size_t retransmitCandidates(TUserID sourceID, TTime timeStamp, int64_t minSlackSamples, std::span<TTime> missing);
+        size_t retransmitCandidates(TUserID sourceID, TTime timeStamp, int64_t minSlackSamples, std::span<TTime> missing, int64_t nowNs);
+
+        /*! @brief Current playout delay in samples.*/
+        inline size_t delaySamples() const { return mDelaySamples.load(std::memory_order_relaxed); }
+
+        Stats stats(TUserID sourceID) const;
+        /*!
+         * @brief Fraction of the packets lost by all the sources since the previous call (RFC 3550, A.3).
+         * @return 0 to 1.
+         */
+        double fractionLost();
+        void removeSource(TUserID sourceID);
+
+    private:
+        struct Source
+        {
+            bool                                    started{false};
+            TTime                                   highest{0};
+            TTime                                   lastAdmitted{0};
+            TTime                                   first{0};
+            /*! @brief Packets received once, duplicates and packets older than the window excluded.*/
+            uint64_t                                unique{0};
+            uint64_t                                expectedPrior{0};
+            uint64_t                                uniquePrior{0};
+            /*! @brief Timestamp received in each window slot, a timestamp lives in slot (timeStamp / packetSamples) % kWindowPackets.*/
+            std::array<TTime, kWindowPackets>       receivedAt{};
+            int64_t                                 lastTransitNs{0};
+            std::array<int64_t, kWindowPackets>     lateness{};
+            size_t                                  latenessIndex{0};
+            size_t                                  latenessCount{0};
+            int64_t                                 lastHeardNs{0};
+            /*! @brief Packets up to here were already retransmit candidates.*/
+            TTime                                   retransmitRequested{std::numeric_limits<TTime>::min()};
+            Stats                                   stats{};
+        };
+
+        Settings                                mSettings{};
+        mutable DAWn::Realtime::CheckedMutex<std::mutex> mMutex;
+        std::unordered_map<TUserID, Source>     mSources{};
+        size_t                                  mShrinkCount{0};
+
+        std::atomic<TTime>                      mHead{0};
+        std::atomic<int64_t>                    mHeadNs{0};
+        std::atomic<bool>                       mHeadValid{false};
+        std::atomic<size_t>                     mDelaySamples{960};
+
+        size_t windowSlot(TTime timeStamp) const;
+        int64_t targetDelay(const Source& source) const;
+        uint64_t expected(const Source& source) const;
+        void updateDelay(int64_t nowNs);
+        TTime headAt(int64_t nowNs) const;
+    };
+}
+
+#endif //AUDIOSTREAMPLUGIN_JITTERBUFFER_H
@@ -0,0 +1,120 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+
+#include "LoadGenerator.h"
+
+#include <algorithm>
+
+DAWn::LoadGen::LoadGenerator::LoadGenerator(Options options) : mOptions(std::move(options))
+{
+    mOptions.encoders = std::max(mOptions.encoders, 1u);
+    mOptions.peer.uidCount = static_cast<uint32_t>(mOptions.maxPeers);
+    //Made once: the clock and encoder threads read the slots below mActive without locks.
+    mPeers.resize(mOptions.maxPeers);
+    for (auto encoder = 0u; encoder < mOptions.encoders; ++encoder) mWakeUps.push_back(std::make_unique<DAWn::Events::Notifier>());
+}
+
+DAWn::LoadGen::LoadGenerator::~LoadGenerator()
+{
+    stop();
+    mPeers.clear();
+}
+
+void DAWn::LoadGen::LoadGenerator::start()
+{
+    if (bRun.exchange(true)) return;
+    mOptions.peer.epoch = Clock::now();
+    mClockThread = std::thread([this](){ clockLoop(); });
+    for (auto encoder = 0u; encoder < mOptions.encoders; ++encoder)
+    {
+        mEncoderThreads.emplace_back([this, encoder](){ encoderLoop(encoder); });
+    }
+}
+
+void DAWn::LoadGen::LoadGenerator::stop()
+{
+    if (!bRun.exchange(false)) return;
+    if (mClockThread.joinable()) mClockThread.join();
+    for (auto& wakeUp : mWakeUps) wakeUp->notify();
+    for (auto& thread : mEncoderThreads) thread.join();
+    mEncoderThreads.clear();
+
+    for (auto index = 0ul; index < peers(); ++index) mPeers[index]->stop();
+}
+
+size_t DAWn::LoadGen::LoadGenerator::addPeers(size_t count)
+{
+    auto active = peers();
+    auto target = std::min(active + count, mOptions.maxPeers);
+    for (; active < target; ++active)
+    {
+        auto uid = mOptions.peer.uidBase + static_cast<uint32_t>(active);
+        auto pPeer = std::make_unique<SyntheticPeer>(mOptions.peer, uid);
+        if (!pPeer->start(mWakeUps[active % mOptions.encoders].get())) break;
+        mPeers[active] = std::move(pPeer);
+        //Publish the slot: from here the clock captures into it and its encoder thread sends.
+        mActive.store(active + 1, std::memory_order_release);
+    }
+    return active;
+}
+
+void DAWn::LoadGen::LoadGenerator::clockLoop()
+{
+    const auto& settings = mOptions.peer;
+    const auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(static_cast<double>(settings.dawBlockSize) / settings.sampleRate));
+    uint64_t block = 0;
+
+    while (bRun.load(std::memory_order_acquire))
+    {
+        //processBlock of block runs once its last sample is in.
+        auto due = settings.epoch + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(static_cast<double>((block + 1) * settings.dawBlockSize) / settings.sampleRate));
+        std::this_thread::sleep_until(due);
+        if (Clock::now() - due > period) mOverruns.fetch_add(1, std::memory_order_relaxed);
+
+        auto timeStamp = static_cast<uint32_t>(block * settings.dawBlockSize);
+        auto active = peers();
+        for (auto index = 0ul; index < active; ++index) mPeers[index]->capture(timeStamp);
+        ++block;
+    }
+}
+
+void DAWn::LoadGen::LoadGenerator::encoderLoop(unsigned encoder)
+{
+    auto& wakeUp = *mWakeUps[encoder];
+    while (bRun.load(std::memory_order_acquire))
+    {
+        //Take the ticket before looking for work, a capture in between wakes the wait below right away.
+        auto ticket = wakeUp.ticket();
+        auto active = peers();
+        for (auto index = static_cast<size_t>(encoder); index < active; index += mOptions.encoders) mPeers[index]->encode();
+        if (bRun.load(std::memory_order_acquire)) wakeUp.wait(ticket);
+    }
+}
+
+DAWn::LoadGen::Summary DAWn::LoadGen::LoadGenerator::report()
+{
+    Summary summary{};
+    summary.peers = peers();
+    auto overruns = mOverruns.load(std::memory_order_relaxed);
+    summary.overruns = overruns - mReportedOverruns;
+    mReportedOverruns = overruns;
+
+    for (auto index = 0ul; index < summary.peers; ++index)
+    {
+        auto peer = mPeers[index]->report();
+        summary.framesSent += peer.framesSent;
+        summary.encodeErrors += peer.encodeErrors;
+        summary.queueDrops += peer.queueDrops;
+        summary.sendJitter += peer.sendJitter;
+        summary.latency += peer.latency;
+        summary.hostLatency += peer.hostLatency;
+        summary.received += peer.received;
+        summary.lost += peer.lost;
+        summary.hostReceived += peer.hostReceived;
+        summary.hostLost += peer.hostLost;
+        summary.rttMs = std::max(summary.rttMs, peer.rttMs);
+        summary.perPeer.push_back(std::move(peer));
+    }
+    return summary;
+}
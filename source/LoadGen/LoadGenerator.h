@@ -0,0 +1,85 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+
+#ifndef AUDIOSTREAMPLUGIN_LOADGENERATOR_H
+#define AUDIOSTREAMPLUGIN_LOADGENERATOR_H
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "SyntheticPeer.h"
+
+namespace DAWn::LoadGen
+{
+    struct Options
+    {
+        PeerSettings    peer{};
+        size_t          maxPeers{8};    //!Peers are added up to this many, the slots are made once.
+        unsigned        encoders{1};    //!Encoder threads, each one serves every encoders-th peer.
+    };
+
+    /*! @brief The peers together, over one report interval.*/
+    struct Summary
+    {
+        size_t                              peers{0};
+        uint64_t                            framesSent{0};
+        uint64_t                            encodeErrors{0};
+        uint64_t                            queueDrops{0};
+        uint64_t                            overruns{0};    //!Capture ticks the clock thread started late: the generator is the bottleneck.
+        DAWn::Metrics::Histogram::Snapshot  sendJitter{};
+        DAWn::Metrics::Histogram::Snapshot  latency{};
+        DAWn::Metrics::Histogram::Snapshot  hostLatency{};
+        uint64_t                            received{0};
+        uint64_t                            lost{0};
+        uint64_t                            hostReceived{0};
+        uint64_t                            hostLost{0};
+        double                              rttMs{-1.0};
+        std::vector<PeerReport>             perPeer{};
+
+        inline double lossFraction() const { return received + lost ? static_cast<double>(lost) / static_cast<double>(received + lost) : 0.0; }
+        inline double hostLossFraction() const { return hostReceived + hostLost ? static_cast<double>(hostLost) / static_cast<double>(hostReceived + hostLost) : 0.0; }
+    };
+
+    /*!
+     * @brief N synthetic peers at real time cadence.
+     *
+     * A clock thread plays the DAW: every dawBlockSize samples it captures a block into every peer, like
+     * processBlock does. Encoder threads wait on the adapters the way the encoder thread of the plugin does and send.
+     * Peers can be added while it runs, never removed: the clock and encoder threads walk the peers without locks.
+     */
+    class LoadGenerator
+    {
+    public:
+        explicit LoadGenerator(Options options);
+        ~LoadGenerator();
+
+        void start();
+        void stop();
+
+        /*! @brief Start count more peers, up to maxPeers. @return The peers running.*/
+        size_t addPeers(size_t count);
+        inline size_t peers() const { return mActive.load(std::memory_order_acquire); }
+
+        /*! @brief Everything measured since the previous call. Call it from one thread.*/
+        Summary report();
+
+    private:
+        void clockLoop();
+        void encoderLoop(unsigned encoder);
+
+        Options                                         mOptions;
+        std::vector<std::unique_ptr<SyntheticPeer>>     mPeers{};
+        std::atomic<size_t>                             mActive{0};
+        std::vector<std::unique_ptr<DAWn::Events::Notifier>> mWakeUps{};
+        std::atomic<bool>                               bRun{false};
+        std::atomic<uint64_t>                           mOverruns{0};
+        uint64_t                                        mReportedOverruns{0};
+        std::thread                                     mClockThread{};
+        std::vector<std::thread>                        mEncoderThreads{};
+    };
+}
+
+#endif //AUDIOSTREAMPLUGIN_LOADGENERATOR_H
@@ -0,0 +1,196 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+
+#include "SyntheticPeer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+namespace
+{
+    OpusImpl::CODECConfig codecConfig(const DAWn::LoadGen::PeerSettings& settings, uint32_t uid)
+    {
+        OpusImpl::CODECConfig config{};
+        config.mSampRate = static_cast<int32_t>(settings.sampleRate);
+        config.mBlockSize = static_cast<int>(settings.blockSize);
+        config.mChannels = static_cast<int>(settings.channels);
+        config.bitrate = settings.bitrate;
+        config.complexity = settings.complexity;
+        config.ownerID = uid;
+        return config;
+    }
+
+    int64_t toMicroseconds(DAWn::LoadGen::Clock::duration duration)
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+    }
+}
+
+DAWn::LoadGen::SyntheticPeer::SyntheticPeer(const PeerSettings& settings, uint32_t uid) :
+    mSettings(settings),
+    mUid(uid),
+    mCodec(codecConfig(settings, uid)),
+    mBsaOut(settings.blockSize, settings.channels)
+{
+    //A tone per peer, so a mix of them is not silence nor a single sine.
+    auto frequency = 220.0 + 20.0 * static_cast<double>(uid % 32);
+    mPhaseStep = 2.0 * std::numbers::pi * frequency / static_cast<double>(mSettings.sampleRate);
+    mCaptured.resize(static_cast<size_t>(mSettings.dawBlockSize) * mSettings.channels);
+    mInterleaved.resize(static_cast<size_t>(mSettings.blockSize) * mSettings.channels);
+}
+
+DAWn::LoadGen::SyntheticPeer::~SyntheticPeer()
+{
+    stop();
+}
+
+bool DAWn::LoadGen::SyntheticPeer::start(DAWn::Events::Notifier* notifier)
+{
+    if (pRtp) return true;
+
+    mBsaOut.setChannelsAndOutputBlockSize(mSettings.channels, mSettings.blockSize);
+    mBsaOut.setNotifier(notifier);
+
+    auto pUdpRtp = std::make_unique<UDPRTPWrap>();
+    pUdpRtp->SetUDPOptions(mSettings.udp);
+    pUdpRtp->SetClockRate(mSettings.sampleRate);
+    mRtpSessionID = pUdpRtp->CreateSession(mSettings.ip);
+    mRtpStreamID = pUdpRtp->CreateStream(mRtpSessionID, mSettings.port, static_cast<int>(mUid));
+
+    auto pStream = _rtpwrap::data::GetStream(mRtpStreamID);
+    if (!pStream)
+    {
+        std::cout << "LoadGen: peer " << mUid << " could not open its stream" << std::endl;
+        return false;
+    }
+    pStream->letDataFromPeerIsReady.Connect(
+        [this](uint64_t, const xlet::Packet& packet) {
+            onDatagram(packet);
+        }
+    );
+    pStream->letOperationalError.Connect(std::function<void(uint64_t, std::string)>{
+        [this](uint64_t, std::string error) {
+            std::cout << "LoadGen: peer " << mUid << " socket error: " << error << std::endl;
+        }
+    });
+    pStream->run();
+
+    pRtp = std::move(pUdpRtp);
+    pRtp->PushProbe(mRtpStreamID);
+    return true;
+}
+
+void DAWn::LoadGen::SyntheticPeer::stop()
+{
+    if (!pRtp) return;
+    pRtp->DestroyStream(mRtpStreamID);
+    pRtp->DestroySession(mRtpSessionID);
+    pRtp.reset();
+}
+
+void DAWn::LoadGen::SyntheticPeer::capture(uint32_t timeStamp)
+{
+    //Joined while the session plays: the stream starts where the timeline is, like getCodecPairForUser does.
+    if (!bCapturing)
+    {
+        mBsaOut.setTimeStamp(timeStamp, true);
+        bCapturing = true;
+    }
+
+    const auto channels = mSettings.channels;
+    for (auto frame = 0u; frame < mSettings.dawBlockSize; ++frame)
+    {
+        auto sample = static_cast<float>(0.25 * std::sin(mPhase));
+        mPhase += mPhaseStep;
+        for (auto channel = 0u; channel < channels; ++channel) mCaptured[frame * channels + channel] = sample;
+    }
+    mPhase = std::fmod(mPhase, 2.0 * std::numbers::pi);
+    mBsaOut.push(std::span<const float>(mCaptured), timeStamp);
+}
+
+size_t DAWn::LoadGen::SyntheticPeer::encode()
+{
+    if (!pRtp) return 0;
+
+    auto sent = 0ul;
+    while (mBsaOut.dataReady())
+    {
+        uint32_t timeStamp;
+        mBsaOut.pop(mInterleaved, timeStamp);
+        auto frame = pRtp->TakeFrame(mRtpStreamID, mCodec.maxEncodedBytes());
+        size_t encodedBytes = 0;
+        if (mCodec.encodeChannel(mInterleaved, DAWn::Wire::payload(frame), encodedBytes, 0) != OpusImpl::Result::OK)
+        {
+            mEncodeErrors.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        pRtp->PushFrame(std::move(frame), encodedBytes, mRtpStreamID, timeStamp);
+        ++sent;
+
+        //The block was complete when its last sample was captured: from there to here is the send delay.
+        auto captured = mSettings.epoch + std::chrono::microseconds((static_cast<int64_t>(timeStamp) + mSettings.blockSize) * 1000000 / mSettings.sampleRate);
+        auto sendDelayUs = toMicroseconds(Clock::now() - captured);
+        if (mLastSendDelayUs >= 0) mSendJitter.record(static_cast<uint64_t>(std::abs(sendDelayUs - mLastSendDelayUs)));
+        mLastSendDelayUs = sendDelayUs;
+    }
+    mFramesSent.fetch_add(sent, std::memory_order_relaxed);
+    return sent;
+}
+
+void DAWn::LoadGen::SyntheticPeer::onDatagram(const xlet::Packet& packet)
+{
+    //RTCP feeds the stats of the UDPRTPWrap, probes and commands carry no audio.
+    DAWn::Wire::Header header{};
+    if (!DAWn::Wire::read(packet.span(), header) || header.type != DAWn::Wire::PayloadType::Audio) return;
+
+    auto captured = mSettings.epoch + std::chrono::microseconds((static_cast<int64_t>(header.timeStamp) + mSettings.blockSize) * 1000000 / mSettings.sampleRate);
+    auto latencyUs = static_cast<uint64_t>(std::max<int64_t>(toMicroseconds(Clock::now() - captured), 0));
+    if (isSynthetic(header.source)) mLatency.record(latencyUs);
+    else mHostLatency.record(latencyUs);
+}
+
+DAWn::LoadGen::PeerReport DAWn::LoadGen::SyntheticPeer::report()
+{
+    PeerReport total{};
+    total.uid = mUid;
+    total.framesSent = mFramesSent.load(std::memory_order_relaxed);
+    total.encodeErrors = mEncodeErrors.load(std::memory_order_relaxed);
+    total.sendJitter = mSendJitter.snapshot();
+    total.latency = mLatency.snapshot();
+    total.hostLatency = mHostLatency.snapshot();
+    if (pRtp)
+    {
+        if (auto pStream = _rtpwrap::data::GetStream(mRtpStreamID)) total.queueDrops = pStream->stats(xlet::Direction::OUTB).dropped;
+        for (auto& peer : pRtp->GetStats())
+        {
+            auto lost = static_cast<uint64_t>(std::max(peer.cumulativeLost, 0));
+            total.rttMs = std::max(total.rttMs, peer.rttMs);
+            if (isSynthetic(peer.ssrc))
+            {
+                total.received += peer.packetsReceived;
+                total.lost += lost;
+            }
+            else
+            {
+                total.hostReceived += peer.packetsReceived;
+                total.hostLost += lost;
+            }
+        }
+    }
+
+    //A source RTCP timed out takes its counters with it: clamp rather than wrap.
+    PeerReport interval{total};
+    interval.framesSent -= mPrevious.framesSent;
+    interval.encodeErrors -= mPrevious.encodeErrors;
+    interval.sendJitter = total.sendJitter - mPrevious.sendJitter;
+    interval.latency = total.latency - mPrevious.latency;
+    interval.hostLatency = total.hostLatency - mPrevious.hostLatency;
+    interval.received -= std::min(interval.received, mPrevious.received);
+    interval.lost -= std::min(interval.lost, mPrevious.lost);
+    interval.hostReceived -= std::min(interval.hostReceived, mPrevious.hostReceived);
+    interval.hostLost -= std::min(interval.hostLost, mPrevious.hostLost);
+    mPrevious = total;
+    return interval;
+}
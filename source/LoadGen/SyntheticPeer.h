@@ -0,0 +1,125 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+
+#ifndef AUDIOSTREAMPLUGIN_SYNTHETICPEER_H
+#define AUDIOSTREAMPLUGIN_SYNTHETICPEER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "RTPWrap.h"
+#include "BlockSizeAdapter.h"
+#include "Histogram.h"
+
+namespace DAWn::LoadGen
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct PeerSettings
+    {
+        std::string         ip{"127.0.0.1"};
+        int                 port{8899};
+        uint32_t            sampleRate{48000};
+        uint32_t            blockSize{480};     //!Codec block, audio.bsize.
+        uint32_t            dawBlockSize{256};  //!Samples per processBlock.
+        uint32_t            channels{2};
+        int                 bitrate{OPUS_AUTO};
+        int                 complexity{-1};
+        xlet::UDPOptions    udp{};
+        /*! @brief The uids of the synthetic peers are [uidBase, uidBase + uidCount), every other source is a host.*/
+        uint32_t            uidBase{0x10000};
+        uint32_t            uidCount{0};
+        /*! @brief Sample 0 of the shared timeline: every peer is a DAW playing the same session in sync.*/
+        Clock::time_point   epoch{};
+    };
+
+    /*! @brief What one peer measured since its previous report. Times in microseconds.*/
+    struct PeerReport
+    {
+        uint32_t                            uid{0};
+        uint64_t                            framesSent{0};
+        uint64_t                            encodeErrors{0};
+        uint64_t                            queueDrops{0};      //!Outbound datagrams the stream dropped, cumulative.
+        DAWn::Metrics::Histogram::Snapshot  sendJitter{};       //!Change of the capture to send delay between frames.
+        DAWn::Metrics::Histogram::Snapshot  latency{};          //!Capture to arrival, audio from the other synthetic peers.
+        DAWn::Metrics::Histogram::Snapshot  hostLatency{};      //!Capture to arrival, audio from a host (the mixer).
+        uint64_t                            received{0};        //!RTP from peers and hosts, from RTCP.
+        uint64_t                            lost{0};
+        uint64_t                            hostReceived{0};
+        uint64_t                            hostLost{0};
+        double                              rttMs{-1.0};        //!Worst round trip RTCP measured, negative if none.
+
+        inline double lossFraction() const { return received + lost ? static_cast<double>(lost) / static_cast<double>(received + lost) : 0.0; }
+        inline double hostLossFraction() const { return hostReceived + hostLost ? static_cast<double>(hostLost) / static_cast<double>(hostReceived + hostLost) : 0.0; }
+    };
+
+    /*!
+     * @brief A DAW in a session, without the DAW: generated audio goes through a BlockSizeAdapter, an OpusImpl::CODEC
+     * and a UDPRTPWrap stream the way AudioStreamPluginProcessor sends it.
+     *
+     * capture() is the processBlock side, encode() the encoder thread side. Inbound datagrams are only measured,
+     * they are not decoded.
+     */
+    class SyntheticPeer
+    {
+    public:
+        SyntheticPeer(const PeerSettings& settings, uint32_t uid);
+        ~SyntheticPeer();
+        SyntheticPeer(const SyntheticPeer&) = delete;
+        SyntheticPeer& operator=(const SyntheticPeer&) = delete;
+
+        /*!
+         * @brief Open the stream and say hello to the relay.
+         * @param notifier Woken on every capture, the encoder thread of this peer waits on it.
+         */
+        bool start(DAWn::Events::Notifier* notifier);
+        void stop();
+
+        /*! @brief One processBlock: dawBlockSize samples of a tone at timeStamp. The first one anchors the stream.*/
+        void capture(uint32_t timeStamp);
+        /*! @brief Encode and send the blocks ready. @return The frames sent.*/
+        size_t encode();
+
+        /*! @brief The measurements since the previous call.*/
+        PeerReport report();
+        inline uint32_t uid() const { return mUid; }
+
+    private:
+        void onDatagram(const xlet::Packet& packet);
+        inline bool isSynthetic(uint32_t source) const { return source - mSettings.uidBase < mSettings.uidCount; }
+
+        const PeerSettings&                         mSettings;
+        uint32_t                                    mUid;
+        std::unique_ptr<UDPRTPWrap>                 pRtp{};
+        uint64_t                                    mRtpSessionID{0};
+        uint64_t                                    mRtpStreamID{0};
+        OpusImpl::CODEC                             mCodec;
+        Utilities::Buffer::BlockSizeAdapter         mBsaOut;
+
+        //Capture side.
+        bool                                        bCapturing{false};
+        double                                      mPhase{0.0};
+        double                                      mPhaseStep{0.0};
+        std::vector<float>                          mCaptured{};
+        //Encoder side.
+        std::vector<float>                          mInterleaved{};
+        int64_t                                     mLastSendDelayUs{-1};
+
+        DAWn::Metrics::Histogram                    mSendJitter{};
+        DAWn::Metrics::Histogram                    mLatency{};
+        DAWn::Metrics::Histogram                    mHostLatency{};
+        std::atomic<uint64_t>                       mFramesSent{0};
+        std::atomic<uint64_t>                       mEncodeErrors{0};
+
+        //report() only.
+        PeerReport                                  mPrevious{};
+    };
+}
+
+#endif //AUDIOSTREAMPLUGIN_SYNTHETICPEER_H
@@ -0,0 +1,173 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+
+#include "LoadGenerator.h"
+
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+
+namespace
+{
+    std::atomic<bool> sStop{false};
+
+    void onSignal(int)
+    {
+        sStop.store(true);
+    }
+
+    void usage(const char* name)
+    {
+        std::cout << "Usage: " << name << " [options]\n"
+                  << "  --target IP        Relay or host to send to (127.0.0.1).\n"
+                  << "  --port N           Its port (8899).\n"
+                  << "  --peers N          Peers to start with (8).\n"
+                  << "  --max-peers N      Ramp up to this many (--peers).\n"
+                  << "  --step N           Peers added after each step, 0 runs a single step (0).\n"
+                  << "  --step-seconds S   Length of a step (10).\n"
+                  << "  --block N          Codec block, audio.bsize (480).\n"
+                  << "  --daw-block N      processBlock size (256).\n"
+                  << "  --channels N       Channels (2).\n"
+                  << "  --bitrate N        Bits per second, 0 lets Opus pick (0).\n"
+                  << "  --complexity N     Opus complexity 0..10, -1 default (-1).\n"
+                  << "  --encoders N       Encoder threads (1).\n"
+                  << "  --batched          recvmmsg / sendmmsg on the streams.\n"
+                  << "  --uid-base N       First peer uid (65536).\n"
+                  << "  --deadline-ms D    Latency growth that means the mixer fell behind (10).\n"
+                  << "  --loss-limit P     Loss percent that means the mixer fell behind (1).\n"
+                  << "  --quiet            Summaries only, no line per peer.\n";
+    }
+
+    double toMs(uint64_t microseconds)
+    {
+        return static_cast<double>(microseconds) / 1000.0;
+    }
+
+    void print(const DAWn::LoadGen::Summary& summary, bool perPeer)
+    {
+        std::cout << std::fixed << std::setprecision(2);
+        std::cout << "peers " << summary.peers << " sent " << summary.framesSent
+                  << " sendjitter p99 " << toMs(summary.sendJitter.percentile(0.99)) << "ms"
+                  << " | peers latency p50 " << toMs(summary.latency.percentile(0.50)) << " p99 " << toMs(summary.latency.percentile(0.99))
+                  << " max " << toMs(summary.latency.max) << "ms loss " << summary.lossFraction() * 100.0 << "%"
+                  << " | host latency p50 " << toMs(summary.hostLatency.percentile(0.50)) << " p99 " << toMs(summary.hostLatency.percentile(0.99))
+                  << " max " << toMs(summary.hostLatency.max) << "ms loss " << summary.hostLossFraction() * 100.0 << "%"
+                  << " | rtt " << summary.rttMs << "ms encode errors " << summary.encodeErrors << " queue drops " << summary.queueDrops
+                  << " overruns " << summary.overruns << std::endl;
+        if (!perPeer) return;
+        for (auto& peer : summary.perPeer)
+        {
+            std::cout << "  peer " << peer.uid << " sent " << peer.framesSent
+                      << " sendjitter p99 " << toMs(peer.sendJitter.percentile(0.99)) << " max " << toMs(peer.sendJitter.max) << "ms"
+                      << " latency p99 " << toMs(peer.latency.percentile(0.99)) << "ms loss " << peer.lossFraction() * 100.0 << "%"
+                      << " host latency p99 " << toMs(peer.hostLatency.percentile(0.99)) << "ms loss " << peer.hostLossFraction() * 100.0 << "%"
+                      << " rtt " << peer.rttMs << "ms" << std::endl;
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    DAWn::LoadGen::Options options{};
+    size_t startPeers = 8;
+    size_t maxPeers = 0;
+    size_t step = 0;
+    long stepSeconds = 10;
+    double deadlineMs = 10.0;
+    double lossLimit = 0.01;
+    bool perPeer = true;
+
+    for (auto index = 1; index < argc; ++index)
+    {
+        std::string arg{argv[index]};
+        auto next = [&]() -> std::string {
+            if (index + 1 >= argc)
+            {
+                usage(argv[0]);
+                std::exit(1);
+            }
+            return argv[++index];
+        };
+        auto number = [&]() -> long { return std::strtol(next().c_str(), nullptr, 10); };
+
+        if (arg == "--target") options.peer.ip = next();
+        else if (arg == "--port") options.peer.port = static_cast<int>(number());
+        else if (arg == "--peers") startPeers = static_cast<size_t>(number());
+        else if (arg == "--max-peers") maxPeers = static_cast<size_t>(number());
+        else if (arg == "--step") step = static_cast<size_t>(number());
+        else if (arg == "--step-seconds") stepSeconds = number();
+        else if (arg == "--block") options.peer.blockSize = static_cast<uint32_t>(number());
+        else if (arg == "--daw-block") options.peer.dawBlockSize = static_cast<uint32_t>(number());
+        else if (arg == "--channels") options.peer.channels = static_cast<uint32_t>(number());
+        else if (arg == "--bitrate") { auto bitrate = number(); options.peer.bitrate = bitrate ? static_cast<int>(bitrate) : OPUS_AUTO; }
+        else if (arg == "--complexity") options.peer.complexity = static_cast<int>(number());
+        else if (arg == "--encoders") options.encoders = static_cast<unsigned>(number());
+        else if (arg == "--batched") options.peer.udp.batched = true;
+        else if (arg == "--uid-base") options.peer.uidBase = static_cast<uint32_t>(number());
+        else if (arg == "--deadline-ms") deadlineMs = std::strtod(next().c_str(), nullptr);
+        else if (arg == "--loss-limit") lossLimit = std::strtod(next().c_str(), nullptr) / 100.0;
+        else if (arg == "--quiet") perPeer = false;
+        else
+        {
+            usage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+    options.maxPeers = std::max(maxPeers, startPeers);
+    if (startPeers == 0 || stepSeconds <= 0 || options.peer.dawBlockSize == 0 || options.peer.blockSize == 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+
+    DAWn::LoadGen::LoadGenerator generator{options};
+    generator.addPeers(startPeers);
+    generator.start();
+    std::cout << "LoadGen: " << generator.peers() << " peers to " << options.peer.ip << ":" << options.peer.port << std::endl;
+
+    //The first step is the reference: the mixer is behind once its latency grows by the deadline, or it loses packets.
+    double baselineMs = -1.0;
+    size_t keptUpWith = 0;
+    size_t fellBehindAt = 0;
+    while (!sStop.load())
+    {
+        for (auto tick = 0l; tick < stepSeconds * 10 && !sStop.load(); ++tick) std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (sStop.load()) break;
+
+        auto summary = generator.report();
+        print(summary, perPeer);
+
+        //Against a mixer host what matters is its stream, against a bare relay the streams of the peers.
+        auto host = summary.hostLatency.count > 0;
+        auto& latency = host ? summary.hostLatency : summary.latency;
+        auto loss = host ? summary.hostLossFraction() : summary.lossFraction();
+        auto p99Ms = toMs(latency.percentile(0.99));
+        if (latency.count > 0 && baselineMs < 0.0) baselineMs = p99Ms;
+        if (summary.overruns > 0) std::cout << "LoadGen: the generator itself is late, add cores or --encoders" << std::endl;
+
+        if (latency.count == 0 || loss > lossLimit || p99Ms - baselineMs > deadlineMs)
+        {
+            fellBehindAt = summary.peers;
+            std::cout << "LoadGen: behind with " << summary.peers << " peers (p99 " << p99Ms << "ms, baseline " << baselineMs
+                      << "ms, loss " << loss * 100.0 << "%)" << std::endl;
+            break;
+        }
+        keptUpWith = summary.peers;
+        if (step == 0 || generator.peers() >= options.maxPeers) break;
+        generator.addPeers(step);
+    }
+
+    generator.stop();
+    std::cout << "RESULT peers_within_deadline=" << keptUpWith;
+    if (fellBehindAt) std::cout << " behind_at=" << fellBehindAt;
+    std::cout << std::endl;
+    return 0;
+}
@@ -0,0 +1,502 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+
+#include "MixerKernels.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define MIXER_KERNELS_X86 1
+#include <immintrin.h>
+#define MIXER_TARGET(isa) __attribute__((target(isa)))
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+#define MIXER_KERNELS_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace Mixer::Kernels
+{
+    /************************* SCALAR (REFERENCE) *************************/
+    void Scalar::add(const float* a, const float* b, float* out, size_t size)
+    {
+        for (auto index = 0ul; index < size; ++index)
+        {
+            out[index] = a[index] + b[index];
+        }
+    }
+
+    void Scalar::sub(const float* a, const float* b, float* out, size_t size)
+    {
+        for (auto index = 0ul; index < size; ++index)
+        {
+            out[index] = a[index] - b[index];
+        }
+    }
+
+    void Scalar::mixDelta(float* playback, float* lastSource, const float* source, size_t size)
+    {
+        for (auto index = 0ul; index < size; ++index)
+        {
+            playback[index] += source[index] - lastSource[index];
+            lastSource[index] = source[index];
+        }
+    }
+
+    void Scalar::interleave2(const float* left, const float* right, float* interleaved, size_t size)
+    {
+        for (auto index = 0ul; index < size; ++index)
+        {
+            interleaved[index << 1] = left[index];
+            interleaved[(index << 1) + 1] = right[index];
+        }
+    }
+
+    void Scalar::deinterleave2(const float* interleaved, float* left, float* right, size_t size)
+    {
+        for (auto index = 0ul; index < size; ++index)
+        {
+            left[index] = interleaved[index << 1];
+            right[index] = interleaved[(index << 1) + 1];
+        }
+    }
+
+    void Scalar::monoSplit(float* left, float* right, size_t size)
+    {
+        for (auto index = 0ul; index < size; ++index)
+        {
+            auto mono = (left[index] + right[index]) * 0.5f;
+            left[index] = mono;
+            right[index] = mono;
+        }
+    }
+
+#if defined(MIXER_KERNELS_X86)
+    /************************* SSE2 *************************/
+    MIXER_TARGET("sse2") static void addSSE2(const float* a, const float* b, float* out, size_t size)
+    {
+        auto index = 0ul;
+        for (; index + 4 <= size; index += 4)
+        {
+            _mm_storeu_ps(out + index, _mm_add_ps(_mm_loadu_ps(a + index), _mm_loadu_ps(b + index)));
+        }
+        Scalar::add(a + index, b + index, out + index, size - index);
+    }
+
+    MIXER_TARGET("sse2") static void subSSE2(const float* a, const float* b, float* out, size_t size)
+    {
+        auto index = 0ul;
+        for (; index + 4 <= size; index += 4)
+        {
+            _mm_storeu_ps(out + index, _mm_sub_ps(_mm_loadu_ps(a + index), _mm_loadu_ps(b + index)));
+        }
+        Scalar::sub(a + index, b + index, out + index, size - index);
+    }
+
+    MIXER_TARGET("sse2") static void mixDeltaSSE2(float* playback, float* lastSource, const float* source, size_t size)
+    {
+        auto index = 0ul;
+        for (; index + 4 <= size; index += 4)
+        {
+            auto src = _mm_loadu_ps(source + index);
+            auto delta = _mm_sub_ps(src, _mm_loadu_ps(lastSource + index));
+            _mm_storeu_ps(playback + index, _mm_add_ps(_mm_loadu_ps(playback + index), delta));
+            _mm_storeu_ps(lastSource + index, src);
+        }
+        Scalar::mixDelta(playback + index, lastSource + index, source + index, size - index);
+    }
+
+    MIXER_TARGET("sse2") static void interleave2SSE2(const float* left, const float* right, float* interleaved, size_t size)
+    {
+        auto index = 0ul;
+        for (; index + 4 <= size; index += 4)
+        {
+            auto l = _mm_loadu_ps(left + index);
+            auto r = _mm_loadu_ps(right + index);
+            _mm_storeu_ps(interleaved + (index << 1), _mm_unpacklo_ps(l, r));
+            _mm_storeu_ps(interleaved + (index << 1) + 4, _mm_unpackhi_ps(l, r));
+        }
+        Scalar::interleave2(left + index, right + index, interleaved + (index << 1), size - index);
+    }
+
+    MIXER_TARGET("sse2") static void deinterleave2SSE2(const float* interleaved, float* left, float* right, size_t size)
+    {
+        auto index = 0ul;
+        for (; index + 4 <= size; index += 4)
+        {
+            auto a = _mm_loadu_ps(interleaved + (index << 1));
+            auto b = _mm_loadu_ps(interleaved + (index << 1) + 4);
+            _mm_storeu_ps(left + index, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(right + index, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+        Scalar::deinterleave2(interleaved + (index << 1), left + index, right + index, size - index);
+    }
+
+    MIXER_TARGET("sse2") static void monoSplitSSE2(float* left, float* right, size_t size)
+    {
+        auto half = _mm_set1_ps(0.5f);
+        auto index = 0ul;
+        for (; index + 4 <= size; index += 4)
+        {
+            auto mono = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(left + index), _mm_loadu_ps(right + index)), half);
+            _mm_storeu_ps(left + index, mono);
+            _mm_storeu_ps(right + index, mono);
+        }
+        Scalar::monoSplit(left + index, right + index, size - index);
+    }
+
+    /************************* AVX2 *************************/
+    MIXER_TARGET("avx2") static void addAVX2(const float* a, const float* b, float* out, size_t size)
+    {
+        auto index = 0ul;
+        for (; index + 8 <= size; index += 8)
+        {
+            _mm256_storeu_ps(out + index, _mm256_add_ps(_mm256_loadu_ps(a + index), _mm256_loadu_ps(b + index)));
+        }
+        addSSE2(a + index, b + index, out + index, size - index);
+    }
+
+    MIXER_TARGET("avx2") static void subAVX2(const float* a, const float* b, float* out, size_t size)
+    {
+        auto index = 0ul;
+        for (; index + 8 <= size; index += 8)
+        {
+            _mm256_storeu_ps(out + index, _mm256_sub_ps(_mm256_loadu_ps(a + index), _mm256_loadu_ps(b + index)));
+        }
+        subSSE2(a + index, b + index, out + index, size - index);
+    }
+
+    MIXER_TARGET("avx2") static void mixDeltaAVX2(float* playback, float* lastSource, const float* source, size_t size)
+    {
+        auto index = 0ul;
+        for (; index + 8 <= size; index += 8)
+        {
+            auto src = _mm256_loadu_ps(source + index);
+            auto delta = _mm256_sub_ps(src, _mm256_loadu_ps(lastSource + index));
+            _mm256_storeu_ps(playback + index, _mm256_add_ps(_mm256_loadu_ps(playback + index), delta));
+            _mm256_storeu_ps(lastSource + index, src);
+        }
+        mixDeltaSSE2(playback + index, lastSource + index, source + index, size - index);
+    }
+
+    MIXER_TARGET("avx2") static void interleave2AVX2(const float* left, const float* right, float* interleaved, size_t size)
+    {
+        auto index = 0ul;
+        for (; index + 8 <= size; index += 8)
+        {
+            //unpack works per 128 bit lane: [l0 r0 l1 r1 | l4 r4 l5 r5] and [l2 r2 l3 r3 | l6 r6 l7 r7].
+            auto l = _mm256_loadu_ps(left + index);
+            auto r = _mm256_loadu_ps(right + index);
+            auto lo = _mm256_unpacklo_ps(l, r);
+            auto hi = _mm256_unpackhi_ps(l, r);
+            _mm256_storeu_ps(interleaved + (index << 1), _mm256_permute2f128_ps(lo, hi, 0x20));
+            _mm256_storeu_ps(interleaved + (index << 1) + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+        }
+        interleave2SSE2(left + index, right + index, interleaved + (index << 1), size - index);
+    }
+
+    MIXER_TARGET("avx2") static void deinterleave2AVX2(const float* interleaved, float* left, float* right, size_t size)
+    {
+        auto index = 0ul;
+        for (; index + 8 <= size; index += 8)
+        {
+            //shuffle works per 128 bit lane: [l0 l1 l4 l5 | l2 l3 l6 l7], the 64 bit permute puts the pairs in order.
+            auto a = _mm256_loadu_ps(interleaved + (index << 1));
+            auto b = _mm256_loadu_ps(interleaved + (index << 1) + 8);
+            auto l = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+            auto r = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+            _mm256_storeu_ps(left + index, _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(l), _MM_SHUFFLE(3, 1, 2, 0))));
+            _mm256_storeu_ps(right + index, _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(r), _MM_SHUFFLE(3, 1, 2, 0))));
+        }
+        deinterleave2SSE2(interleaved + (index << 1), left + index, right + index, size - index);
+    }
+
+    MIXER_TARGET("avx2") static void monoSplitAVX2(float* left, float* right, size_t size)
+    {
+        auto half = _mm256_set1_ps(0.5f);
+        auto index = 0ul;
+        for (; index + 8 <= size; index += 8)
+        {
+            auto mono = _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(left + index), _mm256_loadu_ps(right + index)), half);
+            _mm256_storeu_ps(left + index, mono);
+            _mm256_storeu_ps(right + index, mono);
+        }
+        monoSplitSSE2(left + index, right + index, size - index);
+    }
+
+    /************************* AVX-512 *************************/
+    MIXER_TARGET("avx512f") static void addAVX512(const float* a, const float* b, float* out, size_t size)
+    {
+        auto index = 0ul;
+        for (; index + 16 <= size; index += 16)
+        {
+            _mm512_storeu_ps(out + index, _mm512_add_ps(_mm512_loadu_ps(a + index), _mm512_loadu_ps(b + index)));
+        }
+        addAVX2(a + index, b + index, out + index, size - index);
+    }
+
+    MIXER_TARGET("avx512f") static void subAVX512(const float* a, const float* b, float* out, size_t size)
+    {
+        auto index = 0ul;
+        for (; index + 16 <= size; index += 16)
+        {
+            _mm512_storeu_ps(out + index, _mm512_sub_ps(_mm512_loadu_ps(a + index), _mm512_loadu_ps(b + index)));
+        }
+        subAVX2(a + index, b + index, out + index, size - index);
+    }
+
+    MIXER_TARGET("avx512f") static void mixDeltaAVX512(float* playback, float* lastSource, const float* source, size_t size)
+    {
+        auto index = 0ul;
+        for (; index + 16 <= size; index += 16)
+        {
+            auto src = _mm512_loadu_ps(source + index);
+            auto delta = _mm512_sub_ps(src, _mm512_loadu_ps(lastSource + index));
+            _mm512_storeu_ps(playback + index, _mm512_add_ps(_mm512_loadu_ps(playback + index), delta));
+            _mm512_storeu_ps(lastSource + index, src);
+        }
+        mixDeltaAVX2(playback + index, lastSource + index, source + index, size - index);
+    }
+
+    MIXER_TARGET("avx512f") static void interleave2AVX512(const float* left, const float* right, float* interleaved, size_t size)
+    {
+        //Indexes into (a, b): 0-15 pick from a, 16-31 from b.
+        auto lo = _mm512_setr_epi32(0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23);
+        auto hi = _mm512_setr_epi32(8, 24, 9, 25, 10, 26, 11, 27, 12, 28, 13, 29, 14, 30, 15, 31);
+        auto index = 0ul;
+        for (; index + 16 <= size; index += 16)
+        {
+            auto l = _mm512_loadu_ps(left + index);
+            auto r = _mm512_loadu_ps(right + index);
+            _mm512_storeu_ps(interleaved + (index << 1), _mm512_permutex2var_ps(l, lo, r));
+            _mm512_storeu_ps(interleaved + (index << 1) + 16, _mm512_permutex2var_ps(l, hi, r));
+        }
+        interleave2AVX2(left + index, right + index, interleaved + (index << 1), size - index);
+    }
+
+    MIXER_TARGET("avx512f") static void deinterleave2AVX512(const float* interleaved, float* left, float* right, size_t size)
+    {
+        auto even = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+        auto odd = _mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31);
+        auto index = 0ul;
+        for (; index + 16 <= size; index += 16)
+        {
+            auto a = _mm512_loadu_ps(interleaved + (index << 1));
+            auto b = _mm512_loadu_ps(interleaved + (index << 1) + 16);
+            _mm512_storeu_ps(left + index, _mm512_permutex2var_ps(a, even, b));
+            _mm512_storeu_ps(right + index, _mm512_permutex2var_ps(a, odd, b));
+        }
+        deinterleave2AVX2(interleaved + (index << 1), left + index, right + index, size - index);
+    }
+
+    MIXER_TARGET("avx512f") static void monoSplitAVX512(float* left, float* right, size_t size)
+    {
+        auto half = _mm512_set1_ps(0.5f);
+        auto index = 0ul;
+        for (; index + 16 <= size; index += 16)
+        {
+            auto mono = _mm512_mul_ps(_mm512_add_ps(_mm512_loadu_ps(left + index), _mm512_loadu_ps(right + index)), half);
+            _mm512_storeu_ps(left + index, mono);
+            _mm512_storeu_ps(right + index, mono);
+        }
+        monoSplitAVX2(left + index, right + index, size - index);
+    }
+#endif
+
+#if defined(MIXER_KERNELS_NEON)
+    /************************* NEON *************************/
+    static void addNEON(const float* a, const float* b, float* out, size_t size)
+    {
+        auto index = 0ul;
+        for (; index + 4 <= size; index += 4)
+        {
+            vst1q_f32(out + index, vaddq_f32(vld1q_f32(a + index), vld1q_f32(b + index)));
+        }
+        Scalar::add(a + index, b + index, out + index, size - index);
+    }
+
+    static void subNEON(const float* a, const float* b, float* out, size_t size)
+    {
+        auto index = 0ul;
+        for (; index + 4 <= size; index += 4)
+        {
+            vst1q_f32(out + index, vsubq_f32(vld1q_f32(a + index), vld1q_f32(b + index)));
+        }
+        Scalar::sub(a + index, b + index, out + index, size - index);
+    }
+
+    static void mixDeltaNEON(float* playback, float* lastSource, const float* source, size_t size)
+    {
+        auto index = 0ul;
+        for (; index + 4 <= size; index += 4)
+        {
+            auto src = vld1q_f32(source + index);
+            auto delta = vsubq_f32(src, vld1q_f32(lastSource + index));
+            vst1q_f32(playback + index, vaddq_f32(vld1q_f32(playback + index), delta));
+            vst1q_f32(lastSource + index, src);
+        }
+        Scalar::mixDelta(playback + index, lastSource + index, source + index, size - index);
+    }
+
+    static void interleave2NEON(const float* left, const float* right, float* interleaved, size_t size)
+    {
+        auto index = 0ul;
+        for (; index + 4 <= size; index += 4)
+        {
+            vst2q_f32(interleaved + (index << 1), (float32x4x2_t{vld1q_f32(left + index), vld1q_f32(right + index)}));
+        }
+        Scalar::interleave2(left + index, right + index, interleaved + (index << 1), size - index);
+    }
+
+    static void deinterleave2NEON(const float* interleaved, float* left, float* right, size_t size)
+    {
+        auto index = 0ul;
+        for (; index + 4 <= size; index += 4)
+        {
+            auto pair = vld2q_f32(interleaved + (index << 1));
+            vst1q_f32(left + index, pair.val[0]);
+            vst1q_f32(right + index, pair.val[1]);
+        }
+        Scalar::deinterleave2(interleaved + (index << 1), left + index, right + index, size - index);
+    }
+
+    static void monoSplitNEON(float* left, float* right, size_t size)
+    {
+        auto half = vdupq_n_f32(0.5f);
+        auto index = 0ul;
+        for (; index + 4 <= size; index += 4)
+        {
+            auto mono = vmulq_f32(vaddq_f32(vld1q_f32(left + index), vld1q_f32(right + index)), half);
+            vst1q_f32(left + index, mono);
+            vst1q_f32(right + index, mono);
+        }
+        Scalar::monoSplit(left + index, right + index, size - index);
+    }
+#endif
+
+    /************************* N CHANNELS *************************/
+    void Interleave(const float* const* planar, size_t channels, float* interleaved, size_t size, const Table& kernels)
+    {
+        if (channels == 2 && planar[0] && planar[1])
+        {
+            kernels.interleave2(planar[0], planar[1], interleaved, size);
+            return;
+        }
+        //Channel by channel: each pass reads one block in order and writes with a stride of channels.
+        for (auto channelIndex = 0ul; channelIndex < channels; ++channelIndex)
+        {
+            auto block = planar[channelIndex];
+            auto out = interleaved + channelIndex;
+            if (!block)
+            {
+                for (auto index = 0ul; index < size; ++index) out[index * channels] = 0.0f;
+                continue;
+            }
+            for (auto index = 0ul; index < size; ++index) out[index * channels] = block[index];
+        }
+    }
+
+    void Deinterleave(const float* interleaved, size_t channels, float* const* planar, size_t size, const Table& kernels)
+    {
+        if (channels == 2 && planar[0] && planar[1])
+        {
+            kernels.deinterleave2(interleaved, planar[0], planar[1], size);
+            return;
+        }
+        for (auto channelIndex = 0ul; channelIndex < channels; ++channelIndex)
+        {
+            auto block = planar[channelIndex];
+            if (!block) continue;
+            auto in = interleaved + channelIndex;
+            for (auto index = 0ul; index < size; ++index) block[index] = in[index * channels];
+        }
+    }
+
+    /************************* DISPATCH *************************/
+    static const Table sScalarTable {ISA::Scalar, &Scalar::add, &Scalar::sub, &Scalar::mixDelta,
+        &Scalar::interleave2, &Scalar::deinterleave2, &Scalar::monoSplit};
+#if defined(MIXER_KERNELS_X86)
+    static const Table sSSE2Table {ISA::SSE2, &addSSE2, &subSSE2, &mixDeltaSSE2,
+        &interleave2SSE2, &deinterleave2SSE2, &monoSplitSSE2};
+    static const Table sAVX2Table {ISA::AVX2, &addAVX2, &subAVX2, &mixDeltaAVX2,
+        &interleave2AVX2, &deinterleave2AVX2, &monoSplitAVX2};
+    static const Table sAVX512Table {ISA::AVX512, &addAVX512, &subAVX512, &mixDeltaAVX512,
+        &interleave2AVX512, &deinterleave2AVX512, &monoSplitAVX512};
+#endif
+#if defined(MIXER_KERNELS_NEON)
+    static const Table sNEONTable {ISA::NEON, &addNEON, &subNEON, &mixDeltaNEON,
+        &interleave2NEON, &deinterleave2NEON, &monoSplitNEON};
+#endif
+
+    bool IsSupported(ISA isa)
+    {
+        switch (isa)
+        {
+            case ISA::Scalar:
+                return true;
+#if defined(MIXER_KERNELS_X86)
+            case ISA::SSE2:
+                return __builtin_cpu_supports("sse2");
+            case ISA::AVX2:
+                return __builtin_cpu_supports("avx2");
+            case ISA::AVX512:
+                return __builtin_cpu_supports("avx512f");
+#endif
+#if defined(MIXER_KERNELS_NEON)
+            case ISA::NEON:
+                return true;
+#endif
+            default:
+                return false;
+        }
+    }
+
+    const Table& Select(ISA isa)
+    {
+        if (!IsSupported(isa)) return sScalarTable;
+        switch (isa)
+        {
+#if defined(MIXER_KERNELS_X86)
+            case ISA::SSE2:
+                return sSSE2Table;
+            case ISA::AVX2:
+                return sAVX2Table;
+            case ISA::AVX512:
+                return sAVX512Table;
+#endif
+#if defined(MIXER_KERNELS_NEON)
+            case ISA::NEON:
+                return sNEONTable;
+#endif
+            default:
+                return sScalarTable;
+        }
+    }
+
+    std::vector<ISA> SupportedISAs()
+    {
+        std::vector<ISA> isas{};
+        for (auto isa : {ISA::Scalar, ISA::SSE2, ISA::AVX2, ISA::AVX512, ISA::NEON})
+        {
+            if (IsSupported(isa)) isas.push_back(isa);
+        }
+        return isas;
+    }
+
+    const Table& Active()
+    {
+        static const Table& active = Select(SupportedISAs().back());
+        return active;
+    }
+
+    const char* ISAName(ISA isa)
+    {
+        switch (isa)
+        {
+            case ISA::Scalar:   return "scalar";
+            case ISA::SSE2:     return "sse2";
+            case ISA::AVX2:     return "avx2";
+            case ISA::AVX512:   return "avx512";
+            case ISA::NEON:     return "neon";
+        }
+        return "unknown";
+    }
+}
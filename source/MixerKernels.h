@@ -0,0 +1,96 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+
+#ifndef AUDIOSTREAMPLUGIN_MIXERKERNELS_H
+#define AUDIOSTREAMPLUGIN_MIXERKERNELS_H
+
+#include <cstddef>
+#include <vector>
+
+namespace Mixer::Kernels
+{
+    /*!
+     * @brief Instruction sets the mixing kernels are implemented for.
+     */
+    enum class ISA
+    {
+        Scalar,
+        SSE2,
+        AVX2,
+        AVX512,
+        NEON
+    };
+
+    using BinaryKernel          = void (*)(const float* a, const float* b, float* out, size_t size);
+    using DeltaKernel           = void (*)(float* playback, float* lastSource, const float* source, size_t size);
+    using InterleaveKernel      = void (*)(const float* left, const float* right, float* interleaved, size_t size);
+    using DeinterleaveKernel    = void (*)(const float* interleaved, float* left, float* right, size_t size);
+    using PairKernel            = void (*)(float* left, float* right, size_t size);
+
+    /*!
+     * @brief A set of kernels for one instruction set.
+     */
+    struct Table
+    {
+        ISA             isa;
+        BinaryKernel    add;        //!out = a + b
+        BinaryKernel    sub;        //!out = a - b
+        DeltaKernel     mixDelta;   //!playback += source - lastSource; lastSource = source
+
+        /* Channel layout. size counts samples per channel, interleaved holds 2 * size floats. */
+        InterleaveKernel    interleave2;    //!interleaved = [left[0], right[0], left[1], right[1] ...]
+        DeinterleaveKernel  deinterleave2;  //!inverse of interleave2
+        PairKernel          monoSplit;      //!left = right = (left + right) * 0.5
+    };
+
+    /*!
+     * @brief The scalar kernels. These are the reference implementation every other ISA is tested against.
+     */
+    namespace Scalar
+    {
+        void add(const float* a, const float* b, float* out, size_t size);
+        void sub(const float* a, const float* b, float* out, size_t size);
+        void mixDelta(float* playback, float* lastSource, const float* source, size_t size);
+        void interleave2(const float* left, const float* right, float* interleaved, size_t size);
+        void deinterleave2(const float* interleaved, float* left, float* right, size_t size);
+        void monoSplit(float* left, float* right, size_t size);
+    }
+
+    /*!
+     * @brief Check if the running CPU can execute the kernels of an ISA.
+     */
+    bool IsSupported(ISA isa);
+
+    /*!
+     * @brief Get the kernels for an ISA. If the ISA is not supported the scalar kernels are returned.
+     */
+    const Table& Select(ISA isa);
+
+    /*!
+     * @brief The best kernels for the running CPU. Resolved once, on first use.
+     */
+    const Table& Active();
+
+    /*!
+     * @brief All the ISAs the running CPU supports, Scalar first.
+     */
+    std::vector<ISA> SupportedISAs();
+
+    const char* ISAName(ISA isa);
+
+    /*!
+     * @brief Planar to interleaved for any number of channels: interleaved[sample * channels + channel] = planar[channel][sample].
+     * Two channels go through interleave2, one is a copy, more are strided. A nullptr channel is silence.
+     * @param interleaved size * channels floats.
+     */
+    void Interleave(const float* const* planar, size_t channels, float* interleaved, size_t size, const Table& kernels = Active());
+
+    /*!
+     * @brief Inverse of Interleave. A nullptr channel is skipped.
+     * @param interleaved size * channels floats.
+     */
+    void Deinterleave(const float* interleaved, size_t channels, float* const* planar, size_t size, const Table& kernels = Active());
+}
+
+#endif //AUDIOSTREAMPLUGIN_MIXERKERNELS_H
@@ -4,77 +4,303 @@
 
 #include "opusImpl.h"
 
+#include <algorithm>
+#include <new>
+#include <numeric>
+
+OpusImpl::Result OpusImpl::CODEC::encodeChannel (std::span<const float> pcm, std::span<std::byte> encoded, size_t& encodedBytes, const size_t encoderIndex)
+{
+    encodedBytes = 0;
+    if (encoderIndex >= encoderCount())
+    {
+        OpusImpl::CODEC::sEncoderErr.Emit(cfg.ownerID, "Bad channel encoder index", const_cast<float*>(pcm.data()));
+        return Result::ERROR;
+    }
+    if (pcm.size() < blockSamples())
+    {
+        OpusImpl::CODEC::sEncoderErr.Emit(cfg.ownerID, "PCM buffer shorter than a block", const_cast<float*>(pcm.data()));
+        return Result::ERROR;
+    }
+
+    auto pEncoded = reinterpret_cast<unsigned char*>(encoded.data());
+    auto encodedCapacity = static_cast<int32_t>(std::min(encoded.size(), maxEncodedBytes()));
+    auto encodedSize = mMSEnc ? opus_multistream_encode_float (mMSEnc, pcm.data(), cfg.mBlockSize, pEncoded, encodedCapacity)
+                              : opus_encode_float (mEncs[encoderIndex], pcm.data(), cfg.mBlockSize, pEncoded, encodedCapacity);
+
+    if (encodedSize < 0)
+    {
+        OpusImpl::CODEC::sEncoderErr.Emit(cfg.ownerID, opus_strerror (encodedSize), const_cast<float*>(pcm.data()));
+        return Result::ERROR;
+    }
+    encodedBytes = static_cast<size_t>(encodedSize);
+    return Result::OK;
+}
+
 std::tuple<OpusImpl::Result, std::vector<std::byte>, size_t> OpusImpl::CODEC::encodeChannel (float* pfPCM, const size_t encoderIndex)
 {
-    auto blockSize = static_cast<size_t>(8 * cfg.mBlockSize * cfg.mChannels);
-    if ((size_t) encoderIndex >= mEncs.size())
+    std::vector<std::byte> encodedBlock (maxEncodedBytes(), std::byte{0});
+    size_t encodedBytes = 0;
+    auto result = encodeChannel(std::span<const float>(pfPCM, blockSamples()), encodedBlock, encodedBytes, encoderIndex);
+    if (result != Result::OK)
     {
-        std::stringstream  ss;
-        ss << "Bad channel encoder index [" << encoderIndex << "]" << std::endl;
-        OpusImpl::CODEC::sEncoderErr.Emit(cfg.ownerID, ss.str().c_str(), pfPCM);
         return EncodingResult (std::make_tuple (Result::ERROR, std::vector<std::byte>(), 0));
     }
-    std::vector<std::byte> encodedBlock (blockSize, std::byte{0});
-    auto refEnc = mEncs[(size_t) encoderIndex];
+    encodedBlock.resize (encodedBytes);
+    return EncodingResult (std::make_tuple (Result::OK, std::move(encodedBlock), encodedBytes));
+}
 
-    auto encodedBytes = opus_encode_float (
-        refEnc.get(),
-        pfPCM,
-        cfg.mBlockSize,
-        reinterpret_cast<unsigned char*>(encodedBlock.data()),
-        static_cast<int32_t>(blockSize));
+int OpusImpl::bandwidthFromName(const std::string& name)
+{
+    if (name == "narrowband") return OPUS_BANDWIDTH_NARROWBAND;
+    if (name == "mediumband") return OPUS_BANDWIDTH_MEDIUMBAND;
+    if (name == "wideband") return OPUS_BANDWIDTH_WIDEBAND;
+    if (name == "superwideband") return OPUS_BANDWIDTH_SUPERWIDEBAND;
+    if (name == "fullband") return OPUS_BANDWIDTH_FULLBAND;
+    return OPUS_AUTO;
+}
 
-    if (encodedBytes < 0)
+void OpusImpl::StateDeallocator::operator()(std::byte* ptr) const
+{
+    ::operator delete[](ptr, std::align_val_t{kStateAlignment});
+}
+
+static size_t alignedStateSize(opus_int32 size)
+{
+    auto stateSize = static_cast<size_t>(std::max(size, opus_int32{0}));
+    return (stateSize + OpusImpl::kStateAlignment - 1) & ~(OpusImpl::kStateAlignment - 1);
+}
+
+void OpusImpl::CODEC::create()
+{
+    auto application = cfg.voice ? OPUS_APPLICATION_VOIP : OPUS_APPLICATION_AUDIO;
+    auto coupledStreams = cfg.mChannels >> 1;
+    auto streams = coupledStreams + (cfg.mChannels & 1);
+    auto stateChannels = cfg.stateChannels();
+
+    //LAYOUT: [encoder states | decoder states], each on its own cache line.
+    auto encoderSize = cfg.multistream() ? alignedStateSize(opus_multistream_encoder_get_size(streams, coupledStreams)) : alignedStateSize(opus_encoder_get_size(stateChannels));
+    auto decoderSize = cfg.multistream() ? alignedStateSize(opus_multistream_decoder_get_size(streams, coupledStreams)) : alignedStateSize(opus_decoder_get_size(stateChannels));
+    auto states = cfg.multistream() ? 1ul : static_cast<size_t>(streams);
+    auto decodersOffset = states * encoderSize;
+    auto blockSize = decodersOffset + states * decoderSize;
+    mStates = StateBlock(static_cast<std::byte*>(::operator new[](std::max<size_t>(blockSize, kStateAlignment), std::align_val_t{kStateAlignment})));
+
+    if (cfg.multistream())
     {
-        std::stringstream ss;
-        ss << "Error Message: " << opus_strerror (encodedBytes) << std::endl;
-        OpusImpl::CODEC::sEncoderErr.Emit(cfg.ownerID, ss.str().c_str(), pfPCM);
-        return EncodingResult (std::make_tuple (Result::ERROR, std::vector<std::byte>(), 0));
+        //Coupled streams take channels [0, 2 * coupledStreams), the mono stream of an odd last channel comes after them: identity mapping.
+        std::vector<unsigned char> mapping(static_cast<size_t>(cfg.mChannels));
+        std::iota(mapping.begin(), mapping.end(), static_cast<unsigned char>(0));
+        auto pEnc = reinterpret_cast<OpusMSEncoder*>(mStates.get());
+        auto pDec = reinterpret_cast<OpusMSDecoder*>(mStates.get() + decodersOffset);
+        error = opus_multistream_encoder_init(pEnc, cfg.mSampRate, cfg.mChannels, streams, coupledStreams, mapping.data(), application);
+        if (error == OPUS_OK) error = opus_multistream_decoder_init(pDec, cfg.mSampRate, cfg.mChannels, streams, coupledStreams, mapping.data());
+        if (error != OPUS_OK) return;
+        mMSEnc = pEnc;
+        mMSDec = pDec;
+        return;
     }
+    mEncs.clear();
+    mDecs.clear();
+    for (auto index = 0ul; index < states; ++index)
+    {
+        auto pEnc = reinterpret_cast<OpusEncoder*>(mStates.get() + index * encoderSize);
+        auto pDec = reinterpret_cast<OpusDecoder*>(mStates.get() + decodersOffset + index * decoderSize);
+        error = opus_encoder_init(pEnc, cfg.mSampRate, stateChannels, application);
+        if (error == OPUS_OK) error = opus_decoder_init(pDec, cfg.mSampRate, stateChannels);
+        if (error != OPUS_OK) break;
+        mEncs.push_back(pEnc);
+        mDecs.push_back(pDec);
+    }
+}
 
-    encodedBlock.resize ((size_t) encodedBytes);
-    return EncodingResult (std::make_tuple (Result::OK, encodedBlock, encodedBytes));
+void OpusImpl::CODEC::configure()
+{
+    encoderCtl(OPUS_SET_INBAND_FEC(cfg.inbandFEC ? 1 : 0));
+    encoderCtl(OPUS_SET_PACKET_LOSS_PERC(cfg.packetLossPercent));
+    encoderCtl(OPUS_SET_BITRATE(cfg.bitrate));
+    encoderCtl(OPUS_SET_VBR(cfg.vbr ? 1 : 0));
+    encoderCtl(OPUS_SET_BANDWIDTH(cfg.bandwidth));
+    if (cfg.complexity >= 0) encoderCtl(OPUS_SET_COMPLEXITY(cfg.complexity));
+    mNextTimeStamp.assign(decoderCount(), kNoTimeStamp);
+    mEncodeScratch.assign(maxEncodedBytes(), std::byte{0});
+    mDecodeScratch.assign(static_cast<size_t>(kMaxConcealedPackets + 1) * blockSamples(), 0.0f);
 }
 
-std::tuple<OpusImpl::Result, std::vector<float>, size_t> OpusImpl::CODEC::decodeChannel (std::byte* pEncodedData, size_t channelSizeInBytes, const size_t channelIndex)
+void OpusImpl::CODEC::setBitrate(int bitsPerSecond)
 {
-    auto maxDecodedBlockSize = static_cast<size_t>(cfg.mBlockSize * cfg.mChannels);
-    auto i32DataSize = static_cast<int32_t>(channelSizeInBytes);
-    std::vector<float> decodedData (maxDecodedBlockSize, 0.0f);
-    auto pfPCM = decodedData.data();
+    if (cfg.bitrate == bitsPerSecond) return;
+    cfg.bitrate = bitsPerSecond;
+    encoderCtl(OPUS_SET_BITRATE(bitsPerSecond));
+}
+
+void OpusImpl::CODEC::setPacketLossPercent(int percent)
+{
+    if (cfg.packetLossPercent == percent) return;
+    cfg.packetLossPercent = percent;
+    encoderCtl(OPUS_SET_PACKET_LOSS_PERC(percent));
+}
 
-    if (channelIndex >= mDecs.size())
+OpusImpl::BitrateController::BitrateController()
+{
+    reset(Settings{});
+}
+
+OpusImpl::BitrateController::BitrateController(Settings settings)
+{
+    reset(settings);
+}
+
+void OpusImpl::BitrateController::reset(Settings settings)
+{
+    mSettings = settings;
+    mSettings.maxBitrate = std::max(mSettings.maxBitrate, mSettings.minBitrate);
+    mBitrate = std::clamp(mSettings.startBitrate, mSettings.minBitrate, mSettings.maxBitrate);
+    mLastDrops = 0;
+    mHold = 0;
+}
+
+int OpusImpl::BitrateController::update(double fractionLost, size_t queueDepth, uint64_t queueDrops)
+{
+    auto queueDropped = queueDrops > mLastDrops;
+    mLastDrops = queueDrops;
+
+    if (queueDropped || queueDepth >= mSettings.queueHigh || fractionLost >= mSettings.lossHigh)
+    {
+        //MULTIPLICATIVE DECREASE
+        mBitrate = std::max(mSettings.minBitrate, mBitrate - mBitrate / 4);
+        mHold = kHoldUpdates;
+    }
+    else if (mHold > 0)
     {
-        std::stringstream ss;
-        ss << "Bad channel decoder index [" << channelIndex  << "]";
-        OpusImpl::CODEC::sDecoderErr.Emit(cfg.ownerID, ss.str().c_str(), pEncodedData);
-        return std::make_tuple(Result::ERROR, std::vector<float>{}, 0);
+        --mHold;
     }
+    else if (fractionLost <= mSettings.lossLow && queueDepth <= mSettings.queueLow)
+    {
+        //ADDITIVE INCREASE
+        auto step = std::max((mSettings.maxBitrate - mSettings.minBitrate) / 20, 1000);
+        mBitrate = std::min(mSettings.maxBitrate, mBitrate + step);
+    }
+    return mBitrate;
+}
 
-    auto refDecoder = mDecs[channelIndex];
+OpusImpl::Result OpusImpl::CODEC::decodeChannel (std::span<const std::byte> encoded, std::span<float> pcm, size_t& decodedSize, const size_t channelIndex)
+{
+    return decode(encoded.data(), encoded.size(), pcm.data(), pcm.size(), decodedSize, channelIndex, 0);
+}
 
-    auto decodedSamples = opus_decode_float(
-        refDecoder.get(),
-        reinterpret_cast<unsigned char*>(pEncodedData),
-        i32DataSize,
-        pfPCM,
-        cfg.mBlockSize, 0);
-    auto decodedBlockSize = static_cast<size_t>(decodedSamples * cfg.mChannels);
+OpusImpl::Result OpusImpl::CODEC::decodeChannel (std::span<const std::byte> encoded, std::span<float> pcm, size_t& decodedSize, const size_t channelIndex, uint32_t timeStamp, uint32_t& firstTimeStamp)
+{
+    decodedSize = 0;
+    firstTimeStamp = timeStamp;
+    if (channelIndex >= decoderCount())
+    {
+        return decode(encoded.data(), encoded.size(), pcm.data(), pcm.size(), decodedSize, channelIndex, 0);
+    }
 
-    if (decodedSamples < 0)
+    //LOST PACKETS: how many blocks are missing between the expected timestamp and this one (timestamps wrap at 32 bits).
+    auto& nextTimeStamp = mNextTimeStamp[channelIndex];
+    auto blockSize = static_cast<int64_t>(cfg.mBlockSize);
+    int64_t missingPackets = 0;
+    if (nextTimeStamp != kNoTimeStamp)
+    {
+        auto gap = static_cast<int64_t>(static_cast<int32_t>(timeStamp - static_cast<uint32_t>(nextTimeStamp)));
+        if (gap > 0 && gap % blockSize == 0) missingPackets = gap / blockSize;
+    }
+    //Rebuild no more than the buffer holds, this packet included.
+    auto fitPackets = static_cast<int64_t>(pcm.size() / std::max<size_t>(blockSamples(), 1)) - 1;
+    if (missingPackets > kMaxConcealedPackets || missingPackets > fitPackets) missingPackets = 0;
+
+    //PLC for all but the last missing packet, FEC (from this packet) for the last one.
+    size_t written = 0;
+    for (auto index = 0; index < missingPackets; ++index)
+    {
+        auto useFEC = index + 1 == missingPackets && cfg.inbandFEC;
+        size_t rebuiltSize = 0;
+        auto result = useFEC ? decode(encoded.data(), encoded.size(), pcm.data() + written, pcm.size() - written, rebuiltSize, channelIndex, 1)
+                             : decode(nullptr, 0, pcm.data() + written, pcm.size() - written, rebuiltSize, channelIndex, 0);
+        if (result != Result::OK)
+        {
+            written = 0;
+            missingPackets = 0;
+            break;
+        }
+        written += rebuiltSize;
+    }
+
+    size_t packetSize = 0;
+    if (decode(encoded.data(), encoded.size(), pcm.data() + written, pcm.size() - written, packetSize, channelIndex, 0) != Result::OK)
+    {
+        return Result::ERROR;
+    }
+    decodedSize = written + packetSize;
+    firstTimeStamp = timeStamp - static_cast<uint32_t>(missingPackets * blockSize);
+    //Only forward: after an older packet the next one in order must not look like a gap to rebuild.
+    auto expected = static_cast<uint32_t>(timeStamp) + static_cast<uint32_t>(blockSize);
+    if (nextTimeStamp == kNoTimeStamp || static_cast<int32_t>(expected - static_cast<uint32_t>(nextTimeStamp)) > 0)
+    {
+        nextTimeStamp = static_cast<int64_t>(expected);
+    }
+    return Result::OK;
+}
+
+std::tuple<OpusImpl::Result, std::vector<float>, size_t> OpusImpl::CODEC::decodeChannel (const std::byte* pEncodedData, size_t channelSizeInBytes, const size_t channelIndex)
+{
+    std::vector<float> decodedData (blockSamples(), 0.0f);
+    size_t decodedSize = 0;
+    auto result = decode(pEncodedData, channelSizeInBytes, decodedData.data(), decodedData.size(), decodedSize, channelIndex, 0);
+    if (result != Result::OK) return std::make_tuple(Result::ERROR, std::vector<float>{}, 0);
+    return std::make_tuple(Result::OK, std::move(decodedData), decodedSize);
+}
+
+std::tuple<OpusImpl::Result, std::vector<float>, size_t> OpusImpl::CODEC::concealChannel (const size_t channelIndex)
+{
+    return decodeChannel(nullptr, 0, channelIndex);
+}
+
+std::tuple<OpusImpl::Result, std::vector<float>, size_t> OpusImpl::CODEC::recoverChannel (const std::byte* pNextEncodedData, size_t channelSizeInBytes, const size_t channelIndex)
+{
+    std::vector<float> decodedData (blockSamples(), 0.0f);
+    size_t decodedSize = 0;
+    auto result = decode(pNextEncodedData, channelSizeInBytes, decodedData.data(), decodedData.size(), decodedSize, channelIndex, 1);
+    if (result != Result::OK) return std::make_tuple(Result::ERROR, std::vector<float>{}, 0);
+    return std::make_tuple(Result::OK, std::move(decodedData), decodedSize);
+}
+
+std::tuple<OpusImpl::Result, std::vector<float>, uint32_t> OpusImpl::CODEC::decodeChannel (const std::byte* pEncodedData, size_t channelSizeInBytes, const size_t channelIndex, uint32_t timeStamp)
+{
+    std::vector<float> decodedData (static_cast<size_t>(kMaxConcealedPackets + 1) * blockSamples(), 0.0f);
+    size_t decodedSize = 0;
+    uint32_t firstTimeStamp = timeStamp;
+    auto result = decodeChannel(std::span<const std::byte>(pEncodedData, channelSizeInBytes), decodedData, decodedSize, channelIndex, timeStamp, firstTimeStamp);
+    if (result != Result::OK) return std::make_tuple(Result::ERROR, std::vector<float>{}, timeStamp);
+    decodedData.resize(decodedSize);
+    return std::make_tuple(Result::OK, std::move(decodedData), firstTimeStamp);
+}
+
+OpusImpl::Result OpusImpl::CODEC::decode (const std::byte* pEncodedData, size_t channelSizeInBytes, float* pcm, size_t pcmSize, size_t& decodedSize, const size_t channelIndex, int decodeFEC)
+{
+    decodedSize = 0;
+    if (channelIndex >= decoderCount())
     {
-        std::stringstream ss;
-        ss << "Error Message: " << opus_strerror(decodedSamples);
-        OpusImpl::CODEC::sDecoderErr.Emit(cfg.ownerID, ss.str().c_str(), pEncodedData);
-        return std::make_tuple(Result::ERROR, std::vector<float>{}, 0);
+        OpusImpl::CODEC::sDecoderErr.Emit(cfg.ownerID, "Bad channel decoder index", pEncodedData);
+        return Result::ERROR;
     }
-    else if ((size_t)decodedBlockSize > maxDecodedBlockSize)
+    if (pcmSize < blockSamples())
     {
-        std::stringstream ss;
-        ss << "Error: decoded samples [" << decodedSamples << ":" << decodedBlockSize << " bytes]  max block size [" << maxDecodedBlockSize << "]";
-        OpusImpl::CODEC::sDecoderErr.Emit(cfg.ownerID, ss.str().c_str(), pEncodedData);
-        return std::make_tuple(Result::ERROR, std::vector<float>{}, 0);
+        OpusImpl::CODEC::sDecoderErr.Emit(cfg.ownerID, "PCM buffer shorter than a block", pEncodedData);
+        return Result::ERROR;
     }
 
-    return std::make_tuple(Result::OK, decodedData, decodedBlockSize);
-}
\ No newline at end of file
+    auto pEncoded = reinterpret_cast<const unsigned char*>(pEncodedData);
+    auto encodedSize = static_cast<int32_t>(channelSizeInBytes);
+    auto decodedSamples = mMSDec ? opus_multistream_decode_float(mMSDec, pEncoded, encodedSize, pcm, cfg.mBlockSize, decodeFEC)
+                                 : opus_decode_float(mDecs[channelIndex], pEncoded, encodedSize, pcm, cfg.mBlockSize, decodeFEC);
+
+    if (decodedSamples < 0)
+    {
+        OpusImpl::CODEC::sDecoderErr.Emit(cfg.ownerID, opus_strerror(decodedSamples), pEncodedData);
+        return Result::ERROR;
+    }
+    decodedSize = static_cast<size_t>(decodedSamples * cfg.stateChannels());
+    return Result::OK;
+}
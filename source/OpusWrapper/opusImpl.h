@@ -6,10 +6,16 @@
 #define AUDIOSTREAMPLUGIN_OPUSIMPL_H
 
 #include "opus.h"
+#include "opus_multistream.h"
 #include "Events.h"
 
+#include <algorithm>
 #include <map>
+#include <span>
+#include <vector>
 #include <memory>
+#include <string>
+#include <utility>
 #include <sstream>
 #include <iostream>
 
@@ -24,8 +30,6 @@ namespace OpusImpl
     };
 
 }
-using SPEncoder         = std::shared_ptr<OpusEncoder>;
-using SPDecoder         = std::shared_ptr<OpusDecoder>;
 using SPCodec           = std::shared_ptr<OpusImpl::CODEC>;
 using StrmIOCodec       = std::map<uint64_t, SPCodec>;
 using EncodingResult    = std::tuple<OpusImpl::Result, std::vector<std::byte>, int>; // Result, EncodedData, EncodedDataSizeInBytes
@@ -34,26 +38,18 @@ using DecodingResult    = std::tuple<OpusImpl::Result, std::vector<std::byte>, i
 namespace OpusImpl
 {
 
-    struct EncoderDeallocator
+    /*! @brief Frees the state block of a CODEC, allocated with kStateAlignment.*/
+    struct StateDeallocator
     {
-        void operator()(OpusEncoder * ptr)
-        {
-            if (ptr != nullptr)
-            {
-                opus_encoder_destroy(ptr);
-            }
-        }
-    };
-    struct DecoderDeallocator
-    {
-        void operator()(OpusDecoder * ptr)
-        {
-            if (ptr != nullptr)
-            {
-                opus_decoder_destroy(ptr);
-            }
-        }
+        void operator()(std::byte* ptr) const;
     };
+    using StateBlock = std::unique_ptr<std::byte[], StateDeallocator>;
+    /*! @brief Every encoder / decoder state starts on its own cache line.*/
+    inline constexpr size_t kStateAlignment = 64;
+
+    /*! @brief OPUS_BANDWIDTH_* for narrowband, mediumband, wideband, superwideband or fullband. OPUS_AUTO for anything else.*/
+    int bandwidthFromName(const std::string& name);
+
     struct CODECConfig
     {
         int32_t             mSampRate{48000};
@@ -61,43 +57,219 @@ namespace OpusImpl
         int                 mChannels{2};
         bool                voice{false};
         uint32_t            ownerID{0};
+        /*! @brief Carry a low bitrate copy of the previous frame in every packet (LBRR), so one lost packet can be rebuilt from the next one.*/
+        bool                inbandFEC{true};
+        /*! @brief Expected loss. The encoder spends more on the FEC copy the higher it is.*/
+        int                 packetLossPercent{10};
+        /*! @brief Bits per second. OPUS_AUTO lets libopus pick from the channels and sample rate.*/
+        int                 bitrate{OPUS_AUTO};
+        /*! @brief 0 (fastest) to 10 (best quality). -1 keeps the libopus default.*/
+        int                 complexity{-1};
+        /*! @brief Variable bitrate. false for CBR.*/
+        bool                vbr{true};
+        /*! @brief OPUS_BANDWIDTH_NARROWBAND ... OPUS_BANDWIDTH_FULLBAND, OPUS_AUTO to let libopus decide.*/
+        int                 bandwidth{OPUS_AUTO};
 
         CODECConfig() = default;
+        /*!
+         * @brief More than 2 channels are coded as a single multistream packet per block: one coupled (stereo) stream
+         * per channel pair, plus a mono stream for an odd last channel. Channel n is mapped to output n.
+         */
+        inline bool multistream() const { return mChannels > 2; }
+        /*! @brief Channels of one encoder / decoder state: mono or stereo for up to 2 channels, all of them for a multistream one.*/
+        inline int stateChannels() const { return multistream() ? mChannels : std::min(mChannels, 2); }
     };
+    /*!
+     * @brief The encoders and decoders of one user.
+     *
+     * All their states live in one cache aligned allocation (opus_*_get_size + opus_*_init), made once when the
+     * CODEC is created: no per state allocation or reference counting. A CODEC owns its states, so it can be moved
+     * but not copied.
+     */
     struct CODEC
     {
         int error{};
-        int*const pError{&error};
         CODECConfig cfg;
-        std::vector<SPEncoder> mEncs{};
-        std::vector<SPDecoder> mDecs{};
+        /*! @brief One mono or stereo state. They point into mStates.*/
+        std::vector<OpusEncoder*> mEncs{};
+        std::vector<OpusDecoder*> mDecs{};
+        /*! @brief Set instead of mEncs / mDecs when cfg.multistream(). Index 0 is the only encoder / decoder then.*/
+        OpusMSEncoder* mMSEnc{nullptr};
+        OpusMSDecoder* mMSDec{nullptr};
+        StateBlock mStates{};
+        /*! @brief Timestamp each decoder expects next, to detect lost packets. kNoTimeStamp before the first packet.*/
+        std::vector<int64_t> mNextTimeStamp{};
+        /*! @brief Per CODEC scratch memory, sized once by configure(). The span API works on it without allocating.*/
+        std::vector<std::byte> mEncodeScratch{};
+        std::vector<float> mDecodeScratch{};
+
+        /*! @brief Longest gap (in packets) rebuilt with FEC + PLC. Longer gaps are left to the jitter buffer, concealing them would only add latency.*/
+        static constexpr int64_t kMaxConcealedPackets = 5;
+        static constexpr int64_t kNoTimeStamp = -1;
 
         CODEC()
         {
-            CODECConfig _cfg;
-            mEncs = std::vector<SPEncoder>(std::vector(static_cast<size_t>(_cfg.mChannels & 1 ? (_cfg.mChannels + 1) >> 1 : _cfg.mChannels >> 1), std::shared_ptr<OpusEncoder>(opus_encoder_create(_cfg.mSampRate, 2, _cfg.voice ? OPUS_APPLICATION_VOIP : OPUS_APPLICATION_AUDIO, pError), EncoderDeallocator())));
-            mDecs = std::vector(static_cast<size_t>(_cfg.mChannels & 1 ? (_cfg.mChannels + 1) >> 1 : _cfg.mChannels >> 1), std::shared_ptr<OpusDecoder>(opus_decoder_create(_cfg.mSampRate, 2, pError), DecoderDeallocator()));
-
-            std::cout << "Created a CODEC with " << mEncs.size() << " encoders and " << mDecs.size() << " decoders" << std::endl;
+            create();
+            configure();
+            std::cout << "Created a CODEC with " << encoderCount() << " encoders and " << decoderCount() << " decoders" << std::endl;
         }
-        CODEC(const CODEC&) = default;
-        CODEC(const CODECConfig _cfg) : cfg (_cfg),
-                                          mEncs(std::vector(static_cast<size_t>(_cfg.mChannels & 1 ? (_cfg.mChannels + 1) >> 1 : _cfg.mChannels >> 1), std::shared_ptr<OpusEncoder>(opus_encoder_create(_cfg.mSampRate, 2, _cfg.voice ? OPUS_APPLICATION_VOIP : OPUS_APPLICATION_AUDIO, pError), EncoderDeallocator()))),
-                                          mDecs(std::vector(static_cast<size_t>(_cfg.mChannels & 1 ? (_cfg.mChannels + 1) >> 1 : _cfg.mChannels >> 1), std::shared_ptr<OpusDecoder>(opus_decoder_create(_cfg.mSampRate, 2, pError), DecoderDeallocator())))
+        CODEC(const CODECConfig _cfg) : cfg (_cfg)
         {
+            create();
+            configure();
         }
-
-        ~CODEC()
+        CODEC(const CODEC&) = delete;
+        CODEC& operator=(const CODEC&) = delete;
+        /*! @brief The moved-from CODEC is left with no encoder nor decoder: its pointers would dangle into mStates.*/
+        CODEC(CODEC&& other) noexcept
+        : error(other.error)
+        , cfg(other.cfg)
+        , mEncs(std::exchange(other.mEncs, {}))
+        , mDecs(std::exchange(other.mDecs, {}))
+        , mMSEnc(std::exchange(other.mMSEnc, nullptr))
+        , mMSDec(std::exchange(other.mMSDec, nullptr))
+        , mStates(std::move(other.mStates))
+        , mNextTimeStamp(std::exchange(other.mNextTimeStamp, {}))
+        , mEncodeScratch(std::move(other.mEncodeScratch))
+        , mDecodeScratch(std::move(other.mDecodeScratch))
+        {
+        }
+        CODEC& operator=(CODEC&& other) noexcept
         {
-            mEncs.clear();
-            mDecs.clear();
+            if (this == &other) return *this;
+            error = other.error;
+            cfg = other.cfg;
+            mEncs = std::exchange(other.mEncs, {});
+            mDecs = std::exchange(other.mDecs, {});
+            mMSEnc = std::exchange(other.mMSEnc, nullptr);
+            mMSDec = std::exchange(other.mMSDec, nullptr);
+            mStates = std::move(other.mStates);
+            mNextTimeStamp = std::exchange(other.mNextTimeStamp, {});
+            mEncodeScratch = std::move(other.mEncodeScratch);
+            mDecodeScratch = std::move(other.mDecodeScratch);
+            return *this;
         }
+        ~CODEC() = default;
+
+        inline size_t encoderCount() const { return mMSEnc ? 1 : mEncs.size(); }
+        inline size_t decoderCount() const { return mMSDec ? 1 : mDecs.size(); }
+
+        /*! @brief Largest encoded frame, in bytes.*/
+        inline size_t maxEncodedBytes() const { return static_cast<size_t>(8 * cfg.mBlockSize * cfg.mChannels); }
+        /*! @brief Interleaved samples in one decoded block, for the channels of the state.*/
+        inline size_t blockSamples() const { return static_cast<size_t>(cfg.mBlockSize * cfg.stateChannels()); }
+        /*! @brief maxEncodedBytes() of scratch to encode into.*/
+        inline std::span<std::byte> encodeScratch() { return mEncodeScratch; }
+        /*! @brief Scratch to decode into, room for a packet and the longest gap it can rebuild.*/
+        inline std::span<float> decodeScratch() { return mDecodeScratch; }
+
+        /******** SPAN API. Caller provided buffers, no allocation, no error strings built. ********/
+        /*!
+         * @brief Encode one block.
+         * @param pcm mBlockSize interleaved frames.
+         * @param encoded Where the frame goes, maxEncodedBytes() is always enough.
+         * @param encodedBytes The size of the encoded frame.
+         */
+        Result encodeChannel (std::span<const float> pcm, std::span<std::byte> encoded, size_t& encodedBytes, const size_t encoderIndex);
+        /*!
+         * @brief Decode one packet.
+         * @param pcm At least blockSamples() floats.
+         * @param decodedSize Interleaved samples written.
+         */
+        Result decodeChannel (std::span<const std::byte> encoded, std::span<float> pcm, size_t& decodedSize, const size_t channelIndex);
+        /*!
+         * @brief Decode a packet, rebuilding the packets lost right before it.
+         *
+         * When timeStamp is ahead of the timestamp the decoder expects, the missing packets are concealed: PLC
+         * (a null packet decode) for all but the last one, and the last one is rebuilt from the FEC data carried by
+         * this packet. The decoded audio of this packet follows. Only as many packets as fit in pcm are rebuilt,
+         * decodeScratch() fits the longest gap.
+         * A packet older than one already decoded never moves the expected timestamp back.
+         *
+         * @param timeStamp The timestamp of the packet.
+         * @param decodedSize Interleaved samples written, from the first rebuilt packet to the end of this one.
+         * @param firstTimeStamp The timestamp of the first sample written.
+         */
+        Result decodeChannel (std::span<const std::byte> encoded, std::span<float> pcm, size_t& decodedSize, const size_t channelIndex, uint32_t timeStamp, uint32_t& firstTimeStamp);
 
+        /******** TUPLE API. Wraps the span API, allocates the result. ********/
         std::tuple<OpusImpl::Result, std::vector<std::byte>, size_t> encodeChannel (float* pfPCM, const size_t encoderIndex);
-        std::tuple<OpusImpl::Result, std::vector<float>, size_t> decodeChannel (std::byte* pEncodedData, size_t channelSizeInBytes, const size_t channelIndex);
+        std::tuple<OpusImpl::Result, std::vector<float>, size_t> decodeChannel (const std::byte* pEncodedData, size_t channelSizeInBytes, const size_t channelIndex);
+        /*! @return Result, the interleaved audio from the first rebuilt packet to the end of this one, and the timestamp of its first sample.*/
+        std::tuple<OpusImpl::Result, std::vector<float>, uint32_t> decodeChannel (const std::byte* pEncodedData, size_t channelSizeInBytes, const size_t channelIndex, uint32_t timeStamp);
+        /*! @brief Change the target bitrate of every encoder at runtime.*/
+        void setBitrate(int bitsPerSecond);
+        /*! @brief Change the expected loss the encoders tune their FEC for.*/
+        void setPacketLossPercent(int percent);
+        /*! @brief Packet loss concealment: synthesize one block for a packet that never arrived.*/
+        std::tuple<OpusImpl::Result, std::vector<float>, size_t> concealChannel (const size_t channelIndex);
+        /*! @brief Rebuild the packet lost right before pNextEncodedData from its in-band FEC data. Falls back to PLC if it carries none.*/
+        std::tuple<OpusImpl::Result, std::vector<float>, size_t> recoverChannel (const std::byte* pNextEncodedData, size_t channelSizeInBytes, const size_t channelIndex);
+
+    private:
+        /*! @brief Lay out and init the encoders and decoders for cfg in mStates: a mono or stereo encoder / decoder, or a multistream one.*/
+        void create();
+        /*! @brief Apply the encoder controls of cfg to the encoders and size the decoder state.*/
+        void configure();
+        /*! @brief opus_encoder_ctl / opus_multistream_encoder_ctl on every encoder. Takes an OPUS_SET_* macro.*/
+        template<typename... Args>
+        void encoderCtl(int request, Args... args)
+        {
+            for (auto pEnc : mEncs)
+            {
+                opus_encoder_ctl(pEnc, request, args...);
+            }
+            if (mMSEnc) opus_multistream_encoder_ctl(mMSEnc, request, args...);
+        }
+        Result decode (const std::byte* pEncodedData, size_t channelSizeInBytes, float* pcm, size_t pcmSize, size_t& decodedSize, const size_t channelIndex, int decodeFEC);
 
+    public:
         inline static DAWn::Events::Signal<uint32_t, const char*, float*>     sEncoderErr{};
-        inline static DAWn::Events::Signal<uint32_t, const char*, std::byte*> sDecoderErr{};
+        inline static DAWn::Events::Signal<uint32_t, const char*, const std::byte*> sDecoderErr{};
+    };
+
+    /*!
+     * @brief AIMD bitrate adaptation for the outbound stream.
+     *
+     * Called periodically with the loss observed on the link and the state of the outbound transport queue. A queue
+     * that drops or builds up, or a loss above lossHigh, cuts the bitrate by a quarter and holds it for a few updates.
+     * A clean link (loss below lossLow, queue almost empty) raises it by a twentieth of the range per update.
+     */
+    class BitrateController
+    {
+    public:
+        struct Settings
+        {
+            int     minBitrate{24000};
+            int     maxBitrate{256000};
+            int     startBitrate{96000};
+            /*! @brief Queued packets considered a build up.*/
+            size_t  queueHigh{8};
+            size_t  queueLow{2};
+            double  lossHigh{0.10};
+            double  lossLow{0.02};
+        };
+        static constexpr int kHoldUpdates = 3;
+
+        BitrateController();
+        explicit BitrateController(Settings settings);
+        void reset(Settings settings);
+
+        /*!
+         * @brief One adaptation step.
+         * @param fractionLost Loss observed since the previous update, 0 to 1.
+         * @param queueDepth Packets waiting in the outbound queue.
+         * @param queueDrops Packets the outbound queue dropped so far (cumulative).
+         * @return The bitrate to use.
+         */
+        int update(double fractionLost, size_t queueDepth, uint64_t queueDrops);
+        inline int bitrate() const { return mBitrate; }
+
+    private:
+        Settings    mSettings{};
+        int         mBitrate{96000};
+        uint64_t    mLastDrops{0};
+        int         mHold{0};
     };
 
 
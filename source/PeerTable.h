@@ -0,0 +1,128 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+
+#ifndef AUDIOSTREAMPLUGIN_PEERTABLE_H
+#define AUDIOSTREAMPLUGIN_PEERTABLE_H
+
+#include <memory>
+#include <unordered_map>
+
+#include "CopyOnWrite.h"
+
+namespace Mixer
+{
+    /*!
+     * @brief Peer table read without locks, copied on write (RCU).
+     *
+     * The table is an immutable snapshot (an unordered_map of shared_ptr entries) in a DAWn::Events::CopyOnWrite. A
+     * reader enters a read section and walks or searches it without any lock. A writer (insert, erase) publishes a
+     * changed copy, so a reader never sees a half updated table. Writers never wait for readers, so a thread may
+     * insert while it is inside a read section. The own entry is created off the audio thread (prepareOwnPeer), the
+     * mixer and audio threads only read.
+     *
+     * Entries are shared_ptr: work queued for a peer (a decode job) can keep its entry alive after it was erased.
+     */
+    template <typename Key, typename Value>
+    class PeerTable
+    {
+    public:
+        using Entry = std::shared_ptr<Value>;
+        using Map = std::unordered_map<Key, Entry>;
+
+        /*!
+         * @brief A read section. The snapshot it pins stays valid until it is destroyed. Keep it short: retired
+         * snapshots are freed only after every read section that saw them is over.
+         */
+        class ReadGuard
+        {
+            typename DAWn::Events::CopyOnWrite<Map>::ReadGuard mSnapshot;
+
+        public:
+            explicit ReadGuard(const DAWn::Events::CopyOnWrite<Map>& map) : mSnapshot(map.read()) {}
+
+            inline typename Map::const_iterator begin() const { return mSnapshot->begin(); }
+            inline typename Map::const_iterator end() const { return mSnapshot->end(); }
+            inline size_t size() const { return mSnapshot->size(); }
+            /*! @brief The entry of key, nullptr if there is none. Only valid inside this read section.*/
+            inline Value* find(const Key& key) const
+            {
+                auto it = mSnapshot->find(key);
+                return it == mSnapshot->end() ? nullptr : it->second.get();
+            }
+            /*! @brief The shared entry of key, empty if there is none.*/
+            inline Entry entry(const Key& key) const
+            {
+                auto it = mSnapshot->find(key);
+                return it == mSnapshot->end() ? Entry{} : it->second;
+            }
+        };
+
+        PeerTable() = default;
+        PeerTable(const PeerTable&) = delete;
+        PeerTable& operator=(const PeerTable&) = delete;
+
+        /*! @brief Enter a read section. Lock free: it only retries if a publish flips the epoch in between.*/
+        ReadGuard read() const
+        {
+            return ReadGuard{mMap};
+        }
+
+        /*! @brief The entry of key, shared: it outlives the read section and an erase. nullptr if there is none.*/
+        Entry find(const Key& key) const
+        {
+            return read().entry(key);
+        }
+
+        /*!
+         * @brief The entry of key. If there is none, build it with factory() and publish it.
+         * @param factory Returns an Entry (std::make_shared<Value>(...)). Only called on insertion.
+         */
+        template <typename Factory>
+        Entry findOrInsert(const Key& key, Factory&& factory)
+        {
+            if (auto entry = find(key)) return entry;
+
+            Entry entry{};
+            mMap.update([&](const Map& current) -> std::unique_ptr<Map> {
+                auto it = current.find(key);
+                if (it != current.end())
+                {
+                    entry = it->second;
+                    return nullptr;
+                }
+                entry = factory();
+                auto next = std::make_unique<Map>(current);
+                next->emplace(key, entry);
+                return next;
+            });
+            return entry;
+        }
+
+        /*! @return False if there was no entry for key.*/
+        bool erase(const Key& key)
+        {
+            return mMap.update([&](const Map& current) -> std::unique_ptr<Map> {
+                if (current.find(key) == current.end()) return nullptr;
+                auto next = std::make_unique<Map>(current);
+                next->erase(key);
+                return next;
+            });
+        }
+
+        void clear()
+        {
+            mMap.update([](const Map&) { return std::make_unique<Map>(); });
+        }
+
+        size_t size() const { return read().size(); }
+
+        /*! @brief Snapshots published but not freed yet, readers still in their epoch.*/
+        size_t retired() const { return mMap.retired(); }
+
+    private:
+        DAWn::Events::CopyOnWrite<Map> mMap{};
+    };
+}
+
+#endif //AUDIOSTREAMPLUGIN_PEERTABLE_H
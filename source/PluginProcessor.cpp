@@ -28,11 +28,17 @@ AudioStreamPluginProcessor::AudioStreamPluginProcessor()
     }
 
     VALID_PLUGIN
+    mValidPlugin = true;
 
     //Init the execution mode, options.wscommands = true, means we are using websockets for commands and authentication.
     mAPIKey = auth.key;
 
 
+    mTrace.setEnabled(debug.trace);
+
+    //Before any stream exists: the network thread submits to the pool as soon as one does.
+    mDecodePool.start(options.decodeworkers, [this](DecodeJob& job) { decodeAndMix(job); });
+
     std::cout << "Process ID : [" << getpid() << "] ";
     std::cout << "USER ID: " << mUserID << " ";
 
@@ -41,6 +47,15 @@ AudioStreamPluginProcessor::AudioStreamPluginProcessor()
 void AudioStreamPluginProcessor::prepareToPlay (double sampleRate , int blockSize )
 {
     VALID_PLUGIN
+
+    //AUDIO THREAD SCRATCH. blockSize is the largest block processBlock will get.
+    auto maxBlockSize = static_cast<size_t>(std::max(blockSize, 0));
+    auto dawChannels = static_cast<size_t>(std::max(getTotalNumInputChannels(), getTotalNumOutputChannels()));
+    auto scratchChannels = std::max(dawChannels, static_cast<size_t>(audio.channels));
+    mRealtimeScratch.daw.resize(scratchChannels, maxBlockSize);
+    mRealtimeScratch.mixed.resize(static_cast<size_t>(audio.channels), maxBlockSize);
+    mRealtimeScratch.interleaved.assign(static_cast<size_t>(audio.channels) * maxBlockSize, 0.0f);
+    mRealtimeScratch.output.assign(scratchChannels, std::span<float>{});
     std::call_once(mOnceFlag, [sampleRate, blockSize, this](){
       // ARA Initialization
       //  Note: check if ARA supports changes in blocksize after this point
@@ -69,12 +84,26 @@ void AudioStreamPluginProcessor::prepareToPlay (double sampleRate , int blockSiz
             state = STOPPED;
 
             std::once_flag bOnce;
+            uint8_t lastAudioCancelReason = 0;
             while(bRun)
             {
                 std::call_once(bOnce, [this](){
                    std::cout << "Running the event thread with a poll period of: " << eventDetection.pollPeriod << std::endl;
                 });
                 std::this_thread::sleep_for(pollPeriod);
+
+                //WHAT THE AUDIO THREAD CAN NOT DO ITSELF: run the resume slots and log why it skips blocks.
+                if (playback.TakeResume())
+                {
+                    playback.dawOriginatedPlayback.Emit(playback.mNowTimeStamp);
+                }
+                auto audioCancelReason = mAudioCancelReason.load(std::memory_order_relaxed);
+                if (audioCancelReason && audioCancelReason != lastAudioCancelReason)
+                {
+                    printCancelReason("audioThread", audioCancelReason);
+                }
+                lastAudioCancelReason = audioCancelReason;
+
                 millisecondsCounter += eventDetection.pollPeriod;
                 if (millisecondsCounter > 30000)
                 {
@@ -96,85 +125,127 @@ void AudioStreamPluginProcessor::prepareToPlay (double sampleRate , int blockSiz
             };
         }};
         mDAWPlaybackEvents.detach();
+
+        OpusImpl::BitrateController::Settings bitrateSettings{};
+        bitrateSettings.minBitrate = static_cast<int>(audio.minbitrate);
+        bitrateSettings.maxBitrate = static_cast<int>(audio.maxbitrate);
+        if (audio.bitrate) bitrateSettings.startBitrate = static_cast<int>(audio.bitrate);
+        mBitrateController.reset(bitrateSettings);
+
         mOpusEncoderMapThreadManager = std::thread{[this]()
         {
 
+            size_t encodedSinceAdaptation = 0;
+            //Allocated once, the loop below does not touch the allocator: the CODEC encodes into its scratch and the stream recycles its buffers.
+            std::vector<float> interleavedAdaptedBlock(audio.bsize * audio.channels, 0.0f);
             while (bRun)
             {
-                if (!pRtp)
+                //Take the ticket before looking for work, a push in between wakes the wait below right away.
+                auto ticket = mEncoderWakeUp.ticket();
                 {
-                    continue;
-                }
+                    //Read section: the snapshot is pinned until the end of the walk, not across the wait.
+                    auto peers = mPeers.read();
+                    for (auto& [userId, pCodecPair] : peers)
+                    {
+                        if (!pRtp)
+                        {
+                            break;
+                        }
 
-                for (auto& [userId, codec_bsa] : mOpusCodecMap)
-                {
-                    auto& [codec, bsa] = codec_bsa;
-                    auto& bsaOutput = bsa[0];
+                        auto& [codec, bsa] = *pCodecPair;
+                        auto& bsaOutput = bsa[0];
 
-                    while (bsaOutput.dataReady())
-                    {
-                        uint32_t timeStamp;
-                        std::vector<float> interleavedAdaptedBlock(audio.bsize * 2, 0.0f);
-                        bsaOutput.pop(interleavedAdaptedBlock, timeStamp);
-                        auto [_r, _p, _pS] = codec.encodeChannel(interleavedAdaptedBlock.data(), 0);
-                        auto& result = _r;
-                        if (result != OpusImpl::Result::OK)
+                        while (bsaOutput.dataReady())
                         {
-                            std::cout << "Encoding Error:" << _pS << std::endl;
+                            uint32_t timeStamp;
+                            bsaOutput.pop(interleavedAdaptedBlock, timeStamp);
+                            //TRACE: the frame was complete when the DAW block holding its last sample was pushed.
+                            DAWn::Trace::Stamp pushed{};
+                            uint64_t poppedNs = 0;
+                            if (mTrace.enabled() && mTrace.mCaptured.find(0, timeStamp + static_cast<uint32_t>(audio.bsize) - 1, pushed))
+                            {
+                                poppedNs = DAWn::Trace::now();
+                                mTrace.record(DAWn::Trace::Stage::Popped, pushed.stampNs, poppedNs);
+                            }
+                            //Encode right after the headroom of a stream buffer: the wire header goes in front, nothing moves.
+                            auto frame = pRtp->TakeFrame(mRtpStreamID, codec.maxEncodedBytes());
+                            size_t encodedBytes = 0;
+                            if (codec.encodeChannel(interleavedAdaptedBlock, DAWn::Wire::payload(frame), encodedBytes, 0) != OpusImpl::Result::OK)
+                            {
+                                continue;
+                            }
+                            if (poppedNs)
+                            {
+                                auto encodedNs = DAWn::Trace::now();
+                                mTrace.record(DAWn::Trace::Stage::Encoded, poppedNs, encodedNs);
+                                mTrace.mEncoded.publish(0, timeStamp, timeStamp + static_cast<uint32_t>(audio.bsize), {encodedNs, pushed.originNs});
+                            }
+                            pRtp->PushFrame(std::move(frame), encodedBytes, mRtpStreamID, timeStamp);
+
+                            if (audio.adaptbitrate && ++encodedSinceAdaptation >= kBitrateAdaptationPackets)
+                            {
+                                encodedSinceAdaptation = 0;
+                                adaptBitrate(codec);
+                            }
                         }
-                        auto &payload = _p;
-                        pRtp->PushFrame(payload, mRtpStreamID, timeStamp);
                     }
                 }
+                if (bRun) mEncoderWakeUp.wait(ticket);
             }
             std::cout << "BYE ENCODER" << std::endl;
         }};
         mOpusEncoderMapThreadManager.detach();
         mAudioMixerThreadManager = std::thread{[this](){
             uint8_t lastReason = 0;
+            std::vector<Mixer::Block> blocks{};
+            std::vector<float> interleavedAdaptedBlock{};
             while (bRun)
             {
-
-
+                auto ticket = mMixerWakeUp.ticket();
                 auto role = mUserID.GetRole();
-                for (auto& [userId, codec_bsa] : mOpusCodecMap)
                 {
-                    //FETCH CODEC&BSA
-                    auto& [codec, bsa] = codec_bsa;
-                    auto& bsaInput = bsa[1];
-
-                    //DATA
-                    while (bsaInput.dataReady())
+                    auto peers = mPeers.read();
+                    for (auto& [userId, pCodecPair] : peers)
                     {
-                        uint32_t timeStamp;
-                        std::vector<Mixer::Block> blocks{};
-                        std::vector<float> interleavedAdaptedBlock(2 * mAudioSettings.mDAWBlockSize, 0.0f);
-                        bsaInput.pop(interleavedAdaptedBlock, timeStamp);
-                        Utilities::Buffer::deinterleaveBlocks(blocks, interleavedAdaptedBlock);
-
-                        int64_t realTimeStamp64;
-                        int64_t timeStamp64 = static_cast<int64_t>(timeStamp);
+                        //FETCH CODEC&BSA
+                        auto& [codec, bsa] = *pCodecPair;
+                        auto& bsaInput = bsa[1];
 
-                        if (ShouldCancel(timeStamp64, lastReason, "audioMixerThread", true)) continue;
-
-                        if (role == DAWn::Session::Role::Rogue)
+                        //DATA
+                        while (bsaInput.dataReady())
                         {
-                            Mixer::AudioMixerBlock::mix(mAudioMixerBlocks, timeStamp, blocks, userId);
-                        }
-                        else if (role == DAWn::Session::Role::Mixer)
-                        {
-
-                            Mixer::AudioMixerBlock::mix(mAudioMixerBlocks, timeStamp, blocks, userId);
-
-                            auto mixedData = Mixer::AudioMixerBlock::getBlocks(mAudioMixerBlocks, timeStamp64, realTimeStamp64);
-                            packEncodeAndPush(mixedData, static_cast<uint32_t> (timeStamp64));
-                        }
-                        else if (role == DAWn::Session::Role::NonMixer)
-                        {
-                            Mixer::AudioMixerBlock::replace(mAudioMixerBlocks, timeStamp, blocks, userId);
+                            uint32_t timeStamp;
+                            interleavedAdaptedBlock.resize(audio.channels * mAudioSettings.mDAWBlockSize);
+                            bsaInput.pop(interleavedAdaptedBlock, timeStamp);
+                            auto dawBlockSize = static_cast<uint32_t>(mAudioSettings.mDAWBlockSize);
+                            DAWn::Trace::Stamp decoded{};
+                            auto traced = mTrace.enabled() && mTrace.mDecoded.find(userId, timeStamp + dawBlockSize - 1, decoded);
+                            Utilities::Buffer::deinterleaveBlocks(blocks, interleavedAdaptedBlock, audio.channels);
+
+                            int64_t timeStamp64 = static_cast<int64_t>(timeStamp);
+
+                            if (ShouldCancel(timeStamp64, lastReason, "audioMixerThread", true)) continue;
+
+                            //The Mixer role broadcasts the mix from processBlock, the only producer of the own encoder BSA.
+                            if (role == DAWn::Session::Role::Rogue || role == DAWn::Session::Role::Mixer)
+                            {
+                                Mixer::AudioMixerBlock::mix(mAudioMixerBlocks, timeStamp, blocks, userId);
+                            }
+                            else if (role == DAWn::Session::Role::NonMixer)
+                            {
+                                Mixer::AudioMixerBlock::replace(mAudioMixerBlocks, timeStamp, blocks, userId);
+                            }
+
+                            if (traced)
+                            {
+                                auto mixedNs = DAWn::Trace::now();
+                                mTrace.record(DAWn::Trace::Stage::Mixed, decoded.stampNs, mixedNs);
+                                mTrace.mMixed.publish(0, timeStamp, timeStamp + dawBlockSize, {mixedNs, decoded.originNs});
+                            }
                         }
                     }
                 }
+                if (bRun) mMixerWakeUp.wait(ticket);
             }
             std::cout << "BYE MIXER" << std::endl;
         }};
@@ -182,7 +253,7 @@ void AudioStreamPluginProcessor::prepareToPlay (double sampleRate , int blockSiz
 
         //INITALIZATION LIST
         //Object 0. WEBSOCKET.
-        //Object 1. AUDIOMIXERS[2] => Two Audio Mixers. One for each channel. IM FORCING 2 CHANNELS. If other channels are involved Im ignoring them.
+        //Object 1. AUDIOMIXERS[audio.channels] => One Audio Mixer for each channel. More than 2 channels travel as one multistream Opus packet.
         //Object 2. RTPWRAP => RTPWrap object. This object is the one that handles the Network Interface.
         //Object 3. OpusCodecMap => Errors assoc with this map.
 
@@ -216,16 +287,16 @@ void AudioStreamPluginProcessor::prepareToPlay (double sampleRate , int blockSiz
             mWebSocketSorcery.detach();
         }
 
+        if (debug.trace)
+        {
+            playback.daw30Seconds.Connect(std::function<void()>{[this](){
+                std::cout << "LATENCY TRACE" << std::endl << latencyTrace();
+            }});
+        }
+
         //OBJECT 1. AUDIO MIXER
         mAudioMixerBlocks   = std::vector<Mixer::AudioMixerBlock>(audio.channels);
-
-        Mixer::AudioMixerBlock::mixFinished.Connect(std::function<void(std::vector<Mixer::Block>, int64_t)>{
-            [this](auto playbackHead, auto timeStamp64){
-                auto& role = mUserID.GetRole();
-                if (role != DAWn::Session::Role::Mixer) return;
-                packEncodeAndPush (playbackHead, static_cast<uint32_t> (timeStamp64));
-            }
-        });
+        mJitterBuffer.reset(jitterBufferSettings());
 
         //OBJECT 3. OPUS CODEC MAP, error handling.
         OpusImpl::CODEC::sEncoderErr.Connect(std::function<void(uint32_t, const char*, float*)>{
@@ -234,7 +305,7 @@ void AudioStreamPluginProcessor::prepareToPlay (double sampleRate , int blockSiz
                 std::cout << "@" << std::hex << pdata << std::dec << std::endl;
             }
         });
-        OpusImpl::CODEC::sDecoderErr.Connect(std::function<void(uint32_t, const char*, std::byte*)>{
+        OpusImpl::CODEC::sDecoderErr.Connect(std::function<void(uint32_t, const char*, const std::byte*)>{
             [](auto uid, auto err, auto pdata){
                 std::cout << "Decoder Error for UID[" << uid << "] :" << err << std::endl;
                 std::cout << "@" << std::hex << pdata << std::dec << std::endl;
@@ -253,6 +324,7 @@ void AudioStreamPluginProcessor::prepareToPlay (double sampleRate , int blockSiz
         playback.dawOriginatedPlayback.Connect(std::function<void(int64_t)>{
             [this](auto timeStamp){
                 std::cout << "Playback Resumed at: " << timeStamp << std::endl;
+                if (pRtp) pRtp->MarkDiscontinuity();
                 broadcastCommand (kCommandPlay, static_cast<uint32_t>(timeStamp));
             }
         });
@@ -267,6 +339,15 @@ void AudioStreamPluginProcessor::prepareToPlay (double sampleRate , int blockSiz
         }
     });
 
+    prepareOwnPeer();
+}
+
+void AudioStreamPluginProcessor::prepareOwnPeer()
+{
+    //The audio thread only looks these up: creating them allocates.
+    getCodecPairForUser(mUserID(), 0);
+    Mixer::AudioMixerBlock::registerSource(mAudioMixerBlocks, mUserID());
+    bReanchorEncoder.store(true, std::memory_order_release);
 }
 
 bool& AudioStreamPluginProcessor::getMonoFlagReference()
@@ -297,11 +378,11 @@ std::tuple<uint32_t, int64_t> AudioStreamPluginProcessor::getUpdatedTimePosition
     auto timeStampDelta = playback.mLastTimeStamp < playback.mNowTimeStamp;
     if (wasPaused && timeStampDelta)
     {
-        playback.SetPause(false);
+        playback.Resume();
     }
     return std::make_tuple(ui32nTimeMS, i64nSamplePosition);
 }
-bool AudioStreamPluginProcessor::ShouldCancel(int64_t time, uint8_t& lastreason, const std::string from, bool overrideSilence)
+uint8_t AudioStreamPluginProcessor::cancelReason(int64_t time, bool overrideSilence) const
 {
     //should Cancel?
 
@@ -311,24 +392,36 @@ bool AudioStreamPluginProcessor::ShouldCancel(int64_t time, uint8_t& lastreason,
     bool isSilent = iCareAboutSound && std::max(rmsLevelsInputAudioBuffer.first, rmsLevelsInputAudioBuffer.second) < -60.0f && debug.overridermssilence == false; //Silence?
 
     bool isRoleNotSet = mUserID.IsRoleSet() == false && debug.requiresrole == true; //No Role yet?
-    bool isTimeNotSynced = time % static_cast<int64_t>(mAudioSettings.mDAWBlockSize); // N x BlockSize != TimeStamp?.
+    bool isTimeNotSynced = !isBlockSz0 && time % static_cast<int64_t>(mAudioSettings.mDAWBlockSize); // N x BlockSize != TimeStamp?.
 
-    bool shouldCancel = (isSilent || isRoleNotSet || isBlockSz0 || isTimeNotSynced);
-    uint8_t reason = (isSilent ? 0x1 : 0) | (isRoleNotSet ? 0x2 : 0) | (isBlockSz0 ? 0x4 : 0) | (isTimeNotSynced ? 0x8 : 0);
+    return static_cast<uint8_t>((isSilent ? kCancelSilent : 0) | (isRoleNotSet ? kCancelRoleNotSet : 0) | (isBlockSz0 ? kCancelBlockSize0 : 0) | (isTimeNotSynced ? kCancelTimeNotSynced : 0));
+}
 
-    if (shouldCancel && lastreason != reason)
+void AudioStreamPluginProcessor::printCancelReason(std::string_view from, uint8_t reason) const
+{
+    std::cout << "[" << from << "][" << playback.mNowTimeStamp << "] Audio Thread Cancel Reason: " << std::endl;
+    std::cout << "Silent: " << ((reason & kCancelSilent) != 0)
+              << " RoleNotSet: " << ((reason & kCancelRoleNotSet) != 0)
+              << " Block Size 0: " << ((reason & kCancelBlockSize0) != 0)
+              << " Time Not Synced: " << ((reason & kCancelTimeNotSynced) != 0)
+              << " Unknown Role: " << ((reason & kCancelUnknownRole) != 0)
+              << " Block Too Large: " << ((reason & kCancelBlockTooLarge) != 0) << std::endl;
+}
+
+bool AudioStreamPluginProcessor::ShouldCancel(int64_t time, uint8_t& lastreason, std::string_view from, bool overrideSilence)
+{
+    auto reason = cancelReason(time, overrideSilence);
+    if (reason && lastreason != reason)
     {
         lastreason = reason;
-        std::cout << "[" << from << "][" << playback.mNowTimeStamp << "] Audio Thread Cancel Reason: " << std::endl;
-        std::cout << "Silent: " << isSilent << " RoleNotSet: " << isRoleNotSet << " Block Size 0: " << isBlockSz0 << " Time Not Synced: " << isTimeNotSynced << std::endl;
+        printCancelReason(from, reason);
     }
-    return shouldCancel;
+    return reason != 0;
 
 }
 void AudioStreamPluginProcessor::beforeProcessBlock(juce::AudioBuffer<float>& buffer, bool& shouldCancel)
 {
 
-    static uint8_t lastreason = 0;
     auto dawReportedBlockSize = buffer.getNumSamples();
     if (mAudioSettings.mDAWBlockSize != static_cast<size_t>(dawReportedBlockSize))
     {
@@ -347,103 +440,240 @@ void AudioStreamPluginProcessor::beforeProcessBlock(juce::AudioBuffer<float>& bu
         buffer.clear (i, 0, dawReportedBlockSize);
     }
 
-    shouldCancel = ShouldCancel(playback.mNowTimeStamp, lastreason);
+    //The event thread prints the reason, the audio thread only publishes it.
+    auto reason = cancelReason(playback.mNowTimeStamp, false);
+    if (static_cast<size_t>(dawReportedBlockSize) > mRealtimeScratch.daw.maxSamples()) reason |= kCancelBlockTooLarge;
+    mAudioCancelReason.store(reason, std::memory_order_relaxed);
+    shouldCancel = reason != 0;
 
 }
 
-std::pair<OpusImpl::CODEC, std::vector<Utilities::Buffer::BlockSizeAdapter>>& AudioStreamPluginProcessor::getCodecPairForUser(Mixer::TUserID userID, uint32_t timeStamp)
+AudioStreamPluginProcessor::PeerTable::Entry AudioStreamPluginProcessor::getCodecPairForUser(Mixer::TUserID userID, uint32_t timeStamp)
 {
-    //  std::lock_guard<std::mutex> lock(mOpusCodecMapMutex);
-    if (mOpusCodecMap.find(userID) == mOpusCodecMap.end())
+    //Lock free when the user is known. A new user is built and set up before it is published, readers never see it half done.
+    return mPeers.findOrInsert(userID, [this, userID, timeStamp]()
     {
         std::cout << "Create FENCDEC and BSA for userID: " << userID << std::endl;
         auto nOfSizeAdaptersInOneDirection = (audio.channels >> 1) + (audio.channels % 2);
-        mOpusCodecMap.insert(
-            std::make_pair(
-                userID,
-                std::make_pair(
-                    OpusImpl::CODEC(),
-                    std::vector<Utilities::Buffer::BlockSizeAdapter>(
-                        2 * nOfSizeAdaptersInOneDirection,
-                        Utilities::Buffer::BlockSizeAdapter(audio.bsize, audio.channels)))));
-
-        mOpusCodecMap[userID].first.cfg.ownerID = userID;
-
-        jassert(mOpusCodecMap.find(userID) != mOpusCodecMap.end());
-        jassert(mOpusCodecMap[userID].first.cfg.ownerID == userID);
-        jassert(mOpusCodecMap[userID].first.mEncs.size() < 16);
-        jassert(mOpusCodecMap[userID].first.mDecs.size() < 16);
-
-        auto& [codec, bsa]  = mOpusCodecMap[userID];
+        OpusImpl::CODECConfig codecConfig{};
+        codecConfig.mSampRate = static_cast<int32_t>(audio.srate);
+        codecConfig.mBlockSize = static_cast<int>(audio.bsize);
+        codecConfig.mChannels = static_cast<int>(audio.channels);
+        codecConfig.inbandFEC = options.opusfec;
+        codecConfig.packetLossPercent = static_cast<int>(options.opuslossperc);
+        codecConfig.bitrate = audio.adaptbitrate ? mBitrateController.bitrate() : (audio.bitrate ? static_cast<int>(audio.bitrate) : OPUS_AUTO);
+        codecConfig.complexity = audio.complexity;
+        codecConfig.vbr = audio.vbr;
+        codecConfig.bandwidth = OpusImpl::bandwidthFromName(audio.bandwidth);
+        codecConfig.ownerID = static_cast<uint32_t>(userID);
+        //Built in place: the CODEC owns its opus states, it is never copied.
+        auto pCodecPair = std::make_shared<CodecPair>(
+            std::piecewise_construct,
+            std::forward_as_tuple(codecConfig),
+            std::forward_as_tuple(
+                2 * nOfSizeAdaptersInOneDirection,
+                Utilities::Buffer::BlockSizeAdapter(audio.bsize, audio.channels)));
+
+        jassert(pCodecPair->first.encoderCount() < 16);
+        jassert(pCodecPair->first.decoderCount() < 16);
+
+        auto& [codec, bsa]  = *pCodecPair;
 
         auto& bsaOut        = bsa[0];
         bsaOut.setTimeStamp(timeStamp, true);
         bsaOut.setChannelsAndOutputBlockSize(audio.channels, audio.bsize);
+        bsaOut.setNotifier(&mEncoderWakeUp);
 
         auto& bsaIn         = bsa[1];
         bsaIn.setTimeStamp(timeStamp, true);
         bsaIn.setChannelsAndOutputBlockSize(audio.channels, mAudioSettings.mDAWBlockSize);
+        bsaIn.setNotifier(&mMixerWakeUp);
 
+        return pCodecPair;
+    });
+}
+
+void AudioStreamPluginProcessor::removePeer(Mixer::TUserID userID)
+{
+    if (userID == mUserID()) return;
+    if (mPeers.erase(userID))
+    {
+        std::cout << "Removed FENCDEC and BSA for userID: " << userID << std::endl;
     }
-    return mOpusCodecMap[userID];
+    mJitterBuffer.removeSource(userID);
 }
 
-void AudioStreamPluginProcessor::extractDecodeAndMix(std::vector<std::byte> uid_ts_encodedPayload)
+void AudioStreamPluginProcessor::extractDecodeAndMix(const xlet::Packet& uid_ts_encodedPayload)
 {
+    //RTCP is for the RTP interface, it keeps the statistics.
+    if (DAWn::Rtcp::isRtcp(uid_ts_encodedPayload.span())) return;
+
     //
     //LAYOUT
-    auto [result, userID, nSample, encodedPayLoad] = Utilities::Buffer::extractIncomingData(uid_ts_encodedPayload);
+    auto [result, header, encodedPayLoad] = Utilities::Buffer::extractIncomingData(uid_ts_encodedPayload.span());
 
     if (result == false)
     {
         std::cout << "Error: Buffer Extraction" << std::endl;
+        return;
     }
 
-    if (0xdeadbee0 <= userID && userID <= 0xdeadbeef)
+    switch (header.type)
     {
-        inboundCommandFromStream(userID, static_cast<uint32_t>(nSample));
-        return;
+        case DAWn::Wire::PayloadType::Audio:
+            break;
+        case DAWn::Wire::PayloadType::Command:
+            if (!encodedPayLoad.empty())
+            {
+                inboundCommandFromStream(std::to_integer<uint32_t>(encodedPayLoad[0]), header.timeStamp);
+            }
+            return;
+        default:
+            //Probes open the path to the relay, FEC has no consumer yet.
+            return;
     }
 
-    if (mOpusCodecMap.find(userID) == mOpusCodecMap.end())
+    auto userID = header.source;
+    auto nSample = static_cast<int64_t>(header.timeStamp);
+
+    if (!mPeers.find(userID))
     {
         std::cout << "NEW USER IN THE STREAM" << std::endl;
     }
 
-    //FETCH CODEC&BSA
+    //JITTER BUFFER: do not waste a decode on what can not be played.
+    auto verdict = mJitterBuffer.admit(userID, static_cast<Mixer::TTime>(nSample));
+    if (verdict == Mixer::JitterBuffer::Verdict::Late || verdict == Mixer::JitterBuffer::Verdict::Duplicate || verdict == Mixer::JitterBuffer::Verdict::Superseded)
+    {
+        return;
+    }
+    if (transport.rtrx && verdict == Mixer::JitterBuffer::Verdict::Discontinuous && !(header.flags & DAWn::Wire::kFlagRetransmission))
+    {
+        requestRetransmission(userID, static_cast<Mixer::TTime>(nSample));
+    }
+
+    //FETCH CODEC&BSA. Created here, on the network thread, so the workers never insert into the table.
     auto ui32nSample = static_cast<uint32_t>(nSample);
-    auto& [codec, blockSzAdapters] = getCodecPairForUser(userID, ui32nSample);
-    auto& bsaInput = blockSzAdapters[1]; //This is the input channel.
+    auto pCodecPair = getCodecPairForUser(userID, ui32nSample);
 
-    //DATA DECODE
-    auto [_r, _p, _pS]      = codec.decodeChannel(encodedPayLoad.data(), encodedPayLoad.size(), 0);
-    auto& decodingResult    = _r;
-    auto& decodedPayload    = _p;
+    //TRACE
+    uint64_t extractedNs = 0;
+    if (mTrace.enabled())
+    {
+        extractedNs = DAWn::Trace::now();
+        mTrace.record(DAWn::Trace::Stage::Extracted, uid_ts_encodedPayload.arrivalNs(), extractedNs);
+    }
 
-    if (decodingResult != OpusImpl::Result::OK)
+    //TO THE DECODE WORKER OF THIS PEER
+    auto payloadOffset = static_cast<size_t>(encodedPayLoad.data() - uid_ts_encodedPayload.data());
+    mDecodePool.submit(userID, DecodeJob{
+        uid_ts_encodedPayload.view(payloadOffset, encodedPayLoad.size()),
+        userID,
+        ui32nSample,
+        verdict,
+        std::move(pCodecPair),
+        uid_ts_encodedPayload.arrivalNs(),
+        extractedNs});
+}
+
+void AudioStreamPluginProcessor::decodeAndMix(DecodeJob& job)
+{
+    auto& [codec, blockSzAdapters] = *job.pCodecPair;
+    auto& bsaInput = blockSzAdapters[1]; //This is the input channel.
+
+    //DATA DECODE (packets lost right before this one are rebuilt with FEC / PLC)
+    auto decodedPayload     = codec.decodeScratch();
+    size_t decodedSize      = 0;
+    uint32_t firstTimeStamp = job.timeStamp;
+    if (codec.decodeChannel(job.payload.span(), decodedPayload, decodedSize, 0, job.timeStamp, firstTimeStamp) != OpusImpl::Result::OK)
     {
-        std::cout << "Decoding Error: " << _pS << std::endl;
         return;
     }
 
-    //SEND TO MIXER THREAD
-    bsaInput.push(decodedPayload, ui32nSample);
+    //SEND TO MIXER THREAD. After a gap that could not be rebuilt, re-anchor the adapter so the audio lands on its own timestamp.
+    //Only forward: the jitter buffer drops what is older than a packet already decoded.
+    if (job.verdict == Mixer::JitterBuffer::Verdict::Discontinuous && firstTimeStamp == job.timeStamp)
+    {
+        bsaInput.setTimeStamp(job.timeStamp, true);
+    }
+
+    //TRACE: published before the push, the mixer thread may pop right away.
+    if (job.extractedNs && job.receivedNs)
+    {
+        auto decodedNs = DAWn::Trace::now();
+        auto samples = static_cast<uint32_t>(decodedSize / audio.channels);
+        mTrace.mDecoded.publish(job.userID, firstTimeStamp, firstTimeStamp + samples, {decodedNs, job.receivedNs});
+        mTrace.record(DAWn::Trace::Stage::Decoded, job.extractedNs, decodedNs);
+    }
+    bsaInput.push(std::span<const float>(decodedPayload.first(decodedSize)), firstTimeStamp);
+}
 
+void AudioStreamPluginProcessor::adaptBitrate(OpusImpl::CODEC& codec)
+{
+    auto pStrm = _rtpwrap::data::GetStream(mRtpStreamID);
+    if (!pStrm) return;
+
+    //The link quality seen on the way in is the best hint there is of the way out. The queue tells about our uplink.
+    auto fractionLost = mJitterBuffer.fractionLost();
+    auto outbound = pStrm->stats(xlet::Direction::OUTB);
+    codec.setBitrate(mBitrateController.update(fractionLost, outbound.depth, outbound.dropped));
+    codec.setPacketLossPercent(std::max(static_cast<int>(options.opuslossperc), static_cast<int>(fractionLost * 100.0)));
 }
 
-void AudioStreamPluginProcessor::packEncodeAndPush(std::vector<Mixer::Block>& blocks, uint32_t timeStamp)
+void AudioStreamPluginProcessor::packEncodeAndPush(Mixer::ConstChannels blocks, uint32_t timeStamp, uint64_t captureNs)
 {
+    auto interleaved = Utilities::Buffer::interleaveBlocks(mRealtimeScratch.interleaved, blocks, audio.channels);
+
+    //FETCH CODEC&BSA, lookup only. Inside a read section and without taking a reference: the snapshots are freed by
+    //the writers, so a role change erasing the own entry never frees its CODEC and rings on the audio thread.
+    auto peers = mPeers.read();
+    auto pCodecPair = peers.find(mUserID());
+    if (!pCodecPair || interleaved.empty()) return;
+    pushToEncoder(*pCodecPair, interleaved, timeStamp, captureNs);
+}
 
-    std::vector<Mixer::Block> __interleavedBlocks{};
-    Utilities::Buffer::interleaveBlocks(__interleavedBlocks, blocks);
-    auto& interleavedBlocks = __interleavedBlocks[0]; // This is the first pair of interleaved blocks. We are only using 2 channels.
+void AudioStreamPluginProcessor::pushToEncoder(CodecPair& codecPair, std::span<const float> interleaved, uint32_t timeStamp, uint64_t captureNs)
+{
+    auto& bsaOutput = codecPair.second[0];
+    if (bReanchorEncoder.exchange(false, std::memory_order_acq_rel))
+    {
+        bsaOutput.setTimeStamp(timeStamp, true);
+    }
 
-    //FETCH CODEC&BSA
-    auto& [codec, blockSzAdapters] = getCodecPairForUser(mUserID(), timeStamp);
+    //TRACE: published before the push, the encoder thread may pop right away.
+    if (mTrace.enabled())
+    {
+        auto pushedNs = DAWn::Trace::now();
+        if (captureNs == 0) captureNs = pushedNs;
+        auto samples = static_cast<uint32_t>(interleaved.size() / audio.channels);
+        mTrace.mCaptured.publish(0, timeStamp, timeStamp + samples, {pushedNs, captureNs});
+        mTrace.record(DAWn::Trace::Stage::Pushed, captureNs, pushedNs);
+    }
 
     //SEND TO ENCODER THREAD
-    blockSzAdapters[0].push(interleavedBlocks, timeStamp);
+    bsaOutput.push(interleaved, timeStamp);
+}
 
+void AudioStreamPluginProcessor::requestRetransmission(Mixer::TUserID userID, Mixer::TTime timeStamp)
+{
+    //Until the peer reported on our stream its round trip is unknown, assume a slow link meanwhile.
+    constexpr double kAssumedRttMs = 100.0;
+    //The mixer timeline assumes 48k sample/second
+    constexpr double kSamplesPerMs = 48.0;
+    if (!pRtp) return;
+
+    auto rttMs = pRtp->GetRoundTripMs(userID);
+    if (rttMs < 0.0) rttMs = kAssumedRttMs;
+    //A round trip, plus a packet for the sender to notice and the decoder to catch up.
+    auto minSlackSamples = static_cast<int64_t>(rttMs * kSamplesPerMs) + static_cast<int64_t>(audio.bsize);
+
+    std::array<Mixer::TTime, DAWn::Rtcp::kMaxNackTimeStamps> missing{};
+    auto count = mJitterBuffer.retransmitCandidates(userID, timeStamp, minSlackSamples, missing);
+    if (count == 0) return;
+
+    std::array<uint32_t, DAWn::Rtcp::kMaxNackTimeStamps> timeStamps{};
+    for (auto index = 0ul; index < count; ++index) timeStamps[index] = static_cast<uint32_t>(missing[index]);
+    pRtp->PushNack(mRtpStreamID, userID, std::span<const uint32_t>(timeStamps.data(), count));
 }
 
 void AudioStreamPluginProcessor::broadcastCommand (uint32_t command, uint32_t timeStamp)
@@ -461,21 +691,10 @@ void AudioStreamPluginProcessor::broadcastCommand (uint32_t command, uint32_t ti
     else
     {
         //Stream the command thru the network
-        auto pStrm = _rtpwrap::data::GetStream(mRtpStreamID);
-        if (!pStrm || !pRtp)
+        if (!pRtp || !pRtp->PushCommand(static_cast<uint8_t>(command), mRtpStreamID, timeStamp))
         {
             std::cout << "WARNING: not connected to the stream router" << std::endl;
         }
-        else
-        {
-            command += 0xdeadbee0;
-            std::vector<std::byte> pData{};
-            auto pts = reinterpret_cast<std::byte*>(&timeStamp);
-            auto puid = reinterpret_cast<std::byte*>(&command);
-            pData.insert(pData.begin(), pts, pts+4);
-            pData.insert(pData.begin(), puid, puid+4);
-            pStrm->push_back(xlet::Data{.first = dynamic_cast<UDPRTPWrap*>(pRtp.get())->GetPeerID(), .second = pData}, xlet::Direction::OUTB);
-        }
     }
 }
 
@@ -484,7 +703,10 @@ void AudioStreamPluginProcessor::
     processBlock (juce::AudioBuffer<float>& buffer,
                                               juce::MidiBuffer&)
 {
-    VALID_PLUGIN
+    //From here on no heap, no blocking lock and no I/O: a debug build reports it (DAWn::Realtime).
+    DAWn::Realtime::ScopedRealtime realtimeSection;
+    if (!mValidPlugin) return;
+    const uint64_t captureNs = mTrace.enabled() ? DAWn::Trace::now() : 0;
 
     // GET TIME
     auto [nTimeMS, timeStamp64] = getUpdatedTimePosition();
@@ -503,42 +725,67 @@ void AudioStreamPluginProcessor::
     }
 
     // GRAB DATA FROM DAW
-    std::vector<Mixer::Block> dawBufferData{};
-    Utilities::Buffer::splitChannels(dawBufferData, buffer, mAudioSettings.mMonoSplit);
-
-    // MIX AND SEND
+    auto& scratch = mRealtimeScratch;
+    auto numSamples = static_cast<size_t>(buffer.getNumSamples());
+    scratch.daw.setSamples(numSamples);
+    Utilities::Buffer::splitChannels(scratch.daw.channels(), buffer, mAudioSettings.mMonoSplit);
+    auto dawBufferData = scratch.daw.constChannels();
+
+    // MIX AND SEND. A mixer busy on the mixer thread is skipped for this block, never waited for.
+    constexpr auto kTryOnly = Mixer::LockPolicy::TryOnly;
     int64_t playbackTime64;
     auto role = mUserID.GetRole();
     auto userId = mUserID();
 
     if (role == DAWn::Session::Role::Audioplayer || role == DAWn::Session::Role::Rogue)
     {
-        Mixer::AudioMixerBlock::mix(mAudioMixerBlocks, timeStamp64, dawBufferData, userId);
+        Mixer::AudioMixerBlock::mix(mAudioMixerBlocks, timeStamp64, dawBufferData, userId, kTryOnly);
     }
     else if (role == DAWn::Session::Role::Mixer)
     {
         // MIX DAW DATA into the mixer block.
-        Mixer::AudioMixerBlock::mix(mAudioMixerBlocks, timeStamp64, dawBufferData, mUserID());
+        Mixer::AudioMixerBlock::mix(mAudioMixerBlocks, timeStamp64, dawBufferData, userId, kTryOnly);
 
         // BROADCAST MIXED DATA
-        auto mixedData = Mixer::AudioMixerBlock::getBlocks(mAudioMixerBlocks, timeStamp64, playbackTime64);
-        packEncodeAndPush(mixedData, static_cast<uint32_t> (timeStamp64));
+        scratch.mixed.setSamples(numSamples);
+        Mixer::AudioMixerBlock::getBlocks(mAudioMixerBlocks, timeStamp64, playbackTime64, scratch.mixed.channels(), kTryOnly);
+        packEncodeAndPush(scratch.mixed.constChannels(), static_cast<uint32_t> (timeStamp64), captureNs);
     }
     else if (role == DAWn::Session::Role::NonMixer)
     {
         // BROADCAST DAW DATA
-        packEncodeAndPush(dawBufferData, static_cast<uint32_t> (timeStamp64));
+        packEncodeAndPush(dawBufferData, static_cast<uint32_t> (timeStamp64), captureNs);
     }
     else
     {
-        std::cout << "ERROR: Unknown Role" << std::endl;
+        mAudioCancelReason.store(kCancelUnknownRole, std::memory_order_relaxed);
         return;
     }
 
 
 
-    // PLAYBACK AUDIO (origin daw buffer is modified with the contents from the mixer block)
-    Utilities::Buffer::joinChannels(buffer, Mixer::AudioMixerBlock::getBlocksDelayed(mAudioMixerBlocks, timeStamp64, playbackTime64));
+    // PLAYBACK AUDIO (origin daw buffer is overwritten with the contents from the mixer block)
+    mJitterBuffer.setPlaybackHead(timeStamp64);
+    Mixer::AudioMixerBlock::setDelay(mAudioMixerBlocks, mJitterBuffer.delaySamples(), kTryOnly);
+    auto numChannels = static_cast<size_t>(buffer.getNumChannels());
+    auto numOutput = std::min({numChannels, scratch.output.size(), mAudioMixerBlocks.size()});
+    auto wrPtrs = buffer.getArrayOfWritePointers();
+    for (auto channelIndex = 0ul; channelIndex < numOutput; ++channelIndex)
+    {
+        scratch.output[channelIndex] = std::span<float>(wrPtrs[channelIndex], numSamples);
+    }
+    auto skipped = Mixer::AudioMixerBlock::getBlocksDelayed(mAudioMixerBlocks, timeStamp64, playbackTime64, std::span<const std::span<float>>(scratch.output).first(numOutput), kTryOnly);
+    DAWn::Trace::Stamp mixed{};
+    if (captureNs && skipped < numOutput && mTrace.mMixed.find(0, static_cast<uint32_t>(playbackTime64), mixed))
+    {
+        auto playedNs = DAWn::Trace::now();
+        mTrace.record(DAWn::Trace::Stage::PlayedOut, mixed.stampNs, playedNs);
+        mTrace.record(DAWn::Trace::Stage::ReceiveTotal, mixed.originNs, playedNs);
+    }
+    for (auto channelIndex = numOutput; channelIndex < numChannels; ++channelIndex)
+    {
+        buffer.clear(static_cast<int>(channelIndex), 0, static_cast<int>(numSamples));
+    }
 
     // POST PROCESS BLOCK
     rmsLevelsJitterBuffer.first = buffer.getRMSLevel(0, 0, buffer.getNumSamples());
@@ -562,7 +809,13 @@ void AudioStreamPluginProcessor::startRTP(std::string ip, int port)
         auto userId = mUserID();
 
         std::cout << "Start RTP stream: [" << ip << ":" << port << "]" << std::endl;
-        pRtp = std::make_unique<UDPRTPWrap>();
+        auto pUdpRtp = std::make_unique<UDPRTPWrap>();
+        pUdpRtp->SetUDPOptions(xlet::UDPOptions{
+            .batched = transport.batchedio,
+            .batchSize = transport.batchsize,
+            .pollTimeoutMs = transport.polltimeoutms});
+        pUdpRtp->SetRetransmission(transport.rtrx ? transport.rtrxpackets : 0, audio.bsize);
+        pRtp = std::move(pUdpRtp);
 
         //TODO: TEMPORAL
         mRtpSessionID   = pRtp->CreateSession (ip);
@@ -574,11 +827,24 @@ void AudioStreamPluginProcessor::startRTP(std::string ip, int port)
 
         auto pStream = _rtpwrap::data::GetStream (mRtpStreamID);
         //bind a codec to the stream
-        pStream->letDataFromPeerIsReady.Connect (std::function<void (uint64_t, std::vector<std::byte>)> {
-            [this] (auto, auto uid_ts_encodedPayload) {
+        //Once per packet: an inplace slot, no std::function.
+        pStream->letDataFromPeerIsReady.Connect (
+            [this] (uint64_t, const xlet::Packet& uid_ts_encodedPayload) {
                 extractDecodeAndMix(uid_ts_encodedPayload);
             }
-        });
+        );
+        //TRACE: a frame leaves the socket. Retransmissions were encoded long ago, they are not the path being timed.
+        if (debug.trace) pStream->letDataSent.Connect (
+            [this] (uint64_t, std::span<const std::byte> datagram) {
+                DAWn::Wire::Header header{};
+                DAWn::Trace::Stamp encoded{};
+                if (!DAWn::Wire::read(datagram, header) || header.type != DAWn::Wire::PayloadType::Audio) return;
+                if ((header.flags & DAWn::Wire::kFlagRetransmission) || !mTrace.mEncoded.find(0, header.timeStamp, encoded)) return;
+                auto sentNs = DAWn::Trace::now();
+                mTrace.record(DAWn::Trace::Stage::Sent, encoded.stampNs, sentNs);
+                mTrace.record(DAWn::Trace::Stage::SendTotal, encoded.originNs, sentNs);
+            }
+        );
 
         pStream->letOperationalError.Connect (std::function<void (uint64_t, std::string)> {
             [] (uint64_t peerId, std::string error) {
@@ -593,10 +859,11 @@ void AudioStreamPluginProcessor::startRTP(std::string ip, int port)
         });
 
         pStream->run();
+        //The encoder skips its work while there is no RTP interface, wake it up now there is one.
+        mEncoderWakeUp.notify();
         if (role != "loopback")
         {
-            std::byte b{0};
-            pRtp->PushFrame(std::vector<std::byte>{b}, mRtpStreamID, 0);
+            pRtp->PushProbe(mRtpStreamID);
         }
     }
 }
@@ -604,13 +871,21 @@ void AudioStreamPluginProcessor::startRTP(std::string ip, int port)
 void AudioStreamPluginProcessor::commandSetHost(const char* command)
 {
     //from desirialize or parse char*
+    auto previousUserID = mUserID();
     mUserID.SetRole(DAWn::Session::Role::Mixer);
+    //A new role is a new user ID.
+    removePeer(previousUserID);
+    prepareOwnPeer();
     startRTP("44.205.23.6", 8899);
 }
 
 void AudioStreamPluginProcessor::commandSetPeer (const char*)
 {
+    auto previousUserID = mUserID();
     mUserID.SetRole(DAWn::Session::Role::NonMixer);
+    //A new role is a new user ID.
+    removePeer(previousUserID);
+    prepareOwnPeer();
     startRTP("44.205.23.6", 8899);
 }
 
@@ -619,9 +894,22 @@ void AudioStreamPluginProcessor::commandDisconnect (const char*)
     std::cout << "FINISH THE PLUGIN AND THE DAW AND RESTART" << std::endl;
 }
 
-void AudioStreamPluginProcessor::peerGone (const char*)
+void AudioStreamPluginProcessor::peerGone (const char* payload)
 {
     std::cout << "PEER GONE" << std::endl;
+    nlohmann::json j;
+    try {
+        j = nlohmann::json::parse(payload);
+    } catch (nlohmann::json::parse_error& e) {
+        std::cout << "Could not parse payload for peer gone (" << e.what() << ")." << std::endl;
+        return;
+    }
+    if (j.find("UserID") == j.end() || !j["UserID"].is_number_unsigned())
+    {
+        std::cout << "Peer gone without a UserID: " << j.dump() << std::endl;
+        return;
+    }
+    removePeer(j["UserID"].get<Mixer::TUserID>());
 }
 
 void AudioStreamPluginProcessor::peerConnected (const char*)
@@ -647,22 +935,45 @@ void AudioStreamPluginProcessor::generalCacheReset(uint32_t timeStamp)
 {
     if (mAudioSettings.mDAWBlockSize == 0) return;
     {
-        //Set Input BSAs
-        for (auto& [userId, codec_bsa] : mOpusCodecMap)
+        //Reset the Input BSAs: the decode workers push into them, so the worker applies it before its next push.
+        auto peers = mPeers.read();
+        for (auto& [userId, pCodecPair] : peers)
         {
-            auto& [codec, bsa] = codec_bsa;
-            auto& bsaInput = bsa[1];
-            bsaInput.setChannelsAndOutputBlockSize(2, mAudioSettings.mDAWBlockSize);
-            bsaInput.setTimeStamp(timeStamp); //This Resets the BSA.
+            auto& [codec, bsa] = *pCodecPair;
+            bsa[1].requestReset(audio.channels, mAudioSettings.mDAWBlockSize, timeStamp);
         }
     }
     //Reset the Audio Mixer Blocks
-    Mixer::AudioMixerBlock::resetMixers(mAudioMixerBlocks, mAudioSettings.mDAWBlockSize, options.delayseconds);
+    auto jitterSettings = jitterBufferSettings();
+    Mixer::AudioMixerBlock::resetMixers(mAudioMixerBlocks, mAudioSettings.mDAWBlockSize, options.delayseconds, jitterSettings.maxDelaySamples);
+    //The reset dropped every lane, the audio thread does not add its own.
+    Mixer::AudioMixerBlock::registerSource(mAudioMixerBlocks, mUserID());
+    mJitterBuffer.reset(jitterSettings);
+    Mixer::AudioMixerBlock::setDelay(mAudioMixerBlocks, mJitterBuffer.delaySamples());
+}
+
+Mixer::JitterBuffer::Settings AudioStreamPluginProcessor::jitterBufferSettings() const
+{
+    //The mixer timeline assumes 48k sample/second
+    constexpr size_t kSamplesPerMs = 48;
+    Mixer::JitterBuffer::Settings settings{};
+    settings.packetSamples = audio.bsize;
+    settings.blockSize = mAudioSettings.mDAWBlockSize ? mAudioSettings.mDAWBlockSize : audio.bsize;
+    settings.sampleRate = 48000;
+    if (options.jitterbuffer)
+    {
+        settings.minDelaySamples = options.jittermindelayms * kSamplesPerMs;
+        settings.maxDelaySamples = options.jittermaxdelayms * kSamplesPerMs;
+    }
+    else
+    {
+        settings.minDelaySamples = settings.maxDelaySamples = options.delayseconds * settings.sampleRate;
+    }
+    return settings;
 }
 
 void AudioStreamPluginProcessor::inboundCommandFromStream (uint32_t command, uint32_t timeStamp)
 {
-    command -= 0xdeadbee0;
     uint8_t ui8Command = command & 0xff;
     std::cout << "COMMAND STREAM: 0x" << std::hex << command << std::endl;
 
@@ -885,21 +1196,22 @@ AudioStreamPluginProcessor::~AudioStreamPluginProcessor()
     VALID_PLUGIN
     validMap.erase(this);
 
-    std::cout << "Size of mOpusCodecMap : " << mOpusCodecMap.size() << std::endl;
+    std::cout << "Size of mPeers : " << mPeers.size() << std::endl;
 
     if (options.wscommands == false) broadcastCommand(kCommandRemove);
 
     bRun = false;
-    mOpusCodecMap.clear();
-    if (bRun == false)
-    {
-    }
-    //Tear down UDP
+    mEncoderWakeUp.notify();
+    mMixerWakeUp.notify();
+    //Tear down UDP first: no more packets for extractDecodeAndMix. A submit still in flight is waited for by stop,
+    //later ones are dropped, so nothing is decoded on the network thread while the peers go away.
     auto pStream = _rtpwrap::data::GetStream (mRtpStreamID);
     if (pStream)
     {
         pStream->closeAndJoin();
     }
+    mDecodePool.stop();
+    mPeers.clear();
 
 }
 
@@ -918,9 +1230,10 @@ bool AudioStreamPluginProcessor::isBusesLayoutSupported (const BusesLayout& layo
     return true;
 #else
     // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
+    // Mono, stereo, or as many channels as the stream carries (audio.channels).
     if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono()
-        && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
+        && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo()
+        && static_cast<uint64_t>(layouts.getMainOutputChannelSet().size()) != audio.channels)
         return false;
 
         // This checks if the input layout matches the output layout
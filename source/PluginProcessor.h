@@ -12,12 +12,21 @@ constexpr auto COMPILATION_TIMESTAMP = __DATE__ " " __TIME__;
 #include "Utilities/Configuration/Configuration.h"
 #include "Utilities/Utilities.h"
 #include "AudioMixerBlock.h"
+#include "JitterBuffer.h"
+#include "DecodePool.h"
+#include "PeerTable.h"
+#include "Realtime.h"
+#include "Trace.h"
 #include "wsclient.h"
 #include "opusImpl.h"
 #include "RTPWrap.h"
+#include "Notifier.h"
 
+#include <atomic>
 #include <deque>
 #include <mutex>
+#include <span>
+#include <string_view>
 
 
 #define VALID_PLUGIN if(!IsValidPlugin(this))return;
@@ -84,6 +93,11 @@ public:
     std::pair<float, float>& getRMSLevelsAudioBuffer() { return rmsLevelsInputAudioBuffer; }
     std::pair<float, float>& getRMSLevelsJitterBuffer() { return rmsLevelsJitterBuffer; }
 
+    /*!
+     * @brief Per stage latency of the audio path since the plugin started, p50 / p99 / max. Empty unless debug.trace.
+     */
+    std::string latencyTrace() const { return mTrace.format(); }
+
     /*!@brief Necessary to shutdown the plugin when removed. Will signal the threads to stop.*/
     bool bRun {true};
 
@@ -138,14 +152,23 @@ private:
         int64_t                                                         mNowTimeStamp{0};
         inline void SetPause(bool v)
         {
-            mPaused = v;
+            mPaused.store(v, std::memory_order_relaxed);
             if (v) dawOriginatedPlaybackStop.Emit();
             else dawOriginatedPlayback.Emit(mNowTimeStamp);
         }
-        inline bool IsPaused() { return mPaused; }
+        /*! @brief Un-pause from the audio thread. The slots run on the event thread, see TakeResume.*/
+        inline void Resume()
+        {
+            mPaused.store(false, std::memory_order_relaxed);
+            mResumePending.store(true, std::memory_order_release);
+        }
+        /*! @brief True once after each Resume.*/
+        inline bool TakeResume() { return mResumePending.exchange(false, std::memory_order_acq_rel); }
+        inline bool IsPaused() { return mPaused.load(std::memory_order_relaxed); }
         float outputGain{1.0f};
     private:
-        bool    mPaused{true};
+        std::atomic<bool>   mPaused{true};
+        std::atomic<bool>   mResumePending{false};
 
 
     } playback;
@@ -156,23 +179,113 @@ private:
      * @param lastReason a reference to the lastReason the blocks couldn't be processed by thread.
      * @return
      */
-    bool ShouldCancel(int64_t dataTime, uint8_t& lastReason, const std::string from = "audioThread", bool overrideSilence = false);
+    bool ShouldCancel(int64_t dataTime, uint8_t& lastReason, std::string_view from = "audioThread", bool overrideSilence = false);
+    /*! @brief Why a block is not processed. Bits, 0 if it is. */
+    enum CancelReason : uint8_t
+    {
+        kCancelSilent           = 0x01,
+        kCancelRoleNotSet       = 0x02,
+        kCancelBlockSize0       = 0x04,
+        kCancelTimeNotSynced    = 0x08,
+        kCancelUnknownRole      = 0x10,
+        kCancelBlockTooLarge    = 0x20
+    };
+    /*! @brief The CancelReason bits for a block at dataTime. No I/O, safe on the audio thread.*/
+    uint8_t cancelReason(int64_t dataTime, bool overrideSilence) const;
+    void printCancelReason(std::string_view from, uint8_t reason) const;
+    /*! @brief CancelReason of the last block the audio thread skipped, 0 if it did not. Logged by the event thread.*/
+    std::atomic<uint8_t> mAudioCancelReason{0};
     /*!
      * @brief Update information about buffer settings.
      * @param buffer The buffer to update.
      * @param cancel If true the buffer should not be processed.
      */
     void beforeProcessBlock(juce::AudioBuffer<float>& buffer, bool &cancel);
+    using CodecPair = std::pair<OpusImpl::CODEC, std::vector<Utilities::Buffer::BlockSizeAdapter>>;
+    using PeerTable = Mixer::PeerTable<Mixer::TUserID, CodecPair>;
     /*!
-     * @brief Process Encoded Information.
-     * @param uid_ts_encodedPayload
+     * @brief A received packet on its way to the decoder of its peer.
      */
-    void extractDecodeAndMix(std::vector<std::byte> uid_ts_encodedPayload);
+    struct DecodeJob
+    {
+        /*! @brief A view on the encoded payload. Keeps the pooled datagram alive until the job is done.*/
+        xlet::Packet                    payload{};
+        Mixer::TUserID                  userID{0};
+        uint32_t                        timeStamp{0};
+        Mixer::JitterBuffer::Verdict    verdict{Mixer::JitterBuffer::Verdict::OnTime};
+        /*! @brief Shared: the peer may leave the table while the job is queued.*/
+        PeerTable::Entry                pCodecPair{nullptr};
+        /*! @brief DAWn::Trace stamps: the datagram arrived, and was submitted. 0 when not tracing.*/
+        uint64_t                        receivedNs{0};
+        uint64_t                        extractedNs{0};
+    };
+    /*!
+     * @brief Process Encoded Information. Parses, admits and routes the packet on the network thread, the decode
+     * runs on the decode pool worker of its peer.
+     * @param uid_ts_encodedPayload The received datagram (a pooled packet). Nothing is copied.
+     */
+    void extractDecodeAndMix(const xlet::Packet& uid_ts_encodedPayload);
+    /*!
+     * @brief Decode a packet and push it to the input BlockSizeAdapter of its peer.
+     */
+    void decodeAndMix(DecodeJob& job);
+    /*!
+     * @brief After a gap in the packets of userID, ask it to send again the ones that can still make their playout
+     * deadline after a round trip (transport.rtrx).
+     */
+    void requestRetransmission(Mixer::TUserID userID, Mixer::TTime timeStamp);
+    /*! @brief Per stage latency of this instance (debug.trace). Declared before the pool: the workers record into it.*/
+    DAWn::Trace::Tracer mTrace {};
+    /*!
+     * @brief Decodes the inbound peers in parallel, options.decodeworkers threads.
+     */
+    Mixer::DecodePool<DecodeJob> mDecodePool {};
 
     /*!
-     * @brief Encode A vector of blocks and push them thru outlet interface
-     * */
-    void packEncodeAndPush(std::vector<Mixer::Block>& blocks, uint32_t timeStamp);
+     * @brief One step of the outbound bitrate adaptation. Runs on the encoder thread.
+     */
+    void adaptBitrate(OpusImpl::CODEC& codec);
+    /*! @brief Encoded packets between bitrate adaptation steps (half a second of 480 samples packets).*/
+    static constexpr size_t kBitrateAdaptationPackets = 50;
+    /*! @brief Adapts the outbound bitrate between audio.minbitrate and audio.maxbitrate.*/
+    OpusImpl::BitrateController mBitrateController {};
+
+    /*!
+     * @brief Encode and push through the outlet: interleaves into mRealtimeScratch and only looks the own entry
+     * up (prepareOwnPeer creates it). Blocks are dropped if it does not exist yet.
+     *
+     * Audio thread only: it is the single producer of the own encoder BSA, in every role.
+     */
+    void packEncodeAndPush(Mixer::ConstChannels blocks, uint32_t timeStamp, uint64_t captureNs = 0);
+    /*!
+     * @brief Push one interleaved frame to the own encoder BSA.
+     * @param captureNs When processBlock got the frame, for DAWn::Trace. 0 is now.
+     */
+    void pushToEncoder(CodecPair& codecPair, std::span<const float> interleaved, uint32_t timeStamp, uint64_t captureNs = 0);
+    /*!
+     * @brief Create, off the audio thread, what processBlock needs for the current user ID: its codec and BSAs and
+     * its lane in the mixers. The next block pushed re-anchors the encoder timestamps.
+     */
+    void prepareOwnPeer();
+    /*! @brief The own encoder BSA was created ahead of time, re-anchor it on the next push.*/
+    std::atomic<bool> bReanchorEncoder{false};
+
+    /*!
+     * @brief What processBlock works on. Sized in prepareToPlay: the audio thread does not allocate, lock or print.
+     */
+    struct
+    {
+        /*! @brief The DAW input, one block per channel.*/
+        Mixer::PlanarBuffer             daw{};
+        /*! @brief The mixed blocks the Mixer role broadcasts.*/
+        Mixer::PlanarBuffer             mixed{};
+        /*! @brief One encoder frame, the channels interleaved.*/
+        std::vector<float>              interleaved{};
+        /*! @brief Views on the output channels of the DAW buffer, re-pointed every block.*/
+        std::vector<std::span<float>>   output{};
+    } mRealtimeScratch;
+    /*! @brief IsValidPlugin, cached in the constructor. It may allocate, the audio thread reads this instead.*/
+    bool mValidPlugin{false};
 
 
     /*!
@@ -186,6 +299,11 @@ private:
      */
     std::vector<Mixer::AudioMixerBlock> mAudioMixerBlocks {};
 
+    /*!
+     * @brief Drops late and duplicate packets before decoding and sets the playout delay of mAudioMixerBlocks.
+     */
+    Mixer::JitterBuffer mJitterBuffer {};
+
     /*!
      * @brief The Transport Interface. Identifier of the Stream Session.
      */
@@ -215,20 +333,29 @@ private:
      *     OPUSDECODER[USERID][1] => BSADAPTER[USERID][3]   => INTERLEAVED CHANNEL[PAIR1]
      *     OPUSDECODER[USERID][2] => BSADAPTER[USERID][5]   => INTERLEAVED CHANNEL[PAIRN]
      *
+     * The encoder and mixer threads walk the table while the network thread adds peers and the websocket removes
+     * them: it is a lock free read, copy on write table (see Mixer::PeerTable).
      */
-    std::mutex mOpusCodecMapMutex;
-    std::map<Mixer::TUserID, std::pair<OpusImpl::CODEC, std::vector<Utilities::Buffer::BlockSizeAdapter>>> mOpusCodecMap {};
+    PeerTable mPeers {};
     std::thread mDAWPlaybackEvents;
     std::thread mOpusEncoderMapThreadManager;
     std::thread mAudioMixerThreadManager;
+    /*! @brief Wake up the encoder thread. Notified by the output BSAs (bsa[0]) on push.*/
+    DAWn::Events::Notifier mEncoderWakeUp;
+    /*! @brief Wake up the mixer thread. Notified by the input BSAs (bsa[1]) on push.*/
+    DAWn::Events::Notifier mMixerWakeUp;
     std::thread mWebSocketSorcery;
     /*!
      * @brief The Opus Codec for the user ID.
      * @param userID The user ID.
      * @param timeStamp In case the BSA adapter is not being used before, it will be created and will be assigned the timeStamp.
-     * @return A reference to the Opus Codec.
+     * @return The codec and BSAs of the user, shared with the table.
+     */
+    PeerTable::Entry getCodecPairForUser(Mixer::TUserID, uint32_t timeStamp = 0);
+    /*!
+     * @brief Drop the codec, BSAs and jitter state of a user. Work already queued for it keeps its entry alive until done.
      */
-    std::pair<OpusImpl::CODEC, std::vector<Utilities::Buffer::BlockSizeAdapter>>& getCodecPairForUser(Mixer::TUserID, uint32_t timeStamp = 0);
+    void removePeer(Mixer::TUserID userID);
 
     /*********** BACKEND COMMANDS ***********/
     void startRTP(std::string ip, int port);
@@ -267,9 +394,12 @@ private:
      */
     void backendConnected(const char*);
 
-    /*! @brief Set Mixers and BSAs to ZERO */
+    /*! @brief Set Mixers and BSAs to ZERO. The input BSAs are reset by their decode worker, see BlockSizeAdapter::requestReset.*/
     void generalCacheReset(uint32_t timeStamp);
 
+    /*! @brief Jitter buffer bounds from the configuration. A fixed delayseconds delay if the jitter buffer is disabled.*/
+    Mixer::JitterBuffer::Settings jitterBufferSettings() const;
+
     /******** GUI ********/
     std::pair<float, float> rmsLevelsInputAudioBuffer {0.0f, 0.0f}; //first LEFT, second RIGHT
     std::pair<float, float> rmsLevelsJitterBuffer{0.0f, 0.0f};
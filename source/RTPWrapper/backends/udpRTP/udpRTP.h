@@ -9,6 +9,7 @@
 #define UDPRTP_MAXSIZE 512
 
 #include "xlet.h"
+#include "Retransmission.h"
 using sessiontoken  = uint64_t;
 using streamtoken   = xlet::UDPInOut;
 
@@ -21,6 +22,7 @@ class UDPRTPWrap : public RTPWrap
 
 public:
     UDPRTPWrap() : RTPWrap() {}
+    ~UDPRTPWrap() override;
     uint64_t Initialize() override;
     /**
      * @brief Create a session and return a session handle.
@@ -38,20 +40,65 @@ public:
     uint64_t CreateStream(uint64_t sessionId, int remotePort, int direction) override;
     uint64_t CreateLoopBackStream (uint64_t sessionId, std::string remoteIp, int remotePort, int userId);
     bool PushFrame(std::vector<std::byte> pData, uint64_t streamId, uint32_t timestamp) override;
+    /*! @brief [Wire header | payload] written into a buffer recycled by the stream. No allocation once the stream runs.*/
+    bool PushFrame(std::span<const std::byte> payload, uint64_t streamId, uint32_t timestamp) override;
+    /*! @brief A buffer recycled by the stream, with the headroom for the wire header.*/
+    std::vector<std::byte> TakeFrame(uint64_t streamId, size_t maxPayload) override;
+    bool PushFrame(std::vector<std::byte>&& frame, size_t payloadBytes, uint64_t streamId, uint32_t timestamp) override;
+    bool PushCommand(uint8_t command, uint64_t streamId, uint32_t timestamp) override;
+    bool PushProbe(uint64_t streamId) override;
+    void MarkDiscontinuity() override;
+    /*! @brief Per peer jitter, loss and round trip, from the RTCP reports on the stream sockets.*/
+    std::vector<DAWn::Rtcp::PeerStats> GetStats() const override;
+    double GetRoundTripMs(uint32_t source) const override;
+    bool PushNack(uint64_t streamId, uint32_t source, std::span<const uint32_t> timeStamps) override;
     bool DestroyStream(uint64_t streamId) override;
     bool DestroySession(uint64_t sessionId) override;
     void Shutdown() override;
 
     //Outbound CODEC
     inline uint32_t GetUID() const { return __uid; }
-    bool __dataIsCached (uint64_t streamId, uint32_t timestamp);
-    void __cacheData (uint32_t timestamp, std::vector<std::byte>& data);
-    void __clearCache();
     uint64_t GetPeerID() const { return __peerId; }
+    /*! @brief The sequence number the next datagram will carry.*/
+    inline uint16_t GetSequence() const { return __sequence.load(std::memory_order_relaxed); }
+    /*! @brief Socket I/O options for the streams created from now on.*/
+    inline void SetUDPOptions(const xlet::UDPOptions& options) { __udpOptions = options; }
+    /*! @brief Time stamp units per second, for the jitter. Set before creating the streams.*/
+    inline void SetClockRate(uint32_t clockRate) { __clockRate = clockRate; }
+    /*!
+     * @brief Keep the last packets audio datagrams to send them again when a peer asks. 0 disables it.
+     * @param packetSamples Time stamp step between two audio datagrams.
+     */
+    inline void SetRetransmission(size_t packets, size_t packetSamples) { __rtx.reset(packets, packetSamples); }
+    inline DAWn::Rtx::Ring::Stats GetRetransmissionStats() const { return __rtx.stats(); }
+    /*! @brief Mean time between RTCP reports.*/
+    inline void SetReportInterval(DAWn::Rtcp::Clock::duration interval) { __rtcp.setInterval(interval); }
 private:
 
     /*! \brief The peer id in the network (THIS IS NOT A DAW AudioStream User ID)*/
     uint64_t __peerId{0};
     uint32_t __uid{0};
+    /*! \brief One sequence for every datagram of this sender (RTP): the encoder and the command senders share it.*/
+    std::atomic<uint16_t> __sequence{0};
+
+    /*! \brief The first audio frame of a stream and the one after a jump carry the marker.*/
+    std::atomic<bool> __discontinuity{true};
+    uint32_t __clockRate{48000};
+    DAWn::Rtcp::Session __rtcp{};
+    DAWn::Rtx::Ring __rtx{};
+    /*! \brief The inbound slot of each stream, it feeds the RTCP statistics.*/
+    std::unordered_map<uint64_t, size_t> __watchSlots{};
+
+    /*! \brief Write the wire header into the headroom of frame and queue it. frame holds the header and payloadBytes.*/
+    bool __push(std::vector<std::byte>&& frame, size_t payloadBytes, uint64_t streamId, DAWn::Wire::PayloadType type, uint32_t timestamp);
+    /*! \brief Connect the RTCP side to the inbound datagrams of the stream.*/
+    void __watch(uint64_t streamId, xlet::UDPInOut& stream);
+    /*! \brief Every inbound datagram: RTP goes to the statistics, RTCP to the round trip. Network thread.*/
+    void __onDatagram(uint64_t streamId, std::span<const std::byte> datagram);
+    /*! \brief Send an SR / RR on the stream if one is due.*/
+    void __report(uint64_t streamId);
+    /*! \brief Send the audio datagram of timestamp again, if the ring still has it.*/
+    void __retransmit(uint64_t streamId, uint32_t timestamp);
+    xlet::UDPOptions __udpOptions{};
 };
 #endif //AUDIOSTREAMPLUGIN_UDPRTP_H
@@ -7,36 +7,33 @@
 //
 #include "RTPWrap.h"
 
-#include <unordered_map>
+#include <span>
+#include <cstring>
+#include <algorithm>
 
-struct DataCache : std::unordered_map<uint32_t, std::vector<std::byte>>
-{
-
-    bool IsCached(uint32_t ts)
-    {
-        auto it = this->find(ts);
-        if (it == this->end()) return false;
-        return true;
-    }
-
-    std::vector<std::byte>& GetCached(uint32_t ts)
-    {
-        return this->at(ts);
-    }
-
-    void Cache(uint32_t ts, std::vector<std::byte> data)
-    {
-        this->operator[](ts) = data;
-    }
-
-};
-static DataCache __dataCache{};
 static uint32_t generateUniqueID() {
     static std::mt19937 generator(std::random_device{}()); // Initialize once with a random seed
     std::uniform_int_distribution<uint32_t> distribution;
     return distribution(generator);
 }
 
+/*!
+ * @brief Commands and probes (DAWn::Wire payload types) go through the never-drop lanes of the stream.
+ */
+static bool isControlCommand(std::span<const std::byte> datagram)
+{
+    return DAWn::Wire::isControl(datagram);
+}
+
+UDPRTPWrap::~UDPRTPWrap()
+{
+    //The streams outlive this wrap in the index, their slots must not call back into it.
+    for (auto& [streamId, slotId] : __watchSlots)
+    {
+        if (auto pStrm = _rtpwrap::data::GetStream(streamId)) pStrm->letDataFromPeerIsReady.Disconnect(slotId);
+    }
+}
+
 uint64_t UDPRTPWrap::Initialize()
 {
     return 0;
@@ -61,18 +58,30 @@ uint64_t UDPRTPWrap::CreateStream(uint64_t sessionId, int remotePort, int userId
     __peerId                = xlet::UDPlet::sockAddToPeerId(sckaddr);
 
     //IP, Port, Do not bind or listen, is qsynced to send and receive data.
-    auto streamID           = _rtpwrap::data::IndexStream(sessionId, std::shared_ptr<xlet::UDPInOut>(new xlet::UDPInOut (remoteIp, remotePort, false, true)));
+    auto stream             = std::shared_ptr<xlet::UDPInOut>(new xlet::UDPInOut (remoteIp, remotePort, false, true, false, __udpOptions));
+    stream->setControlClassifier(isControlCommand);
+    auto streamID           = _rtpwrap::data::IndexStream(sessionId, stream);
+    __watch(streamID, *stream);
     return streamID;
 }
 uint64_t UDPRTPWrap::CreateLoopBackStream(uint64_t sessionId, std::string remoteIp, int remotePort, int userId = 0)
 {
     auto ui32userId = static_cast<uint32_t>(userId);
     __uid = userId != 0 ? ui32userId : generateUniqueID();
-    auto streamID = _rtpwrap::data::IndexStream(sessionId, std::shared_ptr<xlet::UDPInOut>(new xlet::UDPInOut (remoteIp, remotePort, false, true, true)));
+    auto stream = std::shared_ptr<xlet::UDPInOut>(new xlet::UDPInOut (remoteIp, remotePort, false, true, true, __udpOptions));
+    stream->setControlClassifier(isControlCommand);
+    auto streamID = _rtpwrap::data::IndexStream(sessionId, stream);
+    __watch(streamID, *stream);
     return streamID;
 }
 bool UDPRTPWrap::DestroyStream(uint64_t streamId)
 {
+    auto slot = __watchSlots.find(streamId);
+    if (slot != __watchSlots.end())
+    {
+        if (auto pStrm = _rtpwrap::data::GetStream(streamId)) pStrm->letDataFromPeerIsReady.Disconnect(slot->second);
+        __watchSlots.erase(slot);
+    }
     return _rtpwrap::data::RemoveStream(streamId);
 }
 bool UDPRTPWrap::DestroySession(uint64_t sessionId)
@@ -87,44 +96,157 @@ void UDPRTPWrap::Shutdown()
 
 bool UDPRTPWrap::PushFrame(std::vector<std::byte> pData, uint64_t streamId, uint32_t timestamp)
 {
-    auto pStrm = _rtpwrap::data::GetStream(streamId);
-    if (!pStrm) return false;
-
-    auto pts = reinterpret_cast<std::byte*>(&timestamp);
-    auto puid = reinterpret_cast<std::byte*>(&__uid);
-
-    pData.insert(pData.begin(), pts, pts+4);    //[TS | DATA]
-    pData.insert(pData.begin(), puid, puid+4);  //[UID | TS | DATA]
-
     if (pData.size() == 0)
     {
         std::cout << "NO DATA !!!!!!!!!!!!!!!!!!!!!" << std::endl;
     }
-    pStrm->push_back(xlet::Data{.first = __peerId, .second = pData}, xlet::Direction::OUTB);
-
+    return PushFrame(std::span<const std::byte>(pData), streamId, timestamp);
+}
+bool UDPRTPWrap::PushFrame(std::span<const std::byte> payload, uint64_t streamId, uint32_t timestamp)
+{
+    auto frame = TakeFrame(streamId, payload.size());
+    std::copy(payload.begin(), payload.end(), frame.begin() + DAWn::Wire::kHeaderSize);   //[ | DATA]
+    return __push(std::move(frame), payload.size(), streamId, DAWn::Wire::PayloadType::Audio, timestamp);
+}
+std::vector<std::byte> UDPRTPWrap::TakeFrame(uint64_t streamId, size_t maxPayload)
+{
+    auto pStrm = _rtpwrap::data::GetStream(streamId);
+    auto frame = pStrm ? pStrm->takeBuffer() : std::vector<std::byte>{};
+    frame.resize(DAWn::Wire::kHeaderSize + maxPayload);
+    return frame;
+}
+bool UDPRTPWrap::PushFrame(std::vector<std::byte>&& frame, size_t payloadBytes, uint64_t streamId, uint32_t timestamp)
+{
+    return __push(std::move(frame), payloadBytes, streamId, DAWn::Wire::PayloadType::Audio, timestamp);
+}
+bool UDPRTPWrap::PushCommand(uint8_t command, uint64_t streamId, uint32_t timestamp)
+{
+    auto frame = TakeFrame(streamId, 1);
+    frame[DAWn::Wire::kHeaderSize] = static_cast<std::byte>(command);
+    return __push(std::move(frame), 1, streamId, DAWn::Wire::PayloadType::Command, timestamp);
+}
+bool UDPRTPWrap::PushProbe(uint64_t streamId)
+{
+    return __push(TakeFrame(streamId, 0), 0, streamId, DAWn::Wire::PayloadType::Probe, 0);
+}
+void UDPRTPWrap::MarkDiscontinuity()
+{
+    __discontinuity.store(true, std::memory_order_relaxed);
+}
+std::vector<DAWn::Rtcp::PeerStats> UDPRTPWrap::GetStats() const
+{
+    return __rtcp.stats();
+}
+double UDPRTPWrap::GetRoundTripMs(uint32_t source) const
+{
+    return __rtcp.rttMs(source);
+}
+bool UDPRTPWrap::PushNack(uint64_t streamId, uint32_t source, std::span<const uint32_t> timeStamps)
+{
+    auto pStrm = _rtpwrap::data::GetStream(streamId);
+    if (!pStrm || timeStamps.empty()) return false;
+
+    DAWn::Rtcp::Nack nack{};
+    nack.ssrc       = __uid;
+    nack.mediaSsrc  = source;
+    nack.count      = std::min(timeStamps.size(), DAWn::Rtcp::kMaxNackTimeStamps);
+    std::copy(timeStamps.begin(), timeStamps.begin() + static_cast<std::ptrdiff_t>(nack.count), nack.timeStamps.begin());
+
+    auto buffer = pStrm->takeBuffer();
+    buffer.resize(DAWn::Rtcp::kMaxNackSize);
+    buffer.resize(DAWn::Rtcp::write(nack, buffer));
+    pStrm->push_back(xlet::Data{std::move(buffer), __peerId}, xlet::Direction::OUTB);
     return true;
 }
-bool UDPRTPWrap::__dataIsCached (uint64_t streamId, uint32_t timestamp)
+bool UDPRTPWrap::__push(std::vector<std::byte>&& frame, size_t payloadBytes, uint64_t streamId, DAWn::Wire::PayloadType type, uint32_t timestamp)
 {
-    if(!__dataCache.IsCached(timestamp))
-        return false;
     auto pStrm = _rtpwrap::data::GetStream(streamId);
-    //Grab Cached Buffer and send
-    auto pData = __dataCache.GetCached(timestamp);
-    pStrm->push_back(xlet::Data{.first = __peerId, .second = pData}, xlet::Direction::OUTB);
+    if (!pStrm || frame.size() < DAWn::Wire::kHeaderSize + payloadBytes) return false;
+
+    DAWn::Wire::Header header{};
+    header.type         = type;
+    header.sequence     = __sequence.fetch_add(1, std::memory_order_relaxed);
+    header.timeStamp    = timestamp;
+    header.source       = __uid;
+    if (type == DAWn::Wire::PayloadType::Audio && __discontinuity.exchange(false, std::memory_order_relaxed))
+    {
+        header.flags |= DAWn::Wire::kFlagDiscontinuity;
+    }
+    DAWn::Wire::write(header, std::span<std::byte, DAWn::Wire::kHeaderSize>(frame.data(), DAWn::Wire::kHeaderSize)); //[HEADER | DATA]
+    frame.resize(DAWn::Wire::kHeaderSize + payloadBytes);
+    if (type == DAWn::Wire::PayloadType::Audio && __rtx.enabled()) __rtx.store(frame, timestamp);
+    pStrm->push_back(xlet::Data{std::move(frame), __peerId}, xlet::Direction::OUTB);
+    __rtcp.sent(header, payloadBytes);
+
+    if (__rtcp.reportDue(DAWn::Rtcp::Clock::now())) __report(streamId);
     return true;
+}
+
+void UDPRTPWrap::__watch(uint64_t streamId, xlet::UDPInOut& stream)
+{
+    __rtcp.reset(__uid, __clockRate);
+    __discontinuity.store(true, std::memory_order_relaxed);
+    __watchSlots[streamId] = stream.letDataFromPeerIsReady.Connect(
+        [this, streamId](uint64_t, const xlet::Packet& packet) {
+            __onDatagram(streamId, packet.span());
+        });
+}
 
+void UDPRTPWrap::__onDatagram(uint64_t streamId, std::span<const std::byte> datagram)
+{
+    auto now = DAWn::Rtcp::Clock::now();
+    if (DAWn::Rtcp::isRtcp(datagram))
+    {
+        DAWn::Rtcp::Report report{};
+        DAWn::Rtcp::Nack nack{};
+        if (DAWn::Rtcp::read(datagram, report)) __rtcp.received(report, now, DAWn::Rtcp::ntpNow());
+        else if (DAWn::Rtcp::read(datagram, nack) && nack.mediaSsrc == __uid)
+        {
+            for (auto index = 0ul; index < nack.count; ++index) __retransmit(streamId, nack.timeStamps[index]);
+        }
+    }
+    else
+    {
+        DAWn::Wire::Header header{};
+        if (DAWn::Wire::read(datagram, header)) __rtcp.received(header, now);
+    }
+    //A listener sends no media, its receiver reports go out from here.
+    if (__rtcp.reportDue(now)) __report(streamId);
 }
-void UDPRTPWrap::__cacheData (uint32_t timestamp, std::vector<std::byte>& pData)
+
+void UDPRTPWrap::__report(uint64_t streamId)
 {
-    auto pts = reinterpret_cast<std::byte*>(&timestamp);
-    auto puid = reinterpret_cast<std::byte*>(&__uid);
-    pData.insert(pData.begin(), pts, pts+4);    //[TS | DATA]
-    pData.insert(pData.begin(), puid, puid+4);  //[UID | TS | DATA]
-    __dataCache.Cache(timestamp, pData);
+    auto pStrm = _rtpwrap::data::GetStream(streamId);
+    if (!pStrm) return;
+
+    auto buffer = pStrm->takeBuffer();
+    buffer.resize(DAWn::Rtcp::kMaxReportSize);
+    auto size = __rtcp.writeReport(buffer, DAWn::Rtcp::Clock::now(), DAWn::Rtcp::ntpNow());
+    if (size == 0)
+    {
+        pStrm->recycleBuffer(std::move(buffer));
+        return;
+    }
+    buffer.resize(size);
+    //Audio lane: a report may be dropped, the next one supersedes it.
+    pStrm->push_back(xlet::Data{std::move(buffer), __peerId}, xlet::Direction::OUTB);
 }
 
-void UDPRTPWrap::__clearCache()
+void UDPRTPWrap::__retransmit(uint64_t streamId, uint32_t timestamp)
 {
-    __dataCache.clear();
-}
\ No newline at end of file
+    auto pStrm = _rtpwrap::data::GetStream(streamId);
+    if (!pStrm) return;
+
+    auto buffer = pStrm->takeBuffer();
+    if (!__rtx.take(timestamp, buffer))
+    {
+        pStrm->recycleBuffer(std::move(buffer));
+        return;
+    }
+    //Same sequence and time stamp, flagged: the receivers do not count it as jitter.
+    DAWn::Wire::Header header{};
+    if (!DAWn::Wire::read(buffer, header)) return;
+    header.flags |= DAWn::Wire::kFlagRetransmission;
+    DAWn::Wire::write(header, std::span<std::byte, DAWn::Wire::kHeaderSize>(buffer.data(), DAWn::Wire::kHeaderSize));
+    pStrm->push_back(xlet::Data{std::move(buffer), __peerId}, xlet::Direction::OUTB);
+}
@@ -20,9 +20,11 @@
 
 
 #include <map>
+#include <span>
 #include <random>
 #include <string>
 #include <cstdint>
+#include <cstring>
 #include <functional>
 
 #include <unistd.h>
@@ -30,6 +32,8 @@
 #include <sys/socket.h>
 
 #include "opusImpl.h"
+#include "WireFormat.h"
+#include "Rtcp.h"
 
 
 
@@ -85,6 +89,88 @@ class RTPWrap {
      */
     virtual bool PushFrame (std::vector<std::byte> pData, uint64_t streamId, uint32_t timestamp) = 0;
 
+    /**
+     * @brief Push a frame without handing over a vector. Backends that can, fill a recycled buffer and do not allocate.
+     * @param payload The encoded frame, copied before returning.
+     */
+    virtual bool PushFrame (std::span<const std::byte> payload, uint64_t streamId, uint32_t timestamp)
+    {
+        return PushFrame(std::vector<std::byte>(payload.begin(), payload.end()), streamId, timestamp);
+    }
+
+    /**
+     * @brief A frame buffer to encode into: DAWn::Wire::kHeaderSize bytes of headroom, then maxPayload bytes.
+     * Write the payload into DAWn::Wire::payload(frame) and hand the frame to PushFrame(frame, payloadBytes ...).
+     */
+    virtual std::vector<std::byte> TakeFrame (uint64_t streamId, size_t maxPayload)
+    {
+        (void)streamId;
+        return std::vector<std::byte>(DAWn::Wire::kHeaderSize + maxPayload);
+    }
+
+    /**
+     * @brief Push a frame taken with TakeFrame. The header is written into its headroom, the payload is not moved.
+     * @param payloadBytes The bytes of payload written after the headroom.
+     */
+    virtual bool PushFrame (std::vector<std::byte>&& frame, size_t payloadBytes, uint64_t streamId, uint32_t timestamp)
+    {
+        auto payload = DAWn::Wire::payload(frame);
+        if (payloadBytes > payload.size()) return false;
+        return PushFrame(std::span<const std::byte>(payload.first(payloadBytes)), streamId, timestamp);
+    }
+
+    /**
+     * @brief Send a playback command (DAWn::Wire::PayloadType::Command). Commands are never dropped by the stream.
+     * @return False if the backend can not carry commands.
+     */
+    virtual bool PushCommand (uint8_t command, uint64_t streamId, uint32_t timestamp)
+    {
+        (void)command; (void)streamId; (void)timestamp;
+        return false;
+    }
+
+    /**
+     * @brief Send a probe (DAWn::Wire::PayloadType::Probe): nothing to play, it opens the path to the relay.
+     */
+    virtual bool PushProbe (uint64_t streamId)
+    {
+        (void)streamId;
+        return false;
+    }
+
+    /**
+     * @brief The next audio frame starts after a gap in the time stamps (play, locate): it carries the RTP marker and
+     * the receivers do not count the jump as jitter.
+     */
+    virtual void MarkDiscontinuity () {}
+
+    /**
+     * @brief Reception and round trip statistics per peer, from RTCP. Empty if the backend has no RTCP.
+     */
+    virtual std::vector<DAWn::Rtcp::PeerStats> GetStats () const
+    {
+        return {};
+    }
+
+    /**
+     * @brief Round trip to a peer in ms, from RTCP. Negative if it is not known (yet).
+     */
+    virtual double GetRoundTripMs (uint32_t source) const
+    {
+        (void)source;
+        return -1.0;
+    }
+
+    /**
+     * @brief Ask source to send the packets of timeStamps again (DAWn::Rtcp::Nack).
+     * @return False if the backend can not retransmit.
+     */
+    virtual bool PushNack (uint64_t streamId, uint32_t source, std::span<const uint32_t> timeStamps)
+    {
+        (void)streamId; (void)source; (void)timeStamps;
+        return false;
+    }
+
     /**
      * @brief Shutdown the RTP wrapper.
      *
@@ -0,0 +1,58 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+#include "Retransmission.h"
+
+#include <algorithm>
+
+namespace DAWn::Rtx
+{
+    void Ring::reset(size_t packets, size_t packetSamples)
+    {
+        std::lock_guard lock(mMutex);
+        mPackets = packets;
+        mPacketSamples = static_cast<uint32_t>(std::max<size_t>(packetSamples, 1));
+        mSlots.assign(packets, Slot{});
+        mStorage.assign(packets * kSlotBytes, std::byte{0});
+        mStats = Stats{};
+    }
+
+    bool Ring::store(std::span<const std::byte> datagram, uint32_t timeStamp)
+    {
+        std::lock_guard lock(mMutex);
+        if (mPackets == 0) return false;
+        if (datagram.size() > kSlotBytes)
+        {
+            ++mStats.tooBig;
+            return false;
+        }
+        auto index = slotIndex(timeStamp);
+        std::copy(datagram.begin(), datagram.end(), mStorage.begin() + static_cast<std::ptrdiff_t>(index * kSlotBytes));
+        mSlots[index] = Slot{timeStamp, static_cast<uint16_t>(datagram.size()), true, false};
+        ++mStats.stored;
+        return true;
+    }
+
+    bool Ring::take(uint32_t timeStamp, std::vector<std::byte>& dst)
+    {
+        std::lock_guard lock(mMutex);
+        if (mPackets == 0) return false;
+        auto& slot = mSlots[slotIndex(timeStamp)];
+        if (!slot.bValid || slot.bServed || slot.timeStamp != timeStamp)
+        {
+            ++mStats.missed;
+            return false;
+        }
+        auto begin = mStorage.begin() + static_cast<std::ptrdiff_t>(slotIndex(timeStamp) * kSlotBytes);
+        dst.assign(begin, begin + slot.size);
+        slot.bServed = true;
+        ++mStats.served;
+        return true;
+    }
+
+    Ring::Stats Ring::stats() const
+    {
+        std::lock_guard lock(mMutex);
+        return mStats;
+    }
+}
@@ -0,0 +1,80 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+
+#ifndef AUDIOSTREAMPLUGIN_RETRANSMISSION_H
+#define AUDIOSTREAMPLUGIN_RETRANSMISSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <vector>
+
+namespace DAWn::Rtx
+{
+    /*!
+     * @brief The last datagrams a sender sent, kept to send them again when a receiver asks (Rtcp::Nack).
+     *
+     * A fixed ring of slots, allocated once by reset: a datagram lives in slot (timeStamp / packetSamples) % packets
+     * until a newer one takes the slot. Lookup is by time stamp. A datagram is sent again at most once, the relay
+     * fans it out to every receiver that lost it.
+     *
+     * store runs on the encoder thread, take on the network thread.
+     */
+    class Ring
+    {
+    public:
+        /*! @brief The UDP payload of a 1500 bytes MTU. Bigger datagrams are not kept.*/
+        static constexpr size_t kSlotBytes = 1472;
+
+        struct Stats
+        {
+            uint64_t stored{0};
+            uint64_t tooBig{0};
+            /*! @brief Asked and sent again.*/
+            uint64_t served{0};
+            /*! @brief Asked, but overwritten, never kept or already sent again.*/
+            uint64_t missed{0};
+        };
+
+        /*!
+         * @brief Drop everything and keep up to packets datagrams from now on. 0 disables the ring.
+         * @param packetSamples Time stamp step between two datagrams.
+         */
+        void reset(size_t packets, size_t packetSamples);
+
+        inline bool enabled() const { return mPackets != 0; }
+
+        /*! @brief Keep datagram (header included) as the one of timeStamp. @return False if it is not kept.*/
+        bool store(std::span<const std::byte> datagram, uint32_t timeStamp);
+
+        /*!
+         * @brief The datagram of timeStamp, copied into dst (resized), if it is still kept and was not sent again yet.
+         * @return False if it is gone.
+         */
+        bool take(uint32_t timeStamp, std::vector<std::byte>& dst);
+
+        Stats stats() const;
+
+    private:
+        struct Slot
+        {
+            uint32_t    timeStamp{0};
+            uint16_t    size{0};
+            bool        bValid{false};
+            bool        bServed{false};
+        };
+
+        inline size_t slotIndex(uint32_t timeStamp) const { return (timeStamp / mPacketSamples) % mPackets; }
+
+        mutable std::mutex      mMutex;
+        size_t                  mPackets{0};
+        uint32_t                mPacketSamples{1};
+        std::vector<Slot>       mSlots{};
+        std::vector<std::byte>  mStorage{};
+        Stats                   mStats{};
+    };
+}
+
+#endif //AUDIOSTREAMPLUGIN_RETRANSMISSION_H
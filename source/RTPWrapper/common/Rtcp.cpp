@@ -0,0 +1,422 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+#include "Rtcp.h"
+
+#include <algorithm>
+
+namespace DAWn::Rtcp
+{
+    namespace
+    {
+        constexpr uint32_t kSequenceModulo  = 1u << 16;
+        constexpr uint32_t kMaxDropout      = 3000;
+        constexpr uint32_t kMaxMisorder     = 100;
+        /*! @brief Seconds from 1900 (NTP) to 1970 (system clock).*/
+        constexpr uint64_t kNtpUnixOffset   = 2208988800ull;
+        /*! @brief A source silent for this many intervals is no longer reported (RFC 3550 6.3.5).*/
+        constexpr int      kTimeoutIntervals = 5;
+
+        void put16(std::byte* dst, uint16_t value)
+        {
+            dst[0] = static_cast<std::byte>(value >> 8);
+            dst[1] = static_cast<std::byte>(value);
+        }
+        void put32(std::byte* dst, uint32_t value)
+        {
+            put16(dst, static_cast<uint16_t>(value >> 16));
+            put16(dst + 2, static_cast<uint16_t>(value));
+        }
+        uint16_t get16(const std::byte* src)
+        {
+            return static_cast<uint16_t>((std::to_integer<uint16_t>(src[0]) << 8) | std::to_integer<uint16_t>(src[1]));
+        }
+        uint32_t get32(const std::byte* src)
+        {
+            return (static_cast<uint32_t>(get16(src)) << 16) | get16(src + 2);
+        }
+
+        bool isReport(uint8_t type) { return type == kSenderReport || type == kReceiverReport; }
+
+        constexpr std::array<std::byte, 4> kNackName{std::byte{'D'}, std::byte{'N'}, std::byte{'A'}, std::byte{'K'}};
+
+        /*!
+         * @brief Walk the packets of a compound RTCP packet.
+         * @param visit Called with the type and the bytes of each packet, returns true to stop.
+         * @return True if visit stopped the walk.
+         */
+        template <typename Visit>
+        bool walk(std::span<const std::byte> datagram, Visit&& visit)
+        {
+            auto offset = 0ul;
+            while (offset + 4 <= datagram.size())
+            {
+                auto p = datagram.data() + offset;
+                auto length = (static_cast<size_t>(get16(p + 2)) + 1) * 4;
+                if ((std::to_integer<uint8_t>(p[0]) >> 6) != DAWn::Wire::kVersion || offset + length > datagram.size()) return false;
+                offset += length;
+                if (visit(std::to_integer<uint8_t>(p[1]), datagram.subspan(offset - length, length))) return true;
+            }
+            return false;
+        }
+    }
+
+    bool isRtcp(std::span<const std::byte> datagram)
+    {
+        if (datagram.size() < 8) return false;
+        auto type = std::to_integer<uint8_t>(datagram[1]);
+        return (std::to_integer<uint8_t>(datagram[0]) >> 6) == DAWn::Wire::kVersion && type >= 200 && type <= 204;
+    }
+
+    size_t write(const Report& report, std::span<std::byte> dst)
+    {
+        auto count = std::min(report.count, kMaxReportBlocks);
+        auto bSender = report.type == kSenderReport;
+        auto size = 8 + (bSender ? 20 : 0) + count * kReportBlockSize;
+        if (dst.size() < size) return 0;
+
+        auto p = dst.data();
+        p[0] = static_cast<std::byte>((DAWn::Wire::kVersion << 6) | count);
+        p[1] = static_cast<std::byte>(bSender ? kSenderReport : kReceiverReport);
+        put16(p + 2, static_cast<uint16_t>(size / 4 - 1));
+        put32(p + 4, report.ssrc);
+        p += 8;
+        if (bSender)
+        {
+            put32(p, static_cast<uint32_t>(report.ntpTime >> 32));
+            put32(p + 4, static_cast<uint32_t>(report.ntpTime));
+            put32(p + 8, report.rtpTimeStamp);
+            put32(p + 12, report.packetCount);
+            put32(p + 16, report.octetCount);
+            p += 20;
+        }
+        for (auto index = 0ul; index < count; ++index, p += kReportBlockSize)
+        {
+            auto& block = report.blocks[index];
+            auto lost = std::clamp(block.cumulativeLost, -0x800000, 0x7fffff);
+            put32(p, block.ssrc);
+            put32(p + 4, (static_cast<uint32_t>(block.fractionLost) << 24) | (static_cast<uint32_t>(lost) & 0xffffff));
+            put32(p + 8, block.highestSequence);
+            put32(p + 12, block.jitter);
+            put32(p + 16, block.lastSenderReport);
+            put32(p + 20, block.delaySinceLastSenderReport);
+        }
+        return size;
+    }
+
+    bool read(std::span<const std::byte> datagram, Report& report)
+    {
+        return walk(datagram, [&report](uint8_t type, std::span<const std::byte> packet) {
+            if (!isReport(type)) return false;
+            auto p = packet.data();
+            auto count = static_cast<size_t>(std::to_integer<uint8_t>(p[0]) & 0x1f);
+            auto bSender = type == kSenderReport;
+            if (packet.size() < 8 + (bSender ? 20 : 0) + count * kReportBlockSize) return false;
+
+            report.type = type;
+            report.ssrc = get32(p + 4);
+            p += 8;
+            if (bSender)
+            {
+                report.ntpTime      = (static_cast<uint64_t>(get32(p)) << 32) | get32(p + 4);
+                report.rtpTimeStamp = get32(p + 8);
+                report.packetCount  = get32(p + 12);
+                report.octetCount   = get32(p + 16);
+                p += 20;
+            }
+            report.count = count;
+            for (auto index = 0ul; index < count; ++index, p += kReportBlockSize)
+            {
+                auto& block = report.blocks[index];
+                auto lost = get32(p + 4);
+                block.ssrc              = get32(p);
+                block.fractionLost      = static_cast<uint8_t>(lost >> 24);
+                //Sign extend the 24 bits.
+                block.cumulativeLost    = static_cast<int32_t>((lost & 0xffffff) << 8) >> 8;
+                block.highestSequence   = get32(p + 8);
+                block.jitter            = get32(p + 12);
+                block.lastSenderReport  = get32(p + 16);
+                block.delaySinceLastSenderReport = get32(p + 20);
+            }
+            return true;
+        });
+    }
+
+    size_t write(const Nack& nack, std::span<std::byte> dst)
+    {
+        auto count = std::min(nack.count, kMaxNackTimeStamps);
+        auto size = 16 + count * 4;
+        if (dst.size() < size) return 0;
+
+        auto p = dst.data();
+        p[0] = static_cast<std::byte>(DAWn::Wire::kVersion << 6);
+        p[1] = static_cast<std::byte>(kApplication);
+        put16(p + 2, static_cast<uint16_t>(size / 4 - 1));
+        put32(p + 4, nack.ssrc);
+        std::copy(kNackName.begin(), kNackName.end(), p + 8);
+        put32(p + 12, nack.mediaSsrc);
+        for (auto index = 0ul; index < count; ++index) put32(p + 16 + index * 4, nack.timeStamps[index]);
+        return size;
+    }
+
+    bool read(std::span<const std::byte> datagram, Nack& nack)
+    {
+        return walk(datagram, [&nack](uint8_t type, std::span<const std::byte> packet) {
+            if (type != kApplication || packet.size() < 16 || !std::equal(kNackName.begin(), kNackName.end(), packet.begin() + 8)) return false;
+            auto p = packet.data();
+            nack.ssrc       = get32(p + 4);
+            nack.mediaSsrc  = get32(p + 12);
+            nack.count      = std::min((packet.size() - 16) / 4, kMaxNackTimeStamps);
+            for (auto index = 0ul; index < nack.count; ++index) nack.timeStamps[index] = get32(p + 16 + index * 4);
+            return true;
+        });
+    }
+
+    uint64_t ntpNow()
+    {
+        auto sinceUnix = std::chrono::system_clock::now().time_since_epoch();
+        auto seconds = std::chrono::duration_cast<std::chrono::seconds>(sinceUnix);
+        auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(sinceUnix - seconds).count();
+        auto fraction = (static_cast<uint64_t>(nanoseconds) << 32) / 1000000000ull;
+        return ((static_cast<uint64_t>(seconds.count()) + kNtpUnixOffset) << 32) | fraction;
+    }
+
+    // SOURCE STATISTICS
+
+    void SourceStatistics::restart(uint16_t sequence)
+    {
+        mBaseSequence   = sequence;
+        mMaxSequence    = sequence;
+        mBadSequence    = kSequenceModulo + 1;
+        mCycles         = 0;
+        mReceived       = 0;
+        mReceivedPrior  = 0;
+        mExpectedPrior  = 0;
+    }
+
+    bool SourceStatistics::received(const DAWn::Wire::Header& header, uint32_t arrival)
+    {
+        auto sequence = header.sequence;
+        if (!bValid)
+        {
+            //No probation: one sender per random 32 bit id, a collision is not worth the packets.
+            restart(sequence);
+            bValid = true;
+        }
+        else
+        {
+            auto delta = static_cast<uint16_t>(sequence - mMaxSequence);
+            if (delta < kMaxDropout)
+            {
+                if (sequence < mMaxSequence) mCycles += kSequenceModulo;
+                mMaxSequence = sequence;
+            }
+            else if (delta <= kSequenceModulo - kMaxMisorder)
+            {
+                //A big jump: the sender restarted if the next one follows it.
+                if (sequence != mBadSequence)
+                {
+                    mBadSequence = (sequence + 1u) & (kSequenceModulo - 1);
+                    return false;
+                }
+                restart(sequence);
+            }
+            //Otherwise a duplicate or out of order packet.
+        }
+        ++mReceived;
+
+        //Only audio time stamps run with the media clock, commands carry the play head. A retransmission is late on purpose.
+        if (header.type != DAWn::Wire::PayloadType::Audio || (header.flags & DAWn::Wire::kFlagRetransmission)) return true;
+        if (header.flags & DAWn::Wire::kFlagDiscontinuity) bTransitValid = false;
+        auto transit = arrival - header.timeStamp;
+        if (bTransitValid)
+        {
+            auto difference = static_cast<int32_t>(transit - mTransit);
+            auto d = static_cast<uint32_t>(difference < 0 ? -difference : difference);
+            mJitter += d - ((mJitter + 8) >> 4);
+        }
+        mTransit = transit;
+        bTransitValid = true;
+        return true;
+    }
+
+    int32_t SourceStatistics::cumulativeLost() const
+    {
+        auto expected = static_cast<int64_t>(mCycles) + mMaxSequence - mBaseSequence + 1;
+        return static_cast<int32_t>(std::clamp<int64_t>(expected - static_cast<int64_t>(mReceived), -0x800000, 0x7fffff));
+    }
+
+    ReportBlock SourceStatistics::report(uint32_t ssrc)
+    {
+        auto extended = mCycles + mMaxSequence;
+        auto expected = static_cast<uint64_t>(extended) - mBaseSequence + 1;
+        auto expectedInterval = static_cast<int64_t>(expected - mExpectedPrior);
+        auto receivedInterval = static_cast<int64_t>(mReceived - mReceivedPrior);
+        auto lostInterval = expectedInterval - receivedInterval;
+        mExpectedPrior = expected;
+        mReceivedPrior = mReceived;
+        mLastFractionLost = (expectedInterval == 0 || lostInterval <= 0) ? 0 : static_cast<uint8_t>(std::min<int64_t>((lostInterval << 8) / expectedInterval, 255));
+
+        ReportBlock block{};
+        block.ssrc              = ssrc;
+        block.fractionLost      = mLastFractionLost;
+        block.cumulativeLost    = cumulativeLost();
+        block.highestSequence   = extended;
+        block.jitter            = jitter();
+        return block;
+    }
+
+    // SESSION
+
+    Session::Session() : mRandom(std::random_device{}())
+    {
+    }
+
+    void Session::reset(uint32_t ssrc, uint32_t clockRate)
+    {
+        std::lock_guard lock(mMutex);
+        mSsrc.store(ssrc, std::memory_order_relaxed);
+        mPacketCount.store(0, std::memory_order_relaxed);
+        mOctetCount.store(0, std::memory_order_relaxed);
+        bSentSinceReport.store(false, std::memory_order_relaxed);
+        mClockRate = clockRate ? clockRate : 48000;
+        mSources.clear();
+        mEpoch = Clock::now();
+        //The first report goes out after half an interval (RFC 3550 6.2).
+        mNextReport.store((mEpoch + mInterval / 2).time_since_epoch().count(), std::memory_order_relaxed);
+    }
+
+    void Session::setInterval(Clock::duration interval)
+    {
+        std::lock_guard lock(mMutex);
+        mInterval = interval;
+        scheduleNext(Clock::now());
+    }
+
+    void Session::scheduleNext(Clock::time_point now)
+    {
+        std::uniform_real_distribution<double> randomized(0.5, 1.5);
+        auto next = now + std::chrono::duration_cast<Clock::duration>(mInterval * randomized(mRandom));
+        mNextReport.store(next.time_since_epoch().count(), std::memory_order_relaxed);
+    }
+
+    void Session::sent(const DAWn::Wire::Header& header, size_t payloadBytes)
+    {
+        mPacketCount.fetch_add(1, std::memory_order_relaxed);
+        mOctetCount.fetch_add(static_cast<uint32_t>(payloadBytes), std::memory_order_relaxed);
+        if (header.type == DAWn::Wire::PayloadType::Audio) mLastTimeStamp.store(header.timeStamp, std::memory_order_relaxed);
+        bSentSinceReport.store(true, std::memory_order_relaxed);
+    }
+
+    void Session::received(const DAWn::Wire::Header& header, Clock::time_point arrival)
+    {
+        std::lock_guard lock(mMutex);
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(arrival - mEpoch).count();
+        auto arrivalUnits = static_cast<uint32_t>(static_cast<uint64_t>(std::max<int64_t>(elapsed, 0)) * mClockRate / 1000000ull);
+        auto& source = mSources[header.source];
+        source.statistics.received(header, arrivalUnits);
+        source.lastHeard = arrival;
+    }
+
+    void Session::received(const Report& report, Clock::time_point arrival, uint64_t ntpTime)
+    {
+        std::lock_guard lock(mMutex);
+        auto& source = mSources[report.ssrc];
+        source.lastHeard = arrival;
+        if (report.type == kSenderReport)
+        {
+            source.lastSenderReport = ntpMiddle(report.ntpTime);
+            source.lastSenderReportArrival = arrival;
+        }
+
+        auto ssrc = mSsrc.load(std::memory_order_relaxed);
+        for (auto index = 0ul; index < report.count; ++index)
+        {
+            auto& block = report.blocks[index];
+            if (block.ssrc != ssrc) continue;
+            source.remote = block;
+            source.bRemote = true;
+            if (block.lastSenderReport == 0) break;
+            //RTT = A - LSR - DLSR (RFC 3550 6.4.1), 1/65536 seconds. Our own SR clock on both ends.
+            auto rtt = ntpMiddle(ntpTime) - block.lastSenderReport - block.delaySinceLastSenderReport;
+            if (rtt < 0x80000000u) source.rttMs = rtt * 1000.0 / 65536.0;
+            break;
+        }
+    }
+
+    size_t Session::writeReport(std::span<std::byte> dst, Clock::time_point now, uint64_t ntpTime)
+    {
+        std::lock_guard lock(mMutex);
+        if (now.time_since_epoch().count() < mNextReport.load(std::memory_order_relaxed)) return 0;
+
+        Report report{};
+        report.ssrc = mSsrc.load(std::memory_order_relaxed);
+        if (bSentSinceReport.exchange(false, std::memory_order_relaxed))
+        {
+            //The time stamp of the latest audio sent stands for ntpTime: the encoder runs close to real time.
+            report.type         = kSenderReport;
+            report.ntpTime      = ntpTime;
+            report.rtpTimeStamp = mLastTimeStamp.load(std::memory_order_relaxed);
+            report.packetCount  = mPacketCount.load(std::memory_order_relaxed);
+            report.octetCount   = mOctetCount.load(std::memory_order_relaxed);
+        }
+
+        auto timeout = mInterval * kTimeoutIntervals;
+        for (auto it = mSources.begin(); it != mSources.end();)
+        {
+            auto& [ssrc, source] = *it;
+            if (now - source.lastHeard > timeout)
+            {
+                it = mSources.erase(it);
+                continue;
+            }
+            if (source.statistics.isValid() && report.count < kMaxReportBlocks)
+            {
+                auto& block = report.blocks[report.count++];
+                block = source.statistics.report(ssrc);
+                if (source.lastSenderReport)
+                {
+                    block.lastSenderReport = source.lastSenderReport;
+                    auto delay = std::chrono::duration_cast<std::chrono::microseconds>(now - source.lastSenderReportArrival).count();
+                    block.delaySinceLastSenderReport = static_cast<uint32_t>((static_cast<uint64_t>(delay) << 16) / 1000000ull);
+                }
+            }
+            ++it;
+        }
+
+        scheduleNext(now);
+        return write(report, dst);
+    }
+
+    double Session::rttMs(uint32_t ssrc) const
+    {
+        std::lock_guard lock(mMutex);
+        auto it = mSources.find(ssrc);
+        return it == mSources.end() ? -1.0 : it->second.rttMs;
+    }
+
+    std::vector<PeerStats> Session::stats() const
+    {
+        std::lock_guard lock(mMutex);
+        std::vector<PeerStats> peers{};
+        peers.reserve(mSources.size());
+        auto toMs = 1000.0 / mClockRate;
+        for (auto& [ssrc, source] : mSources)
+        {
+            PeerStats peer{};
+            peer.ssrc               = ssrc;
+            peer.packetsReceived    = source.statistics.packets();
+            peer.cumulativeLost     = source.statistics.isValid() ? source.statistics.cumulativeLost() : 0;
+            peer.fractionLost       = source.statistics.lastFractionLost() / 256.0;
+            peer.jitterMs           = source.statistics.jitter() * toMs;
+            if (source.bRemote)
+            {
+                peer.remoteFractionLost = source.remote.fractionLost / 256.0;
+                peer.remoteJitterMs     = source.remote.jitter * toMs;
+            }
+            peer.rttMs = source.rttMs;
+            peers.push_back(peer);
+        }
+        return peers;
+    }
+}
@@ -0,0 +1,223 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+
+#ifndef AUDIOSTREAMPLUGIN_RTCP_H
+#define AUDIOSTREAMPLUGIN_RTCP_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "WireFormat.h"
+
+/*!
+ * @brief RTCP sender and receiver reports (RFC 3550 6.4), multiplexed with the RTP datagrams on the same socket.
+ *
+ * The first byte after the version of an RTCP packet is its type (200 SR, 201 RR). An RTP datagram carries the marker
+ * and a payload type below 128 there, so both share one port (RFC 5761). Reports go alone, without SDES (RFC 5506).
+ */
+namespace DAWn::Rtcp
+{
+    using Clock = std::chrono::steady_clock;
+
+    inline constexpr uint8_t kSenderReport      = 200;
+    inline constexpr uint8_t kReceiverReport    = 201;
+    inline constexpr uint8_t kApplication       = 204;
+    inline constexpr size_t  kMaxReportBlocks   = 31;
+    inline constexpr size_t  kReportBlockSize   = 24;
+    /*! @brief An SR with every report block.*/
+    inline constexpr size_t  kMaxReportSize     = 8 + 20 + kMaxReportBlocks * kReportBlockSize;
+    inline constexpr size_t  kMaxNackTimeStamps = 16;
+    /*! @brief An APP packet named DNAK: header, ssrc, name, media ssrc and the time stamps.*/
+    inline constexpr size_t  kMaxNackSize       = 16 + kMaxNackTimeStamps * 4;
+
+    /*! @brief What a receiver tells a sender about its stream (RFC 3550 6.4.1).*/
+    struct ReportBlock
+    {
+        uint32_t ssrc{0};               //!The source this block is about.
+        uint8_t  fractionLost{0};       //!Lost since the previous report, over 256.
+        int32_t  cumulativeLost{0};     //!24 bits, signed: duplicates make it negative.
+        uint32_t highestSequence{0};    //!Extended: cycles << 16 | sequence.
+        uint32_t jitter{0};             //!Interarrival jitter, time stamp units.
+        uint32_t lastSenderReport{0};   //!Middle 32 bits of the NTP time of the last SR from ssrc, 0 if none.
+        uint32_t delaySinceLastSenderReport{0}; //!Since that SR arrived, 1/65536 seconds.
+    };
+
+    struct Report
+    {
+        uint8_t  type{kReceiverReport};
+        uint32_t ssrc{0};
+        //Sender info, SR only.
+        uint64_t ntpTime{0};
+        uint32_t rtpTimeStamp{0};
+        uint32_t packetCount{0};
+        uint32_t octetCount{0};
+
+        size_t   count{0};
+        std::array<ReportBlock, kMaxReportBlocks> blocks{};
+    };
+
+    /*!
+     * @brief Ask a sender to send some packets again. The stream is indexed by time stamp, not sequence, so this is an
+     * APP packet (name "DNAK") rather than the RFC 4585 generic NACK.
+     */
+    struct Nack
+    {
+        uint32_t ssrc{0};       //!Who asks.
+        uint32_t mediaSsrc{0};  //!Whose packets.
+        size_t   count{0};
+        std::array<uint32_t, kMaxNackTimeStamps> timeStamps{};
+    };
+
+    /*! @brief The measurements about one peer, see Session::stats.*/
+    struct PeerStats
+    {
+        uint32_t ssrc{0};
+        uint64_t packetsReceived{0};
+        int32_t  cumulativeLost{0};
+        double   fractionLost{0.0};         //!Of its stream, since our previous report.
+        double   jitterMs{0.0};             //!Interarrival jitter of its stream.
+        double   remoteFractionLost{0.0};   //!Of our stream, as the peer reported it.
+        double   remoteJitterMs{0.0};       //!Of our stream, as the peer reported it.
+        double   rttMs{-1.0};               //!Round trip from its reports, negative until measured.
+    };
+
+    /*! @brief True if datagram is an RTCP packet, not an RTP one.*/
+    bool isRtcp(std::span<const std::byte> datagram);
+
+    /*!
+     * @brief Write report into dst.
+     * @return The bytes written, 0 if dst is too small.
+     */
+    size_t write(const Report& report, std::span<std::byte> dst);
+
+    /*!
+     * @brief Parse the first SR or RR of a (compound) RTCP packet. Other packet types are skipped.
+     * @return False if there is none or the packet is malformed.
+     */
+    bool read(std::span<const std::byte> datagram, Report& report);
+
+    /*! @return The bytes written, 0 if dst is too small.*/
+    size_t write(const Nack& nack, std::span<std::byte> dst);
+
+    /*! @brief Parse the first DNAK of a (compound) RTCP packet.*/
+    bool read(std::span<const std::byte> datagram, Nack& nack);
+
+    /*! @brief Wall clock as a 64 bit NTP time stamp (seconds since 1900 . fraction).*/
+    uint64_t ntpNow();
+    inline uint32_t ntpMiddle(uint64_t ntpTime) { return static_cast<uint32_t>(ntpTime >> 16); }
+
+    /*!
+     * @brief Reception statistics of one source: sequence tracking (RFC 3550 A.1), loss (A.3) and interarrival jitter
+     * (A.8).
+     */
+    class SourceStatistics
+    {
+    public:
+        /*!
+         * @param arrival Arrival time in time stamp units.
+         * @return False if the sequence jumped too far, the packet is not counted until the jump is confirmed.
+         */
+        bool received(const DAWn::Wire::Header& header, uint32_t arrival);
+
+        /*! @brief The report block about ssrc. Starts a new loss interval.*/
+        ReportBlock report(uint32_t ssrc);
+
+        inline bool isValid() const { return bValid; }
+        inline uint64_t packets() const { return mReceived; }
+        inline uint32_t jitter() const { return mJitter >> 4; }
+        int32_t cumulativeLost() const;
+        inline uint8_t lastFractionLost() const { return mLastFractionLost; }
+
+    private:
+        void restart(uint16_t sequence);
+
+        bool     bValid{false};
+        uint16_t mMaxSequence{0};
+        uint32_t mCycles{0};
+        uint32_t mBaseSequence{0};
+        uint32_t mBadSequence{0};
+        uint64_t mReceived{0};
+        uint64_t mExpectedPrior{0};
+        uint64_t mReceivedPrior{0};
+        uint8_t  mLastFractionLost{0};
+
+        bool     bTransitValid{false};
+        uint32_t mTransit{0};
+        /*! @brief Jitter times 16, the integer form of A.8.*/
+        uint32_t mJitter{0};
+    };
+
+    /*!
+     * @brief The RTCP side of one RTP sender: counts what it sends, tracks every source it receives, measures the
+     * round trip from the reports of its peers and decides when to report.
+     *
+     * sent() is lock free, it is called for every outgoing datagram. The rest locks, it runs on the network thread.
+     */
+    class Session
+    {
+    public:
+        Session();
+
+        /*! @brief Forget everything, report as ssrc from now on.*/
+        void reset(uint32_t ssrc, uint32_t clockRate = 48000);
+        /*! @brief Mean time between reports, randomized by 0.5 .. 1.5 (RFC 3550 6.3.1).*/
+        void setInterval(Clock::duration interval);
+
+        void sent(const DAWn::Wire::Header& header, size_t payloadBytes);
+        void received(const DAWn::Wire::Header& header, Clock::time_point arrival);
+        void received(const Report& report, Clock::time_point arrival, uint64_t ntpTime);
+
+        inline bool reportDue(Clock::time_point now) const
+        {
+            return now.time_since_epoch().count() >= mNextReport.load(std::memory_order_relaxed);
+        }
+        /*!
+         * @brief Write the SR (something was sent since the last report) or RR into dst, if one is due.
+         * @return The bytes written, 0 if no report is due.
+         */
+        size_t writeReport(std::span<std::byte> dst, Clock::time_point now, uint64_t ntpTime);
+
+        std::vector<PeerStats> stats() const;
+        /*! @brief Round trip to ssrc in ms, negative until measured.*/
+        double rttMs(uint32_t ssrc) const;
+
+    private:
+        struct Source
+        {
+            SourceStatistics    statistics{};
+            Clock::time_point   lastHeard{};
+            uint32_t            lastSenderReport{0};
+            Clock::time_point   lastSenderReportArrival{};
+            ReportBlock         remote{};
+            bool                bRemote{false};
+            double              rttMs{-1.0};
+        };
+
+        void scheduleNext(Clock::time_point now);
+
+        std::atomic<uint32_t>   mSsrc{0};
+        std::atomic<uint32_t>   mPacketCount{0};
+        std::atomic<uint32_t>   mOctetCount{0};
+        std::atomic<uint32_t>   mLastTimeStamp{0};
+        std::atomic<bool>       bSentSinceReport{false};
+        std::atomic<Clock::rep> mNextReport{0};
+
+        mutable std::mutex                      mMutex;
+        uint32_t                                mClockRate{48000};
+        Clock::duration                         mInterval{std::chrono::seconds(1)};
+        Clock::time_point                       mEpoch{Clock::now()};
+        std::minstd_rand                        mRandom{};
+        std::unordered_map<uint32_t, Source>    mSources{};
+    };
+}
+
+#endif //AUDIOSTREAMPLUGIN_RTCP_H
@@ -0,0 +1,143 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+
+#ifndef AUDIOSTREAMPLUGIN_WIREFORMAT_H
+#define AUDIOSTREAMPLUGIN_WIREFORMAT_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+/*!
+ * @brief Wire format v2, the header in front of every datagram of a stream.
+ *
+ *     0               1               2               3
+ *     0 1 2 3 4 5 6 7 0 1 2 3 4 5 6 7 0 1 2 3 4 5 6 7 0 1 2 3 4 5 6 7
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *    |V=2|0|0|  0    |M| PayloadType |        Sequence number        |
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *    |                  Time stamp (sample position)                 |
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *    |                        Source (user id)                       |
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *    | Channel pair  |     Flags     |           Reserved            |
+ *    +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *    |                            Payload ...
+ *
+ * The first 12 bytes are the RFC 3550 fixed header (version 2, no padding, extension or CSRC), the source is the
+ * SSRC. The last 4 bytes are a DAWn payload header. Everything is in network byte order.
+ *
+ * Senders reserve kHeaderSize bytes of headroom in front of the payload and write the header there, the payload is
+ * never moved. Parsing reads the header in place and returns a view on the payload.
+ */
+namespace DAWn::Wire
+{
+    inline constexpr uint8_t kVersion = 2;
+    inline constexpr size_t kHeaderSize = 16;
+
+    /*! @brief RTP payload types, from the dynamic range.*/
+    enum class PayloadType : uint8_t
+    {
+        Audio   = 111,  //!An Opus packet. All the channels in one multistream packet.
+        Command = 112,  //!A playback command, one byte (PlaybackCommandEnum).
+        FEC     = 113,  //!Forward error correction data.
+        Probe   = 114   //!No payload to play: keeps the path to the relay open.
+    };
+
+    enum Flags : uint8_t
+    {
+        kFlagNone           = 0x00,
+        kFlagDiscontinuity  = 0x01, //!The time stamp jumps: the sender re-anchored or resumed. Sets the RTP marker.
+        kFlagRetransmission = 0x02  //!Sent again on request, not in sequence order.
+    };
+
+    struct Header
+    {
+        PayloadType type{PayloadType::Audio};
+        uint16_t    sequence{0};
+        uint32_t    timeStamp{0};
+        uint32_t    source{0};
+        uint8_t     channelPair{0};
+        uint8_t     flags{kFlagNone};
+    };
+
+    namespace detail
+    {
+        inline void put16(std::byte* dst, uint16_t value)
+        {
+            dst[0] = static_cast<std::byte>(value >> 8);
+            dst[1] = static_cast<std::byte>(value);
+        }
+        inline void put32(std::byte* dst, uint32_t value)
+        {
+            put16(dst, static_cast<uint16_t>(value >> 16));
+            put16(dst + 2, static_cast<uint16_t>(value));
+        }
+        inline uint16_t get16(const std::byte* src)
+        {
+            return static_cast<uint16_t>((std::to_integer<uint16_t>(src[0]) << 8) | std::to_integer<uint16_t>(src[1]));
+        }
+        inline uint32_t get32(const std::byte* src)
+        {
+            return (static_cast<uint32_t>(get16(src)) << 16) | get16(src + 2);
+        }
+    }
+
+    inline bool isKnownType(uint8_t type)
+    {
+        return type >= static_cast<uint8_t>(PayloadType::Audio) && type <= static_cast<uint8_t>(PayloadType::Probe);
+    }
+
+    /*! @brief Write header into the first kHeaderSize bytes of dst.*/
+    inline void write(const Header& header, std::span<std::byte, kHeaderSize> dst)
+    {
+        auto marker = (header.flags & kFlagDiscontinuity) ? 0x80u : 0x00u;
+        dst[0] = static_cast<std::byte>(kVersion << 6);
+        dst[1] = static_cast<std::byte>(marker | static_cast<uint8_t>(header.type));
+        detail::put16(dst.data() + 2, header.sequence);
+        detail::put32(dst.data() + 4, header.timeStamp);
+        detail::put32(dst.data() + 8, header.source);
+        dst[12] = static_cast<std::byte>(header.channelPair);
+        dst[13] = static_cast<std::byte>(header.flags);
+        dst[14] = std::byte{0};
+        dst[15] = std::byte{0};
+    }
+
+    /*!
+     * @brief Parse the header of datagram in place.
+     * @return False if it is too short, another version, uses RTP padding / extension / CSRC or an unknown payload type.
+     */
+    inline bool read(std::span<const std::byte> datagram, Header& header)
+    {
+        if (datagram.size() < kHeaderSize) return false;
+        auto first = std::to_integer<uint8_t>(datagram[0]);
+        if ((first >> 6) != kVersion || (first & 0x3f) != 0) return false;
+        auto type = static_cast<uint8_t>(std::to_integer<uint8_t>(datagram[1]) & 0x7f);
+        if (!isKnownType(type)) return false;
+
+        header.type         = static_cast<PayloadType>(type);
+        header.sequence     = detail::get16(datagram.data() + 2);
+        header.timeStamp    = detail::get32(datagram.data() + 4);
+        header.source       = detail::get32(datagram.data() + 8);
+        header.channelPair  = std::to_integer<uint8_t>(datagram[12]);
+        header.flags        = std::to_integer<uint8_t>(datagram[13]);
+        return true;
+    }
+
+    /*! @brief The payload part of a frame with headroom.*/
+    inline std::span<std::byte> payload(std::span<std::byte> frame)
+    {
+        return frame.size() < kHeaderSize ? std::span<std::byte>{} : frame.subspan(kHeaderSize);
+    }
+
+    /*! @brief Control datagrams (commands, probes) take the never-drop lanes of a stream, see xlet::ControlClassifier.*/
+    inline bool isControl(std::span<const std::byte> datagram)
+    {
+        Header header{};
+        return read(datagram, header) && (header.type == PayloadType::Command || header.type == PayloadType::Probe);
+    }
+}
+
+#endif //AUDIOSTREAMPLUGIN_WIREFORMAT_H
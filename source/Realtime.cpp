@@ -0,0 +1,63 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+
+#include "Realtime.h"
+
+#if DAWN_REALTIME_CHECKS && DAWN_REALTIME_REPLACE_NEW
+
+#include <cstdlib>
+#include <new>
+
+/*
+ * Debug only: the global operator new / delete report a heap operation made inside a ScopedRealtime section, then
+ * go on with malloc / free. The aligned overloads are left to the standard library, the audio path does not use them.
+ */
+namespace
+{
+    void* allocate(std::size_t size)
+    {
+        DAWn::Realtime::assertNotRealtime("heap allocation");
+        if (size == 0) size = 1;
+        while (true)
+        {
+            if (auto ptr = std::malloc(size)) return ptr;
+            auto handler = std::get_new_handler();
+            if (!handler) throw std::bad_alloc{};
+            handler();
+        }
+    }
+
+    void* allocateNoThrow(std::size_t size) noexcept
+    {
+        try
+        {
+            return allocate(size);
+        }
+        catch (...)
+        {
+            return nullptr;
+        }
+    }
+
+    void deallocate(void* ptr) noexcept
+    {
+        if (!ptr) return;
+        DAWn::Realtime::assertNotRealtime("heap free");
+        std::free(ptr);
+    }
+}
+
+void* operator new(std::size_t size) { return allocate(size); }
+void* operator new[](std::size_t size) { return allocate(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return allocateNoThrow(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return allocateNoThrow(size); }
+
+void operator delete(void* ptr) noexcept { deallocate(ptr); }
+void operator delete[](void* ptr) noexcept { deallocate(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { deallocate(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { deallocate(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { deallocate(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { deallocate(ptr); }
+
+#endif
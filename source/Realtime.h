@@ -0,0 +1,117 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+
+#ifndef AUDIOSTREAMPLUGIN_REALTIME_H
+#define AUDIOSTREAMPLUGIN_REALTIME_H
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdio>
+
+/*!
+ * @brief Debug check of the realtime contract: no heap and no blocking lock inside a ScopedRealtime section.
+ * On by default in debug builds (no NDEBUG). Define DAWN_REALTIME_CHECKS to 0 or 1 to override.
+ */
+#ifndef DAWN_REALTIME_CHECKS
+#ifdef NDEBUG
+#define DAWN_REALTIME_CHECKS 0
+#else
+#define DAWN_REALTIME_CHECKS 1
+#endif
+#endif
+
+/*!
+ * @brief With the checks on, Realtime.cpp replaces the global operator new / delete. Define DAWN_REALTIME_REPLACE_NEW
+ * to 0 in a binary that brings its own replacements (the Benchmarks count every allocation).
+ */
+#ifndef DAWN_REALTIME_REPLACE_NEW
+#define DAWN_REALTIME_REPLACE_NEW DAWN_REALTIME_CHECKS
+#endif
+
+namespace DAWn::Realtime
+{
+    /*! @brief Called on a violation with what was attempted ("heap allocation", "lock").*/
+    using ViolationHandler = void (*)(const char* what);
+
+    namespace detail
+    {
+        inline thread_local int                 tRealtimeDepth{0};
+        inline thread_local bool                tReporting{false};
+        inline std::atomic<size_t>              sViolations{0};
+        inline std::atomic<ViolationHandler>    sHandler{nullptr};
+    }
+
+    /*!
+     * @brief Marks the calling thread as realtime (the audio callback) for the lifetime of the object. Nestable.
+     *
+     * Inside the section the thread must not allocate, free or wait on a lock. In a debug build operator new /
+     * delete and the CheckedMutex locks report any attempt, see setViolationHandler.
+     */
+    class ScopedRealtime
+    {
+    public:
+        ScopedRealtime() { ++detail::tRealtimeDepth; }
+        ~ScopedRealtime() { --detail::tRealtimeDepth; }
+        ScopedRealtime(const ScopedRealtime&) = delete;
+        ScopedRealtime& operator=(const ScopedRealtime&) = delete;
+    };
+
+    inline bool isRealtimeThread() { return detail::tRealtimeDepth > 0; }
+
+    /*!
+     * @brief Replace what a violation does. The default prints to stderr and asserts.
+     * @param handler nullptr restores the default.
+     */
+    inline void setViolationHandler(ViolationHandler handler) { detail::sHandler.store(handler, std::memory_order_release); }
+
+    /*! @brief Violations reported since the process started.*/
+    inline size_t violations() { return detail::sViolations.load(std::memory_order_relaxed); }
+
+    inline void violation(const char* what)
+    {
+        //The handler may print or allocate itself, do not report that again.
+        if (detail::tReporting) return;
+        detail::tReporting = true;
+        detail::sViolations.fetch_add(1, std::memory_order_relaxed);
+        if (auto handler = detail::sHandler.load(std::memory_order_acquire))
+        {
+            handler(what);
+        }
+        else
+        {
+            std::fprintf(stderr, "Realtime contract violated: %s on the audio thread\n", what);
+            assert(false && "Realtime contract violated");
+        }
+        detail::tReporting = false;
+    }
+
+    /*! @brief Report a violation if the calling thread is inside a ScopedRealtime section. Nothing in release.*/
+    inline void assertNotRealtime([[maybe_unused]] const char* what)
+    {
+#if DAWN_REALTIME_CHECKS
+        if (isRealtimeThread()) violation(what);
+#endif
+    }
+
+    /*!
+     * @brief A mutex whose blocking lock() is checked against the realtime contract. try_lock is allowed: the
+     * audio thread may take a lock it finds free and skip the work otherwise.
+     *
+     *     DAWn::Realtime::CheckedMutex<std::mutex> mMutex;
+     *     std::lock_guard lock(mMutex);
+     */
+    template <typename Mutex>
+    class CheckedMutex : public Mutex
+    {
+    public:
+        void lock()
+        {
+            assertNotRealtime("lock");
+            Mutex::lock();
+        }
+    };
+}
+
+#endif //AUDIOSTREAMPLUGIN_REALTIME_H
@@ -0,0 +1,77 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+
+#include "Members.h"
+
+#include <algorithm>
+
+#include "Rtcp.h"
+#include "WireFormat.h"
+
+bool DAWn::Relay::inspect(std::span<const std::byte> datagram, uint32_t& source)
+{
+    if (DAWn::Rtcp::isRtcp(datagram))
+    {
+        //Every RTCP packet we send starts with the ssrc of its sender.
+        if (datagram.size() < 8) return false;
+        source = DAWn::Wire::detail::get32(datagram.data() + 4);
+        return true;
+    }
+    DAWn::Wire::Header header{};
+    if (!DAWn::Wire::read(datagram, header)) return false;
+    source = header.source;
+    return true;
+}
+
+DAWn::Relay::Members::Members(size_t capacity) : mCapacity(std::max<size_t>(capacity, 1))
+{
+    mMembers.reserve(mCapacity);
+}
+
+DAWn::Relay::Members::Verdict DAWn::Relay::Members::heard(PeerId peer, uint32_t source, Clock::time_point now)
+{
+    auto it = std::find_if(mMembers.begin(), mMembers.end(), [peer](const Member& member){ return member.peer == peer; });
+    if (it != mMembers.end())
+    {
+        it->source = source;
+        it->lastHeard = now;
+        ++it->datagrams;
+        return Verdict::Known;
+    }
+
+    if (source != 0)
+    {
+        it = std::find_if(mMembers.begin(), mMembers.end(), [source](const Member& member){ return member.source == source; });
+        if (it != mMembers.end())
+        {
+            it->peer = peer;
+            it->lastHeard = now;
+            ++it->datagrams;
+            return Verdict::Rebound;
+        }
+    }
+
+    if (mMembers.size() >= mCapacity) return Verdict::Full;
+    mMembers.push_back(Member{peer, source, now, 1});
+    return Verdict::Joined;
+}
+
+size_t DAWn::Relay::Members::targets(PeerId sender, bool echo, std::span<PeerId> out) const
+{
+    auto count = 0ul;
+    for (auto& member : mMembers)
+    {
+        if (count == out.size()) break;
+        if (member.peer == sender && !echo) continue;
+        out[count++] = member.peer;
+    }
+    return count;
+}
+
+size_t DAWn::Relay::Members::expire(Clock::time_point now, Clock::duration idle)
+{
+    auto before = mMembers.size();
+    std::erase_if(mMembers, [now, idle](const Member& member){ return now - member.lastHeard > idle; });
+    return before - mMembers.size();
+}
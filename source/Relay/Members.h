@@ -0,0 +1,79 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+
+#ifndef AUDIOSTREAMPLUGIN_RELAYMEMBERS_H
+#define AUDIOSTREAMPLUGIN_RELAYMEMBERS_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace DAWn::Relay
+{
+    using Clock = std::chrono::steady_clock;
+    /*! @brief An IPv4 endpoint as xlet names its peers: s_addr << 32 | port.*/
+    using PeerId = uint64_t;
+
+    inline constexpr size_t kMaxMembers = 32;
+
+    /*!
+     * @brief Check a datagram is something a stream sends: a wire v2 frame (audio, command, FEC, probe) or an RTCP
+     * packet (reports, NACKs).
+     * @param source Set to the wire source / RTCP ssrc of the sender.
+     * @return False for anything else, the relay drops it.
+     */
+    bool inspect(std::span<const std::byte> datagram, uint32_t& source);
+
+    struct Member
+    {
+        PeerId              peer{0};
+        uint32_t            source{0};      //!Last source it sent as, 0 until it sent something valid.
+        Clock::time_point   lastHeard{};
+        uint64_t            datagrams{0};
+    };
+
+    /*!
+     * @brief The members of one relay session, learned from the datagrams they send.
+     *
+     * The table is a flat vector reserved to its capacity: sessions are small, a linear scan beats a hash and the
+     * steady state never allocates. Only the shard that owns the session touches it.
+     */
+    class Members
+    {
+    public:
+        enum class Verdict
+        {
+            Known,      //!Already a member.
+            Joined,     //!New member.
+            Rebound,    //!Same source from a new address (NAT rebinding): the member moved.
+            Full        //!New address, no room: drop what it sends.
+        };
+
+        explicit Members(size_t capacity = kMaxMembers);
+
+        /*! @brief peer sent a datagram as source.*/
+        Verdict heard(PeerId peer, uint32_t source, Clock::time_point now);
+
+        /*!
+         * @brief Who gets what sender sent: every other member, and sender itself if echo.
+         * @return How many peers were written into out, at most out.size().
+         */
+        size_t targets(PeerId sender, bool echo, std::span<PeerId> out) const;
+
+        /*! @brief Drop the members not heard for idle. @return How many left.*/
+        size_t expire(Clock::time_point now, Clock::duration idle);
+
+        inline size_t size() const { return mMembers.size(); }
+        inline size_t capacity() const { return mCapacity; }
+        inline const std::vector<Member>& members() const { return mMembers; }
+
+    private:
+        size_t              mCapacity;
+        std::vector<Member> mMembers{};
+    };
+}
+
+#endif //AUDIOSTREAMPLUGIN_RELAYMEMBERS_H
@@ -0,0 +1,370 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+
+#include "Relay.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+    //Wire v2 datagrams fit a 1500 MTU, anything longer is not ours and gets truncated then dropped.
+    constexpr size_t    kDatagramBytes = 2048;
+    //Batches read per readiness: the loop moves on to the other sessions of the shard after that.
+    constexpr int       kBatchesPerWakeUp = 4;
+    constexpr int       kEpollTimeoutMs = 250;
+    constexpr uint32_t  kWakeUpTag = UINT32_MAX;
+
+    DAWn::Relay::PeerId toPeerId(const sockaddr_in& addr)
+    {
+        return (static_cast<uint64_t>(addr.sin_addr.s_addr) << 32) | ntohs(addr.sin_port);
+    }
+
+    sockaddr_in toSockAddr(DAWn::Relay::PeerId peer)
+    {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(peer & 0xFFFF));
+        addr.sin_addr.s_addr = static_cast<uint32_t>(peer >> 32);
+        return addr;
+    }
+
+    int openSocket(const std::string& ip, uint16_t port, int bufferBytes)
+    {
+        auto fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) return -1;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bufferBytes, sizeof(bufferBytes));
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &bufferBytes, sizeof(bufferBytes));
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        if (inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) != 1 || bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+        {
+            std::cout << "Relay: can't bind " << ip << ":" << port << " " << std::strerror(errno) << std::endl;
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+}
+
+/*!
+ * @brief One epoll loop and the sessions it owns. The stats are the only thing other threads read.
+ */
+class DAWn::Relay::Relay::Shard
+{
+public:
+    explicit Shard(const Options& options) : mOptions(options)
+    {
+        auto batch = std::max(mOptions.batch, 1u);
+        mBuffers.resize(batch * kDatagramBytes);
+        mAddrs.resize(batch);
+        mIovs.resize(batch);
+        mMsgs.resize(batch);
+        mTargets.resize(mOptions.maxMembers);
+        //Sized once for the largest fan-out of a batch: msg_name points into mOutAddrs, it must never reallocate.
+        mOutMsgs.resize(batch * mOptions.maxMembers);
+        mOutAddrs.resize(batch * mOptions.maxMembers);
+    }
+
+    ~Shard()
+    {
+        stop();
+        for (auto& session : mSessions) close(session.fd);
+        if (mWakeFd >= 0) close(mWakeFd);
+        if (mEpollFd >= 0) close(mEpollFd);
+    }
+
+    bool addSession(uint16_t port)
+    {
+        auto fd = openSocket(mOptions.bind, port, mOptions.socketBufferBytes);
+        if (fd < 0) return false;
+        mSessions.push_back(Session{fd, port, Members{mOptions.maxMembers}});
+        return true;
+    }
+
+    bool start()
+    {
+        mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+        mWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (mEpollFd < 0 || mWakeFd < 0) return false;
+
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u32 = kWakeUpTag;
+        if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mWakeFd, &event) < 0) return false;
+        for (auto index = 0u; index < mSessions.size(); ++index)
+        {
+            event.data.u32 = index;
+            if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mSessions[index].fd, &event) < 0) return false;
+        }
+
+        bRunning.store(true, std::memory_order_release);
+        mThread = std::thread([this](){ loop(); });
+        return true;
+    }
+
+    void stop()
+    {
+        if (!bRunning.exchange(false)) return;
+        uint64_t one = 1;
+        [[maybe_unused]] auto written = write(mWakeFd, &one, sizeof(one));
+        if (mThread.joinable()) mThread.join();
+    }
+
+    void addStats(Stats& stats) const
+    {
+        stats.received  += mReceived.load(std::memory_order_relaxed);
+        stats.forwarded += mForwarded.load(std::memory_order_relaxed);
+        stats.invalid   += mInvalid.load(std::memory_order_relaxed);
+        stats.rejected  += mRejected.load(std::memory_order_relaxed);
+        stats.dropped   += mDropped.load(std::memory_order_relaxed);
+        stats.members   += mMembers.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Session
+    {
+        int         fd{-1};
+        uint16_t    port{0};
+        Members     members;
+    };
+
+    void loop()
+    {
+        std::array<epoll_event, 64> events{};
+        auto nextExpiry = Clock::now() + std::chrono::seconds(1);
+
+        while (bRunning.load(std::memory_order_acquire))
+        {
+            auto ready = epoll_wait(mEpollFd, events.data(), static_cast<int>(events.size()), kEpollTimeoutMs);
+            if (ready < 0 && errno != EINTR)
+            {
+                std::cout << "Relay: epoll_wait " << std::strerror(errno) << std::endl;
+                break;
+            }
+            for (auto index = 0; index < ready; ++index)
+            {
+                if (events[index].data.u32 == kWakeUpTag) continue;
+                drain(mSessions[events[index].data.u32]);
+            }
+
+            auto now = Clock::now();
+            if (now >= nextExpiry)
+            {
+                expire(now);
+                nextExpiry = now + std::chrono::seconds(1);
+            }
+        }
+    }
+
+    void drain(Session& session)
+    {
+        const auto batch = mMsgs.size();
+        for (auto round = 0; round < kBatchesPerWakeUp; ++round)
+        {
+            for (auto index = 0ul; index < batch; ++index)
+            {
+                mIovs[index].iov_base = mBuffers.data() + index * kDatagramBytes;
+                mIovs[index].iov_len = kDatagramBytes;
+                mMsgs[index].msg_hdr = {};
+                mMsgs[index].msg_hdr.msg_name = &mAddrs[index];
+                mMsgs[index].msg_hdr.msg_namelen = sizeof(mAddrs[index]);
+                mMsgs[index].msg_hdr.msg_iov = &mIovs[index];
+                mMsgs[index].msg_hdr.msg_iovlen = 1;
+            }
+            auto received = recvmmsg(session.fd, mMsgs.data(), static_cast<unsigned int>(batch), MSG_DONTWAIT, nullptr);
+            if (received < 0)
+            {
+                if (errno != EWOULDBLOCK && errno != EAGAIN && errno != EINTR)
+                {
+                    std::cout << "Relay: recvmmsg on " << session.port << " " << std::strerror(errno) << std::endl;
+                }
+                return;
+            }
+            mReceived.fetch_add(static_cast<uint64_t>(received), std::memory_order_relaxed);
+            fanOut(session, static_cast<size_t>(received));
+            if (static_cast<size_t>(received) < batch) return;
+        }
+    }
+
+    void fanOut(Session& session, size_t received)
+    {
+        auto now = Clock::now();
+        auto outgoing = 0ul;
+        auto invalid = 0ul;
+        auto rejected = 0ul;
+
+        for (auto index = 0ul; index < received; ++index)
+        {
+            auto size = static_cast<size_t>(mMsgs[index].msg_len);
+            auto datagram = std::span<const std::byte>{mBuffers.data() + index * kDatagramBytes, std::min(size, kDatagramBytes)};
+            uint32_t source = 0;
+            if ((mMsgs[index].msg_hdr.msg_flags & MSG_TRUNC) || !inspect(datagram, source))
+            {
+                ++invalid;
+                continue;
+            }
+
+            auto sender = toPeerId(mAddrs[index]);
+            if (session.members.heard(sender, source, now) == Members::Verdict::Full)
+            {
+                ++rejected;
+                continue;
+            }
+
+            auto count = session.members.targets(sender, mOptions.echo, mTargets);
+            mIovs[index].iov_len = datagram.size();
+            for (auto target = 0ul; target < count; ++target, ++outgoing)
+            {
+                mOutAddrs[outgoing] = toSockAddr(mTargets[target]);
+                mOutMsgs[outgoing].msg_hdr = {};
+                mOutMsgs[outgoing].msg_hdr.msg_name = &mOutAddrs[outgoing];
+                mOutMsgs[outgoing].msg_hdr.msg_namelen = sizeof(mOutAddrs[outgoing]);
+                mOutMsgs[outgoing].msg_hdr.msg_iov = &mIovs[index];
+                mOutMsgs[outgoing].msg_hdr.msg_iovlen = 1;
+            }
+        }
+
+        if (invalid) mInvalid.fetch_add(invalid, std::memory_order_relaxed);
+        if (rejected) mRejected.fetch_add(rejected, std::memory_order_relaxed);
+        send(session, outgoing);
+    }
+
+    void send(Session& session, size_t outgoing)
+    {
+        auto sent = 0ul;
+        auto waited = false;
+        while (sent < outgoing)
+        {
+            auto n = sendmmsg(session.fd, mOutMsgs.data() + sent, static_cast<unsigned int>(outgoing - sent), MSG_DONTWAIT);
+            if (n < 0)
+            {
+                if (errno == EINTR) continue;
+                if ((errno == EWOULDBLOCK || errno == EAGAIN) && !waited)
+                {
+                    //Socket buffer full: wait once for room, then drop the rest rather than stall the other sessions.
+                    struct pollfd pfd{};
+                    pfd.fd = session.fd;
+                    pfd.events = POLLOUT;
+                    poll(&pfd, 1, 1);
+                    waited = true;
+                    continue;
+                }
+                if (errno != EWOULDBLOCK && errno != EAGAIN)
+                {
+                    //A member that went away (ICMP unreachable): skip its datagram, not the batch.
+                    mDropped.fetch_add(1, std::memory_order_relaxed);
+                    ++sent;
+                    continue;
+                }
+                break;
+            }
+            sent += static_cast<size_t>(n);
+            mForwarded.fetch_add(static_cast<uint64_t>(n), std::memory_order_relaxed);
+        }
+        if (sent < outgoing) mDropped.fetch_add(outgoing - sent, std::memory_order_relaxed);
+    }
+
+    void expire(Clock::time_point now)
+    {
+        auto members = 0ul;
+        for (auto& session : mSessions)
+        {
+            if (session.members.expire(now, mOptions.idle) > 0)
+            {
+                std::cout << "Relay: session " << session.port << " has " << session.members.size() << " members" << std::endl;
+            }
+            members += session.members.size();
+        }
+        mMembers.store(members, std::memory_order_relaxed);
+    }
+
+    const Options&              mOptions;
+    std::vector<Session>        mSessions{};
+    int                         mEpollFd{-1};
+    int                         mWakeFd{-1};
+    std::thread                 mThread{};
+    std::atomic<bool>           bRunning{false};
+
+    std::vector<std::byte>      mBuffers{};
+    std::vector<sockaddr_in>    mAddrs{};
+    std::vector<iovec>          mIovs{};
+    std::vector<mmsghdr>        mMsgs{};
+    std::vector<PeerId>         mTargets{};
+    std::vector<mmsghdr>        mOutMsgs{};
+    std::vector<sockaddr_in>    mOutAddrs{};
+
+    std::atomic<uint64_t>       mReceived{0};
+    std::atomic<uint64_t>       mForwarded{0};
+    std::atomic<uint64_t>       mInvalid{0};
+    std::atomic<uint64_t>       mRejected{0};
+    std::atomic<uint64_t>       mDropped{0};
+    std::atomic<uint64_t>       mMembers{0};
+};
+
+DAWn::Relay::Relay::Relay(Options options) : mOptions(std::move(options))
+{
+}
+
+DAWn::Relay::Relay::~Relay()
+{
+    stop();
+}
+
+bool DAWn::Relay::Relay::start()
+{
+    auto sessions = std::max<unsigned>(mOptions.sessions, 1u);
+    auto threads = mOptions.threads ? mOptions.threads : std::max(std::thread::hardware_concurrency(), 1u);
+    threads = std::min(threads, sessions);
+
+    mShards.clear();
+    for (auto shard = 0u; shard < threads; ++shard) mShards.push_back(std::make_unique<Shard>(mOptions));
+    for (auto session = 0u; session < sessions; ++session)
+    {
+        if (!mShards[session % threads]->addSession(static_cast<uint16_t>(mOptions.port + session)))
+        {
+            mShards.clear();
+            return false;
+        }
+    }
+    for (auto& shard : mShards)
+    {
+        if (!shard->start())
+        {
+            std::cout << "Relay: can't start a shard " << std::strerror(errno) << std::endl;
+            mShards.clear();
+            return false;
+        }
+    }
+    std::cout << "Relay: " << sessions << " sessions on " << mOptions.bind << ":" << mOptions.port << ".."
+              << mOptions.port + sessions - 1 << ", " << threads << " threads" << std::endl;
+    return true;
+}
+
+void DAWn::Relay::Relay::stop()
+{
+    for (auto& shard : mShards) shard->stop();
+}
+
+DAWn::Relay::Stats DAWn::Relay::Relay::stats() const
+{
+    Stats stats{};
+    for (auto& shard : mShards) shard->addStats(stats);
+    return stats;
+}
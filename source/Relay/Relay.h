@@ -0,0 +1,75 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+
+#ifndef AUDIOSTREAMPLUGIN_RELAY_H
+#define AUDIOSTREAMPLUGIN_RELAY_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Members.h"
+
+/*!
+ * @brief The stream relay: every datagram a session member sends goes to the other members of its session.
+ *
+ * A session is a UDP port, its members are the addresses that send to it (see Members). Plugins point their
+ * transport.ip / transport.port at the relay and exchange wire v2 frames, commands and RTCP through it unchanged.
+ *
+ * Sessions are sharded over threads, one epoll loop per shard; a session lives on one shard so its fan-out never
+ * locks. Datagrams are read with recvmmsg and fanned out with sendmmsg straight from the receive buffers.
+ * Linux only.
+ */
+namespace DAWn::Relay
+{
+    struct Options
+    {
+        std::string     bind{"0.0.0.0"};
+        uint16_t        port{8899};             //!First session port.
+        uint16_t        sessions{1};            //!Sessions on port, port + 1 ...
+        unsigned        threads{0};             //!Shards, 0 is one per core (never more than sessions).
+        unsigned        batch{32};              //!Datagrams per recvmmsg.
+        size_t          maxMembers{kMaxMembers};
+        Clock::duration idle{std::chrono::seconds(10)}; //!Members report every second, silence this long means gone.
+        bool            echo{false};            //!Send members their own datagrams back too (single client tests).
+        int             socketBufferBytes{1 << 22};
+    };
+
+    struct Stats
+    {
+        uint64_t received{0};   //!Datagrams in.
+        uint64_t forwarded{0};  //!Datagrams out.
+        uint64_t invalid{0};    //!Not wire v2 nor RTCP.
+        uint64_t rejected{0};   //!From a new address to a full session.
+        uint64_t dropped{0};    //!Fan-out the socket had no room for.
+        uint64_t members{0};
+    };
+
+    class Relay
+    {
+    public:
+        explicit Relay(Options options);
+        ~Relay();
+        Relay(const Relay&) = delete;
+        Relay& operator=(const Relay&) = delete;
+
+        /*! @brief Open the session sockets and start the shards. @return False if a socket could not be opened.*/
+        bool start();
+        void stop();
+
+        Stats stats() const;
+        inline const Options& options() const { return mOptions; }
+
+    private:
+        class Shard;
+
+        Options                             mOptions;
+        std::vector<std::unique_ptr<Shard>> mShards{};
+    };
+}
+
+#endif //AUDIOSTREAMPLUGIN_RELAY_H
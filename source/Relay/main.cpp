@@ -0,0 +1,100 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+
+#include "Relay.h"
+
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+
+namespace
+{
+    std::atomic<bool> sStop{false};
+
+    void onSignal(int)
+    {
+        sStop.store(true);
+    }
+
+    void usage(const char* name)
+    {
+        std::cout << "Usage: " << name << " [options]\n"
+                  << "  --bind IP          Address to listen on (0.0.0.0).\n"
+                  << "  --port N           First session port (8899).\n"
+                  << "  --sessions N       Sessions, one port each from --port (1).\n"
+                  << "  --threads N        Shards, 0 is one per core (0).\n"
+                  << "  --batch N          Datagrams per recvmmsg (32).\n"
+                  << "  --max-members N    Members per session (32).\n"
+                  << "  --idle S           Seconds of silence before a member is dropped (10).\n"
+                  << "  --stats S          Print the counters every S seconds, 0 never (5).\n"
+                  << "  --echo             Send members their own datagrams back too.\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    DAWn::Relay::Options options{};
+    auto statsSeconds = 5l;
+
+    for (auto index = 1; index < argc; ++index)
+    {
+        std::string arg{argv[index]};
+        auto next = [&]() -> long {
+            if (index + 1 >= argc)
+            {
+                usage(argv[0]);
+                std::exit(1);
+            }
+            return std::strtol(argv[++index], nullptr, 10);
+        };
+
+        if (arg == "--bind" && index + 1 < argc) options.bind = argv[++index];
+        else if (arg == "--port") options.port = static_cast<uint16_t>(next());
+        else if (arg == "--sessions") options.sessions = static_cast<uint16_t>(next());
+        else if (arg == "--threads") options.threads = static_cast<unsigned>(next());
+        else if (arg == "--batch") options.batch = static_cast<unsigned>(next());
+        else if (arg == "--max-members") options.maxMembers = static_cast<size_t>(next());
+        else if (arg == "--idle") options.idle = std::chrono::seconds(next());
+        else if (arg == "--stats") statsSeconds = next();
+        else if (arg == "--echo") options.echo = true;
+        else
+        {
+            usage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+    if (options.sessions == 0 || options.port == 0 || options.port + options.sessions - 1 > 65535)
+    {
+        std::cout << "Relay: the session ports must fit 1..65535" << std::endl;
+        return 1;
+    }
+
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+
+    DAWn::Relay::Relay relay{options};
+    if (!relay.start()) return 1;
+
+    auto tick = std::chrono::milliseconds(100);
+    auto elapsed = std::chrono::milliseconds(0);
+    while (!sStop.load())
+    {
+        std::this_thread::sleep_for(tick);
+        elapsed += tick;
+        if (statsSeconds > 0 && elapsed >= std::chrono::seconds(statsSeconds))
+        {
+            elapsed = std::chrono::milliseconds(0);
+            auto stats = relay.stats();
+            std::cout << "Relay: in " << stats.received << " out " << stats.forwarded << " invalid " << stats.invalid
+                      << " rejected " << stats.rejected << " dropped " << stats.dropped << " members " << stats.members
+                      << std::endl;
+        }
+    }
+
+    relay.stop();
+    return 0;
+}
@@ -0,0 +1,60 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+
+#include "Trace.h"
+
+#include <iomanip>
+#include <sstream>
+
+const char* DAWn::Trace::name(Stage stage)
+{
+    switch (stage)
+    {
+        case Stage::Pushed:         return "capture->push";
+        case Stage::Popped:         return "push->pop";
+        case Stage::Encoded:        return "encode";
+        case Stage::Sent:           return "queue->send";
+        case Stage::SendTotal:      return "send total";
+        case Stage::Extracted:      return "recv->extract";
+        case Stage::Decoded:        return "extract->decode";
+        case Stage::Mixed:          return "decode->mix";
+        case Stage::PlayedOut:      return "mix->playout";
+        case Stage::ReceiveTotal:   return "receive total";
+        default:                    return "unknown";
+    }
+}
+
+std::vector<DAWn::Trace::StageReport> DAWn::Trace::Tracer::report() const
+{
+    std::vector<StageReport> stages{};
+    stages.reserve(kStages);
+    for (auto index = 0ul; index < kStages; ++index)
+    {
+        auto snapshot = mStages[index].snapshot();
+        stages.push_back(StageReport{
+            static_cast<Stage>(index),
+            snapshot.count,
+            snapshot.percentile(0.50),
+            snapshot.percentile(0.99),
+            snapshot.max});
+    }
+    return stages;
+}
+
+std::string DAWn::Trace::Tracer::format() const
+{
+    auto toMs = [](uint64_t microseconds) { return static_cast<double>(microseconds) / 1000.0; };
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(3);
+    for (auto& stage : report())
+    {
+        if (stage.count == 0) continue;
+        ss << std::left << std::setw(16) << name(stage.stage) << std::right
+           << " n " << std::setw(9) << stage.count
+           << " p50 " << std::setw(9) << toMs(stage.p50)
+           << " p99 " << std::setw(9) << toMs(stage.p99)
+           << " max " << std::setw(9) << toMs(stage.max) << " ms\n";
+    }
+    return ss.str();
+}
@@ -0,0 +1,180 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+
+#ifndef AUDIOSTREAMPLUGIN_TRACE_H
+#define AUDIOSTREAMPLUGIN_TRACE_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Histogram.h"
+
+/*!
+ * @brief Optional latency tracing of the audio path, per stage (debug.trace).
+ *
+ * Send side: processBlock capture -> BlockSizeAdapter push -> encoder thread pop -> opus encode -> datagram sent.
+ * Receive side: datagram received -> extractDecodeAndMix -> decode -> mixer thread -> getBlocksDelayed playout.
+ *
+ * The stage that finishes with a block publishes a Stamp for the samples it covers, the next stage finds it by
+ * sample position (the adapters change the block size, so a block is never the same object twice) and records
+ * the difference into the histogram of its stage. Everything is fixed size atomics: no locks and no allocation,
+ * the audio thread records too. Off by default, every call site checks Tracer::enabled() first.
+ */
+namespace DAWn::Trace
+{
+    using Clock = std::chrono::steady_clock;
+
+    /*! @brief Nanoseconds on the steady clock. 0 means no stamp.*/
+    inline uint64_t now()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count());
+    }
+
+    /*! @brief Each stage is the time since the previous one. SendTotal and ReceiveTotal span the whole side.*/
+    enum class Stage : size_t
+    {
+        Pushed,         //!processBlock capture to BlockSizeAdapter push.
+        Popped,         //!Push to encoder thread pop: the codec block waited for its last sample and the thread.
+        Encoded,        //!Opus encode.
+        Sent,           //!Handed to the stream to the datagram leaving the socket.
+        SendTotal,      //!processBlock capture to the datagram leaving the socket.
+        Extracted,      //!Datagram received to extractDecodeAndMix submitting it.
+        Decoded,        //!Submitted to decoded and pushed to the input BlockSizeAdapter.
+        Mixed,          //!Decoded to mixed by the mixer thread.
+        PlayedOut,      //!Mixed to played by processBlock, the jitter buffer delay is here.
+        ReceiveTotal,   //!Datagram received to played.
+        kCount
+    };
+    constexpr size_t kStages = static_cast<size_t>(Stage::kCount);
+
+    const char* name(Stage stage);
+
+    /*! @brief When a stage finished with a block, and when its side of the path started with it.*/
+    struct Stamp
+    {
+        uint64_t stampNs{0};
+        uint64_t originNs{0};
+    };
+
+    /*!
+     * @brief The latest stamps published, looked up by key and sample.
+     *
+     * A stamp covers the samples [first, end) of key (a peer, or 0 for the own stream). Any thread publishes, any
+     * thread finds: each slot is a seqlock, a reader that raced with a writer skips the slot. Old stamps are
+     * overwritten, a stamp nobody found in time is a sample less in the histograms, nothing else.
+     */
+    template <size_t kSlots>
+    class Ring
+    {
+        static_assert((kSlots & (kSlots - 1)) == 0, "kSlots must be a power of two");
+
+        struct Slot
+        {
+            std::atomic<uint32_t> seq{0};
+            std::atomic<uint64_t> key{0};
+            std::atomic<uint32_t> first{0};
+            std::atomic<uint32_t> end{0};
+            std::atomic<uint64_t> stampNs{0};
+            std::atomic<uint64_t> originNs{0};
+        };
+
+        std::atomic<size_t>         mHead{0};
+        std::array<Slot, kSlots>    mSlots{};
+
+    public:
+        void publish(uint64_t key, uint32_t first, uint32_t end, Stamp stamp)
+        {
+            auto& slot = mSlots[mHead.fetch_add(1, std::memory_order_relaxed) & (kSlots - 1)];
+            //A writer lapped by the ring still on this slot: drop this stamp rather than wait.
+            auto seq = slot.seq.load(std::memory_order_relaxed);
+            if ((seq & 1u) || !slot.seq.compare_exchange_strong(seq, seq + 1, std::memory_order_acquire)) return;
+            //The odd seq must be visible before any field store: a reader seeing a new field also sees it odd and retries.
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.key.store(key, std::memory_order_relaxed);
+            slot.first.store(first, std::memory_order_relaxed);
+            slot.end.store(end, std::memory_order_relaxed);
+            slot.stampNs.store(stamp.stampNs, std::memory_order_relaxed);
+            slot.originNs.store(stamp.originNs, std::memory_order_relaxed);
+            slot.seq.store(seq + 2, std::memory_order_release);
+        }
+
+        /*! @brief The newest stamp of key covering sample. @return false if there is none.*/
+        bool find(uint64_t key, uint32_t sample, Stamp& stamp) const
+        {
+            auto head = mHead.load(std::memory_order_relaxed);
+            for (auto age = 1ul; age <= kSlots && age <= head; ++age)
+            {
+                auto& slot = mSlots[(head - age) & (kSlots - 1)];
+                auto seq = slot.seq.load(std::memory_order_acquire);
+                if (seq & 1u) continue;
+                auto slotKey = slot.key.load(std::memory_order_relaxed);
+                auto first = slot.first.load(std::memory_order_relaxed);
+                auto end = slot.end.load(std::memory_order_relaxed);
+                Stamp found{slot.stampNs.load(std::memory_order_relaxed), slot.originNs.load(std::memory_order_relaxed)};
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.seq.load(std::memory_order_relaxed) != seq) continue;
+
+                //Unsigned, so it holds across the 32 bit timestamp wrap.
+                if (slotKey != key || sample - first >= end - first) continue;
+                stamp = found;
+                return true;
+            }
+            return false;
+        }
+    };
+
+    /*! @brief One stage since the Tracer was created. Times in microseconds.*/
+    struct StageReport
+    {
+        Stage       stage{Stage::Pushed};
+        uint64_t    count{0};
+        uint64_t    p50{0};
+        uint64_t    p99{0};
+        uint64_t    max{0};
+    };
+
+    /*!
+     * @brief The trace of one processor: its switch, the histogram of each stage and the rings the stages hand
+     * their stamps over with. AudioStreamPluginProcessor owns one, two plugin instances never mix their samples.
+     */
+    class Tracer
+    {
+    public:
+        /*! @brief The stamps handed from stage to stage.*/
+        Ring<64>     mCaptured{};   //!Own DAW blocks pushed to the encoder adapter, key 0.
+        Ring<64>     mEncoded{};    //!Own codec frames handed to the stream, key 0.
+        Ring<256>    mDecoded{};    //!Decoded frames per peer, key is the peer.
+        Ring<1024>   mMixed{};      //!Mixed DAW blocks waiting for playout (the jitter buffer delay), key 0.
+
+        Tracer() = default;
+        Tracer(const Tracer&) = delete;
+        Tracer& operator=(const Tracer&) = delete;
+
+        inline bool enabled() const { return mEnabled.load(std::memory_order_relaxed); }
+        inline void setEnabled(bool enabled) { mEnabled.store(enabled, std::memory_order_relaxed); }
+
+        /*! @brief Record toNs - fromNs into the histogram of stage, in microseconds. A missing or future stamp is skipped.*/
+        inline void record(Stage stage, uint64_t fromNs, uint64_t toNs)
+        {
+            if (fromNs == 0 || toNs < fromNs) return;
+            mStages[static_cast<size_t>(stage)].record((toNs - fromNs) / 1000);
+        }
+
+        /*! @brief Every stage, in path order. Any thread, any time.*/
+        std::vector<StageReport> report() const;
+        /*! @brief report() as text, a line per stage with samples, in milliseconds.*/
+        std::string format() const;
+
+    private:
+        std::atomic<bool>                               mEnabled{false};
+        std::array<DAWn::Metrics::Histogram, kStages>   mStages{};
+    };
+}
+
+#endif //AUDIOSTREAMPLUGIN_TRACE_H
@@ -8,112 +8,139 @@
 
 void Utilities::Buffer::BlockSizeAdapter::push(const std::vector<float>& buffer, uint32_t tsample)
 {
-    if (tsample <= mTimeStamp)
+    push(std::span<const float>(buffer), tsample);
+}
+
+void Utilities::Buffer::BlockSizeAdapter::push(std::span<const float> buffer, uint32_t tsample)
+{
+    applyRequestedReset();
+    auto reset = pendingReset.load(std::memory_order_acquire);
+    auto currentTimeStamp = reset == NORESET ? mTimeStamp.load(std::memory_order_relaxed) : static_cast<uint32_t>(reset);
+    if (tsample <= currentTimeStamp)
     {
         //RESET THE BUFFER in case the time stamp tp write is less than the current time stamp for read.
-        std::unique_lock<std::recursive_mutex> lock(internalBufferMutex);
-        peekAt = 0; writeAt = 0;
-        mTimeStamp = tsample;
+        setTimeStamp(tsample, true);
     }
     push(buffer.data(), buffer.size());
 }
 
 void Utilities::Buffer::BlockSizeAdapter::push(const float* buffer, size_t size)
 {
+    if (!internalBuffer)
     {
+        return;
+    }
+    applyRequestedReset();
 
-        std::unique_lock<std::recursive_mutex> lock(internalBufferMutex);
-        if (!internalBuffer)
-        {
-            return;
-        }
-
-        auto internalBufferData = internalBuffer.get();
-        auto dstPtr = &internalBufferData[writeAt];
-        if (writeAt + size >= MAXROUNDBUFFERSIZE)
-        {
-            //Copy the remaining data to the beginning of the buffer.
-            auto _bgn = &internalBufferData[peekAt];
-            auto _end = dstPtr;
-            std::copy(_bgn, _end, internalBufferData);
-
-            //Update the pointers.
-            writeAt = writeAt - peekAt;
-            peekAt = 0;
-
-            //Update the destination pointer.
-            dstPtr = &internalBufferData[writeAt];
-        }
-        std::copy(buffer, buffer + size, dstPtr);
-        writeAt += size;
-
+    auto reset = pendingReset.load(std::memory_order_acquire);
+    auto readAt = reset == NORESET ? peekAt.load(std::memory_order_acquire) : static_cast<uint32_t>(reset >> 32);
+    auto writeIndex = writeAt.load(std::memory_order_relaxed);
+    if (size > RINGSIZE - (writeIndex - readAt))
+    {
+        //No room, the consumer is too far behind.
+        return;
     }
+
+    auto internalBufferData = internalBuffer.get();
+    auto offset = writeIndex & RINGMASK;
+    auto firstPart = std::min<size_t>(size, RINGSIZE - offset);
+    std::copy(buffer, buffer + firstPart, &internalBufferData[offset]);
+    std::copy(buffer + firstPart, buffer + size, internalBufferData);
+
+    writeAt.store(writeIndex + static_cast<uint32_t>(size), std::memory_order_release);
+    if (pNotifier) pNotifier->notify();
 }
 
 
 void Utilities::Buffer::BlockSizeAdapter::pop(std::vector<float>& buffer, uint32_t& timeStamp)
 {
+    if (buffer.size() < outputBlockSize) buffer.resize(outputBlockSize);
     return pop(buffer.data(), timeStamp);
 }
 
 void Utilities::Buffer::BlockSizeAdapter::pop(float* buffer, uint32_t& timeStamp)
 {
+    applyPendingReset();
 
-    std::unique_lock<std::recursive_mutex> lock(internalBufferMutex);
-    //std::cout << "\nBFR POP PEEK@: " << peekAt << " WRITE@: " << writeAt << " SIZE: " << outputBlockSize << std::endl;
+    auto blockSize = outputBlockSize.load(std::memory_order_relaxed);
+    timeStamp = mTimeStamp.load(std::memory_order_relaxed);
+    mTimeStamp.store(timeStamp + mTimeStampStep.load(std::memory_order_relaxed), std::memory_order_relaxed);
 
-    timeStamp = mTimeStamp;
-    mTimeStamp += mTimeStampStep;
-    auto internalBufferData = internalBuffer.get();
-    auto srcPtr = &internalBufferData[peekAt];
-    if (peekAt + outputBlockSize >= MAXROUNDBUFFERSIZE)
+    auto readIndex = peekAt.load(std::memory_order_relaxed);
+    auto writeIndex = writeAt.load(std::memory_order_acquire);
+    if (writeIndex - readIndex < blockSize)
     {
-        print ("POP ovflw");
-        auto remaining = MAXROUNDBUFFERSIZE - peekAt;
-        std::copy(srcPtr, srcPtr + remaining, buffer);
-        std::copy(internalBufferData, internalBufferData + outputBlockSize - remaining, buffer + remaining);
-        peekAt = outputBlockSize - remaining;
-    }
-    else
-    {
-        std::copy(srcPtr, srcPtr + outputBlockSize, buffer);
-        peekAt += outputBlockSize;
+        std::fill(buffer, buffer + blockSize, 0.0f);
+        return;
     }
-    //std::cout << "AFT POP PEEK@: " << peekAt << " WRITE@: " << writeAt << " SIZE: " << outputBlockSize << std::endl;
 
+    auto internalBufferData = internalBuffer.get();
+    auto offset = readIndex & RINGMASK;
+    auto firstPart = std::min<size_t>(blockSize, RINGSIZE - offset);
+    std::copy(&internalBufferData[offset], &internalBufferData[offset] + firstPart, buffer);
+    std::copy(internalBufferData, internalBufferData + blockSize - firstPart, buffer + firstPart);
+
+    peekAt.store(readIndex + static_cast<uint32_t>(blockSize), std::memory_order_release);
+}
+
+void Utilities::Buffer::BlockSizeAdapter::applyPendingReset()
+{
+    auto reset = pendingReset.exchange(NORESET, std::memory_order_acq_rel);
+    if (reset == NORESET) return;
+    mTimeStamp.store(static_cast<uint32_t>(reset), std::memory_order_relaxed);
+    peekAt.store(static_cast<uint32_t>(reset >> 32), std::memory_order_release);
+}
+
+uint32_t Utilities::Buffer::BlockSizeAdapter::available() const
+{
+    auto reset = pendingReset.load(std::memory_order_acquire);
+    auto readIndex = reset == NORESET ? peekAt.load(std::memory_order_relaxed) : static_cast<uint32_t>(reset >> 32);
+    return writeAt.load(std::memory_order_acquire) - readIndex;
+}
+
+void Utilities::Buffer::BlockSizeAdapter::requestReset(size_t channs, size_t sz, uint32_t tsample)
+{
+    auto request = (static_cast<uint64_t>(channs & 0xFF) << 56) | (static_cast<uint64_t>(sz & 0xFFFFFF) << 32) | tsample;
+    mRequestedReset.store(request, std::memory_order_release);
+}
+
+void Utilities::Buffer::BlockSizeAdapter::applyRequestedReset()
+{
+    if (mRequestedReset.load(std::memory_order_relaxed) == NOREQUEST) return;
+    auto request = mRequestedReset.exchange(NOREQUEST, std::memory_order_acq_rel);
+    if (request == NOREQUEST) return;
+    setChannelsAndOutputBlockSize(static_cast<size_t>(request >> 56), static_cast<size_t>((request >> 32) & 0xFFFFFF));
+    setTimeStamp(static_cast<uint32_t>(request), true);
 }
 
 void Utilities::Buffer::BlockSizeAdapter::setChannelsAndOutputBlockSize (size_t channs, size_t sz)
 {
-    std::unique_lock<std::recursive_mutex> lock(internalBufferMutex);
-    if (!internalBuffer)
-    {
-        return;
-    }
-    this->mTimeStampStep = static_cast<uint32_t >(sz);
-    this->outputBlockSize = channs * sz;
+    this->mTimeStampStep.store(static_cast<uint32_t >(sz), std::memory_order_relaxed);
+    this->outputBlockSize.store(std::min<size_t>(channs * sz, RINGSIZE), std::memory_order_relaxed);
 }
 
 bool Utilities::Buffer::BlockSizeAdapter::isEmpty() const
 {
-    return peekAt == writeAt;
+    return available() == 0;
 }
 
 bool Utilities::Buffer::BlockSizeAdapter::dataReady() const
 {
-    auto peekAtEnd = peekAt + outputBlockSize;
-    peekAtEnd %= MAXROUNDBUFFERSIZE;
-    return peekAtEnd < writeAt;
+    auto blockSize = outputBlockSize.load(std::memory_order_relaxed);
+    return blockSize > 0 && available() >= blockSize;
 }
 
 
 void Utilities::Buffer::BlockSizeAdapter::setTimeStamp(uint32_t tsample, bool flush)
 {
-    std::unique_lock<std::recursive_mutex> lock(internalBufferMutex);
-    mTimeStamp = tsample;
-    if (flush)
+    applyRequestedReset();
+    auto reset = pendingReset.load(std::memory_order_acquire);
+    if (!flush && reset == NORESET)
     {
-        peekAt = 0;
-        writeAt = 0;
+        mTimeStamp.store(tsample, std::memory_order_relaxed);
+        return;
     }
-}
\ No newline at end of file
+    //The consumer owns peekAt, so the producer only requests the reset: read from writeAt (or the already requested index) on, at tsample.
+    uint64_t resetAt = flush ? writeAt.load(std::memory_order_relaxed) : static_cast<uint32_t>(reset >> 32);
+    pendingReset.store((resetAt << 32) | tsample, std::memory_order_release);
+}
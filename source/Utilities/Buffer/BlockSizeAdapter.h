@@ -5,7 +5,9 @@
 #ifndef AUDIOSTREAMPLUGIN_BLOCKSIZEADAPTER_H
 #define AUDIOSTREAMPLUGIN_BLOCKSIZEADAPTER_H
 
-#include <mutex>
+#include <atomic>
+#include <memory>
+#include <span>
 #include <queue>
 #include <vector>
 #include <thread>
@@ -15,17 +17,47 @@
 #include <algorithm>
 
 #include "Events.h"
+#include "Notifier.h"
 
 namespace Utilities::Buffer
 {
 
+    /*!
+     * @brief Single producer, single consumer block size adapter.
+     *
+     * Samples are pushed in chunks of any size and popped in blocks of outputBlockSize. The storage is a power of two
+     * ring indexed by free running 32 bit counters: the producer owns writeAt, the consumer owns peekAt, and each one
+     * publishes its counter with release and reads the other with acquire. Neither side ever takes a lock.
+     *
+     * Resets (a push with an older timestamp, setTimeStamp with flush) are requested by the producer and applied by
+     * the consumer on its next dataReady / pop, so peekAt keeps a single writer.
+     *
+     * Producer side: push, setTimeStamp, setChannelsAndOutputBlockSize. Consumer side: pop, dataReady, isEmpty.
+     * Any other thread: requestReset, applied by the producer before whatever it does next.
+     */
     class BlockSizeAdapter
     {
-        size_t peekAt{0};
-        size_t writeAt{0};
-        uint32_t mTimeStamp{0x0};
-        uint32_t mTimeStampStep{0};
-        std::recursive_mutex internalBufferMutex;
+        static constexpr uint32_t RINGSIZE = 1u << 20;
+        static constexpr uint32_t RINGMASK = RINGSIZE - 1;
+        /*! @brief No reset pending. A pending reset packs (writeAt << 32 | timeStamp).*/
+        static constexpr uint64_t NORESET = ~0ull;
+        /*! @brief No requestReset pending. A pending one packs (channels << 56 | samples per channel << 32 | timeStamp).*/
+        static constexpr uint64_t NOREQUEST = ~0ull;
+
+        alignas(64) std::atomic<uint32_t> peekAt{0};
+        alignas(64) std::atomic<uint32_t> writeAt{0};
+        alignas(64) std::atomic<uint64_t> pendingReset{NORESET};
+        std::atomic<uint32_t> mTimeStamp{0x0};
+        std::atomic<uint32_t> mTimeStampStep{0};
+        std::atomic<uint64_t> mRequestedReset{NOREQUEST};
+        DAWn::Events::Notifier* pNotifier{nullptr};
+
+        /*! @brief Consumer side. Apply a reset requested by the producer, if any.*/
+        void applyPendingReset();
+        /*! @brief Consumer side. Number of samples ready to be read, taking a pending reset into account.*/
+        uint32_t available() const;
+        /*! @brief Producer side. Apply a requestReset, if any.*/
+        void applyRequestedReset();
     public:
 
         void print(std::string msg)
@@ -37,28 +69,33 @@ namespace Utilities::Buffer
 
         BlockSizeAdapter(size_t sz) : outputBlockSize(sz) {}
         BlockSizeAdapter(size_t sz, size_t channs) : mTimeStampStep(static_cast<uint32_t>(sz)), outputBlockSize(channs * sz) {}
+        /*! @brief Copies the configuration and counters, not the samples. Do not copy an adapter that is in use.*/
         BlockSizeAdapter(const BlockSizeAdapter& other)
         {
-            mTimeStamp = other.mTimeStamp;
-            mTimeStampStep = other.mTimeStampStep;
-            writeAt = other.writeAt;
-            peekAt = other.peekAt;
-            outputBlockSize = other.outputBlockSize;
+            mTimeStamp = other.mTimeStamp.load();
+            mTimeStampStep = other.mTimeStampStep.load();
+            writeAt = other.writeAt.load();
+            peekAt = other.peekAt.load();
+            pendingReset = other.pendingReset.load();
+            mRequestedReset = other.mRequestedReset.load();
+            outputBlockSize = other.outputBlockSize.load();
+            pNotifier = other.pNotifier;
         }
 
-        ~BlockSizeAdapter()
-        {
-            std::unique_lock<std::recursive_mutex> lock(internalBufferMutex);
-            internalBuffer.reset();
-            lock.unlock();
-        }
+        ~BlockSizeAdapter() = default;
 
         /*! @brief Push a buffer of data into the adapter.
          *  @param buffer The buffer to push into the adapter.
          */
         void push(const std::vector<float>& buffer, uint32_t tsample);
+        void push(std::span<const float> buffer, uint32_t tsample);
 
-        /*! @brief Push a buffer of data into the adapter.
+        /*! @brief Wake up the consumer thread through notifier every time data is pushed. nullptr to stop notifying.
+         *  Set it before the producer starts pushing.
+         */
+        void setNotifier(DAWn::Events::Notifier* notifier) { pNotifier = notifier; }
+
+        /*! @brief Push a buffer of data into the adapter. If the ring has no room for it, the buffer is dropped.
          *  @param buffer The buffer to push into the adapter.
          *  @param size The size of the buffer.
          */
@@ -69,7 +106,7 @@ namespace Utilities::Buffer
          */
         void pop(std::vector<float>& buffer, uint32_t& tsample);
 
-        /*! @brief Pop a buffer of data from the adapter.
+        /*! @brief Pop a buffer of data from the adapter. If there is not a full block, buffer is filled with silence.
          *  @param buffer The buffer to pop from the adapter.
          */
         void pop(float* buffer, uint32_t& tsample);
@@ -96,11 +133,18 @@ namespace Utilities::Buffer
          */
         void setTimeStamp(uint32_t tsample, bool flush = true);
 
+        /*!
+         * @brief setChannelsAndOutputBlockSize then setTimeStamp(tsample), from a thread that is not the producer.
+         * The producer applies it before its next push or setTimeStamp. A newer request replaces one not applied yet.
+         * @param channs Up to 255.
+         * @param sz Samples per channel, below 2^24.
+         */
+        void requestReset(size_t channs, size_t sz, uint32_t tsample);
+
 
     private:
-        const size_t MAXROUNDBUFFERSIZE = 48000 * 2 * 10;
-        std::unique_ptr<float[]> internalBuffer{new float[MAXROUNDBUFFERSIZE]};
-        size_t outputBlockSize;
+        std::unique_ptr<float[]> internalBuffer{new float[RINGSIZE]};
+        std::atomic<size_t> outputBlockSize;
 
     };
 
@@ -3,19 +3,77 @@
 //
 
 #include "Utilities.h"
+#include "MixerKernels.h"
+
+#include <cstring>
+
+namespace
+{
+    //Up to this many channels the block pointers live on the stack and the frame goes through the layout kernels.
+    constexpr size_t kKernelChannels = 8;
+
+    /*!
+     * @brief Interleave numSamples of channels blocks into frame. Blocks is any indexable set of float blocks
+     * (vectors, spans). Missing blocks are silence, extra blocks are ignored. Does not allocate.
+     */
+    template <typename Blocks>
+    void interleaveInto(float* frame, const Blocks& blocks, size_t channels, size_t numSamples)
+    {
+        auto numBlocks = std::min(channels, static_cast<size_t>(blocks.size()));
+        auto fullBlocks = true;
+        for (auto channelIndex = 0lu; channelIndex < numBlocks; ++channelIndex) fullBlocks = fullBlocks && blocks[channelIndex].size() >= numSamples;
+
+        if (fullBlocks && channels <= kKernelChannels)
+        {
+            const float* planar[kKernelChannels]{};
+            for (auto channelIndex = 0lu; channelIndex < numBlocks; ++channelIndex) planar[channelIndex] = blocks[channelIndex].data();
+            Mixer::Kernels::Interleave(planar, channels, frame, numSamples);
+            return;
+        }
+
+        std::fill(frame, frame + numSamples * channels, 0.0f);
+        for (auto channelIndex = 0lu; channelIndex < numBlocks; ++channelIndex)
+        {
+            auto& block = blocks[channelIndex];
+            for (auto sampleIndex = 0lu; sampleIndex < std::min(numSamples, static_cast<size_t>(block.size())); ++sampleIndex)
+            {
+                frame[sampleIndex * channels + channelIndex] = block[sampleIndex];
+            }
+        }
+    }
+
+    /*!
+     * @brief Inverse of interleaveInto: numSamples of frame into each of channels blocks. Blocks must hold numSamples.
+     */
+    template <typename Blocks>
+    void deinterleaveInto(Blocks& blocks, const float* frame, size_t channels, size_t numSamples)
+    {
+        if (channels <= kKernelChannels)
+        {
+            float* planar[kKernelChannels]{};
+            for (auto channelIndex = 0lu; channelIndex < channels; ++channelIndex) planar[channelIndex] = blocks[channelIndex].data();
+            Mixer::Kernels::Deinterleave(frame, channels, planar, numSamples);
+            return;
+        }
+        for (auto channelIndex = 0lu; channelIndex < channels; ++channelIndex)
+        {
+            auto& block = blocks[channelIndex];
+            for (auto sampleIndex = 0lu; sampleIndex < numSamples; ++sampleIndex)
+            {
+                block[sampleIndex] = frame[sampleIndex * channels + channelIndex];
+            }
+        }
+    }
+}
 
 namespace Utilities::Buffer
 {
-    std::tuple <bool, uint32_t, int64_t, std::vector<std::byte>> extractIncomingData (std::vector<std::byte>& uid_ts_encodedPayload)
+    std::tuple <bool, DAWn::Wire::Header, std::span<const std::byte>> extractIncomingData (std::span<const std::byte> datagram)
     {
-        //[ UID [0-3] | TS [4-7] | PAYLOAD [8-N] ]
-        auto&src = uid_ts_encodedPayload;
-        if ( src.size() < 8) return std::make_tuple(false, 0, 0, ByteBuff {});
-        auto extractLast = [](auto&source, auto const n)-> ByteBuff {return ByteBuff(std::make_move_iterator(source.begin()+n), std::make_move_iterator(source.end()));};
-        ByteBuff payLoad(extractLast(src, 8));
-        int64_t nSample(*reinterpret_cast<uint32_t*>(extractLast(src, 4).data()));
-        uint32_t userID(*reinterpret_cast<uint32_t*>(src.data()));
-        return std::make_tuple(true, userID, nSample, payLoad);
+        //[ HEADER [0-15] | PAYLOAD [16-N] ]
+        DAWn::Wire::Header header{};
+        if (!DAWn::Wire::read(datagram, header)) return std::make_tuple(false, header, std::span<const std::byte> {});
+        return std::make_tuple(true, header, datagram.subspan(DAWn::Wire::kHeaderSize));
     }
 
     void splitChannels (std::vector<std::vector<float>>& channels, const juce::AudioBuffer<float>& buffer, const bool monoSplit)
@@ -46,11 +104,31 @@ namespace Utilities::Buffer
 
     }
 
+    void splitChannels (std::span<const std::span<float>> channels, const juce::AudioBuffer<float>& buffer, const bool monoSplit)
+    {
+        auto dawBlockSize = static_cast<size_t> (buffer.getNumSamples());
+        auto numChan = std::min(static_cast<size_t> (buffer.getNumChannels()), channels.size());
+        auto rdPtrs = buffer.getArrayOfReadPointers();
+
+        for (auto channelIndex = 0lu; channelIndex < numChan; ++channelIndex)
+        {
+            auto& channel = channels[channelIndex];
+            auto numSamples = std::min(dawBlockSize, channel.size());
+            std::copy(rdPtrs[channelIndex], rdPtrs[channelIndex] + numSamples, channel.begin());
+            std::fill(channel.begin() + static_cast<std::ptrdiff_t>(numSamples), channel.end(), 0.0f);
+        }
+        if (!monoSplit) return;
+        for (auto channelIndex = 0lu; channelIndex + 1 < numChan; channelIndex += 2)
+        {
+            Utilities::Buffer::monoSplit(channels[channelIndex], channels[channelIndex + 1]);
+        }
+    }
+
     void joinChannels (juce::AudioBuffer<float>& buffer, const std::vector<std::vector<float>>& channels)
     {
         buffer.clear();
         auto wrPtrs = buffer.getArrayOfWritePointers();
-        auto numChan = static_cast<size_t> (buffer.getNumChannels());
+        auto numChan = std::min(static_cast<size_t> (buffer.getNumChannels()), channels.size());
         for (auto channelIndex = 0lu; channelIndex < numChan; ++channelIndex)
         {
             std::copy (channels[channelIndex].begin(), channels[channelIndex].end(), wrPtrs[channelIndex]);
@@ -115,22 +193,22 @@ namespace Utilities::Buffer
     std::vector<float> interleaveBlocks(std::vector<float>& block0, std::vector<float>& block1)
     {
         jassert(block0.size() == block1.size());
-        std::vector<float> intBlock{};
-        auto numSamples = static_cast<size_t>(block0.size());
-        for(auto sampleIndex = 0lu; sampleIndex < numSamples; ++sampleIndex)
-        {
-            intBlock.push_back(block0[sampleIndex]);
-            intBlock.push_back(block1[sampleIndex]);
-        }
+        auto numSamples = std::min(block0.size(), block1.size());
+        std::vector<float> intBlock(numSamples << 1, 0.0f);
+        Mixer::Kernels::Active().interleave2(block0.data(), block1.data(), intBlock.data(), numSamples);
         return intBlock;
     }
     void interleaveBlocks(std::vector<std::vector<float>>& intBlocks, std::vector<std::vector<float>>&blocks)
     {
         jassert(blocks.size() % 2 == 0);
-        intBlocks.clear();
-        for (auto index = 0lu; index < blocks.size(); index += 2)
+        auto& kernels = Mixer::Kernels::Active();
+        intBlocks.resize(blocks.size() >> 1);
+        for (auto index = 0lu; index + 1 < blocks.size(); index += 2)
         {
-            intBlocks.push_back(interleaveBlocks(blocks[index], blocks[index+1]));
+            auto numSamples = std::min(blocks[index].size(), blocks[index + 1].size());
+            auto& intBlock = intBlocks[index >> 1];
+            intBlock.resize(numSamples << 1);
+            kernels.interleave2(blocks[index].data(), blocks[index + 1].data(), intBlock.data(), numSamples);
         }
     }
     /*void interleaveBlocks(std::vector<std::vector<float>>& interBlocks, std::vector<Buffer::BlockSizeAdapter>& bsa)
@@ -152,35 +230,22 @@ namespace Utilities::Buffer
 
     void interleaveBlocks (std::vector<std::vector<float>>& intChannels, juce::AudioBuffer<float>& buffer)
     {
-        auto& is = intChannels;
-        auto& b = buffer;
-        //layout
-        auto numChan = static_cast<size_t> (b.getNumChannels());
-        //Force Even Channels
-        bool forcingEven = numChan & 1;
-        auto numSamp = static_cast<size_t> (b.getNumSamples());
-        is.resize ((numChan + (forcingEven ? 1 : 0)) >> 1, std::vector<float> (numSamp << 1, 0.0f));
-        //interleave and force even parity
-        auto _rdPtrs = b.getArrayOfReadPointers(); auto rdPtrs = std::vector<const float*>(_rdPtrs, _rdPtrs + numChan);
-        std::vector<float> lstChann = std::vector<float> (numSamp, 0.0f);
-        if (forcingEven) rdPtrs.push_back(lstChann.data());
-        jassert(rdPtrs.size() % 2 == 0);
-        jassert(forcingEven ^ (rdPtrs[numChan - 1] != lstChann.data()));
-
-
-        //FROM THIS POINT ON ASSUME EVEN PARITY FOR THE NUMBER OF CHANNELS
-        //interleave
-        auto channelIndexOffset = 0lu;
-        for (auto& i : is)
+        //layout: one interleaved block per pair of channels, an odd last channel is paired with silence.
+        auto numChan = static_cast<size_t> (buffer.getNumChannels());
+        auto numSamp = static_cast<size_t> (buffer.getNumSamples());
+        auto rdPtrs = buffer.getArrayOfReadPointers();
+        auto& kernels = Mixer::Kernels::Active();
+
+        intChannels.resize ((numChan + 1) >> 1);
+        for (auto pairIndex = 0lu; pairIndex < intChannels.size(); ++pairIndex)
         {
-            std::iota (i.begin(), i.end(), 0.0f);
-            std::transform (i.begin(), i.end(), i.begin(), [rdPtrs, channelIndexOffset] (float& idx_) -> float {
-                auto idx = static_cast<size_t> (idx_);
-                auto channelIndex = channelIndexOffset + (idx % 2);
-                auto rdOffset = idx / 2;
-                return rdPtrs[channelIndex][rdOffset];
-            });
-            channelIndexOffset += 2;
+            auto leftChannelIndex = pairIndex << 1;
+            auto rightChannelIndex = leftChannelIndex + 1;
+            const float* pair[2] = {rdPtrs[leftChannelIndex], rightChannelIndex < numChan ? rdPtrs[rightChannelIndex] : nullptr};
+
+            auto& intChannel = intChannels[pairIndex];
+            intChannel.resize (numSamp << 1);
+            Mixer::Kernels::Interleave (pair, 2, intChannel.data(), numSamp, kernels);
         }
 
     }
@@ -191,45 +256,81 @@ namespace Utilities::Buffer
         jassert(interleavedBlocks.size() % 2 == 0);
         auto bothBlocksSize = interleavedBlocks.size() >> 1;
         auto blocks = std::vector<std::vector<float>>(2, std::vector<float>(bothBlocksSize, 0.0f));
-        for (auto index = 0lu; index < interleavedBlocks.size(); ++index)
-        {
-            blocks[index % 2][index >> 1] = interleavedBlocks[index];
-        }
+        Mixer::Kernels::Active().deinterleave2(interleavedBlocks.data(), blocks[0].data(), blocks[1].data(), bothBlocksSize);
         return blocks;
     }
 
     void deinterleaveBlocks (std::vector<std::vector<float>>&dBlocks,std::vector<float>&iBlocks)
     {
-        dBlocks.clear();
-        dBlocks.push_back(std::vector<float>{});
-        dBlocks.push_back(std::vector<float>{});
-        for (auto index = 0lu; index < iBlocks.size(); ++index)
+        //An odd trailing sample has no pair and is dropped.
+        auto numSamples = iBlocks.size() >> 1;
+        dBlocks.resize(2);
+        dBlocks[0].resize(numSamples);
+        dBlocks[1].resize(numSamples);
+        Mixer::Kernels::Active().deinterleave2(iBlocks.data(), dBlocks[0].data(), dBlocks[1].data(), numSamples);
+    }
+
+    void deinterleaveBlocks (std::vector<std::vector<float>>& blocks, std::vector<std::vector<float>>& interleavedBlocks)
+    {
+        auto& kernels = Mixer::Kernels::Active();
+        blocks.resize(interleavedBlocks.size() * 2);
+        for (auto index = 0lu; index < interleavedBlocks.size(); ++index)
         {
-            dBlocks[index % 2].push_back(iBlocks[index]);
+            auto numSamples = interleavedBlocks[index].size() >> 1;
+            auto& left = blocks[index << 1];
+            auto& right = blocks[(index << 1) + 1];
+            left.resize(numSamples);
+            right.resize(numSamples);
+            kernels.deinterleave2(interleavedBlocks[index].data(), left.data(), right.data(), numSamples);
         }
     }
 
-    void deinterleaveBlocks (std::vector<std::vector<float>>& blocks, std::vector<std::vector<float>>& interleavedBlocks)
+    void interleaveBlocks (std::vector<float>& interleaved, const std::vector<std::vector<float>>& blocks, size_t channels)
+    {
+        auto numSamples = blocks.empty() ? 0lu : blocks[0].size();
+        interleaved.resize(numSamples * channels);
+        interleaveInto(interleaved.data(), blocks, channels, numSamples);
+    }
+
+    std::span<const float> interleaveBlocks (std::span<float> interleaved, std::span<const std::span<const float>> blocks, size_t channels)
+    {
+        auto numSamples = blocks.empty() ? 0lu : blocks[0].size();
+        if (numSamples * channels > interleaved.size()) return {};
+        auto frame = interleaved.first(numSamples * channels);
+        interleaveInto(frame.data(), blocks, channels, numSamples);
+        return frame;
+    }
+
+    void deinterleaveBlocks (std::vector<std::vector<float>>& blocks, std::span<const float> interleaved, size_t channels)
     {
-        blocks = std::vector<std::vector<float>>(interleavedBlocks.size() * 2, std::vector<float>(interleavedBlocks[0].size() >> 1, 0.0f));
-        for (auto index = 0lu; index < interleavedBlocks.size(); index+=2)
+        if (channels == 0) return;
+        auto numSamples = interleaved.size() / channels;
+        blocks.resize(channels);
+        for (auto& block : blocks) block.resize(numSamples);
+        deinterleaveInto(blocks, interleaved.data(), channels, numSamples);
+    }
+
+    size_t deinterleaveBlocks (std::span<const std::span<float>> blocks, std::span<const float> interleaved, size_t channels)
+    {
+        if (channels == 0 || blocks.size() < channels) return 0;
+        auto numSamples = interleaved.size() / channels;
+        for (auto channelIndex = 0lu; channelIndex < channels; ++channelIndex)
         {
-            auto deinterleavedBlocks = deinterleaveBlock(interleavedBlocks[index]);
-            blocks[index] = deinterleavedBlocks[0];
-            blocks[index + 1] = deinterleavedBlocks[1];
+            if (blocks[channelIndex].size() < numSamples) return 0;
         }
+        deinterleaveInto(blocks, interleaved.data(), channels, numSamples);
+        return numSamples;
     }
 
     OpResult monoSplit (std::vector<float>& left, std::vector<float>& right)
+    {
+        return monoSplit(std::span<float>(left), std::span<float>(right));
+    }
+
+    OpResult monoSplit (std::span<float> left, std::span<float> right)
     {
         if (left.size() != right.size()) return OpResult::InvalidOperands;
-        auto numSamples = left.size();
-        for (auto sampleIndex = 0lu; sampleIndex < numSamples; ++sampleIndex)
-        {
-            left[sampleIndex] += right[sampleIndex];
-            left[sampleIndex] *= 0.5f;
-            right[sampleIndex] = left[sampleIndex];
-        }
+        Mixer::Kernels::Active().monoSplit(left.data(), right.data(), left.size());
         return OpResult::Success;
     }
 }
@@ -30,23 +30,41 @@ namespace DAWn::Utilities
             {"srate",               "uint64_t"},    //sample rate dflt:48000
             {"channels",            "uint64_t"},    //number of channels dflt:2
             {"mono",                "bool"},        //mono stream dlft:false
+            {"bitrate",             "uint32_t"},    //opus bitrate bps, 0 is auto dflt: 0
+            {"complexity",          "int"},         //opus complexity 0..10, -1 is the libopus default dflt: -1
+            {"vbr",                 "bool"},        //opus variable bitrate dflt: true
+            {"bandwidth",           "std::string"}, //opus bandwidth auto|narrowband|mediumband|wideband|superwideband|fullband dflt: auto
+            {"adaptbitrate",        "bool"},        //adapt the bitrate to loss and queue depth dflt: true
+            {"minbitrate",          "uint32_t"},    //bitrate adaptation lower bound dflt: 24000
+            {"maxbitrate",          "uint32_t"},    //bitrate adaptation upper bound dflt: 256000
             {"authEndpoint",        "std::string"}, //authEndpoint dflt:......
             {"wsEndpoint",          "std::string"}, //wsEndpoint dflt:......
             {"rtptype",             "std::string"}, //rtptype dflt:udpRTP
             {"port",                "int"},         //port dflt:8899
             {"ip",                  "std::string"}, //ip dlft:""
             {"rtrx",                "bool"},        //retransmision dflt: false
+            {"rtrxpackets",         "uint32_t"},    //sent packets kept for retransmission dflt: 64
+            {"batchedio",           "bool"},        //batched udp i/o (recvmmsg/sendmmsg) + poll wait dflt: false
+            {"batchsize",           "uint32_t"},    //datagrams per batch dflt: 32
+            {"polltimeoutms",       "int"},         //poll wait upper bound in ms dflt: 100
             {"opuscache",           "bool"},        //opuscache dflt: false
+            {"opusfec",             "bool"},        //opus in-band fec dflt: true
+            {"opuslossperc",        "uint32_t"},    //expected packet loss % for the opus fec dflt: 10
             {"prebuffersize",       "uint32_t"},    //prebuffersize dflt: 500 blocks (4.8x10^2 samplesperblock / 4.8x10^4 samplespersecond) x 500 blocks = (0.01 seconds x 500) = 5 seconds
             {"prebufferenabled",    "bool"},        //prebufferenabled dflt: false => will try to play once there is data
             {"mgmport",             "int"},         //mgmport dflt: 13001
             {"mgmip",               "std::string"}, //mgmip dflt: 0.0.0.0
             {"cli",                 "bool"},        //if true will listen to commands in the mgmport dflt: false
             {"delayseconds",        "uint32_t"},    //delayseconds dflt: 10
+            {"jitterbuffer",        "bool"},        //adaptive playout delay, if false delayseconds is used dflt: true
+            {"jittermindelayms",    "uint32_t"},    //adaptive playout delay lower bound dflt: 20
+            {"jittermaxdelayms",    "uint32_t"},    //adaptive playout delay upper bound dflt: 500
+            {"decodeworkers",       "uint32_t"},    //threads decoding the inbound peers, 0 decodes on the network thread dflt: 2
             {"wscommands",          "bool"},        //enable websocket commands (use mApikey etc). dflt true
             {"wsenroll",            "bool"},        //if enabled the enrollment would take place thru websocket channel, default true
             {"overridermssilence",  "bool"},        //if enabled process (and then streaming) will not be executed on silence. dflt: false
             {"requiresrole",        "bool"},        //if enabled process (and then streaming) will be executed only if role is defined. dflt: true
+            {"trace",               "bool"},        //per stage latency histograms of the audio path, printed every 30 seconds. dflt: false
             {"loopback",            "bool"}         //if enabled will loopback the audio. dflt: false
         };
         for(auto& [key, type] : optionalType)
@@ -106,22 +124,41 @@ namespace DAWn::Utilities
         if (j.find("srate")                 != j.end()) audio.srate = j["srate"];
         if (j.find("channels")              != j.end()) audio.channels = j["channels"];
         if (j.find("mono")                  != j.end()) audio.mono = j["mono"];
+        if (j.find("bitrate")               != j.end()) audio.bitrate = j["bitrate"];
+        if (j.find("complexity")            != j.end()) audio.complexity = j["complexity"];
+        if (j.find("vbr")                   != j.end()) audio.vbr = j["vbr"];
+        if (j.find("bandwidth")             != j.end()) audio.bandwidth = j["bandwidth"];
+        if (j.find("adaptbitrate")          != j.end()) audio.adaptbitrate = j["adaptbitrate"];
+        if (j.find("minbitrate")            != j.end()) audio.minbitrate = j["minbitrate"];
+        if (j.find("maxbitrate")            != j.end()) audio.maxbitrate = j["maxbitrate"];
 
         if (j.find("rtptype")               != j.end()) transport.rtptype = j["rtptype"];
         if (j.find("port")                  != j.end()) transport.port = j["port"];
         if (j.find("ip")                    != j.end()) transport.ip = j["ip"];
         if (j.find("role")                  != j.end()) transport.role = j["role"];
+        if (j.find("rtrx")                  != j.end()) transport.rtrx = j["rtrx"];
+        if (j.find("rtrxpackets")           != j.end()) transport.rtrxpackets = j["rtrxpackets"];
+        if (j.find("batchedio")             != j.end()) transport.batchedio = j["batchedio"];
+        if (j.find("batchsize")             != j.end()) transport.batchsize = j["batchsize"];
+        if (j.find("polltimeoutms")         != j.end()) transport.polltimeoutms = j["polltimeoutms"];
 
         if (j.find("opuscache")             != j.end()) options.opuscache = j["opuscache"];
+        if (j.find("opusfec")               != j.end()) options.opusfec = j["opusfec"];
+        if (j.find("opuslossperc")          != j.end()) options.opuslossperc = j["opuslossperc"];
         if (j.find("mgmport")               != j.end()) options.mgmport = j["mgmport"];
         if (j.find("mgmip")                 != j.end()) options.mgmip = j["mgmip"];
         if (j.find("cli")                   != j.end()) options.cli = j["cli"];
         if (j.find("wscommands")            != j.end()) options.wscommands = j["wscommands"];
         if (j.find("wsenroll")              != j.end()) options.wsenroll = j["wsenroll"];
         if (j.find("delayseconds")          != j.end()) options.delayseconds = j["delayseconds"];
+        if (j.find("jitterbuffer")          != j.end()) options.jitterbuffer = j["jitterbuffer"];
+        if (j.find("jittermindelayms")      != j.end()) options.jittermindelayms = j["jittermindelayms"];
+        if (j.find("jittermaxdelayms")      != j.end()) options.jittermaxdelayms = j["jittermaxdelayms"];
+        if (j.find("decodeworkers")         != j.end()) options.decodeworkers = j["decodeworkers"];
 
         if (j.find("overridermssilence")    != j.end()) debug.overridermssilence = j["overridermssilence"];
         if (j.find("requiresrole")          != j.end()) debug.requiresrole = j["requiresrole"];
+        if (j.find("trace")                 != j.end()) debug.trace = j["trace"];
 
 
 
@@ -139,22 +176,41 @@ namespace DAWn::Utilities
             {"srate", audio.srate},
             {"channels", audio.channels},
             {"mono", audio.mono},
+            {"bitrate", audio.bitrate},
+            {"complexity", audio.complexity},
+            {"vbr", audio.vbr},
+            {"bandwidth", audio.bandwidth},
+            {"adaptbitrate", audio.adaptbitrate},
+            {"minbitrate", audio.minbitrate},
+            {"maxbitrate", audio.maxbitrate},
 
             {"rtptype", transport.rtptype},
             {"port", transport.port},
             {"ip", transport.ip},
             {"role", transport.role},
+            {"rtrx", transport.rtrx},
+            {"rtrxpackets", transport.rtrxpackets},
+            {"batchedio", transport.batchedio},
+            {"batchsize", transport.batchsize},
+            {"polltimeoutms", transport.polltimeoutms},
 
             {"opuscache", options.opuscache},
+            {"opusfec", options.opusfec},
+            {"opuslossperc", options.opuslossperc},
             {"mgmport", options.mgmport},
             {"mgmip", options.mgmip},
             {"cli", options.cli},
             {"wscommands", options.wscommands},
             {"wsenroll", options.wsenroll},
             {"delayseconds", options.delayseconds},
+            {"jitterbuffer", options.jitterbuffer},
+            {"jittermindelayms", options.jittermindelayms},
+            {"jittermaxdelayms", options.jittermaxdelayms},
+            {"decodeworkers", options.decodeworkers},
 
             {"overridermssilence", debug.overridermssilence},
             {"requiresrole", debug.requiresrole},
+            {"trace", debug.trace},
 
         };
         std::cout << j.dump(4) << std::endl;
@@ -19,8 +19,20 @@ namespace DAWn::Utilities
         struct {
             uint64_t bsize = 480;
             uint64_t srate = 48000;
+            /*! @brief Channels streamed. More than 2 are coded as one multistream Opus packet per block.*/
             uint64_t channels = 2;
             bool mono = false;
+            /*! @brief Opus bitrate in bits per second, 0 lets libopus pick. The frame duration is bsize / srate.*/
+            uint32_t bitrate = 0;
+            /*! @brief Opus complexity 0..10, -1 keeps the libopus default.*/
+            int complexity = -1;
+            bool vbr = true;
+            /*! @brief auto, narrowband, mediumband, wideband, superwideband or fullband.*/
+            std::string bandwidth{"auto"};
+            /*! @brief Adapt the bitrate between minbitrate and maxbitrate from the loss and the outbound queue depth.*/
+            bool adaptbitrate = true;
+            uint32_t minbitrate = 24000;
+            uint32_t maxbitrate = 256000;
         } audio;
 
         struct {
@@ -34,7 +46,14 @@ namespace DAWn::Utilities
             int port{8899};
             std::string ip{"127.0.0.1"};
             std::string role{"none"};
+            /*! @brief NACK based retransmission of lost packets that can still be played. dflt: false*/
             bool rtrx{false};
+            /*! @brief Sent packets kept per stream for retransmission, fixed memory (1472 bytes each). dflt: 64*/
+            uint32_t rtrxpackets{64};
+            /*! @brief Batched socket I/O (recvmmsg / sendmmsg on Linux) with a blocking poll wait. dflt: false*/
+            bool batchedio{false};
+            uint32_t batchsize{32};
+            int polltimeoutms{100};
         }transport;
 
         struct {
@@ -44,6 +63,10 @@ namespace DAWn::Utilities
 
         struct {
             bool opuscache = false;
+            /*! @brief Opus in-band FEC, lets the receiver rebuild a lost packet from the next one. dflt: true*/
+            bool opusfec = true;
+            /*! @brief Expected packet loss (%) the encoder tunes its FEC for. dflt: 10*/
+            uint32_t opuslossperc = 10;
 
 
             int mgmport {0};
@@ -53,6 +76,12 @@ namespace DAWn::Utilities
             bool wscommands {true};
             bool wsenroll {true};
             uint32_t delayseconds {0};
+            /*! @brief Adaptive playout delay between jittermindelayms and jittermaxdelayms. If false delayseconds is used. dflt: true*/
+            bool jitterbuffer {true};
+            uint32_t jittermindelayms {20};
+            uint32_t jittermaxdelayms {500};
+            /*! @brief Threads decoding the inbound peers, a peer always decodes on the same one. 0 decodes on the network thread. dflt: 2*/
+            uint32_t decodeworkers {2};
 
         }options;
 
@@ -72,6 +101,11 @@ namespace DAWn::Utilities
              */
             bool requiresrole = true;
 
+            /*!
+             * @brief Per stage latency histograms of the audio path, from processBlock capture to playout (DAWn::Trace). Printed every 30 seconds. dflt: false
+             */
+            bool trace = false;
+
 
             /*!
              * @brief LOOPBACK if enabled NO NETWORK STREAMING WILL TAKE PLACE. Data will be pushed into the BSA then ENCODED then DECODED then pushed into the BSA again and then it will go into the audio mixer to replace whatever is in the audio playhead.
@@ -0,0 +1,151 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+
+#ifndef AUDIOSTREAMPLUGIN_COPYONWRITE_H
+#define AUDIOSTREAMPLUGIN_COPYONWRITE_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Realtime.h"
+
+namespace DAWn::Events
+{
+    /*!
+     * @brief A value read without locks and copied on write (RCU).
+     *
+     * The value is an immutable snapshot behind an atomic pointer. A reader enters a read section, which pins the
+     * snapshot current at that moment, and uses it without any lock. A writer copies the snapshot, changes the copy
+     * and publishes it with a pointer swap, so a reader never sees a half updated value.
+     *
+     * Reclamation is epoch based. Readers announce themselves in the counter of the current epoch (two counters,
+     * epoch parity) before loading the snapshot. Publishing flips the epoch and retires the old snapshot. A retired
+     * snapshot is freed once each counter has been seen at zero after it was retired: every reader that could hold
+     * it has left. New readers go to the other counter after a flip, so the counters drain within two publishes.
+     * Writers never wait for readers, so a thread may write while it is inside a read section.
+     *
+     * Reading is lock free and does not allocate: it is safe on the audio thread. Writing takes a mutex, copies
+     * and allocates.
+     */
+    template <typename T>
+    class CopyOnWrite
+    {
+    public:
+        /*!
+         * @brief A read section. The snapshot it pins stays valid until it is destroyed. Keep it short: retired
+         * snapshots are freed only after every read section that saw them is over.
+         */
+        class ReadGuard
+        {
+            const CopyOnWrite*  pOwner;
+            size_t              mParity;
+            const T*            pValue;
+
+        public:
+            ReadGuard(const CopyOnWrite* owner, size_t parity, const T* value) : pOwner(owner), mParity(parity), pValue(value) {}
+            ReadGuard(const ReadGuard&) = delete;
+            ReadGuard& operator=(const ReadGuard&) = delete;
+            ~ReadGuard() { pOwner->mReaders[mParity].fetch_sub(1, std::memory_order_release); }
+
+            inline const T& operator*() const { return *pValue; }
+            inline const T* operator->() const { return pValue; }
+        };
+
+        CopyOnWrite() : mCurrent(new T{}) {}
+        CopyOnWrite(const CopyOnWrite&) = delete;
+        CopyOnWrite& operator=(const CopyOnWrite&) = delete;
+        ~CopyOnWrite()
+        {
+            delete mCurrent.load(std::memory_order_acquire);
+            for (auto& retired : mRetired) delete retired.pValue;
+        }
+
+        /*! @brief Enter a read section. Lock free: it only retries if a publish flips the epoch in between.*/
+        ReadGuard read() const
+        {
+            while (true)
+            {
+                auto epoch = mEpoch.load(std::memory_order_seq_cst);
+                auto parity = static_cast<size_t>(epoch & 1);
+                mReaders[parity].fetch_add(1, std::memory_order_seq_cst);
+                auto value = mCurrent.load(std::memory_order_seq_cst);
+                if (mEpoch.load(std::memory_order_seq_cst) == epoch)
+                {
+                    return ReadGuard{this, parity, value};
+                }
+                mReaders[parity].fetch_sub(1, std::memory_order_release);
+            }
+        }
+
+        /*!
+         * @brief Change the value. Writers are serialized.
+         * @param change Called with the current snapshot, returns the next one (std::unique_ptr<T>) or nullptr to
+         * leave the value as it is.
+         * @return True if a new snapshot was published.
+         */
+        template <typename Change>
+        bool update(Change&& change)
+        {
+            std::lock_guard lock(mWriterMutex);
+            std::unique_ptr<T> next = change(*mCurrent.load(std::memory_order_acquire));
+            if (!next) return false;
+            publish(next.release());
+            return true;
+        }
+
+        /*! @brief Snapshots published but not freed yet, readers still in their epoch.*/
+        size_t retired() const
+        {
+            std::lock_guard lock(mWriterMutex);
+            return mRetired.size();
+        }
+
+    private:
+        struct Retired
+        {
+            const T*    pValue;
+            /*! @brief The counter of each parity was seen at zero since the snapshot was retired.*/
+            bool        drained[2]{false, false};
+        };
+
+        /*! @brief Swap in next, retire the previous snapshot and free what no reader can hold anymore. Under mWriterMutex.*/
+        void publish(const T* next)
+        {
+            auto previous = mCurrent.exchange(next, std::memory_order_seq_cst);
+            mEpoch.fetch_add(1, std::memory_order_seq_cst);
+            mRetired.push_back(Retired{previous});
+            reclaim();
+        }
+
+        void reclaim()
+        {
+            //A reader counts itself before it loads the snapshot: one holding a retired snapshot is counted since before
+            //the retirement, so a zero seen afterwards means it left. Readers arriving later only see newer snapshots.
+            bool drained[2] = {
+                mReaders[0].load(std::memory_order_seq_cst) == 0,
+                mReaders[1].load(std::memory_order_seq_cst) == 0};
+            auto kept = 0ul;
+            for (auto& retired : mRetired)
+            {
+                retired.drained[0] = retired.drained[0] || drained[0];
+                retired.drained[1] = retired.drained[1] || drained[1];
+                if (retired.drained[0] && retired.drained[1]) delete retired.pValue;
+                else mRetired[kept++] = retired;
+            }
+            mRetired.resize(kept);
+        }
+
+        std::atomic<const T*>                               mCurrent;
+        std::atomic<uint64_t>                               mEpoch{0};
+        mutable std::array<std::atomic<uint32_t>, 2>        mReaders{};
+        mutable DAWn::Realtime::CheckedMutex<std::mutex>    mWriterMutex;
+        std::vector<Retired>                                mRetired{};
+    };
+}
+
+#endif //AUDIOSTREAMPLUGIN_COPYONWRITE_H
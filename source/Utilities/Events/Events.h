@@ -5,10 +5,17 @@
 #ifndef WSCONNECT_SIGNALSSLOTS_H
 #define WSCONNECT_SIGNALSSLOTS_H
 
+#include <atomic>
+#include <memory>
 #include <utility>
+#include <algorithm>
 #include <functional>
+#include <iterator>
 #include <type_traits>
-#include <unordered_map>
+#include <vector>
+
+#include "CopyOnWrite.h"
+#include "InplaceSlot.h"
 namespace DAWn::Events
 {
     template <typename T, typename IDType = int32_t>
@@ -22,7 +29,7 @@ namespace DAWn::Events
         IDType mId{0};
 
      private:
-        inline static int32_t sId{0};
+        inline static std::atomic<int32_t> sId{0};
 
     };
 
@@ -36,31 +43,44 @@ namespace DAWn::Events
     template <typename T, typename... Args, typename... Params>
     struct is_callable_with<T (Params...), Args...> : std::integral_constant<bool, sizeof...(Args) == sizeof...(Params)> {};
 
-    template<typename... Args>
-    class Signal : public Id<Signal<Args...>>
+    /*!
+     * @brief A signal: Emit calls every connected slot with the arguments.
+     *
+     * The slot list is copied on write (CopyOnWrite): Emit walks a snapshot without any lock or allocation, Connect
+     * and Disconnect publish a new list. They may run on any thread, also from inside a slot. A slot disconnected
+     * while another thread is emitting can still be called by that Emit.
+     *
+     * Emit passes the arguments by reference down to the slots: declare big arguments as const& in Args so no copy
+     * is made at all.
+     *
+     * @tparam SlotType The callable stored per slot: std::function (Signal) or InplaceSlot (InplaceSignal), which
+     * never allocates.
+     */
+    template<typename SlotType, typename... Args>
+    class BasicSignal : public Id<BasicSignal<SlotType, Args...>>
     {
 
     public:
         using SlotId    = size_t;
-        using Slot      = std::function<void(Args...)>;
+        using Slot      = SlotType;
 
         /*!
          * @brief Default constructor.
          */
-        Signal() = default;
-        ~Signal() = default;
+        BasicSignal() = default;
+        ~BasicSignal() = default;
 
         /*!
          * @brief Copy constructor. Deleted, because we don't want to copy the signal.
          */
-        Signal(const Signal &) = delete;
-        Signal &operator=(const Signal &) = delete;
+        BasicSignal(const BasicSignal &) = delete;
+        BasicSignal &operator=(const BasicSignal &) = delete;
 
         /*!
          * @brief Move constructor. Deleted, because we don't want to move the signal.
          */
-        Signal(Signal &&) = delete;
-        Signal &operator=(Signal &&) = delete;
+        BasicSignal(BasicSignal &&) = delete;
+        BasicSignal &operator=(BasicSignal &&) = delete;
 
         /*!
          * @brief Authenticate a slot to the signal.
@@ -135,33 +155,79 @@ namespace DAWn::Events
          * @param signal The signal to connect to the signal.
          * @return The SlotId of the slot you just connected.
          */
-        SlotId Connect(Signal<Args...> const& signal)
+        SlotId Connect(BasicSignal const& signal)
+        {
+            return Connect([pSignal = &signal](Args... args) { pSignal->Emit(args...); });
+        }
+
+        /*!
+         * @brief Connect any callable taking Args..., a lambda for instance. It is stored as a Slot.
+         */
+        template <typename F>
+        requires (!std::is_same_v<std::decay_t<F>, Slot> && std::is_invocable_v<std::decay_t<F>&, Args...>)
+        SlotId Connect(F&& func)
         {
-            return Connect([=](Args... args) { signal.Emit(args...); });
+            return Connect(Slot{std::forward<F>(func)});
         }
 
-        SlotId Connect(Slot const& slot)
+        SlotId Connect(Slot slot)
         {
-            mSlots.insert(std::make_pair(++mSlotId, slot));
-            return mSlotId;
+            auto slotId = mSlotId.fetch_add(1, std::memory_order_relaxed) + 1;
+            mSlots.update([&](const Slots& current) {
+                auto next = std::make_unique<Slots>();
+                next->reserve(current.size() + 1);
+                next->insert(next->end(), current.begin(), current.end());
+                next->push_back(SlotEntry{slotId, std::move(slot)});
+                return next;
+            });
+            return slotId;
         }
 
         void Disconnect(SlotId slotId)
         {
-            mSlots.erase(slotId);
+            mSlots.update([slotId](const Slots& current) -> std::unique_ptr<Slots> {
+                auto isSlot = [slotId](const SlotEntry& entry) { return entry.id == slotId; };
+                if (std::none_of(current.begin(), current.end(), isSlot)) return nullptr;
+                auto next = std::make_unique<Slots>();
+                next->reserve(current.size() - 1);
+                std::copy_if(current.begin(), current.end(), std::back_inserter(*next), [&](const SlotEntry& entry) { return !isSlot(entry); });
+                return next;
+            });
         }
 
-        void Emit(Args... args)
+        /*!
+         * @brief Call every slot, in connection order. Lock free and allocation free (for InplaceSlot, and for
+         * std::function slots taking their arguments by reference).
+         */
+        template <typename... EmitArgs>
+        void Emit(EmitArgs&&... args) const
         {
-            for (auto &slot : mSlots)
+            auto slots = mSlots.read();
+            for (auto& entry : *slots)
             {
-                slot.second(args...);
+                entry.slot(args...);
             }
         }
 
     private:
-        std::unordered_map<SlotId, Slot> mSlots;
-        SlotId mSlotId{0};
+        struct SlotEntry
+        {
+            SlotId  id;
+            Slot    slot;
+        };
+        using Slots = std::vector<SlotEntry>;
+
+        CopyOnWrite<Slots>      mSlots{};
+        std::atomic<SlotId>     mSlotId{0};
     };
+
+    template<typename... Args>
+    using Signal = BasicSignal<std::function<void(Args...)>, Args...>;
+
+    /*!
+     * @brief A Signal whose slots never allocate. Connect lambdas capturing at most 32 bytes (this and a pointer or two).
+     */
+    template<typename... Args>
+    using InplaceSignal = BasicSignal<InplaceSlot<void(Args...)>, Args...>;
 }
 #endif //WSCONNECT_SIGNALSSLOTS_H
@@ -0,0 +1,125 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+
+#ifndef AUDIOSTREAMPLUGIN_INPLACESLOT_H
+#define AUDIOSTREAMPLUGIN_INPLACESLOT_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace DAWn::Events
+{
+    template <typename Signature, size_t Capacity = 32>
+    class InplaceSlot;
+
+    /*!
+     * @brief A std::function that keeps its callable inside the object: building, copying and calling it never
+     * allocates. A callable bigger than Capacity bytes does not compile, capture less (a pointer to the owner).
+     *
+     *     DAWn::Events::InplaceSlot<void(int)> slot{[this](int value){ onValue(value); }};
+     */
+    template <typename R, typename... Params, size_t Capacity>
+    class InplaceSlot<R(Params...), Capacity>
+    {
+    public:
+        InplaceSlot() = default;
+
+        template <typename F>
+        requires (!std::is_same_v<std::decay_t<F>, InplaceSlot> && std::is_invocable_r_v<R, std::decay_t<F>&, Params...>)
+        InplaceSlot(F&& callable)
+        {
+            using Callable = std::decay_t<F>;
+            static_assert(sizeof(Callable) <= Capacity, "The callable does not fit the slot: capture less or raise Capacity.");
+            static_assert(alignof(Callable) <= alignof(std::max_align_t), "The callable is over aligned.");
+            static_assert(std::is_copy_constructible_v<Callable>, "Slots are copied with the slot list: the callable must be copyable.");
+            static_assert(std::is_nothrow_move_constructible_v<Callable>, "The callable must be nothrow movable.");
+            ::new (static_cast<void*>(mStorage)) Callable(std::forward<F>(callable));
+            pOps = &sOps<Callable>;
+        }
+
+        InplaceSlot(const InplaceSlot& other) : pOps(other.pOps)
+        {
+            if (pOps) pOps->copy(mStorage, other.mStorage);
+        }
+
+        InplaceSlot(InplaceSlot&& other) noexcept : pOps(other.pOps)
+        {
+            if (pOps) pOps->move(mStorage, other.mStorage);
+        }
+
+        InplaceSlot& operator=(const InplaceSlot& other)
+        {
+            if (this == &other) return *this;
+            reset();
+            if (other.pOps) other.pOps->copy(mStorage, other.mStorage);
+            pOps = other.pOps;
+            return *this;
+        }
+
+        InplaceSlot& operator=(InplaceSlot&& other) noexcept
+        {
+            if (this == &other) return *this;
+            reset();
+            if (other.pOps) other.pOps->move(mStorage, other.mStorage);
+            pOps = other.pOps;
+            return *this;
+        }
+
+        ~InplaceSlot() { reset(); }
+
+        /*! @brief Call the callable. Calling an empty slot is undefined, check it with operator bool.*/
+        R operator()(Params... params) const
+        {
+            return pOps->invoke(const_cast<std::byte*>(mStorage), std::forward<Params>(params)...);
+        }
+
+        explicit operator bool() const { return pOps != nullptr; }
+
+    private:
+        struct Ops
+        {
+            R       (*invoke)(void* storage, Params&&... params);
+            void    (*copy)(void* dst, const void* src);
+            void    (*move)(void* dst, void* src) noexcept;
+            void    (*destroy)(void* storage) noexcept;
+        };
+
+        template <typename Callable>
+        static R invokeCallable(void* storage, Params&&... params)
+        {
+            return (*static_cast<Callable*>(storage))(std::forward<Params>(params)...);
+        }
+        template <typename Callable>
+        static void copyCallable(void* dst, const void* src)
+        {
+            ::new (dst) Callable(*static_cast<const Callable*>(src));
+        }
+        template <typename Callable>
+        static void moveCallable(void* dst, void* src) noexcept
+        {
+            ::new (dst) Callable(std::move(*static_cast<Callable*>(src)));
+        }
+        template <typename Callable>
+        static void destroyCallable(void* storage) noexcept
+        {
+            static_cast<Callable*>(storage)->~Callable();
+        }
+
+        template <typename Callable>
+        inline static constexpr Ops sOps{&invokeCallable<Callable>, &copyCallable<Callable>, &moveCallable<Callable>, &destroyCallable<Callable>};
+
+        void reset()
+        {
+            if (pOps) pOps->destroy(mStorage);
+            pOps = nullptr;
+        }
+
+        alignas(std::max_align_t) std::byte mStorage[Capacity]{};
+        const Ops* pOps{nullptr};
+    };
+}
+
+#endif //AUDIOSTREAMPLUGIN_INPLACESLOT_H
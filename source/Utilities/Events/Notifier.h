@@ -0,0 +1,63 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+
+#ifndef AUDIOSTREAMPLUGIN_NOTIFIER_H
+#define AUDIOSTREAMPLUGIN_NOTIFIER_H
+
+#include <atomic>
+#include <cstdint>
+
+namespace DAWn::Events
+{
+    /*!
+     * @brief Wake up a worker thread when there is work for it.
+     *
+     * A sequence number is bumped on every notify. A worker takes a ticket (the current sequence), does all the
+     * pending work and then waits on that ticket: if anything was notified in between, wait returns right away, so
+     * no wakeup is lost. The wait is a std::atomic wait (a futex on Linux, ulock on macOS).
+     *
+     * notify never blocks and only enters the kernel when a worker is actually sleeping, so it is safe to call from
+     * the audio thread.
+     *
+     *     auto ticket = notifier.ticket();
+     *     processPendingWork();
+     *     notifier.wait(ticket);
+     */
+    class Notifier
+    {
+    public:
+        using Ticket = uint32_t;
+
+        Notifier() = default;
+        Notifier(const Notifier&) = delete;
+        Notifier& operator=(const Notifier&) = delete;
+
+        /*! @brief The current sequence. Take it BEFORE looking for work.*/
+        Ticket ticket() const
+        {
+            return mSequence.load(std::memory_order_acquire);
+        }
+
+        /*! @brief Signal there is work. Wakes every waiting worker.*/
+        void notify()
+        {
+            mSequence.fetch_add(1, std::memory_order_seq_cst);
+            if (mWaiters.load(std::memory_order_seq_cst) > 0) mSequence.notify_all();
+        }
+
+        /*! @brief Sleep until a notify happens after ticket was taken. Returns immediately if it already did.*/
+        void wait(Ticket ticket)
+        {
+            mWaiters.fetch_add(1, std::memory_order_seq_cst);
+            mSequence.wait(ticket, std::memory_order_seq_cst);
+            mWaiters.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+    private:
+        std::atomic<Ticket> mSequence{0};
+        std::atomic<uint32_t> mWaiters{0};
+    };
+}
+
+#endif //AUDIOSTREAMPLUGIN_NOTIFIER_H
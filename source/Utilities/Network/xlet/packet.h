@@ -0,0 +1,196 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+
+#ifndef XLET_PACKET_H
+#define XLET_PACKET_H
+
+#include <span>
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+#ifndef XLET_MAXBLOCKSIZE
+#define XLET_MAXBLOCKSIZE_SHIFTER   13
+#define XLET_MAXBLOCKSIZE           (1 << XLET_MAXBLOCKSIZE_SHIFTER)
+#endif
+
+namespace xlet
+{
+    class PacketPool;
+
+    /*!
+     * @brief Storage for one datagram. It only lives inside a PacketPool, never allocated on its own.
+     */
+    struct PacketBuffer
+    {
+        std::atomic<uint32_t>   refs{0};
+        uint32_t                index{0};
+        uint32_t                size{0};
+        uint64_t                peerId{0};
+        uint64_t                arrivalNs{0};   //!Steady clock when the datagram was read off the socket.
+        PacketPool*             pool{nullptr};
+        alignas(16) std::byte   data[XLET_MAXBLOCKSIZE];
+    };
+
+    /*!
+     * @brief A refcounted view on a pooled datagram.
+     *
+     * Copying a Packet only bumps the refcount, the bytes are never copied. When the last view goes away the
+     * buffer goes back to its pool. A Packet must not outlive the let (and so the pool) it was received on.
+     */
+    class Packet
+    {
+        PacketBuffer*   pBuffer{nullptr};
+        uint32_t        mOffset{0};
+        uint32_t        mSize{0};
+
+        inline void release();
+
+    public:
+        Packet() = default;
+        explicit Packet(PacketBuffer* buffer) : pBuffer(buffer), mSize(buffer ? buffer->size : 0)
+        {
+            if (pBuffer) pBuffer->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        Packet(const Packet& other) : pBuffer(other.pBuffer), mOffset(other.mOffset), mSize(other.mSize)
+        {
+            if (pBuffer) pBuffer->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        Packet(Packet&& other) noexcept : pBuffer(other.pBuffer), mOffset(other.mOffset), mSize(other.mSize)
+        {
+            other.pBuffer = nullptr;
+            other.mOffset = other.mSize = 0;
+        }
+        Packet& operator=(Packet other) noexcept
+        {
+            std::swap(pBuffer, other.pBuffer);
+            std::swap(mOffset, other.mOffset);
+            std::swap(mSize, other.mSize);
+            return *this;
+        }
+        ~Packet() { release(); }
+
+        inline bool valid() const { return pBuffer != nullptr; }
+        inline explicit operator bool() const { return valid(); }
+
+        inline const std::byte* data() const { return pBuffer ? pBuffer->data + mOffset : nullptr; }
+        inline size_t size() const { return mSize; }
+        inline std::span<const std::byte> span() const { return {data(), mSize}; }
+        inline uint64_t peerId() const { return pBuffer ? pBuffer->peerId : 0; }
+        /*! @brief Nanoseconds on the steady clock when the datagram was received, 0 if it was not stamped.*/
+        inline uint64_t arrivalNs() const { return pBuffer ? pBuffer->arrivalNs : 0; }
+
+        /*!
+         * @brief Another view on the same buffer, [offset, offset + size) relative to this view. Clamped to this view.
+         */
+        inline Packet view(size_t offset, size_t size) const
+        {
+            Packet packet{*this};
+            offset = offset > mSize ? mSize : offset;
+            packet.mOffset = mOffset + static_cast<uint32_t>(offset);
+            packet.mSize = static_cast<uint32_t>(size > mSize - offset ? mSize - offset : size);
+            return packet;
+        }
+
+        /******** FILLING (only while this is the single owner, before handing the packet out) ********/
+        inline std::byte* writableData() { return pBuffer ? pBuffer->data : nullptr; }
+        static constexpr size_t capacity() { return XLET_MAXBLOCKSIZE; }
+        inline void setSize(size_t size)
+        {
+            mOffset = 0;
+            mSize = static_cast<uint32_t>(size < capacity() ? size : capacity());
+            if (pBuffer) pBuffer->size = mSize;
+        }
+        inline void setPeerId(uint64_t peerId) { if (pBuffer) pBuffer->peerId = peerId; }
+        inline void setArrivalNs(uint64_t arrivalNs) { if (pBuffer) pBuffer->arrivalNs = arrivalNs; }
+    };
+
+    /*!
+     * @brief Fixed capacity pool of datagram buffers.
+     *
+     * All the buffers are allocated once, up front. The free list is a lock-free stack with a tagged head, so any
+     * thread can acquire and release. When the pool is exhausted acquire returns an invalid Packet and the caller
+     * drops the datagram.
+     */
+    class PacketPool
+    {
+        static constexpr uint64_t kIndexMask = 0xFFFFFFFFull;
+
+        size_t                                      mCapacity;
+        std::unique_ptr<PacketBuffer[]>             mBuffers;
+        /*! @brief Next free buffer (index + 1, 0 is the end of the list) for each buffer.*/
+        std::unique_ptr<std::atomic<uint32_t>[]>    mNext;
+        /*! @brief (tag << 32) | (index + 1) of the first free buffer. The tag avoids ABA.*/
+        std::atomic<uint64_t>                       mFreeHead{0};
+
+    public:
+        static constexpr size_t kDefaultCapacity = 512;
+
+        explicit PacketPool(size_t capacity = kDefaultCapacity) :
+            mCapacity(capacity),
+            mBuffers(new PacketBuffer[capacity]),
+            mNext(new std::atomic<uint32_t>[capacity])
+        {
+            for (auto index = 0ul; index < mCapacity; ++index)
+            {
+                mBuffers[index].index = static_cast<uint32_t>(index);
+                mBuffers[index].pool = this;
+                mNext[index].store(index + 1 < mCapacity ? static_cast<uint32_t>(index + 2) : 0, std::memory_order_relaxed);
+            }
+            mFreeHead.store(mCapacity ? 1 : 0, std::memory_order_release);
+        }
+        PacketPool(const PacketPool&) = delete;
+        PacketPool& operator=(const PacketPool&) = delete;
+
+        /*!
+         * @brief Get a free buffer.
+         * @return A Packet owning the buffer, with size 0. Invalid if the pool is exhausted.
+         */
+        Packet acquire()
+        {
+            auto head = mFreeHead.load(std::memory_order_acquire);
+            while (true)
+            {
+                auto first = static_cast<uint32_t>(head & kIndexMask);
+                if (first == 0) return Packet{};
+                auto next = mNext[first - 1].load(std::memory_order_relaxed);
+                auto newHead = (((head >> 32) + 1) << 32) | next;
+                if (mFreeHead.compare_exchange_weak(head, newHead, std::memory_order_acquire, std::memory_order_acquire))
+                {
+                    auto& buffer = mBuffers[first - 1];
+                    buffer.size = 0;
+                    buffer.peerId = 0;
+                    buffer.arrivalNs = 0;
+                    return Packet{&buffer};
+                }
+            }
+        }
+
+        /*! @brief Give a buffer back. Called by the last Packet referencing it.*/
+        void release(PacketBuffer* buffer)
+        {
+            auto head = mFreeHead.load(std::memory_order_relaxed);
+            while (true)
+            {
+                mNext[buffer->index].store(static_cast<uint32_t>(head & kIndexMask), std::memory_order_relaxed);
+                auto newHead = (((head >> 32) + 1) << 32) | (buffer->index + 1);
+                if (mFreeHead.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed)) return;
+            }
+        }
+
+        inline size_t capacity() const { return mCapacity; }
+    };
+
+    inline void Packet::release()
+    {
+        if (pBuffer && pBuffer->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            pBuffer->pool->release(pBuffer);
+        }
+        pBuffer = nullptr;
+    }
+}
+
+#endif //XLET_PACKET_H
@@ -0,0 +1,177 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+
+#ifndef XLET_RING_H
+#define XLET_RING_H
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <cstddef>
+#include <cstdint>
+
+namespace xlet
+{
+    /*!
+     * @brief What a full queue does with a new element.
+     */
+    enum class Overflow
+    {
+        DropOldest, //!The oldest element is discarded to make room. For audio: late audio is useless anyway.
+        NeverDrop   //!The producer waits until there is room. For control commands.
+    };
+
+    struct QueueStats
+    {
+        uint64_t    pushed{0};
+        uint64_t    dropped{0};
+        uint64_t    highWater{0};
+        size_t      capacity{0};
+        /*! @brief Elements queued when the stats were taken.*/
+        size_t      depth{0};
+    };
+
+    /*!
+     * @brief Bounded lock-free MPMC queue (D. Vyukov's array queue) with an overflow policy.
+     *
+     * Each cell carries a sequence number telling producers and consumers whose turn it is, so push and pop are a CAS
+     * on their own index plus a move, never a lock and never an allocation. The capacity is rounded up to a power of two.
+     */
+    template <typename T>
+    class BoundedQueue
+    {
+        struct Cell
+        {
+            std::atomic<size_t> sequence{0};
+            T                   value{};
+        };
+
+        size_t                      mMask;
+        Overflow                    mPolicy;
+        std::unique_ptr<Cell[]>     mCells;
+        alignas(64) std::atomic<size_t>     mEnqueueAt{0};
+        alignas(64) std::atomic<size_t>     mDequeueAt{0};
+        alignas(64) std::atomic<uint64_t>   mPushed{0};
+        std::atomic<uint64_t>               mDropped{0};
+        std::atomic<uint64_t>               mHighWater{0};
+
+        static size_t roundUp(size_t capacity)
+        {
+            size_t pow2 = 2;
+            while (pow2 < capacity) pow2 <<= 1;
+            return pow2;
+        }
+
+        void updateHighWater()
+        {
+            auto current = static_cast<uint64_t>(size());
+            auto highWater = mHighWater.load(std::memory_order_relaxed);
+            while (current > highWater && !mHighWater.compare_exchange_weak(highWater, current, std::memory_order_relaxed));
+        }
+
+    public:
+        explicit BoundedQueue(size_t capacity, Overflow policy = Overflow::DropOldest) :
+            mMask(roundUp(capacity) - 1),
+            mPolicy(policy),
+            mCells(new Cell[mMask + 1])
+        {
+            for (auto index = 0ul; index <= mMask; ++index) mCells[index].sequence.store(index, std::memory_order_relaxed);
+        }
+        BoundedQueue(const BoundedQueue&) = delete;
+        BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+        /*!
+         * @brief Push if there is room. value is only moved from on success.
+         */
+        bool tryPush(T& value)
+        {
+            auto position = mEnqueueAt.load(std::memory_order_relaxed);
+            Cell* cell;
+            while (true)
+            {
+                cell = &mCells[position & mMask];
+                auto sequence = cell->sequence.load(std::memory_order_acquire);
+                auto difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+                if (difference == 0)
+                {
+                    if (mEnqueueAt.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+                }
+                else if (difference < 0) return false;
+                else position = mEnqueueAt.load(std::memory_order_relaxed);
+            }
+            cell->value = std::move(value);
+            cell->sequence.store(position + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool tryPop(T& value)
+        {
+            auto position = mDequeueAt.load(std::memory_order_relaxed);
+            Cell* cell;
+            while (true)
+            {
+                cell = &mCells[position & mMask];
+                auto sequence = cell->sequence.load(std::memory_order_acquire);
+                auto difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+                if (difference == 0)
+                {
+                    if (mDequeueAt.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+                }
+                else if (difference < 0) return false;
+                else position = mDequeueAt.load(std::memory_order_relaxed);
+            }
+            value = std::move(cell->value);
+            cell->sequence.store(position + mMask + 1, std::memory_order_release);
+            return true;
+        }
+
+        /*!
+         * @brief Push applying the overflow policy. Always succeeds.
+         * @return False if an older element was dropped to make room.
+         */
+        bool push(T value)
+        {
+            auto dropped = false;
+            while (!tryPush(value))
+            {
+                if (mPolicy == Overflow::NeverDrop)
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+                T oldest{};
+                if (tryPop(oldest))
+                {
+                    mDropped.fetch_add(1, std::memory_order_relaxed);
+                    dropped = true;
+                }
+            }
+            mPushed.fetch_add(1, std::memory_order_relaxed);
+            updateHighWater();
+            return !dropped;
+        }
+
+        /*! @brief Approximate number of queued elements.*/
+        size_t size() const
+        {
+            auto enqueueAt = mEnqueueAt.load(std::memory_order_acquire);
+            auto dequeueAt = mDequeueAt.load(std::memory_order_acquire);
+            return enqueueAt > dequeueAt ? enqueueAt - dequeueAt : 0;
+        }
+        bool empty() const { return size() == 0; }
+        size_t capacity() const { return mMask + 1; }
+
+        QueueStats stats() const
+        {
+            return QueueStats{
+                mPushed.load(std::memory_order_relaxed),
+                mDropped.load(std::memory_order_relaxed),
+                mHighWater.load(std::memory_order_relaxed),
+                capacity(),
+                size()};
+        }
+    };
+}
+
+#endif //XLET_RING_H
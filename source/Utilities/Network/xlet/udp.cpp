@@ -1,5 +1,18 @@
 #include "xlet.h"
 #include <arpa/inet.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iterator>
+
+namespace
+{
+    //The arrival stamp of a received packet, see xlet::Packet::arrivalNs.
+    uint64_t steadyNs()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+}
 
 
 struct sockaddr_in xlet::UDPlet::toSystemSockAddr(std::string ip, int port)
@@ -32,11 +45,12 @@ uint64_t xlet::UDPlet::sockAddToPeerId(struct sockaddr_in& addr)
 
 struct sockaddr_in xlet::UDPlet::peerIdToSockAddr(uint64_t peerId)
 {
+    //The upper 32 bits are s_addr as is (see sockAddrIpToUInt64), no need to go thru the ip string.
     struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
-    addr.sin_port = htons(static_cast<uint32_t>(peerId & 0xFFFF));
-    auto ipString = letIdToIpString(peerId);
-    addr.sin_addr.s_addr = inet_addr(ipString.c_str());
+    addr.sin_port = htons(static_cast<uint16_t>(peerId & 0xFFFF));
+    addr.sin_addr.s_addr = static_cast<uint32_t>(peerId >> 32);
     return addr;
 }
 
@@ -135,6 +149,132 @@ std::size_t xlet::UDPlet::pushData(const uint64_t peerId,  const std::vector<std
 
 
 
+void xlet::UDPlet::receiveBatched(const std::function<void(xlet::Packet&&)>& dispatch)
+{
+    const auto batchSize = static_cast<size_t>(std::max(options_.batchSize, 1u));
+    std::vector<xlet::Packet> packets(batchSize);
+    std::vector<struct sockaddr_in> addrs(batchSize);
+    std::vector<std::byte> dropBuffer(XLET_MAXBLOCKSIZE, std::byte{0});
+#if defined(__linux__)
+    std::vector<struct mmsghdr> msgs(batchSize);
+    std::vector<struct iovec> iovs(batchSize);
+#endif
+
+    while (sockfd_ > 0) {
+        struct pollfd pfd{};
+        pfd.fd = sockfd_;
+        pfd.events = POLLIN;
+        auto ready = poll(&pfd, 1, options_.pollTimeoutMs);
+        if (ready < 0 && errno != EINTR) {
+            letOperationalError.Emit(sockfd_, "poll");
+            continue;
+        }
+        if (ready <= 0 || !(pfd.revents & POLLIN)) continue;
+
+        //Pool exhausted: still drain the socket, the datagram is dropped.
+        for (auto index = 0ul; index < batchSize; ++index) {
+            if (!packets[index]) packets[index] = packetPool_.acquire();
+        }
+
+#if defined(__linux__)
+        for (auto index = 0ul; index < batchSize; ++index) {
+            iovs[index].iov_base = packets[index] ? packets[index].writableData() : dropBuffer.data();
+            iovs[index].iov_len = XLET_MAXBLOCKSIZE;
+            msgs[index].msg_hdr = {};
+            msgs[index].msg_hdr.msg_name = &addrs[index];
+            msgs[index].msg_hdr.msg_namelen = sizeof(addrs[index]);
+            msgs[index].msg_hdr.msg_iov = &iovs[index];
+            msgs[index].msg_hdr.msg_iovlen = 1;
+        }
+        auto received = recvmmsg(sockfd_, msgs.data(), static_cast<unsigned int>(batchSize), MSG_DONTWAIT, nullptr);
+        auto receivedSize = [&msgs](size_t index) { return static_cast<size_t>(msgs[index].msg_len); };
+#else
+        socklen_t len = sizeof(addrs[0]);
+        auto n = recvfrom(sockfd_, packets[0] ? packets[0].writableData() : dropBuffer.data(), XLET_MAXBLOCKSIZE, 0, (struct sockaddr *) &addrs[0], &len);
+        auto received = n < 0 ? -1 : 1;
+        auto receivedSize = [n](size_t) { return static_cast<size_t>(n); };
+#endif
+        if (received < 0) {
+            if (errno != EWOULDBLOCK && errno != EAGAIN && errno != EINTR) {
+                letOperationalError.Emit(sockfd_, "recvmmsg");
+            }
+            continue;
+        }
+
+        //One clock read per batch, the datagrams of a batch were all waiting in the socket by now.
+        const auto arrivalNs = steadyNs();
+        for (auto index = 0ul; index < static_cast<size_t>(received); ++index) {
+            auto& packet = packets[index];
+            auto size = receivedSize(index);
+            if (size == 0) continue;
+            if (!packet) {
+                poolDrops_.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            packet.setSize(size);
+            packet.setPeerId(sockAddToPeerId(addrs[index]));
+            packet.setArrivalNs(arrivalNs);
+            dispatch(std::move(packet));
+            packet = xlet::Packet{};
+        }
+    }
+}
+
+std::size_t xlet::UDPlet::sendBatched(const std::vector<xlet::Data>& batch)
+{
+    if (sockfd_ < 0) {
+        letInvalidSocketError.Emit();
+        return 0;
+    }
+#if defined(__linux__)
+    //Only grows, so in steady state there are no allocations.
+    static thread_local std::vector<struct mmsghdr> msgs{};
+    static thread_local std::vector<struct iovec> iovs{};
+    static thread_local std::vector<struct sockaddr_in> addrs{};
+    if (msgs.size() < batch.size()) {
+        msgs.resize(batch.size());
+        iovs.resize(batch.size());
+        addrs.resize(batch.size());
+    }
+    for (auto index = 0ul; index < batch.size(); ++index) {
+        addrs[index] = peerIdToSockAddr(batch[index].first);
+        iovs[index].iov_base = const_cast<std::byte*>(batch[index].second.data());
+        iovs[index].iov_len = batch[index].second.size();
+        msgs[index].msg_hdr = {};
+        msgs[index].msg_hdr.msg_name = &addrs[index];
+        msgs[index].msg_hdr.msg_namelen = sizeof(addrs[index]);
+        msgs[index].msg_hdr.msg_iov = &iovs[index];
+        msgs[index].msg_hdr.msg_iovlen = 1;
+    }
+
+    auto sent = 0ul;
+    while (sent < batch.size() && sockfd_ > 0) {
+        auto n = sendmmsg(sockfd_, msgs.data() + sent, static_cast<unsigned int>(batch.size() - sent), 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EWOULDBLOCK || errno == EAGAIN) {
+                //Socket buffer full, wait until there is room.
+                struct pollfd pfd{};
+                pfd.fd = sockfd_;
+                pfd.events = POLLOUT;
+                poll(&pfd, 1, options_.pollTimeoutMs);
+                continue;
+            }
+            letOperationalError.Emit(sockfd_, strerror(errno));
+            break;
+        }
+        sent += static_cast<size_t>(n);
+    }
+    return sent;
+#else
+    auto sent = 0ul;
+    for (auto& data : batch) {
+        if (pushData(data.first, data.second) > 0) ++sent;
+    }
+    return sent;
+#endif
+}
+
 /********************/
 /****** UDPOut ******/
 xlet::UDPOut::UDPOut(const std::string ipstring, int port, bool qSynced) : UDPlet(ipstring, port, xlet::Direction::OUTB, false)
@@ -149,12 +289,8 @@ xlet::UDPOut::UDPOut(const std::string ipstring, int port, bool qSynced) : UDPle
             letThreadStarted.Emit(static_cast<uint64_t>(sockfd_));
             while (sockfd_ > 0) {
 
-                if (qout_.empty()) continue;
-
-                std::unique_lock<std::mutex> lock(mtxout_);
-                Data data = qout_[0];
-                qout_.erase(qout_.begin(), qout_.begin() + 1);
-                lock.unlock();
+                Data data;
+                if (!qout_.tryPop(data)) continue;
 
                 letDataReadyToBeTransmitted.Emit(letIdToString(data.first), data.second);
                 pushData(data.first, data.second);
@@ -171,13 +307,17 @@ xlet::UDPIn::UDPIn(const std::string ipstring, int port, bool qSynced) : UDPlet(
         while (qPause && sockfd_ > 0);
         letBindedOn.Emit(servId_, std::this_thread::get_id());
         letThreadStarted.Emit(static_cast<uint64_t>(sockfd_));
+        std::vector<std::byte> dropBuffer(XLET_MAXBLOCKSIZE, std::byte{0});
+        xlet::Packet packet{};
         while (sockfd_ > 0) {
             struct sockaddr_in cliaddr;
             socklen_t len = sizeof(cliaddr);
-            std::vector<std::byte> inDataBuffer(XLET_MAXBLOCKSIZE, std::byte{0});
+            if (!packet) packet = packetPool_.acquire();
+            //Pool exhausted: still drain the socket, the datagram is dropped.
+            auto dstPtr = packet ? packet.writableData() : dropBuffer.data();
             ssize_t n = 0;
             {
-                n = recvfrom(sockfd_, inDataBuffer.data(), inDataBuffer.size(), 0, (struct sockaddr *) &cliaddr, &len);
+                n = recvfrom(sockfd_, dstPtr, XLET_MAXBLOCKSIZE, 0, (struct sockaddr *) &cliaddr, &len);
             }
 
             if (n < 0) {
@@ -186,19 +326,25 @@ xlet::UDPIn::UDPIn(const std::string ipstring, int port, bool qSynced) : UDPlet(
                     continue;
                 }
             }
+            else if (n > 0 && !packet)
+            {
+                poolDrops_.fetch_add(1, std::memory_order_relaxed);
+            }
             else if (n > 0)
             {
-                inDataBuffer.resize(static_cast<size_t>(n));
+                packet.setSize(static_cast<size_t>(n));
+                packet.setPeerId(sockAddToPeerId(cliaddr));
+                packet.setArrivalNs(steadyNs());
 
                 if (queueManaged)
                 {
-                    qin_.push_back (xlet::Data { .first = sockAddToPeerId (cliaddr), .second = inDataBuffer });
+                    push_back(std::move(packet));
                 }
                 else
                 {
-                    letDataFromPeerIsReady.Emit(sockAddToPeerId(cliaddr), inDataBuffer);
+                    letDataFromPeerIsReady.Emit(packet.peerId(), packet);
                 }
-
+                packet = xlet::Packet{};
             }
         }
     }};
@@ -208,14 +354,10 @@ xlet::UDPIn::UDPIn(const std::string ipstring, int port, bool qSynced) : UDPlet(
             while (qPause && sockfd_ > 0);
             while (sockfd_ > 0) {
 
-                if (qin_.empty()) continue;
+                xlet::Packet packet;
+                if (!qin_.tryPop(packet)) continue;
 
-                std::unique_lock<std::mutex> lock(mtxin_);
-                auto data = qin_[0];
-                qin_.erase(qin_.begin(), qin_.begin() + 1);
-                lock.unlock();
-
-                letDataFromPeerIsReady.Emit(data.first, data.second);
+                letDataFromPeerIsReady.Emit(packet.peerId(), packet);
             }
         }};
     }
@@ -223,8 +365,9 @@ xlet::UDPIn::UDPIn(const std::string ipstring, int port, bool qSynced) : UDPlet(
 }
 /********************/
 /****** UDPInOut *****/
-xlet::UDPInOut::UDPInOut(const std::string ipstring, int port, bool listen, bool qSynced, bool loopback) : UDPlet(ipstring, port, xlet::Direction::INOUTB, listen)
+xlet::UDPInOut::UDPInOut(const std::string ipstring, int port, bool listen, bool qSynced, bool loopback, UDPOptions options) : UDPlet(ipstring, port, xlet::Direction::INOUTB, listen)
 {
+    options_ = options;
     std::cout << "Creating the UDPInOut" << std::endl;
     std::cout << "UDP Let Socket no. " << sockfd_ << std::endl;
     std::cout << "UDP Let Direction " << direction << std::endl;
@@ -233,6 +376,7 @@ xlet::UDPInOut::UDPInOut(const std::string ipstring, int port, bool listen, bool
     std::cout << "Loopback " << loopback << std::endl;
     std::cout << "Calling IP: " << ipstring << std::endl;
     std::cout << "Port: " << port << std::endl;
+    std::cout << "Batched I/O " << options_.batched << " (" << options_.batchSize << ")" << std::endl;
 
 
     if (loopback && sockfd_ > 0)
@@ -246,13 +390,25 @@ xlet::UDPInOut::UDPInOut(const std::string ipstring, int port, bool listen, bool
             letBindedOn.Emit(servId_, std::this_thread::get_id());
             letThreadStarted.Emit(static_cast<uint64_t>(sockfd_));
 
+            if (options_.batched) {
+                receiveBatched([this](xlet::Packet&& packet) {
+                    if (queueManaged) push_back(std::move(packet));
+                    else letDataFromPeerIsReady.Emit(packet.peerId(), packet);
+                });
+                return;
+            }
+
+            std::vector<std::byte> dropBuffer(XLET_MAXBLOCKSIZE, std::byte{0});
+            xlet::Packet packet{};
             while (sockfd_ > 0) {
                 struct sockaddr_in cliaddr;
                 socklen_t len = sizeof(cliaddr);
-                std::vector<std::byte> inDataBuffer(XLET_MAXBLOCKSIZE, std::byte{0});
+                if (!packet) packet = packetPool_.acquire();
+                //Pool exhausted: still drain the socket, the datagram is dropped.
+                auto dstPtr = packet ? packet.writableData() : dropBuffer.data();
                 ssize_t n = 0;
                 {
-                    n = recvfrom(sockfd_, inDataBuffer.data(), inDataBuffer.size(), 0, (struct sockaddr *) &cliaddr, &len);
+                    n = recvfrom(sockfd_, dstPtr, XLET_MAXBLOCKSIZE, 0, (struct sockaddr *) &cliaddr, &len);
                 }
                 if (n < 0) {
                     if (errno != EWOULDBLOCK && errno != EAGAIN) {
@@ -260,16 +416,23 @@ xlet::UDPInOut::UDPInOut(const std::string ipstring, int port, bool listen, bool
                         continue;
                     }
                 }
+                else if (n > 0 && !packet)
+                {
+                    poolDrops_.fetch_add(1, std::memory_order_relaxed);
+                }
                 else if (n > 0)
                 {
-                    inDataBuffer.resize(static_cast<size_t>(n));
+                    packet.setSize(static_cast<size_t>(n));
+                    packet.setPeerId(sockAddToPeerId(cliaddr));
+                    packet.setArrivalNs(steadyNs());
                     {
                         if (queueManaged)
                         {
-                            push_back(xlet::Data { .first = sockAddToPeerId (cliaddr), .second = inDataBuffer }, xlet::Direction::INB);
+                            push_back(std::move(packet));
                         }
-                        else letDataFromPeerIsReady.Emit(sockAddToPeerId(cliaddr), inDataBuffer);
+                        else letDataFromPeerIsReady.Emit(packet.peerId(), packet);
                     }
+                    packet = xlet::Packet{};
                 }
             }
 
@@ -280,27 +443,20 @@ xlet::UDPInOut::UDPInOut(const std::string ipstring, int port, bool listen, bool
         qThread = std::thread{[this, loopback](){
             while (qPause);
             letThreadStarted.Emit(static_cast<uint64_t>(sockfd_));
+            if (options_.batched) {
+                queueLoopBatched(loopback);
+                return;
+            }
             while (sockfd_ > 0) {
 
-                if  (!qin_.empty())
+                if (xlet::Packet packet; popIn(packet))
                 {
-                    std::unique_lock<std::mutex> lock(mtxin_);
-                    auto data = qin_[0];
-                    qin_.erase(qin_.begin(), qin_.begin() + 1);
-                    lock.unlock();
-
-                    letDataFromPeerIsReady.Emit(data.first, data.second);
+                    letDataFromPeerIsReady.Emit(packet.peerId(), packet);
                 }
 
-                if (!qout_.empty())
+                if (Data data; popOut(data))
                 {
-
-                    std::unique_lock<std::mutex> lock(mtxout_);
-                    Data data = qout_[0];
-                    qout_.erase(qout_.begin(), qout_.begin() + 1);
-                    lock.unlock();
-
-                    std::vector<std::byte> payload = data.second;
+                    const std::vector<std::byte>& payload = data.second;
                     if (payload.empty())
                     {
                         std::cout << "PLUGIN PRODUCED NO DATA !!!!!!!!!!!!!!!!!!!!!" << std::endl;
@@ -311,12 +467,19 @@ xlet::UDPInOut::UDPInOut(const std::string ipstring, int port, bool listen, bool
                     letDataReadyToBeTransmitted.Emit(letIdToString(data.first), data.second);
                     if (!loopback)
                     {
-                        pushData(data.first, data.second);
+                        if (pushData(data.first, data.second) > 0) letDataSent.Emit(data.first, std::span<const std::byte>(payload));
                     }
-                    else
+                    else if (auto packet = packetPool_.acquire(); packet)
                     {
-                        qin_.push_back(data);
+                        auto size = std::min(payload.size(), xlet::Packet::capacity());
+                        std::copy(payload.begin(), payload.begin() + static_cast<std::ptrdiff_t>(size), packet.writableData());
+                        packet.setSize(size);
+                        packet.setPeerId(data.first);
+                        letDataSent.Emit(data.first, std::span<const std::byte>(payload));
+                        packet.setArrivalNs(steadyNs());
+                        push_back(std::move(packet));
                     }
+                    recycleBuffer(std::move(data.second));
 
                 }
             }
@@ -326,4 +489,62 @@ xlet::UDPInOut::UDPInOut(const std::string ipstring, int port, bool listen, bool
 
 }
 
+void xlet::UDPInOut::queueLoopBatched(bool loopback)
+{
+    std::vector<xlet::Data> outBatch{};
+    outBatch.reserve(options_.batchSize);
+
+    while (sockfd_ > 0) {
+        //Take the ticket before looking at the queues, a push in between wakes the wait below right away.
+        auto ticket = queueWakeUp_.ticket();
+        auto idle = true;
+
+        for (xlet::Packet packet; popIn(packet); ) {
+            letDataFromPeerIsReady.Emit(packet.peerId(), packet);
+            idle = false;
+        }
+
+        for (Data data; outBatch.size() < std::max(options_.batchSize, 1u) && popOut(data); ) {
+            idle = false;
+            //Nothing to send: no zero length datagram, the buffer goes straight back.
+            if (data.second.empty()) {
+                recycleBuffer(std::move(data.second));
+                continue;
+            }
+            outBatch.push_back(std::move(data));
+        }
+
+        if (!outBatch.empty()) {
+            idle = false;
+            for (auto& data : outBatch) {
+                letDataReadyToBeTransmitted.Emit(letIdToString(data.first), data.second);
+            }
+            if (!loopback) {
+                auto sent = sendBatched(outBatch);
+                for (auto index = 0ul; index < sent; ++index) {
+                    letDataSent.Emit(outBatch[index].first, std::span<const std::byte>(outBatch[index].second));
+                }
+            }
+            else {
+                for (auto& data : outBatch) {
+                    auto packet = packetPool_.acquire();
+                    if (!packet) {
+                        poolDrops_.fetch_add(1, std::memory_order_relaxed);
+                        continue;
+                    }
+                    auto size = std::min(data.second.size(), xlet::Packet::capacity());
+                    std::copy(data.second.begin(), data.second.begin() + static_cast<std::ptrdiff_t>(size), packet.writableData());
+                    packet.setSize(size);
+                    packet.setPeerId(data.first);
+                    letDataSent.Emit(data.first, std::span<const std::byte>(data.second));
+                    packet.setArrivalNs(steadyNs());
+                    push_back(std::move(packet));
+                }
+            }
+            for (auto& data : outBatch) recycleBuffer(std::move(data.second));
+            outBatch.clear();
+        }
 
+        if (idle && sockfd_ > 0) queueWakeUp_.wait(ticket);
+    }
+}
@@ -5,12 +5,41 @@
 #include "xlet.h"
 #include <mutex>
 
+/*!
+ * @brief Socket I/O options of a UDP let.
+ */
+struct UDPOptions
+{
+    /*! @brief Receive and send in batches (recvmmsg / sendmmsg on Linux, one datagram per call elsewhere) and block in poll instead of spinning.*/
+    bool        batched{false};
+    /*! @brief Maximum number of datagrams per batch.*/
+    uint32_t    batchSize{32};
+    /*! @brief Upper bound for a poll wait, so a closed socket is noticed.*/
+    int         pollTimeoutMs{100};
+};
+
 class UDPlet : public xlet::Xlet {
  protected:
     struct sockaddr_in  servaddr_;
     uint64_t            servId_;
     int                 sockfd_;
     bool                queueManaged{false};
+    /*! @brief Buffers for the received datagrams, handed out as refcounted xlet::Packet views.*/
+    xlet::PacketPool    packetPool_{};
+    /*! @brief Datagrams dropped because the packet pool was exhausted.*/
+    std::atomic<uint64_t> poolDrops_{0};
+    UDPOptions          options_{};
+
+    /*!
+     * @brief Batched receive loop. Waits in poll, then reads up to options_.batchSize datagrams into pooled packets per call.
+     * @param dispatch Called with each received packet.
+     */
+    void receiveBatched(const std::function<void(xlet::Packet&&)>& dispatch);
+    /*!
+     * @brief Send a batch of datagrams with as few syscalls as possible.
+     * @return Number of datagrams sent.
+     */
+    std::size_t sendBatched(const std::vector<xlet::Data>& batch);
  public:
     UDPlet(const std::string address, int port, xlet::Direction direction = xlet::Direction::INOUTB, bool theLetListens = false);
     ~UDPlet() override {}
@@ -22,13 +51,15 @@ class UDPlet : public xlet::Xlet {
     DAWn::Events::Signal<uint64_t>                                      letThreadStarted;
     DAWn::Events::Signal<const std::string, std::vector<std::byte>&>        letDataReadyToBeTransmitted;
     DAWn::Events::Signal<xlet::Data>                                    letDataFromServiceIsReadyToBeRead;
-    DAWn::Events::Signal<uint64_t, std::vector<std::byte>>             letDataFromPeerIsReady;
+    DAWn::Events::InplaceSignal<uint64_t, const xlet::Packet&>          letDataFromPeerIsReady;
+    /*! @brief A datagram left the socket (or the loopback), on the queue thread. Inplace: once per datagram.*/
+    DAWn::Events::InplaceSignal<uint64_t, std::span<const std::byte>>   letDataSent;
     DAWn::Events::Signal<uint64_t, std::thread::id>                     letBindedOn;
 
     //Use only if needed
     std::thread qThread;
     std::thread recvThread;
-    bool        qPause{true};
+    std::atomic<bool> qPause{true};
     std::thread inboundDataHandlerThread;
 
     inline void run()
@@ -58,6 +89,7 @@ class UDPlet : public xlet::Xlet {
     static int peerIdToPort(uint64_t peerId);
 
     int getSocket() const {return sockfd_;}
+    uint64_t getPoolDrops() const {return poolDrops_.load(std::memory_order_relaxed);}
 
     //UDPlet specific
     uint64_t getServId() const {return servId_;}
@@ -88,12 +120,20 @@ class UDPIn : public UDPlet, public xlet::In {
 
 class UDPInOut : public UDPlet, public xlet::InOut {
  public:
-    UDPInOut(const std::string address, int port, bool listen = false, bool qSynced = false, bool loopback = false);
+    UDPInOut(const std::string address, int port, bool listen = false, bool qSynced = false, bool loopback = false, UDPOptions options = {});
     ~UDPInOut() override {
         closeAndJoin();
     }
+    void closeAndJoin() override {
+        UDPlet::closeAndJoin();
+        queueWakeUp_.notify();
+    }
     DAWn::Events::Signal<> letIsLoopbackOnly;
 
+ private:
+    /*! @brief Queue thread in batched mode: sleeps while both queues are empty, sends the outbound queue in batches.*/
+    void queueLoopBatched(bool loopback);
+
 };
 
 
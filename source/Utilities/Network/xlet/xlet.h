@@ -4,6 +4,7 @@
 #include <map>
 #include <set>
 #include <mutex>
+#include <atomic>
 #include <queue>
 #include <memory>
 #include <thread>
@@ -15,6 +16,7 @@
 #include <functional>
 
 #include "Events.h"
+#include "Notifier.h"
 
 /* POSIX */
 #include <poll.h>
@@ -28,6 +30,9 @@
 #define XLET_MAXBLOCKSIZE_SHIFTER   13
 #define XLET_MAXBLOCKSIZE           (1 << XLET_MAXBLOCKSIZE_SHIFTER)
 
+#include "packet.h"
+#include "ring.h"
+
 
 
 // Forward declaration of a template class Queue
@@ -46,7 +51,8 @@ namespace xlet {
         uint64_t first;
     };
 
-    using Queue = std::vector<Data>;
+    using Queue = BoundedQueue<Data>;
+    using PacketQueue = BoundedQueue<Packet>;
 
     enum Transport   {
         UVGRTP, // UVG RTP
@@ -101,59 +107,139 @@ namespace xlet {
 
     };
 
+    /*! @brief Tells control datagrams (never dropped) from audio (dropped oldest first when a queue is full).*/
+    using ControlClassifier = std::function<bool(std::span<const std::byte>)>;
+
+    inline constexpr size_t kAudioQueueCapacity = 256;
+    inline constexpr size_t kControlQueueCapacity = 64;
+    inline constexpr size_t kSpareBufferCapacity = 64;
+
     class In  {
     public:
-        inline void push_back(const xlet::Data& d)
+        explicit In(size_t capacity = kAudioQueueCapacity) : qin_(capacity, Overflow::DropOldest) {}
+        inline void push_back(xlet::Packet packet)
         {
-            std::lock_guard<std::mutex> lock(mtxin_);
-            qin_.push_back(d);
+            qin_.push(std::move(packet));
         }
         inline const bool empty() const
         {
             return qin_.empty();
         }
+        inline QueueStats stats() const { return qin_.stats(); }
 
     protected:
-        Queue qin_;
-        std::mutex mtxin_;
+        PacketQueue qin_;
     };
 
     class Out  {
     public:
-        inline void push_back(const xlet::Data& d)
+        explicit Out(size_t capacity = kAudioQueueCapacity) : qout_(capacity, Overflow::DropOldest) {}
+        inline void push_back(xlet::Data d)
         {
-            std::lock_guard<std::mutex> lock(mtxout_);
-            qout_.push_back(d);
+            qout_.push(std::move(d));
         }
         inline const bool emptyt() const
         {
             return qout_.empty();
         }
+        inline QueueStats stats() const { return qout_.stats(); }
 
     protected:
         Queue qout_;
-        std::mutex mtxout_;
     };
 
+    /*!
+     * @brief Inbound and outbound bounded queues, each split in an audio and a control lane.
+     *
+     * Audio lanes drop the oldest element when full: a stalled consumer must not grow memory, and when it catches up
+     * the freshest audio is what matters. Control lanes never drop, the producer waits for room instead. The queue
+     * thread drains the control lane first. Which lane a datagram goes to is decided by the ControlClassifier, with
+     * no classifier everything is audio.
+     */
     class InOut  {
     public:
-        inline void push_back(const xlet::Data& d, const xlet::Direction dir)
+        explicit InOut(size_t audioCapacity = kAudioQueueCapacity, size_t controlCapacity = kControlQueueCapacity) :
+            qin_(audioCapacity, Overflow::DropOldest),
+            qout_(audioCapacity, Overflow::DropOldest),
+            qinControl_(controlCapacity, Overflow::NeverDrop),
+            qoutControl_(controlCapacity, Overflow::NeverDrop),
+            spareBuffers_(kSpareBufferCapacity, Overflow::DropOldest)
+        {}
+
+        /*! @brief Set before the let starts moving data, it is not synchronized with the queue threads.*/
+        inline void setControlClassifier(ControlClassifier classifier)
+        {
+            isControl_ = std::move(classifier);
+        }
+
+        /*! @brief Queue outbound data. Inbound data is queued as pooled packets, see the Packet overload.*/
+        inline void push_back(xlet::Data d, const xlet::Direction dir)
         {
-            std::lock_guard<std::mutex> lock(dir == xlet::Direction::INB ? mtxin_ : mtxout_);
-            if (dir == INB) qin_.push_back(d);
-            else if (dir == OUTB) qout_.push_back(d);
-            else std::cout << "push: Invalid direction" << std::endl;
+            if (dir != OUTB)
+            {
+                std::cout << "push: Invalid direction" << std::endl;
+                return;
+            }
+            if (isControl_ && isControl_(d.second)) qoutControl_.push(std::move(d));
+            else qout_.push(std::move(d));
+            queueWakeUp_.notify();
+        }
+        inline void push_back(xlet::Packet packet)
+        {
+            if (isControl_ && isControl_(packet.span())) qinControl_.push(std::move(packet));
+            else qin_.push(std::move(packet));
+            queueWakeUp_.notify();
         }
         inline const bool empty(const xlet::Direction dir) const
         {
             if (dir == INOUTB) std::cout << "empty: Invalid direction" << std::endl;
-            return dir == INB ? qin_.empty() : ( dir  == OUTB ? qout_.empty() : false);
+            return dir == INB ? qin_.empty() && qinControl_.empty() : ( dir  == OUTB ? qout_.empty() && qoutControl_.empty() : false);
+        }
+        /*!
+         * @brief An empty buffer to fill with outbound data.
+         *
+         * Buffers of data already sent are recycled here with their capacity, so a producer filling them does not
+         * allocate once the stream is running.
+         */
+        inline std::vector<std::byte> takeBuffer()
+        {
+            std::vector<std::byte> buffer{};
+            spareBuffers_.tryPop(buffer);
+            buffer.clear();
+            return buffer;
+        }
+        /*! @brief Give a sent buffer back for takeBuffer. Freed if there are enough spare buffers already.*/
+        inline void recycleBuffer(std::vector<std::byte>&& buffer)
+        {
+            spareBuffers_.tryPush(buffer);
+        }
+
+        /*! @brief Pushed, dropped and high water mark of a queue. Only the audio lanes ever drop.*/
+        inline QueueStats stats(const xlet::Direction dir, bool control = false) const
+        {
+            if (dir == INB) return control ? qinControl_.stats() : qin_.stats();
+            return control ? qoutControl_.stats() : qout_.stats();
         }
     protected:
-        Queue qin_;
+        /*! @brief Next inbound packet, control first.*/
+        inline bool popIn(xlet::Packet& packet)
+        {
+            return qinControl_.tryPop(packet) || qin_.tryPop(packet);
+        }
+        /*! @brief Next outbound data, control first.*/
+        inline bool popOut(xlet::Data& data)
+        {
+            return qoutControl_.tryPop(data) || qout_.tryPop(data);
+        }
+
+        PacketQueue qin_;
         Queue qout_;
-        std::mutex mtxin_;
-        std::mutex mtxout_;
+        PacketQueue qinControl_;
+        Queue qoutControl_;
+        BoundedQueue<std::vector<std::byte>> spareBuffers_;
+        ControlClassifier isControl_{};
+        /*! @brief Notified on every push, so a queue thread can sleep while both queues are empty.*/
+        DAWn::Events::Notifier queueWakeUp_;
     };
 
 
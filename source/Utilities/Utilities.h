@@ -10,6 +10,7 @@
 #include "juce_audio_processors/juce_audio_processors.h"
 
 #include <map>
+#include <span>
 #include <string>
 #include <utility>
 #include <vector>
@@ -26,6 +27,11 @@ namespace Utilities::Buffer
     using ByteBuff = std::vector<std::byte>;
     void splitChannels (std::vector<Buffer::BlockSizeAdapter>& bsa, const juce::AudioBuffer<float>& buffer, const bool monoSplit = false);
     void splitChannels (std::vector<std::vector<float>>& channels, const juce::AudioBuffer<float>& buffer, const bool monoSplit = false);
+    /*!
+     * @brief Copy the DAW buffer into caller storage, one span per channel. Realtime safe.
+     * @note Copies min(channels, buffer channels) channels of min(span size, buffer samples) samples.
+     */
+    void splitChannels (std::span<const std::span<float>> channels, const juce::AudioBuffer<float>& buffer, const bool monoSplit = false);
     void joinChannels (juce::AudioBuffer<float>& buffer, const std::vector<std::vector<float>>& channels);
     //void joinChannels (juce::AudioBuffer<float>& buffer, const std::vector<Buffer::BlockSizeAdapter>& bsa);
     void enumerateBuffer (juce::AudioBuffer<float>& buffer);
@@ -42,13 +48,38 @@ namespace Utilities::Buffer
     std::vector<float> interleaveBlocks(std::vector<float>& block0, std::vector<float>& block1);
     void interleaveBlocks (std::vector<std::vector<float>>& intChannels, juce::AudioBuffer<float>& buffer);
     void interleaveBlocks (std::vector<std::vector<float>>& interBlocks, std::vector<std::vector<float>>& blocks);
+    /*!
+     * @brief Interleaves channels blocks into one frame: [b0[0], b1[0] ... b(channels-1)[0], b0[1] ...]. Missing blocks are silence, extra blocks are ignored.
+     * @note interleaved is resized, not reallocated if it already has the capacity.
+     */
+    void interleaveBlocks (std::vector<float>& interleaved, const std::vector<std::vector<float>>& blocks, size_t channels);
+    /*!
+     * @brief interleaveBlocks into caller storage. Realtime safe.
+     * @return The interleaved frame, the first samples * channels floats of interleaved (empty if it does not fit).
+     */
+    std::span<const float> interleaveBlocks (std::span<float> interleaved, std::span<const std::span<const float>> blocks, size_t channels);
 
     void deinterleaveBlocks (std::vector<std::vector<float>>& blocks, std::vector<std::vector<float>>& interleavedBlocks);
     void deinterleaveBlocks (std::vector<std::vector<float>>&,std::vector<float>&);
+    /*!
+     * @brief Inverse of interleaveBlocks: channels blocks of interleaved.size() / channels samples each.
+     * @note The blocks are resized, not reallocated if they already have the capacity.
+     */
+    void deinterleaveBlocks (std::vector<std::vector<float>>& blocks, std::span<const float> interleaved, size_t channels);
+    /*!
+     * @brief deinterleaveBlocks into caller storage. Realtime safe.
+     * @return Samples written per block, interleaved.size() / channels. 0 if a block is missing or too short.
+     */
+    size_t deinterleaveBlocks (std::span<const std::span<float>> blocks, std::span<const float> interleaved, size_t channels);
 
-    std::tuple<bool, uint32_t, int64_t, std::vector<std::byte>> extractIncomingData(std::vector<std::byte>& uid_ts_encodedPayload);
+    /*!
+     * @brief Parse [ WIRE HEADER | PAYLOAD ] in place, see DAWn::Wire.
+     * @return Success, the header (source user id, time stamp, sequence, type) and a view on the payload (inside datagram).
+     */
+    std::tuple<bool, DAWn::Wire::Header, std::span<const std::byte>> extractIncomingData(std::span<const std::byte> datagram);
 
     OpResult monoSplit (std::vector<float>& left, std::vector<float>& right);
+    OpResult monoSplit (std::span<float> left, std::span<float> right);
 }
 
 namespace Utilities::Time{
@@ -1,3 +1,110 @@
 //
 // Created by Julian Guarin on 17/11/23.
 //
+#include "AudioMixerBlock.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <vector>
+
+namespace
+{
+    //No delay: the ring is the jitter margin only, 24000 / 4800 + 1 = 6 slots.
+    constexpr size_t kBlockSize = 4800;
+    constexpr int64_t kSlots = 6;
+    constexpr int64_t kRingSamples = kSlots * static_cast<int64_t>(kBlockSize);
+
+    std::vector<Mixer::AudioMixerBlock> makeMixers()
+    {
+        std::vector<Mixer::AudioMixerBlock> mixers(1);
+        Mixer::AudioMixerBlock::resetMixers(mixers, kBlockSize);
+        return mixers;
+    }
+
+    std::vector<Mixer::Block> block(float value)
+    {
+        return {Mixer::Block(kBlockSize, value)};
+    }
+
+    float played(std::vector<Mixer::AudioMixerBlock>& mixers, int64_t time)
+    {
+        int64_t realtime = 0;
+        auto blocks = Mixer::AudioMixerBlock::getBlocks(mixers, time, realtime);
+        REQUIRE(realtime == time);
+        REQUIRE(blocks.size() == 1);
+        REQUIRE(blocks[0].size() == kBlockSize);
+        return blocks[0].front();
+    }
+}
+
+TEST_CASE("AudioMixerBlock mixes the sources of a slot", "[AudioMixerBlock]")
+{
+    auto mixers = makeMixers();
+    Mixer::AudioMixerBlock::mix(mixers, 0, block(1.0f), 1);
+    Mixer::AudioMixerBlock::mix(mixers, 0, block(2.0f), 2);
+    REQUIRE(played(mixers, 0) == 3.0f);
+
+    //A source sending its block again replaces its own contribution, it does not add.
+    Mixer::AudioMixerBlock::mix(mixers, 0, block(0.5f), 1);
+    REQUIRE(played(mixers, 0) == 2.5f);
+    REQUIRE(played(mixers, kBlockSize) == 0.0f);
+}
+
+TEST_CASE("AudioMixerBlock recycles a slot for a newer time stamp", "[AudioMixerBlock]")
+{
+    auto mixers = makeMixers();
+    Mixer::AudioMixerBlock::mix(mixers, 0, block(1.0f), 1);
+    Mixer::AudioMixerBlock::mix(mixers, 0, block(2.0f), 2);
+    REQUIRE(Mixer::AudioMixerBlock::containsTimeStamp(mixers, 0));
+
+    //Same slot, one lap later: the old mix and the old source blocks are zeroed before mixing.
+    Mixer::AudioMixerBlock::mix(mixers, kRingSamples, block(4.0f), 1);
+    REQUIRE_FALSE(Mixer::AudioMixerBlock::containsTimeStamp(mixers, 0));
+    REQUIRE(Mixer::AudioMixerBlock::containsTimeStamp(mixers, kRingSamples));
+    REQUIRE(played(mixers, kRingSamples) == 4.0f);
+    REQUIRE(played(mixers, 0) == 0.0f);
+
+    //Source 2 left nothing behind in the recycled slot: its next block is not mixed against a stale one.
+    Mixer::AudioMixerBlock::mix(mixers, kRingSamples, block(1.0f), 2);
+    REQUIRE(played(mixers, kRingSamples) == 5.0f);
+}
+
+TEST_CASE("AudioMixerBlock drops a write older than the slot owner", "[AudioMixerBlock]")
+{
+    auto mixers = makeMixers();
+    Mixer::AudioMixerBlock::mix(mixers, kRingSamples, block(4.0f), 1);
+
+    //Too late: the slot already belongs to a newer time stamp.
+    Mixer::AudioMixerBlock::mix(mixers, 0, block(1.0f), 2);
+    Mixer::AudioMixerBlock::replace(mixers, 0, block(1.0f));
+    REQUIRE_FALSE(Mixer::AudioMixerBlock::containsTimeStamp(mixers, 0));
+    REQUIRE(played(mixers, kRingSamples) == 4.0f);
+    REQUIRE(played(mixers, 0) == 0.0f);
+}
+
+TEST_CASE("AudioMixerBlock timeline wraps past the ring", "[AudioMixerBlock]")
+{
+    auto mixers = makeMixers();
+
+    //Three laps of the ring: only the last lap is in the timeline, in order.
+    for (int64_t index = 0; index < 3 * kSlots; ++index)
+    {
+        Mixer::AudioMixerBlock::mix(mixers, index * static_cast<int64_t>(kBlockSize), block(static_cast<float>(index)), 1);
+    }
+    for (int64_t index = 0; index < 3 * kSlots; ++index)
+    {
+        auto time = index * static_cast<int64_t>(kBlockSize);
+        auto inLastLap = index >= 2 * kSlots;
+        REQUIRE(Mixer::AudioMixerBlock::containsTimeStamp(mixers, time) == inLastLap);
+        REQUIRE(played(mixers, time) == (inLastLap ? static_cast<float>(index) : 0.0f));
+    }
+
+    //Negative time stamps (pre-roll) wrap to the end of the ring, and block 0 is still its own slot.
+    auto preRoll = makeMixers();
+    Mixer::AudioMixerBlock::mix(preRoll, -static_cast<int64_t>(kBlockSize), block(7.0f), 1);
+    Mixer::AudioMixerBlock::mix(preRoll, 0, block(8.0f), 1);
+    REQUIRE(played(preRoll, -static_cast<int64_t>(kBlockSize)) == 7.0f);
+    REQUIRE(played(preRoll, 0) == 8.0f);
+    //The slot of -1 is the slot of kSlots - 1: the newer one takes it over.
+    Mixer::AudioMixerBlock::mix(preRoll, (kSlots - 1) * static_cast<int64_t>(kBlockSize), block(9.0f), 1);
+    REQUIRE_FALSE(Mixer::AudioMixerBlock::containsTimeStamp(preRoll, -static_cast<int64_t>(kBlockSize)));
+}
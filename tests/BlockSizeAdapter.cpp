@@ -1,11 +1,18 @@
-#define CATCH_CONFIG_MAIN
-#include "catch.hpp"
+//
+// Created by Julian Guarin on 15/02/24.
+//
 #include "BlockSizeAdapter.h"
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_approx.hpp>
+
 #include <vector>
 #include <cmath>
 #include <algorithm>
+#include <atomic>
+#include <thread>
 
 using namespace Utilities::Buffer;
+using Catch::Approx;
 
 // Helper function for generating test data
 std::vector<float> generateTestData(size_t size) {
@@ -23,14 +30,15 @@ TEST_CASE("BlockSizeAdapter Constructor", "[BlockSizeAdapter]") {
 TEST_CASE("BlockSizeAdapter::push and BlockSizeAdapter::pop with vector", "[BlockSizeAdapter]") {
     BlockSizeAdapter bsa(5);
     std::vector<float> inputData = generateTestData(10); // Generate 10 float values
-    bsa.push(inputData);
+    bsa.push(inputData.data(), inputData.size());
 
     SECTION("Data is ready after push") {
         REQUIRE(bsa.dataReady() == true);
     }
 
     std::vector<float> outputData;
-    bsa.pop(outputData);
+    uint32_t timeStamp = 0;
+    bsa.pop(outputData, timeStamp);
 
     SECTION("Pop retrieves correct block size of data") {
         REQUIRE(outputData.size() == 5);
@@ -53,7 +61,8 @@ TEST_CASE("BlockSizeAdapter::push and BlockSizeAdapter::pop with raw pointer", "
     bsa.push(inputData.data(), inputData.size());
 
     float outputData[5];
-    bsa.pop(outputData);
+    uint32_t timeStamp = 0;
+    bsa.pop(outputData, timeStamp);
 
     SECTION("Pop retrieves correct data") {
         for (size_t i = 0; i < 5; ++i) {
@@ -68,56 +77,131 @@ TEST_CASE("BlockSizeAdapter::isEmpty and BlockSizeAdapter::dataReady", "[BlockSi
     REQUIRE(bsa.dataReady() == false);
 
     std::vector<float> inputData = generateTestData(5); // Less than block size
-    bsa.push(inputData);
+    bsa.push(inputData.data(), inputData.size());
 
     SECTION("Adapter is not empty but not ready with partial data") {
         REQUIRE(bsa.isEmpty() == false);
         REQUIRE(bsa.dataReady() == false);
     }
 
-    bsa.push(inputData); // Push enough data to exceed block size
+    bsa.push(inputData.data(), inputData.size()); // Push enough data to exceed block size
 
     SECTION("Adapter is ready when enough data is pushed") {
         REQUIRE(bsa.dataReady() == true);
     }
 }
 
-TEST_CASE("BlockSizeAdapter::setOutputBlockSize changes output block size", "[BlockSizeAdapter]") {
+TEST_CASE("BlockSizeAdapter::setChannelsAndOutputBlockSize changes output block size", "[BlockSizeAdapter]") {
     BlockSizeAdapter bsa(5);
     std::vector<float> inputData = generateTestData(10); // Generate 10 float values
-    bsa.push(inputData);
+    bsa.push(inputData.data(), inputData.size());
 
-    bsa.setOutputBlockSize(10); // Change the output block size
+    bsa.setChannelsAndOutputBlockSize(1, 10); // Change the output block size
 
     std::vector<float> outputData;
-    bsa.pop(outputData);
+    uint32_t timeStamp = 0;
+    bsa.pop(outputData, timeStamp);
 
     SECTION("Output data matches new block size") {
         REQUIRE(outputData.size() == 10);
+        REQUIRE(outputData.back() == Approx(inputData.back()));
     }
 }
 
-TEST_CASE("BlockSizeAdapter::monoSplit", "[BlockSizeAdapter]") {
-    BlockSizeAdapter bsaLeft(2), bsaRight(2);
-    std::vector<float> stereoLeft = {0.3f, 1.2f, 0.4f, 1.4f}; // Interleaved stereo data
-    std::vector<float> stereoRight = {0.1f, 0.6f, 0.2f, 0.7f}; // Interleaved stereo data
+TEST_CASE("BlockSizeAdapter::push wraps around the ring", "[BlockSizeAdapter]") {
+    BlockSizeAdapter bsa(480, 2);
+    std::vector<float> chunk(333);
+    std::vector<float> block(960);
+    uint32_t timeStamp = 0;
+    float next = 0.0f, expected = 0.0f;
+
+    //Push and pop several times the ring size, so every index wraps more than once.
+    for (size_t round = 0; round < 20000; ++round) {
+        for (auto& sample : chunk) sample = next++;
+        bsa.push(chunk.data(), chunk.size());
+        while (bsa.dataReady()) {
+            bsa.pop(block.data(), timeStamp);
+            for (auto sample : block) REQUIRE(sample == expected++);
+        }
+    }
+}
 
-    // Assuming a method to push stereo data for testing purpose
-    bsaLeft.push(stereoSignal);
-    bsaRight.push(stereoSignal);
-    BlockSizeAdapter::monoSplit(bsaLeft, bsaRight);
+TEST_CASE("BlockSizeAdapter::push with an older timestamp resets the adapter", "[BlockSizeAdapter]") {
+    BlockSizeAdapter bsa(4, 1);
+    bsa.setChannelsAndOutputBlockSize(1, 4);
+    bsa.setTimeStamp(100);
+    bsa.push(std::vector<float>(8, 1.0f), 200);
+    bsa.push(std::vector<float>(4, 2.0f), 50);
+
+    std::vector<float> block(4);
+    uint32_t timeStamp = 0;
+    REQUIRE(bsa.dataReady() == true);
+    bsa.pop(block, timeStamp);
+    REQUIRE(timeStamp == 50);
+    REQUIRE(block[0] == 2.0f);
+    REQUIRE(bsa.isEmpty() == true);
+}
 
-    std::vector<float> block0, block1;
-    bsaLeft.pop(block0);
-    bsaLeft.pop(block1);
+TEST_CASE("BlockSizeAdapter::requestReset is applied by the producer", "[BlockSizeAdapter]") {
+    BlockSizeAdapter bsa(4, 1);
+    bsa.setChannelsAndOutputBlockSize(1, 4);
+    bsa.setTimeStamp(100);
+    bsa.push(std::vector<float>(8, 1.0f), 100);
+
+    //Requested from another thread: the consumer still reads the old blocks until the producer pushes again.
+    bsa.requestReset(1, 2, 1000);
+    std::vector<float> block{};
+    uint32_t timeStamp = 0;
+    REQUIRE(bsa.dataReady() == true);
+    bsa.pop(block, timeStamp);
+    REQUIRE(block.size() == 4);
+    REQUIRE(timeStamp == 100);
+    REQUIRE(block[0] == 1.0f);
+
+    //The push applies it first: the last old block is flushed, the new block size and timestamp hold.
+    bsa.push(std::vector<float>(4, 2.0f), 1000);
+    block.clear();
+    REQUIRE(bsa.dataReady() == true);
+    bsa.pop(block, timeStamp);
+    REQUIRE(block.size() == 2);
+    REQUIRE(timeStamp == 1000);
+    REQUIRE(block[0] == 2.0f);
+    bsa.pop(block, timeStamp);
+    REQUIRE(timeStamp == 1002);
+    REQUIRE(bsa.isEmpty() == true);
+}
 
-    SECTION("Left channel contains correct data") {
-        REQUIRE(block0[0] == Approx(0.2f));
-        REQUIRE(block0[1] == Approx(0.9f));
+TEST_CASE("BlockSizeAdapter single producer single consumer", "[BlockSizeAdapter]") {
+    BlockSizeAdapter bsa(480, 2);
+    constexpr size_t kBlocks = 10000;
+    constexpr size_t kBlockSize = 960;
+    constexpr size_t kChunk = 441;
+    std::atomic<size_t> received{0};
+
+    std::thread producer([&]() {
+        std::vector<float> chunk(kChunk);
+        for (size_t sent = 0; sent < kBlocks * kBlockSize;) {
+            //Stay well inside the ring, a full ring drops the pushed chunk.
+            if (sent - received.load() * kBlockSize > 100 * kBlockSize) { std::this_thread::yield(); continue; }
+            auto size = std::min(kChunk, kBlocks * kBlockSize - sent);
+            for (size_t index = 0; index < size; ++index) chunk[index] = static_cast<float>(sent + index);
+            bsa.push(chunk.data(), size);
+            sent += size;
+        }
+    });
+
+    std::vector<float> block(kBlockSize);
+    uint32_t timeStamp = 0;
+    float expected = 0.0f;
+    bool inOrder = true;
+    while (received < kBlocks) {
+        if (!bsa.dataReady()) { std::this_thread::yield(); continue; }
+        bsa.pop(block.data(), timeStamp);
+        for (auto sample : block) inOrder &= (sample == expected++);
+        ++received;
     }
+    producer.join();
 
-    SECTION("Right channel contains correct data") {
-        REQUIRE(block1[0] == Approx(0.3f));
-        REQUIRE(block1[1] == Approx(10.5f));
-    }
+    REQUIRE(inOrder == true);
+    REQUIRE(timeStamp == (kBlocks - 1) * 480);
 }
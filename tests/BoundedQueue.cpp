@@ -0,0 +1,96 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+#include "ring.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <thread>
+#include <vector>
+
+using namespace xlet;
+
+TEST_CASE("BoundedQueue rounds the capacity up to a power of two", "[BoundedQueue]")
+{
+    BoundedQueue<int> queue(100);
+    REQUIRE(queue.capacity() == 128);
+    REQUIRE(queue.empty());
+}
+
+TEST_CASE("BoundedQueue drops the oldest element when full", "[BoundedQueue]")
+{
+    BoundedQueue<int> queue(4, Overflow::DropOldest);
+    for (auto value = 0; value < 4; ++value) REQUIRE(queue.push(value));
+    REQUIRE_FALSE(queue.push(4));
+    REQUIRE_FALSE(queue.push(5));
+
+    auto stats = queue.stats();
+    REQUIRE(stats.pushed == 6);
+    REQUIRE(stats.dropped == 2);
+    REQUIRE(stats.highWater == 4);
+
+    //The freshest data survives.
+    std::vector<int> popped{};
+    for (int value; queue.tryPop(value); ) popped.push_back(value);
+    REQUIRE(popped == std::vector<int>{2, 3, 4, 5});
+}
+
+TEST_CASE("BoundedQueue never drops when told so", "[BoundedQueue]")
+{
+    BoundedQueue<int> queue(2, Overflow::NeverDrop);
+    REQUIRE(queue.push(0));
+    REQUIRE(queue.push(1));
+
+    int spare = 2;
+    REQUIRE_FALSE(queue.tryPush(spare));
+
+    //The producer waits until the consumer makes room.
+    std::thread producer{[&queue](){ queue.push(2); }};
+    int value;
+    while (!queue.tryPop(value)) std::this_thread::yield();
+    REQUIRE(value == 0);
+    producer.join();
+
+    REQUIRE(queue.tryPop(value));
+    REQUIRE(value == 1);
+    REQUIRE(queue.tryPop(value));
+    REQUIRE(value == 2);
+    REQUIRE(queue.stats().dropped == 0);
+}
+
+TEST_CASE("BoundedQueue keeps per producer order with several producers", "[BoundedQueue]")
+{
+    constexpr int kProducers = 4;
+    constexpr int kPerProducer = 100000;
+    BoundedQueue<uint64_t> queue(1024, Overflow::NeverDrop);
+
+    std::vector<std::thread> producers{};
+    for (auto producer = 0; producer < kProducers; ++producer)
+    {
+        producers.emplace_back([&queue, producer](){
+            for (auto sequence = 0; sequence < kPerProducer; ++sequence)
+            {
+                queue.push((static_cast<uint64_t>(producer) << 32) | static_cast<uint64_t>(sequence));
+            }
+        });
+    }
+
+    std::vector<int64_t> last(kProducers, -1);
+    auto received = 0;
+    auto inOrder = true;
+    while (received < kProducers * kPerProducer)
+    {
+        uint64_t value;
+        if (!queue.tryPop(value)) continue;
+        auto producer = value >> 32;
+        auto sequence = static_cast<int64_t>(value & 0xFFFFFFFF);
+        inOrder = inOrder && sequence == last[producer] + 1;
+        last[producer] = sequence;
+        ++received;
+    }
+    for (auto& producer : producers) producer.join();
+
+    REQUIRE(inOrder);
+    REQUIRE(queue.stats().dropped == 0);
+    REQUIRE(queue.stats().highWater <= queue.capacity());
+    REQUIRE(queue.empty());
+}
@@ -0,0 +1,144 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+#include "DecodePool.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono;
+
+namespace
+{
+    struct Job
+    {
+        uint64_t    peer{0};
+        uint64_t    sequence{0};
+    };
+
+    template <typename Predicate>
+    bool waitFor(Predicate predicate)
+    {
+        auto start = steady_clock::now();
+        while (!predicate())
+        {
+            if (steady_clock::now() - start > seconds(5)) return false;
+            std::this_thread::sleep_for(milliseconds(1));
+        }
+        return true;
+    }
+}
+
+TEST_CASE("DecodePool runs the jobs of a peer on one worker, in order", "[DecodePool]")
+{
+    constexpr uint64_t kPeers = 12;
+    constexpr uint64_t kJobsPerPeer = 100;
+
+    std::mutex mutex;
+    std::map<uint64_t, std::vector<uint64_t>> sequences{};
+    std::map<uint64_t, std::thread::id> threads{};
+    bool sameThread = true;
+
+    Mixer::DecodePool<Job> pool{};
+    pool.start(4, [&](Job& job){
+        std::lock_guard<std::mutex> lock(mutex);
+        auto [it, inserted] = threads.try_emplace(job.peer, std::this_thread::get_id());
+        sameThread = sameThread && it->second == std::this_thread::get_id();
+        sequences[job.peer].push_back(job.sequence);
+    });
+    REQUIRE(pool.workers() == 4);
+
+    //Submit in rounds that fit a worker queue: a full queue drops, and on a loaded machine the workers lag behind.
+    constexpr uint64_t kRound = 20;
+    for (auto round = 0ul; round < kJobsPerPeer; round += kRound)
+    {
+        for (auto sequence = round; sequence < round + kRound; ++sequence)
+        {
+            for (auto peer = 0ul; peer < kPeers; ++peer) REQUIRE(pool.submit(peer, Job{peer, sequence}));
+        }
+        REQUIRE(waitFor([&](){
+            std::lock_guard<std::mutex> lock(mutex);
+            auto done = 0ul;
+            for (auto& [peer, received] : sequences) done += received.size();
+            return done == kPeers * (round + kRound);
+        }));
+    }
+    pool.stop();
+
+    REQUIRE(sameThread);
+    for (auto& [peer, received] : sequences)
+    {
+        REQUIRE(received.size() == kJobsPerPeer);
+        for (auto index = 0ul; index < received.size(); ++index) REQUIRE(received[index] == index);
+    }
+    //Peers are spread: 12 peers over 4 workers.
+    std::map<std::thread::id, size_t> peersPerThread{};
+    for (auto& [peer, id] : threads) ++peersPerThread[id];
+    REQUIRE(peersPerThread.size() == 4);
+}
+
+TEST_CASE("DecodePool without workers runs the jobs on the caller", "[DecodePool]")
+{
+    Mixer::DecodePool<Job> pool{};
+    std::thread::id ranOn{};
+    pool.start(0, [&](Job&){ ranOn = std::this_thread::get_id(); });
+    REQUIRE(pool.submit(7, Job{7, 0}));
+    REQUIRE(ranOn == std::this_thread::get_id());
+}
+
+TEST_CASE("DecodePool drops what is submitted after stop", "[DecodePool]")
+{
+    std::atomic<size_t> handled{0};
+    Mixer::DecodePool<Job> pool{};
+    REQUIRE_FALSE(pool.submit(7, Job{7, 0}));
+
+    pool.start(0, [&](Job&){ handled.fetch_add(1); });
+    REQUIRE(pool.submit(7, Job{7, 0}));
+    pool.stop();
+    REQUIRE_FALSE(pool.submit(7, Job{7, 1}));
+    REQUIRE(handled.load() == 1);
+
+    //Stopping while another thread keeps submitting: what got in ran, the rest is dropped, nothing runs after stop.
+    pool.start(2, [&](Job&){ handled.fetch_add(1); });
+    std::atomic<bool> stopped{false};
+    std::atomic<size_t> afterStop{0};
+    std::thread network{[&](){
+        for (auto sequence = 0ul; sequence < 100000; ++sequence)
+        {
+            auto wasStopped = stopped.load();
+            if (pool.submit(sequence, Job{sequence, sequence}) && wasStopped) afterStop.fetch_add(1);
+        }
+    }};
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    pool.stop();
+    stopped.store(true);
+    network.join();
+    REQUIRE(afterStop.load() == 0);
+    REQUIRE(pool.workers() == 0);
+}
+
+TEST_CASE("DecodePool drops the oldest jobs of a worker that falls behind", "[DecodePool]")
+{
+    std::atomic<bool> release{false};
+    std::atomic<size_t> handled{0};
+    Mixer::DecodePool<Job> pool{};
+    pool.start(1, [&](Job&){
+        while (!release.load()) std::this_thread::yield();
+        handled.fetch_add(1);
+    });
+
+    auto overflow = Mixer::DecodePool<Job>::kQueueCapacity * 2;
+    auto dropped = 0ul;
+    for (auto sequence = 0ul; sequence < overflow; ++sequence)
+    {
+        if (!pool.submit(1, Job{1, sequence})) ++dropped;
+    }
+    release.store(true);
+    REQUIRE(dropped > 0);
+    REQUIRE(pool.stats(0).dropped == dropped);
+    REQUIRE(waitFor([&](){ return handled.load() + dropped == overflow; }));
+}
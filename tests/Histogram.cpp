@@ -0,0 +1,62 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+#include "Histogram.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <thread>
+#include <vector>
+
+using DAWn::Metrics::Histogram;
+
+TEST_CASE("Histogram percentiles are within a bucket of the value", "[Histogram]")
+{
+    Histogram histogram{};
+    for (uint64_t value = 1; value <= 10000; ++value) histogram.record(value);
+
+    auto snapshot = histogram.snapshot();
+    REQUIRE(snapshot.count == 10000);
+    REQUIRE(snapshot.max == 10000);
+    auto p50 = snapshot.percentile(0.50);
+    auto p99 = snapshot.percentile(0.99);
+    REQUIRE(p50 >= 5000 - 5000 / Histogram::kSubBuckets);
+    REQUIRE(p50 <= 5000 + 5000 / Histogram::kSubBuckets);
+    REQUIRE(p99 >= 9900 - 9900 / Histogram::kSubBuckets);
+    REQUIRE(p99 <= 10000);
+    REQUIRE(snapshot.percentile(1.0) == 10000);
+    REQUIRE(Histogram::Snapshot{}.percentile(0.5) == 0);
+}
+
+TEST_CASE("Histogram buckets cover every value once", "[Histogram]")
+{
+    for (auto index = 1ul; index < Histogram::kBuckets; ++index)
+    {
+        REQUIRE(Histogram::lowest(index) > Histogram::lowest(index - 1));
+        REQUIRE(Histogram::bucket(Histogram::lowest(index)) == index);
+        REQUIRE(Histogram::bucket(Histogram::lowest(index) - 1) == index - 1);
+    }
+    REQUIRE(Histogram::bucket(~0ull) == Histogram::kBuckets - 1);
+}
+
+TEST_CASE("Histogram snapshots subtract into intervals and add across threads", "[Histogram]")
+{
+    Histogram histogram{};
+    histogram.record(100);
+    auto before = histogram.snapshot();
+
+    std::vector<std::thread> writers{};
+    for (auto writer = 0; writer < 4; ++writer)
+    {
+        writers.emplace_back([&histogram](){ for (auto count = 0; count < 1000; ++count) histogram.record(2000); });
+    }
+    for (auto& writer : writers) writer.join();
+
+    auto interval = histogram.snapshot() - before;
+    REQUIRE(interval.count == 4000);
+    REQUIRE(interval.percentile(0.01) >= 2000 - 2000 / Histogram::kSubBuckets);
+
+    auto merged = before;
+    merged += interval;
+    REQUIRE(merged.count == 4001);
+    REQUIRE(merged.max == 2000);
+}
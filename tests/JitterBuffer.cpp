@@ -0,0 +1,205 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+#include "JitterBuffer.h"
+#include "BlockSizeAdapter.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <array>
+#include <vector>
+
+using namespace Mixer;
+using Verdict = JitterBuffer::Verdict;
+
+namespace
+{
+    constexpr int64_t kPacket = 480;
+    //One 480 samples packet @ 48k.
+    constexpr int64_t kPacketNs = 10'000'000;
+
+    JitterBuffer::Settings settings()
+    {
+        JitterBuffer::Settings settings{};
+        settings.packetSamples = kPacket;
+        settings.blockSize = kPacket;
+        settings.minDelaySamples = 960;
+        settings.maxDelaySamples = 9600;
+        return settings;
+    }
+}
+
+TEST_CASE("JitterBuffer classifies duplicates and superseded packets", "[JitterBuffer]")
+{
+    JitterBuffer jitterBuffer{};
+    jitterBuffer.reset(settings());
+
+    REQUIRE(jitterBuffer.admit(1, 0, 0) == Verdict::Discontinuous);
+    REQUIRE(jitterBuffer.admit(1, kPacket, kPacketNs) == Verdict::OnTime);
+    REQUIRE(jitterBuffer.admit(1, kPacket, kPacketNs) == Verdict::Duplicate);
+
+    //Packet 3 overtakes packet 2: 2 is decoded past already.
+    REQUIRE(jitterBuffer.admit(1, 3 * kPacket, 2 * kPacketNs) == Verdict::Discontinuous);
+    REQUIRE(jitterBuffer.admit(1, 2 * kPacket, 3 * kPacketNs) == Verdict::Superseded);
+    REQUIRE(jitterBuffer.admit(1, 3 * kPacket, 3 * kPacketNs) == Verdict::Duplicate);
+
+    auto stats = jitterBuffer.stats(1);
+    REQUIRE(stats.received == 6);
+    REQUIRE(stats.duplicate == 2);
+    REQUIRE(stats.superseded == 1);
+
+    //Sources are independent.
+    REQUIRE(jitterBuffer.admit(2, kPacket, kPacketNs) == Verdict::Discontinuous);
+}
+
+TEST_CASE("JitterBuffer drops a packet once a newer one was admitted", "[JitterBuffer]")
+{
+    JitterBuffer jitterBuffer{};
+    jitterBuffer.reset(settings());
+    //The input BSA of the source, fed the way decodeAndMix does: a Discontinuous packet re-anchors it.
+    Utilities::Buffer::BlockSizeAdapter bsaInput(kPacket, 1);
+    bsaInput.setTimeStamp(0, true);
+    auto decode = [&](TTime timeStamp) {
+        auto verdict = jitterBuffer.admit(1, timeStamp, timeStamp / kPacket * kPacketNs);
+        if (verdict == Verdict::Late || verdict == Verdict::Duplicate || verdict == Verdict::Superseded) return verdict;
+        auto ui32TimeStamp = static_cast<uint32_t>(timeStamp);
+        if (verdict == Verdict::Discontinuous) bsaInput.setTimeStamp(ui32TimeStamp, true);
+        bsaInput.push(std::vector<float>(kPacket, static_cast<float>(timeStamp / kPacket)), ui32TimeStamp);
+        return verdict;
+    };
+
+    REQUIRE(decode(0) == Verdict::Discontinuous);
+    //Packet 1 is late (reordered, or retransmitted on request): packet 2 was decoded before it.
+    REQUIRE(decode(2 * kPacket) == Verdict::Discontinuous);
+    REQUIRE(decode(kPacket) == Verdict::Superseded);
+    //Nothing moved back: packet 3 follows packet 2.
+    REQUIRE(decode(3 * kPacket) == Verdict::OnTime);
+
+    std::vector<float> block{};
+    uint32_t timeStamp = 0;
+    REQUIRE(bsaInput.dataReady());
+    bsaInput.pop(block, timeStamp);
+    REQUIRE(timeStamp == 2 * kPacket);
+    REQUIRE(block[0] == 2.0f);
+    bsaInput.pop(block, timeStamp);
+    REQUIRE(timeStamp == 3 * kPacket);
+    REQUIRE(block[0] == 3.0f);
+    REQUIRE(bsaInput.isEmpty());
+
+    auto stats = jitterBuffer.stats(1);
+    //It did arrive: dropped, but not lost.
+    REQUIRE(stats.superseded == 1);
+    REQUIRE(stats.lost == 0);
+
+    //A packet ahead of everything admitted is decoded.
+    REQUIRE(decode(5 * kPacket) == Verdict::Discontinuous);
+}
+
+TEST_CASE("JitterBuffer drops packets the playback head already played", "[JitterBuffer]")
+{
+    JitterBuffer jitterBuffer{};
+    jitterBuffer.reset(settings());
+    REQUIRE(jitterBuffer.delaySamples() == 960);
+
+    //Playing sample 48000 with 960 samples of delay: anything ending before 47040 is gone.
+    jitterBuffer.setPlaybackHead(48000, 0);
+    REQUIRE(jitterBuffer.admit(1, 47040, 0) != Verdict::Late);
+    REQUIRE(jitterBuffer.admit(1, 40000 - kPacket, 0) == Verdict::Late);
+    REQUIRE(jitterBuffer.stats(1).late == 1);
+}
+
+TEST_CASE("JitterBuffer grows the delay at once and shrinks it slowly", "[JitterBuffer]")
+{
+    JitterBuffer jitterBuffer{};
+    jitterBuffer.reset(settings());
+
+    //Packets arrive 3000 samples behind the head.
+    int64_t nowNs = 0;
+    int64_t timeStamp = 0;
+    auto send = [&](int64_t lateness){
+        jitterBuffer.setPlaybackHead(timeStamp + lateness, nowNs);
+        jitterBuffer.admit(7, timeStamp, nowNs);
+        timeStamp += kPacket;
+        nowNs += kPacketNs;
+    };
+    send(3000);
+    REQUIRE(jitterBuffer.delaySamples() >= 3000 + kPacket);
+    REQUIRE(jitterBuffer.delaySamples() <= 9600);
+
+    //The link gets better, but the delay holds until the worst lateness leaves the window...
+    auto grown = jitterBuffer.delaySamples();
+    for (auto index = 0ul; index < JitterBuffer::kWindowPackets; ++index) send(0);
+    REQUIRE(jitterBuffer.delaySamples() == grown);
+
+    //...and then shrinks a packet at a time down to the minimum.
+    for (auto index = 0ul; index < 40 * JitterBuffer::kShrinkHoldPackets; ++index) send(0);
+    REQUIRE(jitterBuffer.delaySamples() < grown);
+    REQUIRE(jitterBuffer.delaySamples() >= 960);
+
+    //Lateness beyond the upper bound is clamped.
+    send(100000);
+    REQUIRE(jitterBuffer.delaySamples() == 9600);
+}
+
+TEST_CASE("JitterBuffer counts lost packets", "[JitterBuffer]")
+{
+    JitterBuffer jitterBuffer{};
+    jitterBuffer.reset(settings());
+
+    //10 packets sent, 2 never arrive.
+    for (auto packet = 0; packet < 10; ++packet)
+    {
+        if (packet == 3 || packet == 7) continue;
+        jitterBuffer.admit(1, packet * kPacket, packet * kPacketNs);
+    }
+    REQUIRE(jitterBuffer.stats(1).lost == 2);
+    REQUIRE(jitterBuffer.fractionLost() == 0.2);
+
+    //Nothing lost since the previous call. A late arrival is not a loss anymore.
+    jitterBuffer.admit(1, 10 * kPacket, 10 * kPacketNs);
+    jitterBuffer.admit(1, 7 * kPacket, 11 * kPacketNs);
+    REQUIRE(jitterBuffer.stats(1).lost == 1);
+    REQUIRE(jitterBuffer.fractionLost() == 0.0);
+}
+
+TEST_CASE("JitterBuffer names the missing packets once", "[JitterBuffer]")
+{
+    JitterBuffer jitterBuffer{};
+    jitterBuffer.reset(settings());
+    std::array<TTime, 16> missing{};
+
+    jitterBuffer.admit(1, 0, 0);
+    jitterBuffer.admit(1, kPacket, kPacketNs);
+    REQUIRE(jitterBuffer.admit(1, 4 * kPacket, 2 * kPacketNs) == Verdict::Discontinuous);
+    REQUIRE(jitterBuffer.retransmitCandidates(1, 4 * kPacket, 0, missing, 2 * kPacketNs) == 2);
+    REQUIRE(missing[0] == 3 * kPacket);
+    REQUIRE(missing[1] == 2 * kPacket);
+    REQUIRE(jitterBuffer.retransmitCandidates(1, 4 * kPacket, 0, missing, 2 * kPacketNs) == 0);
+
+    //Packet 2 came back, the next gap only names 6 and 7.
+    jitterBuffer.admit(1, 2 * kPacket, 3 * kPacketNs);
+    jitterBuffer.admit(1, 5 * kPacket, 4 * kPacketNs);
+    jitterBuffer.admit(1, 8 * kPacket, 5 * kPacketNs);
+    REQUIRE(jitterBuffer.retransmitCandidates(1, 8 * kPacket, 0, missing, 5 * kPacketNs) == 2);
+    REQUIRE(missing[0] == 7 * kPacket);
+    REQUIRE(missing[1] == 6 * kPacket);
+
+    //The span caps the count.
+    jitterBuffer.admit(1, 20 * kPacket, 6 * kPacketNs);
+    REQUIRE(jitterBuffer.retransmitCandidates(1, 20 * kPacket, 0, std::span<TTime>(missing).first(4), 6 * kPacketNs) == 4);
+    REQUIRE(missing[3] == 16 * kPacket);
+}
+
+TEST_CASE("JitterBuffer does not name packets a round trip can not save", "[JitterBuffer]")
+{
+    JitterBuffer jitterBuffer{};
+    jitterBuffer.reset(settings());
+    std::array<TTime, 16> missing{};
+
+    jitterBuffer.admit(1, 20 * kPacket, 0);
+    jitterBuffer.admit(1, 25 * kPacket, kPacketNs);
+    //Playout head at packet 21: packet 24 has 4 packets of slack, 23 three, 22 two, 21 one.
+    jitterBuffer.setPlaybackHead(21 * kPacket + static_cast<TTime>(jitterBuffer.delaySamples()), kPacketNs);
+    REQUIRE(jitterBuffer.retransmitCandidates(1, 25 * kPacket, 2 * kPacket, missing, kPacketNs) == 3);
+    REQUIRE(missing[0] == 24 * kPacket);
+    REQUIRE(missing[2] == 22 * kPacket);
+}
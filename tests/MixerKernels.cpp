@@ -0,0 +1,158 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+#include "MixerKernels.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace Mixer::Kernels;
+
+// Helper function for generating test data
+static std::vector<float> generateRandomData(size_t size, uint32_t seed)
+{
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+    std::vector<float> data(size);
+    for (auto& sample : data) sample = distribution(generator);
+    return data;
+}
+
+static const std::vector<size_t> sSizes {0, 1, 3, 4, 7, 8, 15, 16, 17, 31, 64, 128, 480, 512, 1024, 1031};
+
+TEST_CASE("Mixer::Kernels scalar ISA is always supported", "[MixerKernels]")
+{
+    REQUIRE(IsSupported(ISA::Scalar));
+    REQUIRE(SupportedISAs().front() == ISA::Scalar);
+    REQUIRE(IsSupported(Active().isa));
+}
+
+TEST_CASE("Mixer::Kernels add and sub match the scalar reference", "[MixerKernels]")
+{
+    for (auto isa : SupportedISAs())
+    {
+        auto& kernels = Select(isa);
+        REQUIRE(kernels.isa == isa);
+        for (auto size : sSizes)
+        {
+            INFO("isa: " << ISAName(isa) << " size: " << size);
+            // Offset by one sample so the kernels are exercised with unaligned pointers.
+            auto a = generateRandomData(size + 1, 1);
+            auto b = generateRandomData(size + 1, 2);
+            std::vector<float> expected(size + 1, 0.0f), result(size + 1, 0.0f);
+
+            Scalar::add(a.data() + 1, b.data() + 1, expected.data() + 1, size);
+            kernels.add(a.data() + 1, b.data() + 1, result.data() + 1, size);
+            REQUIRE(result == expected);
+
+            Scalar::sub(a.data() + 1, b.data() + 1, expected.data() + 1, size);
+            kernels.sub(a.data() + 1, b.data() + 1, result.data() + 1, size);
+            REQUIRE(result == expected);
+        }
+    }
+}
+
+TEST_CASE("Mixer::Kernels mixDelta matches the scalar reference", "[MixerKernels]")
+{
+    for (auto isa : SupportedISAs())
+    {
+        auto& kernels = Select(isa);
+        for (auto size : sSizes)
+        {
+            INFO("isa: " << ISAName(isa) << " size: " << size);
+            auto source = generateRandomData(size + 1, 3);
+            auto expectedPlayback = generateRandomData(size + 1, 4);
+            auto expectedLastSource = generateRandomData(size + 1, 5);
+            auto playback = expectedPlayback;
+            auto lastSource = expectedLastSource;
+
+            Scalar::mixDelta(expectedPlayback.data() + 1, expectedLastSource.data() + 1, source.data() + 1, size);
+            kernels.mixDelta(playback.data() + 1, lastSource.data() + 1, source.data() + 1, size);
+
+            REQUIRE(playback == expectedPlayback);
+            REQUIRE(lastSource == expectedLastSource);
+            REQUIRE(std::equal(lastSource.begin() + 1, lastSource.end(), source.begin() + 1));
+        }
+    }
+}
+
+TEST_CASE("Mixer::Kernels layout kernels match the scalar reference", "[MixerKernels]")
+{
+    for (auto isa : SupportedISAs())
+    {
+        auto& kernels = Select(isa);
+        for (auto size : sSizes)
+        {
+            INFO("isa: " << ISAName(isa) << " size: " << size);
+            auto left = generateRandomData(size + 1, 6);
+            auto right = generateRandomData(size + 1, 7);
+            std::vector<float> expected(2 * size + 1, 0.0f), interleaved(2 * size + 1, 0.0f);
+
+            Scalar::interleave2(left.data() + 1, right.data() + 1, expected.data() + 1, size);
+            kernels.interleave2(left.data() + 1, right.data() + 1, interleaved.data() + 1, size);
+            REQUIRE(interleaved == expected);
+            for (auto index = 0ul; index < size; ++index)
+            {
+                REQUIRE(interleaved[1 + 2 * index] == left[1 + index]);
+                REQUIRE(interleaved[2 + 2 * index] == right[1 + index]);
+            }
+
+            std::vector<float> outLeft(size + 1, 0.0f), outRight(size + 1, 0.0f);
+            kernels.deinterleave2(interleaved.data() + 1, outLeft.data() + 1, outRight.data() + 1, size);
+            REQUIRE(std::equal(outLeft.begin() + 1, outLeft.end(), left.begin() + 1));
+            REQUIRE(std::equal(outRight.begin() + 1, outRight.end(), right.begin() + 1));
+
+            auto expectedLeft = left, expectedRight = right;
+            Scalar::monoSplit(expectedLeft.data() + 1, expectedRight.data() + 1, size);
+            kernels.monoSplit(left.data() + 1, right.data() + 1, size);
+            REQUIRE(left == expectedLeft);
+            REQUIRE(right == expectedRight);
+            REQUIRE(std::equal(left.begin() + 1, left.end(), right.begin() + 1));
+        }
+    }
+}
+
+TEST_CASE("Mixer::Kernels Interleave and Deinterleave round trip any channel count", "[MixerKernels]")
+{
+    constexpr size_t kSize = 37;
+    for (auto isa : SupportedISAs())
+    {
+        auto& kernels = Select(isa);
+        for (size_t channels : {1ul, 2ul, 3ul, 6ul})
+        {
+            INFO("isa: " << ISAName(isa) << " channels: " << channels);
+            std::vector<std::vector<float>> blocks{};
+            std::vector<const float*> planar{};
+            for (auto channel = 0ul; channel < channels; ++channel)
+            {
+                blocks.push_back(generateRandomData(kSize, static_cast<uint32_t>(10 + channel)));
+                planar.push_back(blocks.back().data());
+            }
+            std::vector<float> interleaved(kSize * channels, 0.0f);
+            Interleave(planar.data(), channels, interleaved.data(), kSize, kernels);
+            for (auto index = 0ul; index < interleaved.size(); ++index)
+            {
+                REQUIRE(interleaved[index] == blocks[index % channels][index / channels]);
+            }
+
+            std::vector<std::vector<float>> outBlocks(channels, std::vector<float>(kSize, 0.0f));
+            std::vector<float*> outPlanar{};
+            for (auto& block : outBlocks) outPlanar.push_back(block.data());
+            Deinterleave(interleaved.data(), channels, outPlanar.data(), kSize, kernels);
+            REQUIRE(outBlocks == blocks);
+        }
+
+        //A missing channel is silence.
+        auto left = generateRandomData(kSize, 20);
+        const float* planar[2] = {left.data(), nullptr};
+        std::vector<float> interleaved(kSize * 2, 1.0f);
+        Interleave(planar, 2, interleaved.data(), kSize, kernels);
+        for (auto index = 0ul; index < kSize; ++index)
+        {
+            REQUIRE(interleaved[2 * index] == left[index]);
+            REQUIRE(interleaved[2 * index + 1] == 0.0f);
+        }
+    }
+}
@@ -0,0 +1,167 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+#include "opusImpl.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <cmath>
+#include <numbers>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    /*!
+     * @brief Interleaved block of a 440 Hz sine, a different amplitude per channel.
+     */
+    std::vector<float> sine(const OpusImpl::CODEC& codec, const std::vector<float>& amplitudes, size_t packet)
+    {
+        auto channels = static_cast<size_t>(codec.cfg.stateChannels());
+        auto blockSize = static_cast<size_t>(codec.cfg.mBlockSize);
+        std::vector<float> pcm(blockSize * channels);
+        for (auto frame = 0ul; frame < blockSize; ++frame)
+        {
+            auto phase = 2.0 * std::numbers::pi * 440.0 * static_cast<double>(packet * blockSize + frame) / static_cast<double>(codec.cfg.mSampRate);
+            for (auto channel = 0ul; channel < channels; ++channel)
+            {
+                pcm[frame * channels + channel] = amplitudes[channel] * static_cast<float>(std::sin(phase));
+            }
+        }
+        return pcm;
+    }
+
+    /*!
+     * @brief Encode and decode kPackets blocks of sine(), then the RMS of every channel of the last decoded block.
+     * The first blocks only let the codec settle (lookahead, bitrate ramp up).
+     */
+    std::vector<double> roundTripRMS(OpusImpl::CODEC& codec, const std::vector<float>& amplitudes)
+    {
+        constexpr size_t kPackets = 10;
+        auto channels = static_cast<size_t>(codec.cfg.stateChannels());
+        std::vector<double> rms(channels, 0.0);
+        for (auto packet = 0ul; packet < kPackets; ++packet)
+        {
+            size_t encodedBytes = 0;
+            REQUIRE(codec.encodeChannel(sine(codec, amplitudes, packet), codec.encodeScratch(), encodedBytes, 0) == OpusImpl::OK);
+            size_t decodedSize = 0;
+            REQUIRE(codec.decodeChannel(codec.encodeScratch().first(encodedBytes), codec.decodeScratch(), decodedSize, 0) == OpusImpl::OK);
+            REQUIRE(decodedSize == codec.blockSamples());
+            if (packet + 1 < kPackets) continue;
+
+            auto decoded = codec.decodeScratch();
+            for (auto index = 0ul; index < decodedSize; ++index)
+            {
+                rms[index % channels] += static_cast<double>(decoded[index]) * decoded[index];
+            }
+        }
+        for (auto& value : rms) value = std::sqrt(value / static_cast<double>(codec.cfg.mBlockSize));
+        return rms;
+    }
+
+    OpusImpl::CODECConfig config(int channels)
+    {
+        OpusImpl::CODECConfig cfg{};
+        cfg.mChannels = channels;
+        //Plenty of bits: each channel keeps its own image, no intensity stereo.
+        cfg.bitrate = 64000 * channels;
+        return cfg;
+    }
+}
+
+TEST_CASE("CODEC rebuilds the packets lost before the one decoded", "[OpusCodec]")
+{
+    OpusImpl::CODEC codec(config(1));
+    REQUIRE(codec.error == OPUS_OK);
+    auto blockSize = static_cast<uint32_t>(codec.cfg.mBlockSize);
+
+    auto decodeAt = [&](uint32_t timeStamp, uint32_t& firstTimeStamp) {
+        size_t encodedBytes = 0;
+        REQUIRE(codec.encodeChannel(sine(codec, {0.5f}, timeStamp / blockSize), codec.encodeScratch(), encodedBytes, 0) == OpusImpl::OK);
+        size_t decodedSize = 0;
+        REQUIRE(codec.decodeChannel(codec.encodeScratch().first(encodedBytes), codec.decodeScratch(), decodedSize, 0, timeStamp, firstTimeStamp) == OpusImpl::OK);
+        return decodedSize;
+    };
+
+    uint32_t firstTimeStamp = 0;
+    REQUIRE(decodeAt(0, firstTimeStamp) == blockSize);
+    REQUIRE(firstTimeStamp == 0);
+
+    //Packet 1 is lost: it is rebuilt (FEC) ahead of packet 2.
+    REQUIRE(decodeAt(2 * blockSize, firstTimeStamp) == 2 * blockSize);
+    REQUIRE(firstTimeStamp == blockSize);
+
+    //Packets 3, 4 and 5 are lost: PLC, PLC, FEC, then packet 6.
+    REQUIRE(decodeAt(6 * blockSize, firstTimeStamp) == 4 * blockSize);
+    REQUIRE(firstTimeStamp == 3 * blockSize);
+
+    //An older packet is decoded alone and does not move the decoder back: packet 7 is no gap.
+    REQUIRE(decodeAt(4 * blockSize, firstTimeStamp) == blockSize);
+    REQUIRE(firstTimeStamp == 4 * blockSize);
+    REQUIRE(decodeAt(7 * blockSize, firstTimeStamp) == blockSize);
+    REQUIRE(firstTimeStamp == 7 * blockSize);
+}
+
+TEST_CASE("CODEC round trips 6 channels in one multistream packet", "[OpusCodec]")
+{
+    OpusImpl::CODEC codec(config(6));
+    REQUIRE(codec.error == OPUS_OK);
+    REQUIRE(codec.encoderCount() == 1);
+    REQUIRE(codec.decoderCount() == 1);
+    REQUIRE(codec.blockSamples() == 6 * static_cast<size_t>(codec.cfg.mBlockSize));
+
+    //Every channel comes back at its own level, in its own place.
+    auto rms = roundTripRMS(codec, {0.05f, 0.1f, 0.15f, 0.2f, 0.25f, 0.3f});
+    for (auto channel = 1ul; channel < rms.size(); ++channel)
+    {
+        REQUIRE(rms[channel] > rms[channel - 1]);
+    }
+    REQUIRE(rms[0] > 0.01);
+}
+
+TEST_CASE("CODEC encodes two stereo pairs independently", "[OpusCodec]")
+{
+    //4 channels: two coupled streams in one packet.
+    OpusImpl::CODEC codec(config(4));
+    REQUIRE(codec.error == OPUS_OK);
+
+    //Only the second pair carries audio, the first one stays silent.
+    auto rms = roundTripRMS(codec, {0.0f, 0.0f, 0.5f, 0.5f});
+    REQUIRE(rms[0] < 0.01);
+    REQUIRE(rms[1] < 0.01);
+    REQUIRE(rms[2] > 0.1);
+    REQUIRE(rms[3] > 0.1);
+
+    //And the other way around.
+    OpusImpl::CODEC swapped(config(4));
+    rms = roundTripRMS(swapped, {0.5f, 0.5f, 0.0f, 0.0f});
+    REQUIRE(rms[0] > 0.1);
+    REQUIRE(rms[1] > 0.1);
+    REQUIRE(rms[2] < 0.01);
+    REQUIRE(rms[3] < 0.01);
+}
+
+TEST_CASE("A moved-from CODEC has no encoder nor decoder", "[OpusCodec]")
+{
+    for (auto channels : {2, 6})
+    {
+        OpusImpl::CODEC codec(config(channels));
+        REQUIRE(codec.encoderCount() == 1);
+
+        OpusImpl::CODEC moved(std::move(codec));
+        REQUIRE(moved.encoderCount() == 1);
+        REQUIRE(moved.decoderCount() == 1);
+        REQUIRE(codec.encoderCount() == 0);
+        REQUIRE(codec.decoderCount() == 0);
+
+        OpusImpl::CODEC assigned(config(1));
+        assigned = std::move(moved);
+        REQUIRE(assigned.encoderCount() == 1);
+        REQUIRE(assigned.cfg.mChannels == channels);
+        REQUIRE(moved.encoderCount() == 0);
+        REQUIRE(moved.decoderCount() == 0);
+
+        //The CODEC moved into still works.
+        auto rms = roundTripRMS(assigned, std::vector<float>(static_cast<size_t>(channels), 0.25f));
+        REQUIRE(rms[0] > 0.05);
+    }
+}
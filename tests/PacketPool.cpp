@@ -0,0 +1,66 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+#include "packet.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <thread>
+#include <vector>
+
+using namespace xlet;
+
+TEST_CASE("PacketPool hands out every buffer once", "[PacketPool]")
+{
+    PacketPool pool(4);
+    std::vector<Packet> packets{};
+    while (auto packet = pool.acquire()) packets.push_back(packet);
+
+    REQUIRE(packets.size() == 4);
+    REQUIRE_FALSE(pool.acquire().valid());
+
+    packets.pop_back();
+    REQUIRE(pool.acquire().valid());
+}
+
+TEST_CASE("Packet views share the buffer", "[PacketPool]")
+{
+    PacketPool pool(1);
+    auto packet = pool.acquire();
+    for (auto index = 0ul; index < 12; ++index) packet.writableData()[index] = std::byte(index);
+    packet.setSize(12);
+    packet.setPeerId(0xabcd);
+
+    auto payload = packet.view(8, 100);
+    REQUIRE(payload.size() == 4);
+    REQUIRE(payload.data() == packet.data() + 8);
+    REQUIRE(payload.data()[0] == std::byte(8));
+    REQUIRE(payload.peerId() == 0xabcd);
+
+    //The buffer goes back to the pool only when the last view is gone.
+    packet = Packet{};
+    REQUIRE_FALSE(pool.acquire().valid());
+    payload = Packet{};
+    REQUIRE(pool.acquire().valid());
+}
+
+TEST_CASE("PacketPool acquire and release from several threads", "[PacketPool]")
+{
+    PacketPool pool(8);
+    std::vector<std::thread> threads{};
+    for (auto thread = 0; thread < 4; ++thread)
+    {
+        threads.emplace_back([&pool]()
+        {
+            for (auto round = 0; round < 100000; ++round)
+            {
+                auto packet = pool.acquire();
+                if (packet) { packet.setSize(1); auto copy = packet; }
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+
+    std::vector<Packet> packets{};
+    while (auto packet = pool.acquire()) packets.push_back(packet);
+    REQUIRE(packets.size() == 8);
+}
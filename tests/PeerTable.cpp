@@ -0,0 +1,108 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+#include "PeerTable.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    struct Peer
+    {
+        uint32_t    id{0};
+        uint64_t    checksum{0};
+    };
+    using Table = Mixer::PeerTable<uint32_t, Peer>;
+
+    Table::Entry makePeer(uint32_t id)
+    {
+        return std::make_shared<Peer>(Peer{id, static_cast<uint64_t>(id) * 31});
+    }
+}
+
+TEST_CASE("PeerTable finds, inserts and erases", "[PeerTable]")
+{
+    Table table{};
+    REQUIRE(table.size() == 0);
+    REQUIRE(!table.find(1));
+
+    auto built = 0;
+    auto first = table.findOrInsert(1, [&](){ ++built; return makePeer(1); });
+    auto again = table.findOrInsert(1, [&](){ ++built; return makePeer(1); });
+    REQUIRE(built == 1);
+    REQUIRE(first == again);
+    REQUIRE(table.find(1)->id == 1);
+
+    REQUIRE(table.erase(1));
+    REQUIRE(!table.erase(1));
+    REQUIRE(!table.find(1));
+    //The entry outlives its erase for whoever holds it.
+    REQUIRE(first->checksum == 31);
+}
+
+TEST_CASE("PeerTable read section keeps its snapshot", "[PeerTable]")
+{
+    Table table{};
+    table.findOrInsert(1, [](){ return makePeer(1); });
+    {
+        auto peers = table.read();
+        //A writer inside a read section does not wait for it.
+        table.findOrInsert(2, [](){ return makePeer(2); });
+        table.erase(1);
+        REQUIRE(peers.size() == 1);
+        REQUIRE(peers.find(1) != nullptr);
+        REQUIRE(peers.find(2) == nullptr);
+        REQUIRE(table.retired() > 0);
+    }
+    REQUIRE(table.size() == 1);
+    REQUIRE(table.find(2));
+
+    //With no reader around the next publish frees every retired snapshot.
+    table.findOrInsert(3, [](){ return makePeer(3); });
+    REQUIRE(table.retired() == 0);
+}
+
+TEST_CASE("PeerTable readers walk while peers join and leave", "[PeerTable]")
+{
+    constexpr uint32_t kPeers = 32;
+    constexpr size_t kRounds = 200;
+
+    Table table{};
+    std::atomic<bool> run{true};
+    std::atomic<bool> consistent{true};
+    std::atomic<size_t> walks{0};
+
+    std::vector<std::thread> readers{};
+    for (auto reader = 0; reader < 3; ++reader)
+    {
+        readers.emplace_back([&](){
+            while (run.load(std::memory_order_acquire))
+            {
+                auto peers = table.read();
+                for (auto& [id, pPeer] : peers)
+                {
+                    if (!pPeer || pPeer->id != id || pPeer->checksum != static_cast<uint64_t>(id) * 31) consistent.store(false);
+                }
+                walks.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+
+    for (auto round = 0ul; round < kRounds; ++round)
+    {
+        for (auto id = 0u; id < kPeers; ++id) table.findOrInsert(id, [id](){ return makePeer(id); });
+        for (auto id = 0u; id < kPeers; id += 2) table.erase(id);
+    }
+    run.store(false, std::memory_order_release);
+    for (auto& reader : readers) reader.join();
+
+    REQUIRE(consistent.load());
+    REQUIRE(walks.load() > 0);
+    REQUIRE(table.size() == kPeers / 2);
+    table.clear();
+    REQUIRE(table.size() == 0);
+    REQUIRE(table.retired() == 0);
+}
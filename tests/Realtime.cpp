@@ -0,0 +1,100 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+#include "Realtime.h"
+#include "AudioMixerBlock.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <mutex>
+#include <vector>
+
+namespace
+{
+    //Record instead of asserting, the tests look at the count.
+    void recordViolation(const char*) {}
+
+    struct RecordViolations
+    {
+        RecordViolations() { DAWn::Realtime::setViolationHandler(recordViolation); }
+        ~RecordViolations() { DAWn::Realtime::setViolationHandler(nullptr); }
+    };
+}
+
+TEST_CASE("Realtime section reports heap use", "[Realtime]")
+{
+    RecordViolations record{};
+    auto before = DAWn::Realtime::violations();
+    //::operator new / delete called directly: a new expression whose result is unused may be elided.
+    ::operator delete(::operator new(sizeof(int)));
+    REQUIRE(DAWn::Realtime::violations() == before);
+
+    {
+        DAWn::Realtime::ScopedRealtime realtime;
+        REQUIRE(DAWn::Realtime::isRealtimeThread());
+        ::operator delete(::operator new(sizeof(int)));
+    }
+    REQUIRE(!DAWn::Realtime::isRealtimeThread());
+    //The allocation and the free.
+    REQUIRE(DAWn::Realtime::violations() == before + 2);
+}
+
+TEST_CASE("Realtime section reports a blocking lock, not a try_lock", "[Realtime]")
+{
+    RecordViolations record{};
+    DAWn::Realtime::CheckedMutex<std::mutex> mutex;
+    auto before = DAWn::Realtime::violations();
+    {
+        DAWn::Realtime::ScopedRealtime realtime;
+        if (mutex.try_lock()) mutex.unlock();
+    }
+    REQUIRE(DAWn::Realtime::violations() == before);
+    {
+        DAWn::Realtime::ScopedRealtime realtime;
+        std::lock_guard lock(mutex);
+    }
+    REQUIRE(DAWn::Realtime::violations() == before + 1);
+}
+
+TEST_CASE("AudioMixerBlock span path keeps the realtime contract", "[Realtime]")
+{
+    constexpr size_t kBlockSize = 480;
+    constexpr Mixer::TUserID kSource = 7;
+    RecordViolations record{};
+
+    std::vector<Mixer::AudioMixerBlock> mixers(2);
+    Mixer::AudioMixerBlock::resetMixers(mixers, kBlockSize);
+    Mixer::AudioMixerBlock::registerSource(mixers, kSource);
+
+    Mixer::PlanarBuffer input{};
+    Mixer::PlanarBuffer output{};
+    input.resize(2, kBlockSize);
+    output.resize(2, kBlockSize);
+    for (auto channel = 0ul; channel < 2; ++channel)
+    {
+        std::fill(input.channels()[channel].begin(), input.channels()[channel].end(), 0.25f * static_cast<float>(channel + 1));
+    }
+
+    auto before = DAWn::Realtime::violations();
+    size_t skipped = 0;
+    size_t unknownSkipped = 0;
+    int64_t realtime = 0;
+    {
+        DAWn::Realtime::ScopedRealtime realtimeSection;
+        input.setSamples(kBlockSize);
+        skipped += Mixer::AudioMixerBlock::mix(mixers, 960, input.constChannels(), kSource, Mixer::LockPolicy::TryOnly);
+        //A source without a lane would allocate one: skipped.
+        unknownSkipped = Mixer::AudioMixerBlock::mix(mixers, 960, input.constChannels(), kSource + 1, Mixer::LockPolicy::TryOnly);
+        skipped += Mixer::AudioMixerBlock::getBlocks(mixers, 960, realtime, output.channels(), Mixer::LockPolicy::TryOnly);
+    }
+    REQUIRE(DAWn::Realtime::violations() == before);
+    REQUIRE(skipped == 0);
+    REQUIRE(unknownSkipped == 2);
+    REQUIRE(realtime == 960);
+    REQUIRE(output.constChannels()[0][0] == 0.25f);
+    REQUIRE(output.constChannels()[1][kBlockSize - 1] == 0.5f);
+
+    //A span of the wrong size is silence, not an overflow.
+    output.setSamples(kBlockSize / 2);
+    REQUIRE(Mixer::AudioMixerBlock::getBlocks(mixers, 960, realtime, output.channels(), Mixer::LockPolicy::TryOnly) == 2);
+    REQUIRE(output.constChannels()[0][0] == 0.0f);
+}
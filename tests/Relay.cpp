@@ -0,0 +1,154 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+#include "Members.h"
+#include "Rtcp.h"
+#include "WireFormat.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <array>
+#include <vector>
+
+#ifdef __linux__
+#include "Relay.h"
+
+#include <chrono>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+using DAWn::Relay::Members;
+
+TEST_CASE("Relay inspect accepts wire v2 frames and RTCP and nothing else", "[Relay]")
+{
+    std::array<std::byte, DAWn::Wire::kHeaderSize + 4> frame{};
+    DAWn::Wire::write(DAWn::Wire::Header{DAWn::Wire::PayloadType::Command, 3, 960, 0x1234, 0, 0}, std::span<std::byte, DAWn::Wire::kHeaderSize>{frame.data(), DAWn::Wire::kHeaderSize});
+    uint32_t source = 0;
+    REQUIRE(DAWn::Relay::inspect(frame, source));
+    REQUIRE(source == 0x1234);
+
+    DAWn::Rtcp::Report report{};
+    report.ssrc = 0x5678;
+    std::array<std::byte, DAWn::Rtcp::kMaxReportSize> rtcp{};
+    auto bytes = DAWn::Rtcp::write(report, rtcp);
+    REQUIRE(DAWn::Relay::inspect(std::span<const std::byte>{rtcp.data(), bytes}, source));
+    REQUIRE(source == 0x5678);
+
+    //The v1 framing, [UID|TS|payload], is not forwarded.
+    std::array<std::byte, 24> legacy{};
+    legacy[0] = std::byte{0x12};
+    REQUIRE_FALSE(DAWn::Relay::inspect(legacy, source));
+    REQUIRE_FALSE(DAWn::Relay::inspect(std::span<const std::byte>{frame.data(), 4}, source));
+}
+
+TEST_CASE("Relay members fan out to everybody else and expire when silent", "[Relay]")
+{
+    Members members{3};
+    auto now = DAWn::Relay::Clock::now();
+    REQUIRE(members.heard(1, 11, now) == Members::Verdict::Joined);
+    REQUIRE(members.heard(2, 22, now) == Members::Verdict::Joined);
+    REQUIRE(members.heard(2, 22, now) == Members::Verdict::Known);
+    REQUIRE(members.heard(3, 33, now + std::chrono::seconds(5)) == Members::Verdict::Joined);
+    REQUIRE(members.heard(4, 44, now) == Members::Verdict::Full);
+
+    std::array<DAWn::Relay::PeerId, 8> targets{};
+    auto count = members.targets(2, false, targets);
+    REQUIRE(std::vector<DAWn::Relay::PeerId>(targets.begin(), targets.begin() + count) == std::vector<DAWn::Relay::PeerId>{1, 3});
+    REQUIRE(members.targets(2, true, targets) == 3);
+    REQUIRE(members.targets(2, true, std::span<DAWn::Relay::PeerId>{targets.data(), 2}) == 2);
+
+    REQUIRE(members.expire(now + std::chrono::seconds(10), std::chrono::seconds(8)) == 2);
+    REQUIRE(members.size() == 1);
+    REQUIRE(members.members()[0].peer == 3);
+}
+
+TEST_CASE("Relay member keeps its place when its address changes", "[Relay]")
+{
+    Members members{2};
+    auto now = DAWn::Relay::Clock::now();
+    members.heard(1, 11, now);
+    members.heard(2, 22, now);
+
+    //Same source, new NAT binding: no room is needed and the old address gets nothing more.
+    REQUIRE(members.heard(5, 11, now) == Members::Verdict::Rebound);
+    std::array<DAWn::Relay::PeerId, 4> targets{};
+    REQUIRE(members.targets(2, false, targets) == 1);
+    REQUIRE(targets[0] == 5);
+}
+
+#ifdef __linux__
+namespace
+{
+    /*! @brief A relay member on the loopback: a UDP socket on an ephemeral port that sends wire v2 frames.*/
+    struct LoopbackMember
+    {
+        int fd{socket(AF_INET, SOCK_DGRAM, 0)};
+        sockaddr_in relay{};
+
+        explicit LoopbackMember(uint16_t port)
+        {
+            relay.sin_family = AF_INET;
+            relay.sin_port = htons(port);
+            relay.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            //Nobody reads the fan-out back: room for all of it.
+            int bufferBytes = 1 << 20;
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bufferBytes, sizeof(bufferBytes));
+        }
+        ~LoopbackMember() { close(fd); }
+
+        void send(uint32_t source, uint16_t sequence)
+        {
+            std::array<std::byte, DAWn::Wire::kHeaderSize + 64> frame{};
+            DAWn::Wire::write(DAWn::Wire::Header{DAWn::Wire::PayloadType::Audio, sequence, sequence * 480u, source, 0, 0}, std::span<std::byte, DAWn::Wire::kHeaderSize>{frame.data(), DAWn::Wire::kHeaderSize});
+            sendto(fd, frame.data(), frame.size(), 0, reinterpret_cast<const sockaddr*>(&relay), sizeof(relay));
+        }
+    };
+
+    template <typename Condition>
+    bool waitFor(Condition condition)
+    {
+        for (auto round = 0; round < 200 && !condition(); ++round) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        return condition();
+    }
+}
+
+TEST_CASE("Relay fans a burst of datagrams out to every other member", "[Relay]")
+{
+    constexpr uint16_t kPort = 38899;
+    constexpr uint16_t kBurst = 64;
+    DAWn::Relay::Options options{};
+    options.bind = "127.0.0.1";
+    options.port = kPort;
+    options.threads = 1;
+    options.batch = 8;
+    DAWn::Relay::Relay relay{options};
+    REQUIRE(relay.start());
+
+    std::array<LoopbackMember, 3> members{LoopbackMember{kPort}, LoopbackMember{kPort}, LoopbackMember{kPort}};
+    //Join one at a time: member n reaches the n members before it.
+    for (auto member = 0u; member < members.size(); ++member)
+    {
+        members[member].send(member + 1, 0);
+        REQUIRE(waitFor([&]() { return relay.stats().received == member + 1; }));
+    }
+    REQUIRE(waitFor([&]() { return relay.stats().forwarded == 3; }));
+
+    //Bursts read in full batches, each datagram to the two other members.
+    for (uint16_t sequence = 1; sequence <= kBurst; ++sequence)
+    {
+        for (auto member = 0u; member < members.size(); ++member) members[member].send(member + 1, sequence);
+    }
+    REQUIRE(waitFor([&]() { return relay.stats().received == 3 + 3 * kBurst; }));
+    REQUIRE(waitFor([&]() { return relay.stats().forwarded + relay.stats().dropped == 3 + 6 * kBurst; }));
+
+    auto stats = relay.stats();
+    relay.stop();
+    REQUIRE(stats.forwarded == 3 + 6 * kBurst);
+    REQUIRE(stats.invalid == 0);
+    REQUIRE(stats.rejected == 0);
+}
+#endif
@@ -0,0 +1,65 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+#include "Retransmission.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <vector>
+
+using namespace DAWn::Rtx;
+
+namespace
+{
+    constexpr uint32_t kPacket = 480;
+
+    std::vector<std::byte> datagram(size_t size, uint8_t fill)
+    {
+        return std::vector<std::byte>(size, std::byte{fill});
+    }
+}
+
+TEST_CASE("Retransmission ring sends a kept datagram again once", "[Retransmission]")
+{
+    Ring ring{};
+    REQUIRE_FALSE(ring.enabled());
+    ring.reset(8, kPacket);
+    REQUIRE(ring.enabled());
+
+    REQUIRE(ring.store(datagram(100, 1), 1000));
+    REQUIRE(ring.store(datagram(200, 2), 1000 + kPacket));
+
+    std::vector<std::byte> sent{};
+    REQUIRE(ring.take(1000 + kPacket, sent));
+    REQUIRE(sent == datagram(200, 2));
+    REQUIRE_FALSE(ring.take(1000 + kPacket, sent));
+    REQUIRE(ring.take(1000, sent));
+    REQUIRE(sent == datagram(100, 1));
+
+    //Never sent.
+    REQUIRE_FALSE(ring.take(1000 + 2 * kPacket, sent));
+    auto stats = ring.stats();
+    REQUIRE(stats.stored == 2);
+    REQUIRE(stats.served == 2);
+    REQUIRE(stats.missed == 2);
+}
+
+TEST_CASE("Retransmission ring keeps a fixed number of datagrams", "[Retransmission]")
+{
+    Ring ring{};
+    ring.reset(4, kPacket);
+
+    for (uint32_t packet = 0; packet < 6; ++packet) ring.store(datagram(10, static_cast<uint8_t>(packet)), packet * kPacket);
+    REQUIRE_FALSE(ring.store(datagram(Ring::kSlotBytes + 1, 9), 6 * kPacket));
+    REQUIRE(ring.stats().tooBig == 1);
+
+    std::vector<std::byte> sent{};
+    //0 and 1 were overwritten by 4 and 5.
+    REQUIRE_FALSE(ring.take(0, sent));
+    REQUIRE_FALSE(ring.take(kPacket, sent));
+    REQUIRE(ring.take(2 * kPacket, sent));
+    REQUIRE(ring.take(5 * kPacket, sent));
+    REQUIRE(sent == datagram(10, 5));
+
+    ring.reset(0, kPacket);
+    REQUIRE_FALSE(ring.store(datagram(10, 1), 0));
+}
@@ -0,0 +1,203 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+#include "Rtcp.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <array>
+#include <vector>
+
+using namespace DAWn;
+
+namespace
+{
+    Wire::Header audio(uint32_t source, uint16_t sequence, uint32_t timeStamp)
+    {
+        Wire::Header header{};
+        header.source = source;
+        header.sequence = sequence;
+        header.timeStamp = timeStamp;
+        return header;
+    }
+}
+
+TEST_CASE("Rtcp reports round trip", "[Rtcp]")
+{
+    Rtcp::Report report{};
+    report.type         = Rtcp::kSenderReport;
+    report.ssrc         = 0x11223344;
+    report.ntpTime      = 0x0102030405060708ull;
+    report.rtpTimeStamp = 48000;
+    report.packetCount  = 7;
+    report.octetCount   = 700;
+    report.count        = 2;
+    report.blocks[0] = Rtcp::ReportBlock{0xaabbccdd, 64, -3, 0x10005, 12, 0x55667788, 16384};
+    report.blocks[1] = Rtcp::ReportBlock{0x01020304, 0, 1000, 9, 0, 0, 0};
+
+    std::array<std::byte, Rtcp::kMaxReportSize> bytes{};
+    auto size = Rtcp::write(report, bytes);
+    REQUIRE(size == 8 + 20 + 2 * Rtcp::kReportBlockSize);
+    REQUIRE(Rtcp::isRtcp(std::span<const std::byte>(bytes).first(size)));
+
+    Rtcp::Report parsed{};
+    REQUIRE(Rtcp::read(std::span<const std::byte>(bytes).first(size), parsed));
+    REQUIRE(parsed.type == Rtcp::kSenderReport);
+    REQUIRE(parsed.ssrc == report.ssrc);
+    REQUIRE(parsed.ntpTime == report.ntpTime);
+    REQUIRE(parsed.packetCount == 7);
+    REQUIRE(parsed.octetCount == 700);
+    REQUIRE(parsed.count == 2);
+    REQUIRE(parsed.blocks[0].fractionLost == 64);
+    REQUIRE(parsed.blocks[0].cumulativeLost == -3);
+    REQUIRE(parsed.blocks[0].highestSequence == 0x10005);
+    REQUIRE(parsed.blocks[0].lastSenderReport == 0x55667788);
+    REQUIRE(parsed.blocks[0].delaySinceLastSenderReport == 16384);
+    REQUIRE(parsed.blocks[1].cumulativeLost == 1000);
+
+    //Truncated: the length field says more than there is.
+    REQUIRE_FALSE(Rtcp::read(std::span<const std::byte>(bytes).first(size - 4), parsed));
+}
+
+TEST_CASE("Rtcp and RTP datagrams are told apart on one socket", "[Rtcp]")
+{
+    std::array<std::byte, Wire::kHeaderSize> rtp{};
+    auto header = audio(1, 2, 3);
+    header.flags = Wire::kFlagDiscontinuity;
+    Wire::write(header, rtp);
+    REQUIRE_FALSE(Rtcp::isRtcp(rtp));
+
+    Rtcp::Report report{};
+    report.ssrc = 1;
+    std::array<std::byte, Rtcp::kMaxReportSize> rtcp{};
+    auto size = Rtcp::write(report, rtcp);
+    REQUIRE(size == 8);
+    Wire::Header parsed{};
+    REQUIRE_FALSE(Wire::read(std::span<const std::byte>(rtcp).first(size), parsed));
+}
+
+TEST_CASE("Rtcp source statistics count loss across a sequence wrap", "[Rtcp]")
+{
+    Rtcp::SourceStatistics statistics{};
+    uint32_t timeStamp = 0;
+    //65530 .. 65535, 0 .. 9 without 2, 3 and 7: 16 expected, 13 received.
+    for (uint32_t sequence = 65530; sequence < 65536 + 10; ++sequence)
+    {
+        auto wrapped = static_cast<uint16_t>(sequence);
+        timeStamp += 480;
+        if (wrapped == 2 || wrapped == 3 || wrapped == 7) continue;
+        REQUIRE(statistics.received(audio(9, wrapped, timeStamp), timeStamp));
+    }
+    //A duplicate.
+    statistics.received(audio(9, 9, timeStamp), timeStamp);
+
+    auto block = statistics.report(9);
+    REQUIRE(block.highestSequence == 65536 + 9);
+    REQUIRE(block.cumulativeLost == 2);
+    REQUIRE(block.fractionLost == (2 << 8) / 16);
+    REQUIRE(block.jitter == 0);
+
+    //Nothing since the last report: no fraction lost.
+    REQUIRE(statistics.report(9).fractionLost == 0);
+}
+
+TEST_CASE("Rtcp jitter follows the transit time variation", "[Rtcp]")
+{
+    Rtcp::SourceStatistics statistics{};
+    uint32_t timeStamp = 1000;
+    for (uint16_t sequence = 0; sequence < 400; ++sequence, timeStamp += 480)
+    {
+        //Every other packet is 20 units late.
+        statistics.received(audio(1, sequence, timeStamp), timeStamp + (sequence % 2 ? 20 : 0));
+    }
+    REQUIRE(statistics.jitter() >= 18);
+    REQUIRE(statistics.jitter() <= 20);
+
+    //A discontinuity is not jitter.
+    auto before = statistics.jitter();
+    auto jump = audio(1, 400, timeStamp + 480000);
+    jump.flags = Wire::kFlagDiscontinuity;
+    statistics.received(jump, timeStamp);
+    REQUIRE(statistics.jitter() == before);
+}
+
+TEST_CASE("Rtcp sessions measure the round trip from SR and RR", "[Rtcp]")
+{
+    using namespace std::chrono_literals;
+    Rtcp::Session a{};
+    Rtcp::Session b{};
+    a.reset(1);
+    b.reset(2);
+    a.setInterval(10s);
+    b.setInterval(10s);
+
+    auto later = Rtcp::Clock::now() + 1h;
+    auto packet = audio(1, 0, 480);
+    a.sent(packet, 100);
+    b.received(packet, later);
+
+    //A sends an SR at ntpA, B answers 250 ms after it arrived, A reads it 300 ms after ntpA: 50 ms round trip.
+    constexpr uint64_t ntpA = 3900000000ull << 32;
+    std::array<std::byte, Rtcp::kMaxReportSize> bytes{};
+    auto size = a.writeReport(bytes, later, ntpA);
+    REQUIRE(size > 0);
+    REQUIRE(a.writeReport(bytes, later, ntpA) == 0);
+
+    Rtcp::Report sr{};
+    REQUIRE(Rtcp::read(std::span<const std::byte>(bytes).first(size), sr));
+    REQUIRE(sr.type == Rtcp::kSenderReport);
+    b.received(sr, later, 0);
+
+    size = b.writeReport(bytes, later + 250ms, 0);
+    REQUIRE(size > 0);
+    Rtcp::Report rr{};
+    REQUIRE(Rtcp::read(std::span<const std::byte>(bytes).first(size), rr));
+    REQUIRE(rr.type == Rtcp::kReceiverReport);
+    REQUIRE(rr.count == 1);
+    REQUIRE(rr.blocks[0].ssrc == 1);
+
+    auto ntpArrival = ntpA + (300ull << 32) / 1000;
+    a.received(rr, later + 300ms, ntpArrival);
+
+    auto stats = a.stats();
+    REQUIRE(stats.size() == 1);
+    REQUIRE(stats[0].ssrc == 2);
+    REQUIRE(stats[0].rttMs > 49.0);
+    REQUIRE(stats[0].rttMs < 51.0);
+    REQUIRE(stats[0].remoteFractionLost == 0.0);
+
+    auto received = b.stats();
+    REQUIRE(received.size() == 1);
+    REQUIRE(received[0].packetsReceived == 1);
+    REQUIRE(received[0].rttMs < 0.0);
+}
+
+TEST_CASE("Rtcp NACK round trips as an APP packet", "[Rtcp]")
+{
+    Rtcp::Nack nack{};
+    nack.ssrc = 5;
+    nack.mediaSsrc = 6;
+    nack.count = 3;
+    nack.timeStamps[0] = 480;
+    nack.timeStamps[1] = 960;
+    nack.timeStamps[2] = 0xfffffe20;
+
+    std::array<std::byte, Rtcp::kMaxNackSize> bytes{};
+    auto size = Rtcp::write(nack, bytes);
+    REQUIRE(size == 16 + 3 * 4);
+    auto packet = std::span<const std::byte>(bytes).first(size);
+    REQUIRE(Rtcp::isRtcp(packet));
+
+    Rtcp::Report report{};
+    REQUIRE_FALSE(Rtcp::read(packet, report));
+    Rtcp::Nack parsed{};
+    REQUIRE(Rtcp::read(packet, parsed));
+    REQUIRE(parsed.ssrc == 5);
+    REQUIRE(parsed.mediaSsrc == 6);
+    REQUIRE(parsed.count == 3);
+    REQUIRE(parsed.timeStamps[2] == 0xfffffe20);
+
+    //A report is not a NACK.
+    std::array<std::byte, Rtcp::kMaxReportSize> reportBytes{};
+    auto reportSize = Rtcp::write(report, reportBytes);
+    REQUIRE_FALSE(Rtcp::read(std::span<const std::byte>(reportBytes).first(reportSize), parsed));
+}
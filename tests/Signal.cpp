@@ -0,0 +1,118 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+#include "Events.h"
+#include "Realtime.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    struct CopyCounter
+    {
+        inline static int sCopies{0};
+        CopyCounter() = default;
+        CopyCounter(const CopyCounter&) { ++sCopies; }
+        CopyCounter(CopyCounter&&) noexcept = default;
+        CopyCounter& operator=(const CopyCounter&) { ++sCopies; return *this; }
+    };
+
+    void recordViolation(const char*) {}
+}
+
+TEST_CASE("Signal calls the slots in connection order until they disconnect", "[Signal]")
+{
+    DAWn::Events::Signal<int> signal{};
+    std::vector<int> calls{};
+    auto first = signal.Connect([&](int value){ calls.push_back(value); });
+    signal.Connect([&](int value){ calls.push_back(value * 10); });
+
+    signal.Emit(1);
+    REQUIRE(calls == std::vector<int>{1, 10});
+
+    signal.Disconnect(first);
+    signal.Disconnect(first);
+    signal.Emit(2);
+    REQUIRE(calls == std::vector<int>{1, 10, 20});
+}
+
+TEST_CASE("Signal slot may disconnect itself while it is called", "[Signal]")
+{
+    DAWn::Events::InplaceSignal<> signal{};
+    int calls = 0;
+    DAWn::Events::InplaceSignal<>::SlotId self{0};
+    self = signal.Connect([&](){ ++calls; signal.Disconnect(self); });
+
+    signal.Emit();
+    signal.Emit();
+    REQUIRE(calls == 1);
+}
+
+TEST_CASE("Signal does not copy the arguments on Emit", "[Signal]")
+{
+    CopyCounter counter{};
+
+    DAWn::Events::Signal<const CopyCounter&> byReference{};
+    for (auto slot = 0; slot < 3; ++slot) byReference.Connect([](const CopyCounter&){});
+    CopyCounter::sCopies = 0;
+    byReference.Emit(counter);
+    REQUIRE(CopyCounter::sCopies == 0);
+
+    //By value the slots get their copy, Emit itself adds none.
+    DAWn::Events::Signal<CopyCounter> byValue{};
+    for (auto slot = 0; slot < 3; ++slot) byValue.Connect([](CopyCounter){});
+    CopyCounter::sCopies = 0;
+    byValue.Emit(counter);
+    REQUIRE(CopyCounter::sCopies == 3);
+}
+
+TEST_CASE("InplaceSignal emits without heap or locks", "[Signal]")
+{
+    DAWn::Realtime::setViolationHandler(recordViolation);
+    DAWn::Events::InplaceSignal<uint64_t, const std::vector<int>&> signal{};
+    size_t sum = 0;
+    signal.Connect([&sum](uint64_t id, const std::vector<int>& data){ sum += id + data.size(); });
+    signal.Connect([&sum](uint64_t, const std::vector<int>& data){ sum += static_cast<size_t>(data[0]); });
+    std::vector<int> data{5, 6, 7};
+
+    auto before = DAWn::Realtime::violations();
+    {
+        DAWn::Realtime::ScopedRealtime realtime;
+        signal.Emit(uint64_t{1}, data);
+    }
+    REQUIRE(DAWn::Realtime::violations() == before);
+    REQUIRE(sum == 1 + 3 + 5);
+    DAWn::Realtime::setViolationHandler(nullptr);
+}
+
+TEST_CASE("Signal slots connect and disconnect while another thread emits", "[Signal]")
+{
+    DAWn::Events::Signal<int> signal{};
+    std::atomic<int> permanent{0};
+    std::atomic<int> transient{0};
+    std::atomic<bool> run{true};
+    signal.Connect([&](int value){ permanent.fetch_add(value); });
+
+    std::thread emitter([&](){
+        while (run.load(std::memory_order_acquire)) signal.Emit(1);
+    });
+    //The emitter is running before the slots change.
+    while (permanent.load() == 0) std::this_thread::yield();
+    for (auto round = 0; round < 500; ++round)
+    {
+        auto slotId = signal.Connect([&](int value){ transient.fetch_add(value); });
+        std::this_thread::yield();
+        signal.Disconnect(slotId);
+    }
+    run.store(false, std::memory_order_release);
+    emitter.join();
+
+    auto emitted = permanent.load();
+    REQUIRE(emitted > 0);
+    REQUIRE(transient.load() <= emitted);
+    signal.Emit(1);
+    REQUIRE(permanent.load() == emitted + 1);
+}
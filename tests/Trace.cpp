@@ -0,0 +1,110 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+#include "Trace.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace DAWn::Trace;
+
+TEST_CASE("Trace ring finds the newest stamp covering a sample", "[Trace]")
+{
+    Ring<8> ring{};
+    Stamp stamp{};
+    REQUIRE_FALSE(ring.find(0, 0, stamp));
+
+    ring.publish(0, 0, 480, {100, 10});
+    ring.publish(0, 480, 960, {200, 20});
+    ring.publish(7, 0, 480, {300, 30});
+
+    REQUIRE(ring.find(0, 479, stamp));
+    REQUIRE(stamp.stampNs == 100);
+    REQUIRE(stamp.originNs == 10);
+    REQUIRE(ring.find(0, 480, stamp));
+    REQUIRE(stamp.stampNs == 200);
+    REQUIRE_FALSE(ring.find(0, 960, stamp));
+
+    //Other keys do not match, and a newer stamp for the same samples wins.
+    REQUIRE(ring.find(7, 0, stamp));
+    REQUIRE(stamp.stampNs == 300);
+    ring.publish(0, 0, 480, {400, 40});
+    REQUIRE(ring.find(0, 0, stamp));
+    REQUIRE(stamp.stampNs == 400);
+
+    //Across the 32 bit timestamp wrap.
+    ring.publish(1, 0xFFFFFF00u, 0x00000100u, {500, 50});
+    REQUIRE(ring.find(1, 0xFFFFFFFFu, stamp));
+    REQUIRE(ring.find(1, 0x000000FFu, stamp));
+    REQUIRE_FALSE(ring.find(1, 0x00000100u, stamp));
+
+    //Lapped stamps are gone.
+    for (auto index = 0u; index < 8; ++index) ring.publish(2, index, index + 1, {600, 60});
+    REQUIRE_FALSE(ring.find(7, 0, stamp));
+}
+
+TEST_CASE("Trace ring never hands out a torn stamp", "[Trace]")
+{
+    Ring<16> ring{};
+    std::atomic<bool> run{true};
+    std::atomic<size_t> torn{0};
+    std::atomic<size_t> found{0};
+
+    std::vector<std::thread> writers{};
+    for (auto writer = 0u; writer < 2; ++writer)
+    {
+        writers.emplace_back([&ring, &run, writer]() {
+            for (uint64_t value = 1; run.load(std::memory_order_relaxed); ++value)
+            {
+                auto sample = static_cast<uint32_t>(value % 4) * 100;
+                ring.publish(writer, sample, sample + 100, {value, value * 3});
+            }
+        });
+    }
+    std::thread reader{[&]() {
+        for (auto round = 0; round < 200000; ++round)
+        {
+            Stamp stamp{};
+            if (!ring.find(static_cast<uint64_t>(round % 2), static_cast<uint32_t>(round % 400), stamp)) continue;
+            found.fetch_add(1, std::memory_order_relaxed);
+            if (stamp.originNs != stamp.stampNs * 3) torn.fetch_add(1, std::memory_order_relaxed);
+        }
+        run.store(false);
+    }};
+
+    reader.join();
+    for (auto& writer : writers) writer.join();
+    REQUIRE(found.load() > 0);
+    REQUIRE(torn.load() == 0);
+}
+
+TEST_CASE("Trace report has every stage in microseconds", "[Trace]")
+{
+    Tracer tracer{};
+    REQUIRE_FALSE(tracer.enabled());
+    auto before = tracer.report();
+    REQUIRE(before.size() == kStages);
+    REQUIRE(before.front().stage == Stage::Pushed);
+    REQUIRE(before.back().stage == Stage::ReceiveTotal);
+    REQUIRE(before[static_cast<size_t>(Stage::Encoded)].count == 0);
+
+    tracer.record(Stage::Encoded, 1000000, 1250000);
+    tracer.record(Stage::Encoded, 1000000, 1500000);
+    //No stamp, or a stamp from the future: skipped.
+    tracer.record(Stage::Encoded, 0, 1500000);
+    tracer.record(Stage::Encoded, 2000000, 1000000);
+
+    auto after = tracer.report();
+    auto& encoded = after[static_cast<size_t>(Stage::Encoded)];
+    REQUIRE(encoded.count == 2);
+    REQUIRE(encoded.max >= 500);
+    REQUIRE(encoded.p99 <= encoded.max);
+    REQUIRE(tracer.format().find(name(Stage::Encoded)) != std::string::npos);
+
+    //Every processor has its own trace.
+    Tracer other{};
+    REQUIRE(other.report()[static_cast<size_t>(Stage::Encoded)].count == 0);
+    REQUIRE(other.format().empty());
+}
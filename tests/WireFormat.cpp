@@ -0,0 +1,84 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+#include "WireFormat.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <array>
+#include <vector>
+
+using namespace DAWn::Wire;
+
+TEST_CASE("WireFormat header round trips", "[WireFormat]")
+{
+    Header header{};
+    header.type         = PayloadType::Audio;
+    header.sequence     = 0xfffe;
+    header.timeStamp    = 0x89abcdef;
+    header.source       = 0x01234567;
+    header.channelPair  = 3;
+    header.flags        = kFlagRetransmission;
+
+    std::vector<std::byte> frame(kHeaderSize + 4, std::byte{0x5a});
+    write(header, std::span<std::byte, kHeaderSize>(frame.data(), kHeaderSize));
+
+    Header parsed{};
+    REQUIRE(read(frame, parsed));
+    REQUIRE(parsed.type == PayloadType::Audio);
+    REQUIRE(parsed.sequence == header.sequence);
+    REQUIRE(parsed.timeStamp == header.timeStamp);
+    REQUIRE(parsed.source == header.source);
+    REQUIRE(parsed.channelPair == header.channelPair);
+    REQUIRE(parsed.flags == header.flags);
+    REQUIRE(payload(frame).size() == 4);
+    REQUIRE(payload(frame)[0] == std::byte{0x5a});
+}
+
+TEST_CASE("WireFormat header is an RTP fixed header in network byte order", "[WireFormat]")
+{
+    Header header{};
+    header.type         = PayloadType::Command;
+    header.sequence     = 0x0102;
+    header.timeStamp    = 0x03040506;
+    header.source       = 0x0708090a;
+    header.flags        = kFlagDiscontinuity;
+
+    std::array<std::byte, kHeaderSize> bytes{};
+    write(header, bytes);
+    REQUIRE(bytes[0] == std::byte{0x80});
+    REQUIRE(bytes[1] == std::byte{0x80 | 112});
+    REQUIRE(bytes[2] == std::byte{0x01});
+    REQUIRE(bytes[3] == std::byte{0x02});
+    REQUIRE(bytes[4] == std::byte{0x03});
+    REQUIRE(bytes[7] == std::byte{0x06});
+    REQUIRE(bytes[8] == std::byte{0x07});
+    REQUIRE(bytes[11] == std::byte{0x0a});
+    REQUIRE(isControl(bytes));
+}
+
+TEST_CASE("WireFormat rejects short, foreign and unknown datagrams", "[WireFormat]")
+{
+    std::array<std::byte, kHeaderSize> bytes{};
+    write(Header{}, bytes);
+    Header parsed{};
+    REQUIRE(read(bytes, parsed));
+    REQUIRE_FALSE(isControl(bytes));
+
+    REQUIRE_FALSE(read(std::span<const std::byte>(bytes).first(kHeaderSize - 1), parsed));
+
+    auto version1 = bytes;
+    version1[0] = std::byte{0x40};
+    REQUIRE_FALSE(read(version1, parsed));
+
+    auto padded = bytes;
+    padded[0] = std::byte{0xa0};
+    REQUIRE_FALSE(read(padded, parsed));
+
+    auto unknown = bytes;
+    unknown[1] = std::byte{96};
+    REQUIRE_FALSE(read(unknown, parsed));
+
+    //A v1 datagram: [UID | TS | PAYLOAD], little endian.
+    std::array<std::byte, kHeaderSize> legacy{std::byte{0xe0}, std::byte{0xee}, std::byte{0xdb}, std::byte{0xde}};
+    REQUIRE_FALSE(read(legacy, parsed));
+}
@@ -0,0 +1,93 @@
+//
+// Created by Julian Guarin on 17/10/26.
+//
+#include "BlockSizeAdapter.h"
+#include "Notifier.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono;
+
+namespace
+{
+    /*!
+     * @brief A worker shaped like the plugin encoder / mixer threads: drain the BSA, then wait on the notifier.
+     */
+    struct Worker
+    {
+        Utilities::Buffer::BlockSizeAdapter bsa{480, 2};
+        DAWn::Events::Notifier wakeUp;
+        std::atomic<bool> bRun{true};
+        std::atomic<size_t> popped{0};
+        std::thread thread;
+
+        Worker()
+        {
+            bsa.setNotifier(&wakeUp);
+            thread = std::thread{[this]()
+            {
+                std::vector<float> block(960);
+                uint32_t timeStamp;
+                while (bRun)
+                {
+                    auto ticket = wakeUp.ticket();
+                    while (bsa.dataReady())
+                    {
+                        bsa.pop(block, timeStamp);
+                        ++popped;
+                    }
+                    if (bRun) wakeUp.wait(ticket);
+                }
+            }};
+        }
+
+        ~Worker()
+        {
+            bRun = false;
+            wakeUp.notify();
+            thread.join();
+        }
+    };
+}
+
+TEST_CASE("Push wakes the worker up", "[WorkerWakeUp]")
+{
+    Worker worker;
+    std::vector<float> block(960, 0.5f);
+    constexpr size_t kRounds = 50;
+
+    for (size_t round = 0; round < kRounds; ++round)
+    {
+        //Let the worker go back to sleep, so every round needs a real wakeup.
+        std::this_thread::sleep_for(microseconds(500));
+        worker.bsa.push(block.data(), block.size());
+        auto start = steady_clock::now();
+        while (worker.popped.load() <= round && steady_clock::now() - start < seconds(5)) std::this_thread::yield();
+        REQUIRE(worker.popped.load() == round + 1);
+    }
+}
+
+TEST_CASE("A notify before the wait is not lost", "[WorkerWakeUp]")
+{
+    DAWn::Events::Notifier notifier;
+    auto ticket = notifier.ticket();
+    notifier.notify();
+
+    //The notify came after the ticket: wait returns at once instead of sleeping for a notify that already happened.
+    std::atomic<bool> woke{false};
+    std::thread waiter{[&]()
+    {
+        notifier.wait(ticket);
+        woke = true;
+    }};
+    auto start = steady_clock::now();
+    while (!woke && steady_clock::now() - start < seconds(5)) std::this_thread::yield();
+    auto wokeUp = woke.load();
+    if (!wokeUp) notifier.notify();
+    waiter.join();
+    REQUIRE(wokeUp);
+}